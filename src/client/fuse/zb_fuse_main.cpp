@@ -2,6 +2,7 @@
 #include <fuse.h>
 #include <gflags/gflags.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
@@ -22,6 +23,14 @@ DEFINE_string(mount_point, "/mnt/zbstorage", "Mount point");
 DEFINE_bool(allow_other, false, "Pass -o allow_other to FUSE so non-root users can access");
 DEFINE_bool(foreground, false, "Run FUSE in foreground (pass -f)");
 DEFINE_string(log_file, "", "Log file path (append). Empty = stdout/stderr");
+DEFINE_int32(size_flush_interval_ms, 1000, "Interval (ms) to flush batched file sizes and renew size leases");
+DEFINE_bool(attach_payload, true, "Send read/write payloads as RPC attachments (disable for pre-attachment storage nodes)");
+DEFINE_bool(sparse_reads, true, "Let storage nodes describe holes instead of sending their zeros");
+DEFINE_int32(stream_threshold_kb, 1024, "Stream reads/writes of at least this many KB block by block; 0 = always unary");
+DEFINE_bool(direct_data_path, true, "Send reads/writes straight to real nodes instead of through the SRM gateway");
+DEFINE_int32(node_map_refresh_ms, 30000, "Interval (ms) to refetch the node address map from SRM");
+DEFINE_bool(dedup, true, "Fingerprint files written front to back and let the MDS deduplicate identical ones on close");
+DEFINE_int32(dedup_min_kb, 64, "Smallest file (KB) offered for deduplication");
 
 namespace {
 
@@ -132,6 +141,13 @@ int fuse_write_cb(const char* path, const char* buf, size_t size, off_t offset,
     return static_cast<int>(bytes);
 }
 
+int fuse_fallocate_cb(const char* path, int mode, off_t offset, off_t length,
+                      struct fuse_file_info* fi) {
+    (void)path;
+    if (!g_client) return -ECOMM;
+    return g_client->Fallocate(static_cast<int>(fi->fh), mode, offset, length);
+}
+
 int fuse_release_cb(const char* path, struct fuse_file_info* fi) {
     (void)path;
     if (!g_client) return -ECOMM;
@@ -140,15 +156,15 @@ int fuse_release_cb(const char* path, struct fuse_file_info* fi) {
 
 int fuse_flush_cb(const char* path, struct fuse_file_info* fi) {
     (void)path;
-    (void)fi;
-    return 0;
+    if (!g_client) return -ECOMM;
+    return g_client->Fsync(static_cast<int>(fi->fh));
 }
 
 int fuse_fsync_cb(const char* path, int isdatasync, struct fuse_file_info* fi) {
     (void)path;
     (void)isdatasync;
-    (void)fi;
-    return 0;
+    if (!g_client) return -ECOMM;
+    return g_client->Fsync(static_cast<int>(fi->fh));
 }
 
 struct fuse_operations BuildFuseOps() {
@@ -158,6 +174,7 @@ struct fuse_operations BuildFuseOps() {
     ops.open = fuse_open_cb;
     ops.read = fuse_read_cb;
     ops.write = fuse_write_cb;
+    ops.fallocate = fuse_fallocate_cb;
     ops.release = fuse_release_cb;
     ops.create = fuse_create_cb;
     ops.flush = fuse_flush_cb;
@@ -186,6 +203,14 @@ int main(int argc, char* argv[]) {
     cfg.srm_addr = FLAGS_srm_addr;
     cfg.mount_point = FLAGS_mount_point;
     cfg.default_node_id = FLAGS_node_id;
+    cfg.size_flush_interval_ms = FLAGS_size_flush_interval_ms;
+    cfg.attach_payload = FLAGS_attach_payload;
+    cfg.sparse_reads = FLAGS_sparse_reads;
+    cfg.stream_threshold_bytes = static_cast<size_t>(std::max(0, FLAGS_stream_threshold_kb)) << 10;
+    cfg.direct_data_path = FLAGS_direct_data_path;
+    cfg.node_map_refresh_ms = FLAGS_node_map_refresh_ms;
+    cfg.dedup = FLAGS_dedup;
+    cfg.dedup_min_bytes = static_cast<size_t>(std::max(0, FLAGS_dedup_min_kb)) << 10;
     g_client = std::make_shared<DfsClient>(cfg);
     if (!g_client->Init()) {
         std::fprintf(stderr, "Failed to initialize DFS client (mds=%s srm=%s)\n",
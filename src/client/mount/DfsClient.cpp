@@ -4,16 +4,92 @@
 #include <algorithm>
 #include <cstring>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
+#include <vector>
 
+#include "common/ChunkStream.h"
 #include "mds.pb.h"
 #include "storage_node.pb.h"
 
+namespace {
+
+uint64_t HoleBytes(const storagenode::ReadReply& resp) {
+    uint64_t n = 0;
+    for (const auto& h : resp.holes()) {
+        n += h.length();
+    }
+    return n;
+}
+
+// Rebuilds a sparse read into out: payload holds the bytes outside the holes,
+// in order. False if the descriptors do not tile [offset, offset + len).
+bool FillHoles(const storagenode::ReadReply& resp, uint64_t offset, const std::string& payload,
+               char* out, size_t len) {
+    uint64_t pos = 0;  // into out
+    size_t src = 0;    // into payload
+    for (const auto& h : resp.holes()) {
+        if (h.offset() < offset + pos || h.offset() - offset > len || h.length() > len - (h.offset() - offset)) {
+            return false;
+        }
+        const size_t data = static_cast<size_t>(h.offset() - offset - pos);
+        if (payload.size() - src < data) {
+            return false;
+        }
+        std::memcpy(out + pos, payload.data() + src, data);
+        src += data;
+        pos += data;
+        std::memset(out + pos, 0, static_cast<size_t>(h.length()));
+        pos += h.length();
+    }
+    if (payload.size() - src != len - pos) {
+        return false;
+    }
+    std::memcpy(out + pos, payload.data() + src, payload.size() - src);
+    return true;
+}
+
+} // namespace
+
 DfsClient::DfsClient(MountConfig cfg)
-    : cfg_(std::move(cfg)), rpc_(std::make_unique<RpcClients>(cfg_)) {}
+    : cfg_(std::move(cfg)),
+      rpc_(std::make_unique<RpcClients>(cfg_)),
+      attach_payload_(cfg_.attach_payload),
+      sparse_reads_(cfg_.sparse_reads) {
+    if (cfg_.client_id.empty()) {
+        char host[HOST_NAME_MAX + 1] = {};
+        if (gethostname(host, sizeof(host) - 1) != 0) {
+            std::strcpy(host, "client");
+        }
+        cfg_.client_id = std::string(host) + ":" + std::to_string(getpid());
+    }
+}
+
+DfsClient::~DfsClient() {
+    {
+        std::lock_guard<std::mutex> lk(flush_mu_);
+        stop_ = true;
+    }
+    flush_cv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    std::vector<uint64_t> inodes;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (const auto& kv : leases_) inodes.push_back(kv.first);
+    }
+    for (uint64_t inode : inodes) {
+        ReleaseLease(inode);
+    }
+}
 
 bool DfsClient::Init() {
-    return rpc_->Init();
+    if (!rpc_->Init()) return false;
+    if (cfg_.size_flush_interval_ms > 0 && !flusher_.joinable()) {
+        flusher_ = std::thread([this]() { FlushLoop(); });
+    }
+    return true;
 }
 
 int DfsClient::StatusToErrno(rpc::StatusCode code) const {
@@ -79,10 +155,12 @@ rpc::StatusCode DfsClient::LookupInode(const std::string& path, InodeInfo& out_i
         return rpc::STATUS_NETWORK_ERROR;
     }
     out_info.node_id = !resp.node_id().empty() ? resp.node_id() : resp.volume_id();
+    out_info.data_node_id = resp.data_node_id();
+    out_info.data_chunk_id = resp.data_chunk_id();
     return rpc::STATUS_SUCCESS;
 }
 
-rpc::StatusCode DfsClient::UpdateRemoteSize(uint64_t inode, uint64_t size_bytes) {
+rpc::StatusCode DfsClient::UpdateRemoteSize(uint64_t inode, uint64_t size_bytes, bool extend_only) {
     if (!rpc_ || !rpc_->mds()) return rpc::STATUS_NETWORK_ERROR;
     rpc::UpdateFileSizeRequest req;
     rpc::Status resp;
@@ -90,6 +168,7 @@ rpc::StatusCode DfsClient::UpdateRemoteSize(uint64_t inode, uint64_t size_bytes)
     cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
     req.set_inode(inode);
     req.set_size_bytes(size_bytes);
+    req.set_extend_only(extend_only);
     rpc_->mds()->UpdateFileSize(&cntl, &req, &resp, nullptr);
     if (cntl.Failed()) {
         std::cerr << "[Client] UpdateFileSize RPC failed inode=" << inode
@@ -99,6 +178,175 @@ rpc::StatusCode DfsClient::UpdateRemoteSize(uint64_t inode, uint64_t size_bytes)
     return StatusUtils::NormalizeCode(resp.code());
 }
 
+rpc::StatusCode DfsClient::CallSizeLease(uint64_t inode, bool release, bool dirty, rpc::SizeLeaseReply& out) {
+    if (!rpc_ || !rpc_->mds()) return rpc::STATUS_NETWORK_ERROR;
+    rpc::SizeLeaseRequest req;
+    brpc::Controller cntl;
+    cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+    req.set_inode(inode);
+    req.set_client_id(cfg_.client_id);
+    req.set_release(release);
+    req.set_dirty(dirty);
+    rpc_->mds()->AcquireSizeLease(&cntl, &req, &out, nullptr);
+    if (cntl.Failed()) {
+        std::cerr << "[Client] AcquireSizeLease RPC failed inode=" << inode
+                  << " err=" << cntl.ErrorText() << std::endl;
+        return rpc::STATUS_NETWORK_ERROR;
+    }
+    return StatusUtils::NormalizeCode(out.status().code());
+}
+
+void DfsClient::AcquireLease(uint64_t inode) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (++leases_[inode].open_refs > 1) return;
+    }
+    rpc::SizeLeaseReply reply;
+    auto code = CallSizeLease(inode, false, false, reply);
+    // Another client holds the lease exclusively: the MDS withholds our grant
+    // and the size until it has flushed, so poll until then or until its lease
+    // would have run out.
+    const auto give_up = std::chrono::steady_clock::now() +
+                         2 * std::chrono::milliseconds(std::max<uint32_t>(reply.lease_ms(), 1));
+    while (code == rpc::STATUS_SUCCESS && reply.pending() &&
+           std::chrono::steady_clock::now() < give_up) {
+        const auto wait = std::chrono::milliseconds(std::clamp<uint32_t>(reply.lease_ms() / 20, 10, 200));
+        std::this_thread::sleep_for(wait);
+        reply.Clear();
+        code = CallSizeLease(inode, false, false, reply);
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = leases_.find(inode);
+    if (it == leases_.end()) return;
+    if (code != rpc::STATUS_SUCCESS || reply.pending()) {
+        // No lease: fall back to synchronous size updates.
+        if (reply.pending()) {
+            std::cerr << "[Client] size lease still recalled, continuing unleased inode=" << inode << std::endl;
+        }
+        it->second.shared = true;
+        return;
+    }
+    const auto lease = std::chrono::milliseconds(reply.lease_ms());
+    it->second.shared = reply.shared();
+    it->second.expires = now + lease;
+    it->second.renew_at = now + lease / 2;
+    auto& size = inode_size_[inode];
+    size = std::max<uint64_t>(size, reply.size_bytes());
+}
+
+void DfsClient::ReleaseLease(uint64_t inode) {
+    auto code = FlushSize(inode);
+    if (code != rpc::STATUS_SUCCESS) {
+        std::cerr << "[Client] size flush on release failed inode=" << inode
+                  << " code=" << static_cast<int>(code) << std::endl;
+    }
+    rpc::SizeLeaseReply reply;
+    CallSizeLease(inode, true, false, reply);
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = leases_.find(inode);
+    if (it != leases_.end() && it->second.open_refs <= 0 && !it->second.dirty) {
+        leases_.erase(it);
+    }
+}
+
+rpc::StatusCode DfsClient::FlushSize(uint64_t inode) {
+    uint64_t size = 0;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = leases_.find(inode);
+        if (it == leases_.end() || !it->second.dirty) return rpc::STATUS_SUCCESS;
+        it->second.dirty = false;
+        size = inode_size_[inode];
+    }
+    auto code = UpdateRemoteSize(inode, size, true);
+    if (code != rpc::STATUS_SUCCESS) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = leases_.find(inode);
+        if (it != leases_.end()) it->second.dirty = true;
+    }
+    return code;
+}
+
+void DfsClient::FlushLoop() {
+    const auto interval = std::chrono::milliseconds(cfg_.size_flush_interval_ms);
+    std::unique_lock<std::mutex> flk(flush_mu_);
+    while (!stop_) {
+        flush_cv_.wait_for(flk, interval, [this]() { return stop_; });
+        if (stop_) break;
+        flk.unlock();
+
+        std::vector<uint64_t> inodes;
+        std::vector<uint64_t> renew;
+        const auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            for (const auto& kv : leases_) {
+                inodes.push_back(kv.first);
+                if (kv.second.open_refs > 0 && now >= kv.second.renew_at) renew.push_back(kv.first);
+            }
+        }
+        for (uint64_t inode : inodes) {
+            FlushSize(inode);
+        }
+        {
+            // Drop leases whose last fd closed while a flush was still failing.
+            std::lock_guard<std::mutex> lk(mu_);
+            for (auto it = leases_.begin(); it != leases_.end();) {
+                if (it->second.open_refs <= 0 && !it->second.dirty) {
+                    it = leases_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        // Renewal also tells us whether another client now shares the inode.
+        for (uint64_t inode : renew) {
+            RenewLease(inode);
+        }
+        flk.lock();
+    }
+}
+
+void DfsClient::RenewLease(uint64_t inode) {
+    // An exclusive holder may batch sizes at any moment, so it counts as dirty
+    // until it has switched to synchronous updates and flushed.
+    bool dirty = false;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = leases_.find(inode);
+        if (it == leases_.end()) return;
+        dirty = it->second.dirty || !it->second.shared;
+    }
+    rpc::SizeLeaseReply reply;
+    auto code = CallSizeLease(inode, false, dirty, reply);
+    if (code == rpc::STATUS_SUCCESS && reply.shared() && dirty) {
+        // Recalled: stop batching, flush, then renew again so the MDS can grant
+        // the waiting client an up-to-date size.
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = leases_.find(inode);
+            if (it != leases_.end()) it->second.shared = true;
+        }
+        if (FlushSize(inode) == rpc::STATUS_SUCCESS) {
+            reply.Clear();
+            code = CallSizeLease(inode, false, false, reply);
+        }
+    }
+    const auto done = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = leases_.find(inode);
+    if (it == leases_.end()) return;
+    if (code != rpc::STATUS_SUCCESS) {
+        it->second.shared = true;
+        return;
+    }
+    const auto lease = std::chrono::milliseconds(reply.lease_ms());
+    it->second.shared = reply.shared();
+    it->second.expires = done + lease;
+    it->second.renew_at = done + lease / 2;
+}
+
 int DfsClient::GetAttr(const std::string& path, struct stat* st) {
     if (!rpc_ || !rpc_->mds()) return -ECOMM;
     InodeInfo info;
@@ -166,6 +414,13 @@ int DfsClient::Open(const std::string& path, int flags, int& out_fd) {
         }
         return -StatusToErrno(code);
     }
+    const bool writable = (flags & O_ACCMODE) != O_RDONLY;
+    if (writable) {
+        int rc = Unshare(info, false);
+        if (rc != 0) {
+            return rc;
+        }
+    }
     int fd = next_fd_++;
     {
         std::lock_guard<std::mutex> lk(mu_);
@@ -174,11 +429,30 @@ int DfsClient::Open(const std::string& path, int flags, int& out_fd) {
             inode_size_[info.inode] = 0;
         }
     }
+    AcquireLease(info.inode);
+    if (info.data_chunk_id != 0) {
+        // The holder may have handed the content over before our lease was
+        // seen; once we hold it the MDS keeps the location fixed, so resolve
+        // it again.
+        InodeInfo fresh;
+        if (LookupInode(path, fresh) == rpc::STATUS_SUCCESS && fresh.inode == info.inode) {
+            std::lock_guard<std::mutex> lk(mu_);
+            fd_info_[fd].data_node_id = fresh.data_node_id;
+            fd_info_[fd].data_chunk_id = fresh.data_chunk_id;
+        }
+    }
+    if (writable && cfg_.dedup) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = leases_.find(info.inode);
+        if (it != leases_.end() && !it->second.fingerprint) {
+            it->second.fingerprint = std::make_shared<ContentFingerprint>();
+        }
+    }
     out_fd = fd;
     return 0;
 }
 
-int DfsClient::Create(const std::string& path, int flags, mode_t mode, int& out_fd) {
+int DfsClient::Create(const std::string& path, int flags, mode_t mode, int& out_fd, uint64_t size_hint) {
     if (!rpc_ || !rpc_->mds()) return -ECOMM;
     rpc::PathModeRequest creq;
     rpc::Status cresp;
@@ -198,7 +472,15 @@ int DfsClient::Create(const std::string& path, int flags, mode_t mode, int& out_
                   << " msg=" << cresp.message() << std::endl;
         return -StatusToErrno(ccode);
     }
-    return Open(path, flags, out_fd);
+    int rc = Open(path, flags, out_fd);
+    if (rc == 0 && size_hint > 0) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = leases_.find(fd_info_[out_fd].inode);
+        if (it != leases_.end()) {
+            it->second.size_hint = size_hint;
+        }
+    }
+    return rc;
 }
 
 int DfsClient::Mkdir(const std::string& path, mode_t mode) {
@@ -250,6 +532,13 @@ int DfsClient::Unlink(const std::string& path) {
     if (!rpc_ || !rpc_->mds()) return -ECOMM;
     InodeInfo info;
     const bool had_inode = (LookupInode(path, info) == rpc::STATUS_SUCCESS);
+    if (had_inode) {
+        // Other inodes may read this one's chunk; hand it over first.
+        int rc = Unshare(info, true);
+        if (rc != 0) {
+            return rc;
+        }
+    }
     rpc::PathRequest req;
     rpc::RemoveFileReply resp;
     brpc::Controller cntl;
@@ -283,7 +572,15 @@ int DfsClient::Truncate(const std::string& path, off_t size) {
     if (code != rpc::STATUS_SUCCESS) {
         return -StatusToErrno(code);
     }
+    return TruncateInode(info, static_cast<uint64_t>(size));
+}
 
+int DfsClient::TruncateInode(const InodeInfo& target, uint64_t size) {
+    InodeInfo info = target;
+    int rc = Unshare(info, size == 0);
+    if (rc != 0) {
+        return rc;
+    }
     storagenode::TruncateRequest treq;
     storagenode::TruncateReply tresp;
     brpc::Controller tcntl;
@@ -291,22 +588,24 @@ int DfsClient::Truncate(const std::string& path, off_t size) {
     const std::string& node_id = info.node_id.empty() ? cfg_.default_node_id : info.node_id;
     treq.set_node_id(node_id);
     treq.set_chunk_id(static_cast<uint64_t>(info.inode));
-    treq.set_size(static_cast<uint64_t>(size));
+    treq.set_size(size);
     rpc_->srm()->Truncate(&tcntl, &treq, &tresp, nullptr);
     if (tcntl.Failed()) {
-        std::cerr << "[Client] Truncate SRM RPC failed path=" << path
+        std::cerr << "[Client] Truncate SRM RPC failed inode=" << info.inode
                   << " err=" << tcntl.ErrorText() << std::endl;
         return -ECOMM;
     }
     auto tcode = StatusUtils::NormalizeCode(tresp.status().code());
     if (tcode != rpc::STATUS_SUCCESS) {
-        std::cerr << "[Client] Truncate failed path=" << path
+        std::cerr << "[Client] Truncate failed inode=" << info.inode
                   << " code=" << static_cast<int>(tcode)
                   << " msg=" << tresp.status().message() << std::endl;
         return -StatusToErrno(tcode);
     }
 
-    auto ucode = UpdateRemoteSize(info.inode, static_cast<uint64_t>(size));
+    // Batched extensions predate the truncate; push them first so they cannot land after it.
+    FlushSize(info.inode);
+    auto ucode = UpdateRemoteSize(info.inode, size, false);
     if (ucode != rpc::STATUS_SUCCESS) {
         std::cerr << "[Client] UpdateFileSize failed inode=" << info.inode
                   << " code=" << static_cast<int>(ucode) << std::endl;
@@ -314,7 +613,16 @@ int DfsClient::Truncate(const std::string& path, off_t size) {
     }
     {
         std::lock_guard<std::mutex> lk(mu_);
-        inode_size_[info.inode] = static_cast<uint64_t>(size);
+        inode_size_[info.inode] = size;
+        auto lit = leases_.find(info.inode);
+        if (lit != leases_.end() && lit->second.fingerprint) {
+            auto& fp = *lit->second.fingerprint;
+            if (size == 0) {
+                fp.Reset();
+            } else if (size != fp.bytes()) {
+                fp.Invalidate();
+            }
+        }
     }
     return 0;
 }
@@ -345,19 +653,91 @@ int DfsClient::Read(int fd, char* buf, size_t size, off_t offset, ssize_t& out_b
         req_len = static_cast<size_t>(std::min<uint64_t>(remain, size));
     }
 
+    // A deduplicated inode reads the chunk that holds its content.
+    const bool deduped = info.data_chunk_id != 0;
+    const std::string& node_id = deduped ? info.data_node_id
+                                         : (info.node_id.empty() ? cfg_.default_node_id : info.node_id);
+    const uint64_t chunk_id = deduped ? info.data_chunk_id : static_cast<uint64_t>(info.inode);
+    auto direct = rpc_->node(node_id);
+    if (cfg_.stream_threshold_bytes > 0 && req_len >= cfg_.stream_threshold_bytes) {
+        storagenode::OpenStreamRequest sreq;
+        sreq.set_node_id(node_id);
+        sreq.set_chunk_id(chunk_id);
+        sreq.set_offset(static_cast<uint64_t>(offset));
+        sreq.set_length(static_cast<uint64_t>(req_len));
+        auto res = ChunkStream::Read(direct ? direct.get() : rpc_->srm(), sreq, ChunkStream::Options(),
+                                     cfg_.rpc_timeout_ms,
+                                     [&](uint64_t off, butil::IOBuf* data) {
+                                         const uint64_t pos = off - static_cast<uint64_t>(offset);
+                                         if (pos + data->size() > req_len) {
+                                             return false;
+                                         }
+                                         data->copy_to(buf + pos, data->size());
+                                         return true;
+                                     });
+        if (direct && (!res.opened || res.code == rpc::STATUS_NETWORK_ERROR)) {
+            // the node did not answer; the gateway path below reads the range again
+            rpc_->DropNode(node_id);
+            direct.reset();
+        } else if (res.opened) {
+            if (res.code != rpc::STATUS_SUCCESS) {
+                std::cerr << "[Client] Read stream failed fd=" << fd
+                          << " code=" << static_cast<int>(res.code)
+                          << " msg=" << res.message << std::endl;
+                return -StatusToErrno(res.code);
+            }
+            out_bytes = static_cast<ssize_t>(res.bytes);
+            return 0;
+        }
+        // no stream (virtual node, older gateway): use the unary path
+    }
+
     storagenode::ReadRequest req;
     storagenode::ReadReply resp;
     brpc::Controller cntl;
-    cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
-    const std::string& node_id = info.node_id.empty() ? cfg_.default_node_id : info.node_id;
     req.set_node_id(node_id);
-    req.set_chunk_id(static_cast<uint64_t>(info.inode));
+    req.set_chunk_id(chunk_id);
     req.set_offset(static_cast<uint64_t>(offset));
     req.set_length(static_cast<uint64_t>(req_len));
-    rpc_->srm()->Read(&cntl, &req, &resp, nullptr);
-    if (cntl.Failed()) {
-        std::cerr << "[Client] Read RPC failed: " << cntl.ErrorText() << std::endl;
-        return -ECOMM;
+    bool attach = attach_payload_.load(std::memory_order_relaxed);
+    bool sparse = sparse_reads_.load(std::memory_order_relaxed);
+    for (;;) {
+        cntl.Reset();
+        cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+        resp.Clear();
+        req.set_wire_version(attach ? storagenode::WIRE_ATTACHMENT : storagenode::WIRE_INLINE);
+        req.set_sparse(sparse);
+        (direct ? direct.get() : rpc_->srm())->Read(&cntl, &req, &resp, nullptr);
+        if (cntl.Failed() && direct) {
+            rpc_->DropNode(node_id);
+            direct.reset();
+            continue;
+        }
+        if (cntl.Failed()) {
+            std::cerr << "[Client] Read RPC failed: " << cntl.ErrorText() << std::endl;
+            return -ECOMM;
+        }
+        if (resp.status().code() != rpc::STATUS_SUCCESS) {
+            break;
+        }
+        const bool attached = resp.wire_version() == storagenode::WIRE_ATTACHMENT;
+        const uint64_t payload = attached ? cntl.response_attachment().size() : resp.data().size();
+        if (payload + HoleBytes(resp) >= resp.bytes_read()) {
+            break;
+        }
+        if (attach && !attached) {
+            // an older gateway dropped the attachment; stay inline from now on
+            std::cerr << "[Client] storage path does not forward attachments, using inline payloads" << std::endl;
+            attach_payload_.store(false, std::memory_order_relaxed);
+            attach = false;
+        } else if (sparse) {
+            // an older gateway dropped the hole descriptors
+            std::cerr << "[Client] storage path does not forward holes, reading them as zeros" << std::endl;
+            sparse_reads_.store(false, std::memory_order_relaxed);
+            sparse = false;
+        } else {
+            break;
+        }
     }
     auto code = StatusUtils::NormalizeCode(resp.status().code());
     if (code != rpc::STATUS_SUCCESS) {
@@ -367,8 +747,26 @@ int DfsClient::Read(int fd, char* buf, size_t size, off_t offset, ssize_t& out_b
         return -StatusToErrno(code);
     }
     out_bytes = static_cast<ssize_t>(resp.bytes_read());
+    if (resp.holes_size() > 0) {
+        std::string payload;
+        if (resp.wire_version() == storagenode::WIRE_ATTACHMENT) {
+            cntl.response_attachment().copy_to(&payload);
+        } else {
+            payload.swap(*resp.mutable_data());
+        }
+        if (static_cast<size_t>(out_bytes) > size ||
+            !FillHoles(resp, static_cast<uint64_t>(offset), payload, buf, static_cast<size_t>(out_bytes))) {
+            std::cerr << "[Client] Read fd=" << fd << " got malformed hole descriptors" << std::endl;
+            return -EIO;
+        }
+        return 0;
+    }
     if (out_bytes > 0 && static_cast<size_t>(out_bytes) <= size) {
-        std::memcpy(buf, resp.data().data(), static_cast<size_t>(out_bytes));
+        if (resp.wire_version() == storagenode::WIRE_ATTACHMENT) {
+            cntl.response_attachment().copy_to(buf, static_cast<size_t>(out_bytes));
+        } else {
+            std::memcpy(buf, resp.data().data(), static_cast<size_t>(out_bytes));
+        }
     }
     return 0;
 }
@@ -376,30 +774,85 @@ int DfsClient::Read(int fd, char* buf, size_t size, off_t offset, ssize_t& out_b
 int DfsClient::Write(int fd, const char* buf, size_t size, off_t offset, ssize_t& out_bytes) {
     if (!rpc_ || !rpc_->srm()) return -ECOMM;
     InodeInfo info;
+    uint64_t size_hint = 0;
+    std::shared_ptr<ContentFingerprint> fingerprint;
     {
         std::lock_guard<std::mutex> lk(mu_);
         auto it = fd_info_.find(fd);
         if (it == fd_info_.end()) return -EBADF;
         info = it->second;
+        auto lit = leases_.find(info.inode);
+        if (lit != leases_.end()) {
+            size_hint = lit->second.size_hint;
+            lit->second.wrote = true;
+            fingerprint = lit->second.fingerprint;
+        }
     }
 
-    storagenode::WriteRequest req;
+    const std::string& node_id = info.node_id.empty() ? cfg_.default_node_id : info.node_id;
+    auto direct = rpc_->node(node_id);
+    bool streamed = false;
     storagenode::WriteReply resp;
+    if (cfg_.stream_threshold_bytes > 0 && size >= cfg_.stream_threshold_bytes) {
+        storagenode::OpenStreamRequest sreq;
+        sreq.set_node_id(node_id);
+        sreq.set_chunk_id(static_cast<uint64_t>(info.inode));
+        sreq.set_offset(static_cast<uint64_t>(offset));
+        sreq.set_mode(0644);
+        sreq.set_size_hint(size_hint);
+        auto res = ChunkStream::Write(direct ? direct.get() : rpc_->srm(), sreq, ChunkStream::Options(),
+                                      cfg_.rpc_timeout_ms, buf, size);
+        if (direct && (!res.opened || res.code == rpc::STATUS_NETWORK_ERROR)) {
+            // rewriting the same bytes through the gateway is harmless
+            rpc_->DropNode(node_id);
+            direct.reset();
+        } else if (res.opened) {
+            streamed = true;
+            StatusUtils::SetStatus(resp.mutable_status(), res.code, res.message);
+            resp.set_bytes_written(res.bytes);
+        }
+    }
+
+    storagenode::WriteRequest req;
     brpc::Controller cntl;
-    cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
-    const std::string& node_id = info.node_id.empty() ? cfg_.default_node_id : info.node_id;
     req.set_node_id(node_id);
     req.set_chunk_id(static_cast<uint64_t>(info.inode));
     req.set_offset(static_cast<uint64_t>(offset));
-    req.set_data(buf, size);
     req.set_checksum(0);
     req.set_flags(0);
     req.set_mode(0644);
+    req.set_size_hint(size_hint);
 
-    rpc_->srm()->Write(&cntl, &req, &resp, nullptr);
-    if (cntl.Failed()) {
-        std::cerr << "[Client] Write RPC failed: " << cntl.ErrorText() << std::endl;
-        return -ECOMM;
+    bool attach = attach_payload_.load(std::memory_order_relaxed);
+    while (!streamed) {
+        cntl.Reset();
+        cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+        resp.Clear();
+        if (attach) {
+            req.set_wire_version(storagenode::WIRE_ATTACHMENT);
+            cntl.request_attachment().append(buf, size);
+        } else {
+            req.set_wire_version(storagenode::WIRE_INLINE);
+            req.set_data(buf, size);
+        }
+        (direct ? direct.get() : rpc_->srm())->Write(&cntl, &req, &resp, nullptr);
+        if (cntl.Failed() && direct) {
+            rpc_->DropNode(node_id);
+            direct.reset();
+            continue;
+        }
+        if (cntl.Failed()) {
+            std::cerr << "[Client] Write RPC failed: " << cntl.ErrorText() << std::endl;
+            return -ECOMM;
+        }
+        if (!attach || size == 0 || resp.wire_version() == storagenode::WIRE_ATTACHMENT ||
+            resp.status().code() != rpc::STATUS_SUCCESS) {
+            break;
+        }
+        // the node never saw the payload; resend it inline and stay inline
+        std::cerr << "[Client] storage path does not accept attachments, using inline payloads" << std::endl;
+        attach_payload_.store(false, std::memory_order_relaxed);
+        attach = false;
     }
     auto code = StatusUtils::NormalizeCode(resp.status().code());
     if (code != rpc::STATUS_SUCCESS) {
@@ -409,6 +862,9 @@ int DfsClient::Write(int fd, const char* buf, size_t size, off_t offset, ssize_t
         return -StatusToErrno(code);
     }
     out_bytes = static_cast<ssize_t>(resp.bytes_written());
+    if (fingerprint) {
+        fingerprint->Update(static_cast<uint64_t>(offset), buf, static_cast<size_t>(out_bytes));
+    }
     uint64_t new_size = 0;
     bool need_update = false;
     {
@@ -418,11 +874,18 @@ int DfsClient::Write(int fd, const char* buf, size_t size, off_t offset, ssize_t
         if (end > cur) {
             cur = end;
             new_size = cur;
-            need_update = true;
+            auto lit = leases_.find(info.inode);
+            if (lit != leases_.end() && !lit->second.shared &&
+                std::chrono::steady_clock::now() < lit->second.expires) {
+                // Exclusive lease: batch the size, flushed on close/fsync/timer.
+                lit->second.dirty = true;
+            } else {
+                need_update = true;
+            }
         }
     }
     if (need_update) {
-        auto code = UpdateRemoteSize(info.inode, new_size);
+        auto code = UpdateRemoteSize(info.inode, new_size, true);
         if (code != rpc::STATUS_SUCCESS) {
             std::cerr << "[Client] UpdateFileSize failed inode=" << info.inode
                       << " code=" << static_cast<int>(code) << std::endl;
@@ -433,10 +896,249 @@ int DfsClient::Write(int fd, const char* buf, size_t size, off_t offset, ssize_t
 }
 
 int DfsClient::Close(int fd) {
-    std::lock_guard<std::mutex> lk(mu_);
-    auto it = fd_info_.find(fd);
-    if (it != fd_info_.end()) {
+    InodeInfo info;
+    bool last_ref = false;
+    bool wrote = false;
+    bool shared = true;
+    uint64_t size = 0;
+    std::shared_ptr<ContentFingerprint> fingerprint;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = fd_info_.find(fd);
+        if (it == fd_info_.end()) {
+            return 0;
+        }
+        info = it->second;
         fd_info_.erase(it);
+        auto lit = leases_.find(info.inode);
+        if (lit != leases_.end() && --lit->second.open_refs <= 0) {
+            last_ref = true;
+            wrote = lit->second.wrote;
+            lit->second.wrote = false;
+            lit->second.size_hint = 0;
+            shared = lit->second.shared;
+            fingerprint = std::move(lit->second.fingerprint);
+            size = inode_size_[info.inode];
+        }
+    }
+    if (last_ref) {
+        ReleaseLease(info.inode);
+    }
+    // Not while another client has the file open: it would keep reading the
+    // chunk emptied here.
+    bool deduped = false;
+    if (wrote && !shared && fingerprint && fingerprint->valid() && fingerprint->bytes() == size &&
+        size > 0 && size >= cfg_.dedup_min_bytes && rpc_ && rpc_->mds() && rpc_->srm()) {
+        deduped = DedupChunk(info, *fingerprint, size);
+    }
+    if (wrote && !deduped && rpc_ && rpc_->srm()) {
+        TrimChunk(info);
+    }
+    return 0;
+}
+
+int DfsClient::Fallocate(int fd, int mode, off_t offset, off_t length) {
+    if (!rpc_ || !rpc_->mds() || !rpc_->srm()) return -ECOMM;
+    if (offset < 0 || length <= 0) return -EINVAL;
+    if (mode != 0 && mode != FALLOC_FL_KEEP_SIZE) return -EOPNOTSUPP;
+    const uint64_t end = static_cast<uint64_t>(offset) + static_cast<uint64_t>(length);
+    InodeInfo info;
+    bool extend = false;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = fd_info_.find(fd);
+        if (it == fd_info_.end()) return -EBADF;
+        info = it->second;
+        auto lit = leases_.find(info.inode);
+        if (lit != leases_.end()) {
+            lit->second.size_hint = std::max(lit->second.size_hint, end);
+        }
+        extend = mode == 0 && end > inode_size_[info.inode];
+    }
+    // The node reserves the space with the first write that carries the hint.
+    return extend ? TruncateInode(info, end) : 0;
+}
+
+void DfsClient::TrimChunk(const InodeInfo& info) {
+    storagenode::TrimChunkRequest req;
+    storagenode::TrimChunkReply resp;
+    brpc::Controller cntl;
+    cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+    req.set_node_id(info.node_id.empty() ? cfg_.default_node_id : info.node_id);
+    req.set_chunk_id(info.inode);
+    rpc_->srm()->TrimChunk(&cntl, &req, &resp, nullptr);
+    // Best effort: the node also trims chunks that stay idle.
+    if (cntl.Failed()) {
+        std::cerr << "[Client] TrimChunk RPC failed inode=" << info.inode
+                  << " err=" << cntl.ErrorText() << std::endl;
+    } else if (resp.status().code() != rpc::STATUS_SUCCESS) {
+        std::cerr << "[Client] TrimChunk failed inode=" << info.inode
+                  << " msg=" << resp.status().message() << std::endl;
+    }
+}
+
+int DfsClient::Unshare(InodeInfo& info, bool discard) {
+    if (!rpc_ || !rpc_->mds()) return -ECOMM;
+    rpc::DedupReleaseRequest req;
+    req.set_inode(info.inode);
+    req.set_discard(discard);
+    // Each round either releases the inode or names one copy to make; a
+    // round only repeats when other inodes release the content meanwhile.
+    // Busy replies (the content is open through another inode, or a copy
+    // into or out of it is under way) are retried for a while without
+    // counting as a round.
+    int busy_waits = 0;
+    for (int round = 0; round < 8;) {
+        rpc::DedupReleaseReply resp;
+        brpc::Controller cntl;
+        cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+        rpc_->mds()->ReleaseDedup(&cntl, &req, &resp, nullptr);
+        if (cntl.Failed()) {
+            std::cerr << "[Client] ReleaseDedup RPC failed inode=" << info.inode
+                      << " err=" << cntl.ErrorText() << std::endl;
+            return -ECOMM;
+        }
+        auto code = StatusUtils::NormalizeCode(resp.status().code());
+        if (code != rpc::STATUS_SUCCESS) {
+            std::cerr << "[Client] ReleaseDedup failed inode=" << info.inode
+                      << " code=" << static_cast<int>(code)
+                      << " msg=" << resp.status().message() << std::endl;
+            return -StatusToErrno(code);
+        }
+        if (resp.busy()) {
+            if (++busy_waits > 50) {
+                std::cerr << "[Client] ReleaseDedup busy inode=" << info.inode << std::endl;
+                return -EBUSY;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        ++round;
+        if (resp.released()) {
+            if (info.data_chunk_id != 0) {
+                info.data_node_id.clear();
+                info.data_chunk_id = 0;
+                // Open fds must see writes made to the inode's own chunk from now on.
+                std::lock_guard<std::mutex> lk(mu_);
+                for (auto& kv : fd_info_) {
+                    if (kv.second.inode == info.inode) {
+                        kv.second.data_node_id.clear();
+                        kv.second.data_chunk_id = 0;
+                    }
+                }
+            }
+            return 0;
+        }
+        int rc = CopyChunk(resp.from_node_id(), resp.from_chunk_id(), resp.to_node_id(), resp.to_chunk_id(),
+                           resp.size_bytes());
+        if (rc != 0) {
+            return rc;
+        }
+        req.set_copied_to(resp.to_chunk_id());
+    }
+    std::cerr << "[Client] ReleaseDedup did not settle inode=" << info.inode << std::endl;
+    return -EBUSY;
+}
+
+int DfsClient::CopyChunk(const std::string& from_node, uint64_t from_chunk, const std::string& to_node,
+                         uint64_t to_chunk, uint64_t size) {
+    if (!rpc_ || !rpc_->srm()) return -ECOMM;
+    constexpr uint64_t kPiece = 1u << 20;
+    for (uint64_t off = 0; off < size;) {
+        const uint64_t len = std::min(kPiece, size - off);
+        storagenode::ReadRequest rreq;
+        storagenode::ReadReply rresp;
+        brpc::Controller rcntl;
+        rcntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+        rreq.set_node_id(from_node);
+        rreq.set_chunk_id(from_chunk);
+        rreq.set_offset(off);
+        rreq.set_length(len);
+        rreq.set_wire_version(storagenode::WIRE_INLINE);
+        rpc_->srm()->Read(&rcntl, &rreq, &rresp, nullptr);
+        if (rcntl.Failed() || StatusUtils::NormalizeCode(rresp.status().code()) != rpc::STATUS_SUCCESS ||
+            rresp.data().size() != len) {
+            std::cerr << "[Client] dedup copy read failed chunk=" << from_chunk << " offset=" << off
+                      << " err=" << (rcntl.Failed() ? rcntl.ErrorText() : rresp.status().message()) << std::endl;
+            return rcntl.Failed() ? -ECOMM : -EIO;
+        }
+        storagenode::WriteRequest wreq;
+        storagenode::WriteReply wresp;
+        brpc::Controller wcntl;
+        wcntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+        wreq.set_node_id(to_node);
+        wreq.set_chunk_id(to_chunk);
+        wreq.set_offset(off);
+        wreq.set_mode(0644);
+        wreq.set_wire_version(storagenode::WIRE_INLINE);
+        wreq.set_data(std::move(*rresp.mutable_data()));
+        rpc_->srm()->Write(&wcntl, &wreq, &wresp, nullptr);
+        if (wcntl.Failed() || StatusUtils::NormalizeCode(wresp.status().code()) != rpc::STATUS_SUCCESS ||
+            wresp.bytes_written() != len) {
+            std::cerr << "[Client] dedup copy write failed chunk=" << to_chunk << " offset=" << off
+                      << " err=" << (wcntl.Failed() ? wcntl.ErrorText() : wresp.status().message()) << std::endl;
+            return wcntl.Failed() ? -ECOMM : -EIO;
+        }
+        off += len;
+    }
+    return 0;
+}
+
+bool DfsClient::DedupChunk(const InodeInfo& info, const ContentFingerprint& fingerprint, uint64_t size) {
+    std::string digest;
+    if (!fingerprint.Final(&digest)) {
+        return false;
+    }
+    rpc::DedupChunkRequest req;
+    rpc::DedupChunkReply resp;
+    brpc::Controller cntl;
+    cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+    req.set_inode(info.inode);
+    req.set_fingerprint(digest);
+    req.set_size_bytes(size);
+    rpc_->mds()->DedupChunk(&cntl, &req, &resp, nullptr);
+    if (cntl.Failed()) {
+        std::cerr << "[Client] DedupChunk RPC failed inode=" << info.inode
+                  << " err=" << cntl.ErrorText() << std::endl;
+        return false;
+    }
+    if (StatusUtils::NormalizeCode(resp.status().code()) != rpc::STATUS_SUCCESS) {
+        std::cerr << "[Client] DedupChunk failed inode=" << info.inode
+                  << " msg=" << resp.status().message() << std::endl;
+        return false;
+    }
+    if (!resp.duplicate()) {
+        return false;
+    }
+    // The MDS has the reference on disk; the inode's own copy is no longer read.
+    storagenode::TruncateRequest treq;
+    storagenode::TruncateReply tresp;
+    brpc::Controller tcntl;
+    tcntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+    treq.set_node_id(info.node_id.empty() ? cfg_.default_node_id : info.node_id);
+    treq.set_chunk_id(info.inode);
+    treq.set_size(0);
+    rpc_->srm()->Truncate(&tcntl, &treq, &tresp, nullptr);
+    if (tcntl.Failed() || StatusUtils::NormalizeCode(tresp.status().code()) != rpc::STATUS_SUCCESS) {
+        std::cerr << "[Client] dedup could not empty chunk inode=" << info.inode
+                  << " err=" << (tcntl.Failed() ? tcntl.ErrorText() : tresp.status().message()) << std::endl;
+    }
+    return true;
+}
+
+int DfsClient::Fsync(int fd) {
+    uint64_t inode = 0;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = fd_info_.find(fd);
+        if (it == fd_info_.end()) return -EBADF;
+        inode = it->second.inode;
+    }
+    auto code = FlushSize(inode);
+    if (code != rpc::STATUS_SUCCESS) {
+        std::cerr << "[Client] Fsync size flush failed inode=" << inode
+                  << " code=" << static_cast<int>(code) << std::endl;
+        return -StatusToErrno(code);
     }
     return 0;
 }
@@ -8,42 +8,100 @@
 #include <fuse.h>
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
 
 #include "RpcClients.h"
+#include "common/ContentFingerprint.h"
 #include "common/StatusUtils.h"
 
 struct InodeInfo {
     uint64_t inode{0};
     std::string node_id;
+    // Set while the inode's content is deduplicated into another chunk, which
+    // reads go to; writes always go to the inode's own chunk.
+    std::string data_node_id;
+    uint64_t data_chunk_id{0};
+};
+
+// Per-inode size lease held while the inode has open fds on this client.
+struct SizeLeaseState {
+    int open_refs{0};
+    bool dirty{false};   // local size is ahead of the MDS
+    bool shared{true};   // another client holds a lease (or none granted): update synchronously
+    std::chrono::steady_clock::time_point expires{};
+    std::chrono::steady_clock::time_point renew_at{};
+    uint64_t size_hint{0};  // expected final size, sent with writes so the node can reserve it
+    bool wrote{false};      // the node may hold space past the end until the last close
+    // Of the content written since the first open for writing, while it is
+    // written front to back; offered for deduplication on the last close.
+    std::shared_ptr<ContentFingerprint> fingerprint;
 };
 
 class DfsClient {
 public:
     explicit DfsClient(MountConfig cfg);
+    ~DfsClient();
     bool Init();
 
     int GetAttr(const std::string& path, struct stat* st);
     int ReadDir(const std::string& path, void* buf, fuse_fill_dir_t filler);
     int Open(const std::string& path, int flags, int& out_fd);
-    int Create(const std::string& path, int flags, mode_t mode, int& out_fd);
+    // size_hint is the expected final size, 0 when unknown.
+    int Create(const std::string& path, int flags, mode_t mode, int& out_fd, uint64_t size_hint = 0);
     int Mkdir(const std::string& path, mode_t mode);
     int Rmdir(const std::string& path);
     int Unlink(const std::string& path);
     int Truncate(const std::string& path, off_t size);
     int Read(int fd, char* buf, size_t size, off_t offset, ssize_t& out_bytes);
     int Write(int fd, const char* buf, size_t size, off_t offset, ssize_t& out_bytes);
+    // Records offset + length as the inode's size hint; mode 0 also extends
+    // the file to it, FALLOC_FL_KEEP_SIZE only reserves.
+    int Fallocate(int fd, int mode, off_t offset, off_t length);
     int Close(int fd);
+    // Push any batched size for the fd's inode to the MDS (fsync/flush).
+    int Fsync(int fd);
 
 private:
     int StatusToErrno(rpc::StatusCode code) const;
     bool PopulateStat(struct stat* st, bool is_dir) const;
     rpc::StatusCode LookupInode(const std::string& path, InodeInfo& out_info);
-    rpc::StatusCode UpdateRemoteSize(uint64_t inode, uint64_t size_bytes);
+    int TruncateInode(const InodeInfo& info, uint64_t size);
+    // Asks the node to give back space it reserved past the end of the chunk.
+    void TrimChunk(const InodeInfo& info);
+    // Gives the inode back content it shares through deduplication, copying
+    // it into the chunk the MDS names, so the inode can be written or
+    // removed; with discard the content is dropped instead where possible.
+    int Unshare(InodeInfo& info, bool discard);
+    int CopyChunk(const std::string& from_node, uint64_t from_chunk, const std::string& to_node, uint64_t to_chunk,
+                  uint64_t size);
+    // Offers the closed inode's content to the MDS index; true if it turned
+    // out to be a duplicate and the inode's own chunk was emptied.
+    bool DedupChunk(const InodeInfo& info, const ContentFingerprint& fingerprint, uint64_t size);
+    rpc::StatusCode UpdateRemoteSize(uint64_t inode, uint64_t size_bytes, bool extend_only);
+    rpc::StatusCode CallSizeLease(uint64_t inode, bool release, bool dirty, rpc::SizeLeaseReply& out);
+    void AcquireLease(uint64_t inode);
+    void RenewLease(uint64_t inode);
+    void ReleaseLease(uint64_t inode);
+    rpc::StatusCode FlushSize(uint64_t inode);
+    void FlushLoop();
 
     MountConfig cfg_;
     std::unique_ptr<RpcClients> rpc_;
     int next_fd_{3};
     std::unordered_map<int, InodeInfo> fd_info_;
     std::unordered_map<uint64_t, uint64_t> inode_size_;
+    std::unordered_map<uint64_t, SizeLeaseState> leases_;
     mutable std::mutex mu_;
+
+    std::thread flusher_;
+    std::mutex flush_mu_;
+    std::condition_variable flush_cv_;
+    bool stop_{false};
+
+    // Cleared once a reply shows the storage path does not understand attachments.
+    std::atomic<bool> attach_payload_{false};
+    std::atomic<bool> sparse_reads_{false};
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 struct MountConfig {
@@ -9,4 +10,28 @@ struct MountConfig {
     std::string default_node_id{"node-1"};
     int rpc_timeout_ms{3000};
     int rpc_max_retry{2};
+    // Interval for flushing batched file sizes and renewing size leases.
+    int size_flush_interval_ms{1000};
+    // Identifies this mount to the MDS lease table; empty = hostname:pid.
+    std::string client_id;
+    // Carry read/write payloads in the brpc attachment (storagenode::WIRE_ATTACHMENT)
+    // instead of protobuf bytes; falls back to inline against older nodes.
+    bool attach_payload{true};
+    // Ask for hole descriptors instead of zero bytes on reads (ReadRequest.sparse)
+    // and fill the zeros in locally.
+    bool sparse_reads{true};
+    // Reads and writes of at least this many bytes go over a block stream
+    // (OpenReadStream/OpenWriteStream) instead of one unary RPC; 0 disables.
+    size_t stream_threshold_bytes{1u << 20};
+    // Send reads and writes straight to the real node that holds the chunk,
+    // using the node addresses SRM lists, instead of through the SRM gateway.
+    // Virtual nodes, unknown nodes and nodes a direct call just failed on
+    // still go through the gateway.
+    bool direct_data_path{true};
+    int node_map_refresh_ms{30000};
+    // Offer files written front to back to MDS deduplication on the last
+    // close (DedupChunk), if at least dedup_min_bytes long. Shared content is
+    // unshared before a write or unlink whether or not this is set.
+    bool dedup{true};
+    size_t dedup_min_bytes{64u << 10};
 };
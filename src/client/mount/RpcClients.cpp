@@ -1,5 +1,15 @@
 #include "RpcClients.h"
 
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// Floor between node map fetches triggered by misses and failures.
+constexpr std::chrono::seconds kMinRefreshInterval{1};
+
+} // namespace
+
 bool RpcClients::Init() {
     brpc::ChannelOptions opts;
     opts.protocol = "baidu_std";
@@ -19,5 +29,116 @@ bool RpcClients::Init() {
 
     mds_stub_ = std::make_unique<rpc::MdsService_Stub>(mds_channel_.get());
     srm_stub_ = std::make_unique<storagenode::StorageService_Stub>(srm_channel_.get());
+    // SRM serves the cluster manager and the gateway on the same port.
+    cluster_stub_ = std::make_unique<storagenode::ClusterManagerService_Stub>(srm_channel_.get());
+    if (cfg_.direct_data_path) {
+        RefreshNodes();
+    }
     return true;
 }
+
+std::shared_ptr<storagenode::StorageService_Stub> RpcClients::node(const std::string& node_id) {
+    if (!cfg_.direct_data_path || !cluster_stub_ || node_id.empty()) {
+        return nullptr;
+    }
+    bool refresh = false;
+    std::shared_ptr<NodeRoute> route;
+    {
+        std::lock_guard<std::mutex> lk(node_mu_);
+        const auto now = std::chrono::steady_clock::now();
+        auto it = nodes_.find(node_id);
+        if (it != nodes_.end()) {
+            route = it->second;
+        } else if (map_valid_ && now - last_refresh_ >= kMinRefreshInterval) {
+            // a node registered since the last fetch
+            next_refresh_ = now;
+        }
+        refresh = now >= next_refresh_ && !refreshing_;
+    }
+    if (refresh) {
+        RefreshNodes();
+        std::lock_guard<std::mutex> lk(node_mu_);
+        auto it = nodes_.find(node_id);
+        route = it != nodes_.end() ? it->second : nullptr;
+    }
+    if (!route || !route->stub) {
+        return nullptr;
+    }
+    // The stub keeps its channel alive even if the map drops the route meanwhile.
+    return std::shared_ptr<storagenode::StorageService_Stub>(route, route->stub.get());
+}
+
+void RpcClients::DropNode(const std::string& node_id) {
+    std::lock_guard<std::mutex> lk(node_mu_);
+    auto it = nodes_.find(node_id);
+    if (it == nodes_.end() || !it->second->stub) {
+        return;
+    }
+    std::cerr << "[Client] direct path to node " << node_id << " at " << it->second->addr
+              << " failed, using the gateway" << std::endl;
+    // Keep the entry, without a stub, so lookups do not refetch on every call.
+    auto gateway_only = std::make_shared<NodeRoute>();
+    it->second = std::move(gateway_only);
+    next_refresh_ = std::min(next_refresh_, last_refresh_ + kMinRefreshInterval);
+}
+
+void RpcClients::RefreshNodes() {
+    std::unordered_map<std::string, std::shared_ptr<NodeRoute>> old;
+    {
+        std::lock_guard<std::mutex> lk(node_mu_);
+        if (refreshing_) {
+            return;
+        }
+        refreshing_ = true;
+        old = nodes_;
+    }
+    storagenode::ListNodesRequest req;
+    storagenode::ListNodesResponse resp;
+    brpc::Controller cntl;
+    cntl.set_timeout_ms(cfg_.rpc_timeout_ms);
+    cluster_stub_->ListNodes(&cntl, &req, &resp, nullptr);
+    const bool ok = !cntl.Failed() && resp.status().code() == rpc::STATUS_SUCCESS;
+
+    std::unordered_map<std::string, std::shared_ptr<NodeRoute>> fresh;
+    if (ok) {
+        brpc::ChannelOptions opts;
+        opts.protocol = "baidu_std";
+        opts.timeout_ms = cfg_.rpc_timeout_ms;
+        opts.max_retry = cfg_.rpc_max_retry;
+        for (const auto& n : resp.nodes()) {
+            auto route = std::make_shared<NodeRoute>();
+            if (!n.is_virtual() && n.online() && !n.ip().empty() && n.port() != 0) {
+                route->addr = n.ip() + ":" + std::to_string(n.port());
+                auto it = old.find(n.node_id());
+                if (it != old.end() && it->second->addr == route->addr && it->second->stub) {
+                    fresh.emplace(n.node_id(), it->second);
+                    continue;
+                }
+                route->channel = std::make_unique<brpc::Channel>();
+                if (route->channel->Init(route->addr.c_str(), &opts) == 0) {
+                    route->stub = std::make_unique<storagenode::StorageService_Stub>(route->channel.get());
+                } else {
+                    std::cerr << "[Client] failed to init channel to node " << n.node_id()
+                              << " at " << route->addr << std::endl;
+                    route->channel.reset();
+                }
+            }
+            fresh.emplace(n.node_id(), std::move(route));
+        }
+    } else {
+        // An SRM without ListNodes, or unreachable: the gateway carries the data.
+        std::cerr << "[Client] ListNodes failed err="
+                  << (cntl.Failed() ? cntl.ErrorText() : resp.status().message()) << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lk(node_mu_);
+    const auto now = std::chrono::steady_clock::now();
+    if (ok) {
+        nodes_.swap(fresh);
+    }
+    map_valid_ = ok;
+    last_refresh_ = now;
+    next_refresh_ = now + std::max<std::chrono::steady_clock::duration>(
+                              std::chrono::milliseconds(cfg_.node_map_refresh_ms), kMinRefreshInterval);
+    refreshing_ = false;
+}
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include <brpc/channel.h>
 
 #include "mds.pb.h"
+#include "cluster_manager.pb.h"
 #include "storage_node.pb.h"
 #include "MountConfig.h"
 
@@ -22,10 +26,35 @@ public:
     rpc::MdsService_Stub* mds() { return mds_stub_.get(); }
     storagenode::StorageService_Stub* srm() { return srm_stub_.get(); }
 
+    // Stub that reaches node_id itself, bypassing the gateway, when SRM lists
+    // it as an online real node; nullptr means go through srm(). The node map
+    // is fetched from SRM (ListNodes) and refreshed every
+    // node_map_refresh_ms, and sooner after a miss or a DropNode.
+    std::shared_ptr<storagenode::StorageService_Stub> node(const std::string& node_id);
+    // Call after a direct call to node_id failed: forgets its route so data
+    // goes through the gateway until the map is refetched.
+    void DropNode(const std::string& node_id);
+
 private:
+    struct NodeRoute {
+        std::string addr;  // empty for nodes only the gateway can serve
+        std::unique_ptr<brpc::Channel> channel;
+        std::unique_ptr<storagenode::StorageService_Stub> stub;
+    };
+
+    void RefreshNodes();
+
     MountConfig cfg_;
     std::unique_ptr<brpc::Channel> mds_channel_;
     std::unique_ptr<brpc::Channel> srm_channel_;
     std::unique_ptr<rpc::MdsService_Stub> mds_stub_;
     std::unique_ptr<storagenode::StorageService_Stub> srm_stub_;
+    std::unique_ptr<storagenode::ClusterManagerService_Stub> cluster_stub_;
+
+    std::mutex node_mu_;
+    std::unordered_map<std::string, std::shared_ptr<NodeRoute>> nodes_;
+    std::chrono::steady_clock::time_point last_refresh_{};
+    std::chrono::steady_clock::time_point next_refresh_{};
+    bool map_valid_{false};  // the last fetch succeeded
+    bool refreshing_{false};
 };
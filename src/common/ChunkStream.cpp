@@ -0,0 +1,249 @@
+#include "ChunkStream.h"
+
+#include <brpc/controller.h>
+#include <bthread/countdown_event.h>
+#include <butil/time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "StatusUtils.h"
+
+namespace {
+
+constexpr uint32_t kDefaultBlockSize = 1u << 20;
+
+// Outcome of a client stream. Shared between the caller and the handler,
+// which brpc keeps until on_closed and which may outlive the call when the
+// caller gives up first.
+struct StreamState {
+    std::mutex mu;
+    bool finished{false};
+    rpc::StatusCode code{rpc::STATUS_SUCCESS};
+    std::string message;
+    uint64_t bytes{0};
+    bthread::CountdownEvent done{1};
+
+    void Finish(rpc::StatusCode c, const std::string& msg) {
+        std::lock_guard<std::mutex> lk(mu);
+        if (finished) {
+            return;
+        }
+        finished = true;
+        code = c;
+        message = msg;
+        done.signal();
+    }
+    bool IsFinished() {
+        std::lock_guard<std::mutex> lk(mu);
+        return finished;
+    }
+};
+
+// brpc runs a stream's callbacks one at a time, so once Finish has been
+// called from one of them no later callback touches the caller's sink.
+class ClientHandler : public brpc::StreamInputHandler {
+public:
+    explicit ClientHandler(std::shared_ptr<StreamState> state) : state_(std::move(state)) {}
+
+    void on_idle_timeout(brpc::StreamId) override {
+        state_->Finish(rpc::STATUS_NETWORK_ERROR, "stream idle timeout");
+    }
+    void on_closed(brpc::StreamId) override {
+        state_->Finish(rpc::STATUS_NETWORK_ERROR, "stream closed before its end frame");
+        delete this;
+    }
+
+protected:
+    std::shared_ptr<StreamState> state_;
+};
+
+class ReadHandler : public ClientHandler {
+public:
+    ReadHandler(std::shared_ptr<StreamState> state, uint64_t offset,
+                const std::function<bool(uint64_t, butil::IOBuf*)>* sink)
+        : ClientHandler(std::move(state)), next_(offset), sink_(sink) {}
+
+    int on_received_messages(brpc::StreamId, butil::IOBuf* const messages[], size_t size) override {
+        for (size_t i = 0; i < size && !state_->IsFinished(); ++i) {
+            ChunkStream::Frame frame;
+            if (!ChunkStream::CutHeader(messages[i], &frame)) {
+                state_->Finish(rpc::STATUS_IO_ERROR, "malformed stream frame");
+            } else if (frame.length == 0) {
+                state_->Finish(StatusUtils::NormalizeCode(frame.code),
+                               frame.code == 0 ? "" : "stream ended with an error");
+            } else if (frame.offset != next_ || messages[i]->size() != frame.length) {
+                state_->Finish(rpc::STATUS_IO_ERROR, "stream frame out of sequence");
+            } else {
+                next_ += frame.length;
+                state_->bytes += frame.length;
+                if (!(*sink_)(frame.offset, messages[i])) {
+                    state_->Finish(rpc::STATUS_SUCCESS, "");
+                }
+            }
+        }
+        return 0;
+    }
+
+private:
+    uint64_t next_;
+    const std::function<bool(uint64_t, butil::IOBuf*)>* sink_;
+};
+
+class WriteHandler : public ClientHandler {
+public:
+    WriteHandler(std::shared_ptr<StreamState> state, uint64_t offset)
+        : ClientHandler(std::move(state)), start_(offset) {}
+
+    int on_received_messages(brpc::StreamId, butil::IOBuf* const messages[], size_t size) override {
+        for (size_t i = 0; i < size && !state_->IsFinished(); ++i) {
+            ChunkStream::Frame frame;
+            if (!ChunkStream::CutHeader(messages[i], &frame) || frame.length != 0) {
+                state_->Finish(rpc::STATUS_IO_ERROR, "malformed stream ack");
+                continue;
+            }
+            state_->bytes = frame.offset > start_ ? frame.offset - start_ : 0;
+            state_->Finish(StatusUtils::NormalizeCode(frame.code),
+                           frame.code == 0 ? "" : "node failed the stream");
+        }
+        return 0;
+    }
+
+private:
+    uint64_t start_;
+};
+
+// Creates the client stream and opens it with method; false leaves result
+// describing why.
+template <typename Method>
+bool OpenStream(storagenode::StorageService_Stub* stub, Method method,
+                const storagenode::OpenStreamRequest& request, const ChunkStream::Options& opts,
+                int rpc_timeout_ms, ClientHandler* handler, brpc::StreamId* id, ChunkStream::Result* result) {
+    brpc::Controller cntl;
+    cntl.set_timeout_ms(rpc_timeout_ms);
+    brpc::StreamOptions so;
+    so.handler = handler;
+    so.max_buf_size = static_cast<int>(opts.window_bytes);
+    so.idle_timeout_ms = opts.idle_timeout_ms;
+    if (brpc::StreamCreate(id, cntl, &so) != 0) {
+        delete handler;
+        result->code = rpc::STATUS_NETWORK_ERROR;
+        result->message = "failed to create stream";
+        return false;
+    }
+    storagenode::OpenStreamReply reply;
+    (stub->*method)(&cntl, &request, &reply, nullptr);
+    if (cntl.Failed()) {
+        // a failed RPC closes its stream, which releases the handler
+        result->code = rpc::STATUS_NETWORK_ERROR;
+        result->message = cntl.ErrorText();
+        return false;
+    }
+    if (reply.status().code() != rpc::STATUS_SUCCESS) {
+        brpc::StreamClose(*id);
+        result->code = StatusUtils::NormalizeCode(reply.status().code());
+        result->message = reply.status().message();
+        return false;
+    }
+    result->opened = true;
+    return true;
+}
+
+void Collect(const std::shared_ptr<StreamState>& state, ChunkStream::Result* result) {
+    std::lock_guard<std::mutex> lk(state->mu);
+    result->code = state->code;
+    result->message = state->message;
+    result->bytes = state->bytes;
+}
+
+} // namespace
+
+void ChunkStream::AppendHeader(const Frame& frame, butil::IOBuf* out) {
+    char raw[kHeaderSize];
+    std::memcpy(raw, &frame.offset, 8);
+    std::memcpy(raw + 8, &frame.length, 4);
+    std::memcpy(raw + 12, &frame.code, 4);
+    out->append(raw, sizeof(raw));
+}
+
+bool ChunkStream::CutHeader(butil::IOBuf* msg, Frame* frame) {
+    if (msg->size() < kHeaderSize) {
+        return false;
+    }
+    char raw[kHeaderSize];
+    msg->cutn(raw, sizeof(raw));
+    std::memcpy(&frame->offset, raw, 8);
+    std::memcpy(&frame->length, raw + 8, 4);
+    std::memcpy(&frame->code, raw + 12, 4);
+    return true;
+}
+
+bool ChunkStream::Send(brpc::StreamId id, const butil::IOBuf& msg, int timeout_ms) {
+    for (;;) {
+        const int rc = brpc::StreamWrite(id, msg);
+        if (rc == 0) {
+            return true;
+        }
+        if (rc != EAGAIN) {
+            return false;
+        }
+        const timespec due = butil::milliseconds_from_now(timeout_ms);
+        if (brpc::StreamWait(id, &due) != 0) {
+            return false;
+        }
+    }
+}
+
+ChunkStream::Result ChunkStream::Read(storagenode::StorageService_Stub* stub,
+                                      const storagenode::OpenStreamRequest& request,
+                                      const Options& opts, int rpc_timeout_ms,
+                                      const std::function<bool(uint64_t offset, butil::IOBuf* data)>& sink) {
+    Result result;
+    auto state = std::make_shared<StreamState>();
+    brpc::StreamId id = brpc::INVALID_STREAM_ID;
+    if (!OpenStream(stub, &storagenode::StorageService_Stub::OpenReadStream, request, opts, rpc_timeout_ms,
+                    new ReadHandler(state, request.offset(), &sink), &id, &result)) {
+        return result;
+    }
+    state->done.wait();
+    brpc::StreamClose(id);
+    Collect(state, &result);
+    return result;
+}
+
+ChunkStream::Result ChunkStream::Write(storagenode::StorageService_Stub* stub,
+                                       const storagenode::OpenStreamRequest& request,
+                                       const Options& opts, int rpc_timeout_ms, const char* data, size_t size) {
+    Result result;
+    auto state = std::make_shared<StreamState>();
+    brpc::StreamId id = brpc::INVALID_STREAM_ID;
+    if (!OpenStream(stub, &storagenode::StorageService_Stub::OpenWriteStream, request, opts, rpc_timeout_ms,
+                    new WriteHandler(state, request.offset()), &id, &result)) {
+        return result;
+    }
+    const size_t block = request.block_size() == 0 ? kDefaultBlockSize : request.block_size();
+    bool sent = true;
+    for (size_t pos = 0; pos < size && sent && !state->IsFinished(); pos += block) {
+        const size_t n = std::min(block, size - pos);
+        butil::IOBuf msg;
+        AppendHeader(Frame{request.offset() + pos, static_cast<uint32_t>(n), 0}, &msg);
+        msg.append(data + pos, n);
+        sent = Send(id, msg, opts.idle_timeout_ms);
+    }
+    if (sent && !state->IsFinished()) {
+        butil::IOBuf end;
+        AppendHeader(Frame{request.offset() + size, 0, 0}, &end);
+        sent = Send(id, end, opts.idle_timeout_ms);
+    }
+    if (!sent) {
+        state->Finish(rpc::STATUS_NETWORK_ERROR, "stream closed while sending");
+    }
+    state->done.wait();
+    brpc::StreamClose(id);
+    Collect(state, &result);
+    return result;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <brpc/stream.h>
+#include <butil/iobuf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "storage_node.pb.h"
+
+// Framing and client side of the StorageService block streams
+// (OpenReadStream / OpenWriteStream). Every stream message is one frame: a
+// 16-byte header {offset u64, length u32, code i32} followed by length bytes
+// of payload. A frame with length 0 ends the transfer and carries its
+// rpc::StatusCode. Flow control is brpc's own: a sender may have at most
+// window_bytes on the wire that the receiver has not consumed yet.
+class ChunkStream {
+public:
+    struct Frame {
+        uint64_t offset{0};
+        uint32_t length{0};
+        int32_t code{0};
+    };
+    static constexpr size_t kHeaderSize = 16;
+
+    struct Options {
+        size_t window_bytes{8u << 20};
+        int idle_timeout_ms{10000};
+    };
+
+    struct Result {
+        rpc::StatusCode code{rpc::STATUS_SUCCESS};
+        std::string message;
+        bool opened{false};  // the stream was established; false means nothing moved
+        uint64_t bytes{0};   // delivered to the sink / acknowledged by the node
+    };
+
+    static void AppendHeader(const Frame& frame, butil::IOBuf* out);
+    // Strips the header off the front of msg.
+    static bool CutHeader(butil::IOBuf* msg, Frame* frame);
+    // Writes msg, waiting for window space. False once the stream is closed
+    // or no space frees up within timeout_ms.
+    static bool Send(brpc::StreamId id, const butil::IOBuf& msg, int timeout_ms);
+
+    // Pulls the request's range; sink gets each block in order and may
+    // return false to stop early.
+    static Result Read(storagenode::StorageService_Stub* stub, const storagenode::OpenStreamRequest& request,
+                       const Options& opts, int rpc_timeout_ms,
+                       const std::function<bool(uint64_t offset, butil::IOBuf* data)>& sink);
+    // Pushes data as blocks of request.block_size() starting at request.offset().
+    static Result Write(storagenode::StorageService_Stub* stub, const storagenode::OpenStreamRequest& request,
+                        const Options& opts, int rpc_timeout_ms, const char* data, size_t size);
+};
@@ -0,0 +1,68 @@
+#include "ContentFingerprint.h"
+
+#include <openssl/evp.h>
+
+struct ContentFingerprint::State {
+    EVP_MD_CTX* ctx{nullptr};
+};
+
+ContentFingerprint::ContentFingerprint() : state_(new State) {
+    state_->ctx = EVP_MD_CTX_new();
+    valid_ = state_->ctx && EVP_DigestInit_ex(state_->ctx, EVP_sha256(), nullptr) == 1;
+}
+
+ContentFingerprint::~ContentFingerprint() {
+    EVP_MD_CTX_free(state_->ctx);
+    delete state_;
+}
+
+void ContentFingerprint::Update(uint64_t offset, const char* data, size_t size) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!valid_ || size == 0) {
+        return;
+    }
+    if (offset != bytes_ || EVP_DigestUpdate(state_->ctx, data, size) != 1) {
+        valid_ = false;
+        return;
+    }
+    bytes_ += size;
+}
+
+void ContentFingerprint::Invalidate() {
+    std::lock_guard<std::mutex> lk(mu_);
+    valid_ = false;
+}
+
+void ContentFingerprint::Reset() {
+    std::lock_guard<std::mutex> lk(mu_);
+    bytes_ = 0;
+    valid_ = state_->ctx && EVP_DigestInit_ex(state_->ctx, EVP_sha256(), nullptr) == 1;
+}
+
+bool ContentFingerprint::valid() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return valid_;
+}
+
+uint64_t ContentFingerprint::bytes() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return bytes_;
+}
+
+bool ContentFingerprint::Final(std::string* out) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!valid_ || !out) {
+        return false;
+    }
+    // Finish a copy so the stream can go on.
+    EVP_MD_CTX* copy = EVP_MD_CTX_new();
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    const bool ok = copy && EVP_MD_CTX_copy_ex(copy, state_->ctx) == 1 && EVP_DigestFinal_ex(copy, md, &len) == 1;
+    EVP_MD_CTX_free(copy);
+    if (!ok) {
+        return false;
+    }
+    out->assign(reinterpret_cast<const char*>(md), len);
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Streaming SHA-256 of a chunk's content, fed by writes as they complete.
+//
+// The digest only covers a chunk written front to back: a write at any other
+// offset than the end of what has been hashed so far (a rewrite, a hole, an
+// out-of-order write) invalidates it for good, until Reset. SHA-256 rather
+// than a faster non-cryptographic hash because a match is trusted without
+// comparing the data; OpenSSL picks the SHA-NI/AVX2 code path at runtime.
+class ContentFingerprint {
+public:
+    static constexpr size_t kSize = 32;
+
+    ContentFingerprint();
+    ~ContentFingerprint();
+
+    ContentFingerprint(const ContentFingerprint&) = delete;
+    ContentFingerprint& operator=(const ContentFingerprint&) = delete;
+
+    // Hashes [offset, offset + size) if it continues the stream, otherwise
+    // invalidates it.
+    void Update(uint64_t offset, const char* data, size_t size);
+    void Invalidate();
+    // Starts over from an empty chunk.
+    void Reset();
+
+    bool valid() const;
+    uint64_t bytes() const;
+
+    // The digest of the bytes hashed so far; false if invalid. Does not end
+    // the stream.
+    bool Final(std::string* out) const;
+
+private:
+    struct State;
+
+    mutable std::mutex mu_;
+    State* state_{nullptr};
+    bool valid_{true};
+    uint64_t bytes_{0};
+};
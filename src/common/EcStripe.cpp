@@ -0,0 +1,332 @@
+#include "EcStripe.h"
+
+#include <brpc/controller.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "StatusUtils.h"
+
+namespace {
+
+// The top byte of a shard's chunk id carries shard + 1, so shards never
+// collide with the unencoded chunk or with each other.
+constexpr int kShardShift = 56;
+constexpr uint64_t kChunkMask = (uint64_t{1} << kShardShift) - 1;
+
+} // namespace
+
+EcStripe::EcStripe(storagenode::StorageService_Stub* stub, Layout layout, ExtentBatch::Options opts)
+    : stub_(stub), layout_(std::move(layout)), opts_(opts), codec_(layout_.k, layout_.m) {}
+
+uint64_t EcStripe::ShardChunkId(uint64_t chunk_id, size_t shard) {
+    return (static_cast<uint64_t>(shard + 1) << kShardShift) | (chunk_id & kChunkMask);
+}
+
+bool EcStripe::Valid(Result* result) const {
+    if (!stub_ || layout_.k == 0 || layout_.m == 0 || layout_.k + layout_.m > 256 || layout_.unit == 0 ||
+        layout_.nodes.size() != layout_.k + layout_.m) {
+        result->code = rpc::STATUS_INVALID_ARGUMENT;
+        result->message = "bad erasure-coding layout";
+        return false;
+    }
+    return true;
+}
+
+EcStripe::Result EcStripe::Write(uint64_t chunk_id, uint64_t offset, const char* data, size_t size) {
+    Result result;
+    if (!Valid(&result)) {
+        return result;
+    }
+    const size_t k = layout_.k;
+    const size_t m = layout_.m;
+    const uint64_t unit = layout_.unit;
+    const uint64_t stripe = stripe_bytes();
+    if (offset % stripe != 0) {
+        result.code = rpc::STATUS_INVALID_ARGUMENT;
+        result.message = "erasure-coded writes start on a stripe boundary";
+        return result;
+    }
+    const uint64_t first = offset / stripe;
+    const uint64_t stripes = (size + stripe - 1) / stripe;
+    // one ExtentBatch call per shard per round
+    const uint64_t per_round = std::max<uint64_t>(1, opts_.max_bytes / unit);
+    std::vector<std::string> shards(k + m);
+    for (uint64_t s = 0; s < stripes; s += per_round) {
+        const uint64_t n = std::min(per_round, stripes - s);
+        const size_t len = static_cast<size_t>(n * unit);
+        for (auto& shard : shards) {
+            shard.assign(len, '\0');
+        }
+        for (uint64_t t = 0; t < n; ++t) {
+            for (size_t d = 0; d < k; ++d) {
+                const uint64_t src = ((s + t) * k + d) * unit;
+                if (src < size) {
+                    std::memcpy(&shards[d][t * unit], data + src, static_cast<size_t>(std::min(unit, size - src)));
+                }
+            }
+        }
+        std::vector<const uint8_t*> in(k);
+        std::vector<uint8_t*> parity(m);
+        for (size_t d = 0; d < k; ++d) {
+            in[d] = reinterpret_cast<const uint8_t*>(shards[d].data());
+        }
+        for (size_t p = 0; p < m; ++p) {
+            parity[p] = reinterpret_cast<uint8_t*>(&shards[k + p][0]);
+        }
+        codec_.Encode(in.data(), parity.data(), len);
+
+        std::vector<ExtentBatch::Write> writes(k + m);
+        for (size_t i = 0; i < k + m; ++i) {
+            writes[i].node_id = layout_.nodes[i];
+            writes[i].chunk_id = ShardChunkId(chunk_id, i);
+            writes[i].offset = (first + s) * unit;
+            writes[i].data = shards[i].data();
+            writes[i].size = len;
+        }
+        ExtentBatch::WriteAll(stub_, &writes, opts_);
+        for (size_t i = 0; i < k + m; ++i) {
+            if (writes[i].code != rpc::STATUS_SUCCESS || writes[i].written != len) {
+                result.code = writes[i].code != rpc::STATUS_SUCCESS ? writes[i].code : rpc::STATUS_IO_ERROR;
+                result.message = "shard " + std::to_string(i) + ": " +
+                                 (writes[i].message.empty() ? "short write" : writes[i].message);
+                return result;
+            }
+        }
+        result.bytes += std::min<uint64_t>(size - s * stripe, n * stripe);
+    }
+    return result;
+}
+
+EcStripe::Result EcStripe::ReadShards(uint64_t chunk_id, uint64_t offset, uint64_t length,
+                                      const std::vector<bool>& skip, const std::vector<bool>& wanted,
+                                      std::vector<std::string>* shards) {
+    Result result;
+    const size_t k = layout_.k;
+    const size_t total = layout_.k + layout_.m;
+    const size_t len = static_cast<size_t>(length);
+    shards->assign(total, std::string());
+    std::unique_ptr<bool[]> present(new bool[total]());
+    std::vector<bool> tried = skip;
+    size_t have = 0;
+    while (have < k) {
+        std::vector<ExtentBatch::Read> reads;
+        std::vector<size_t> index;
+        for (size_t i = 0; i < total && reads.size() < k - have; ++i) {
+            if (!tried[i]) {
+                tried[i] = true;
+                ExtentBatch::Read r;
+                r.node_id = layout_.nodes[i];
+                r.chunk_id = ShardChunkId(chunk_id, i);
+                r.offset = offset;
+                r.length = length;
+                reads.push_back(std::move(r));
+                index.push_back(i);
+            }
+        }
+        if (reads.empty()) {
+            result.code = result.code != rpc::STATUS_SUCCESS ? result.code : rpc::STATUS_IO_ERROR;
+            result.message = "fewer than k shards readable: " + result.message;
+            return result;
+        }
+        ExtentBatch::ReadAll(stub_, &reads, opts_);
+        for (size_t j = 0; j < reads.size(); ++j) {
+            const size_t i = index[j];
+            if (reads[j].code != rpc::STATUS_SUCCESS) {
+                ++result.degraded;
+                result.code = reads[j].code;
+                result.message = "shard " + std::to_string(i) + ": " + reads[j].message;
+                continue;
+            }
+            (*shards)[i] = std::move(reads[j].data);
+            (*shards)[i].resize(len, '\0');  // short past the end of the chunk
+            present[i] = true;
+            ++have;
+        }
+    }
+    result.code = rpc::STATUS_SUCCESS;
+    result.message.clear();
+
+    std::unique_ptr<bool[]> want(new bool[total]());
+    bool parity_wanted = false;
+    for (size_t i = 0; i < total; ++i) {
+        want[i] = wanted[i] && !present[i];
+        parity_wanted = parity_wanted || (i >= k && want[i]);
+    }
+    std::vector<uint8_t*> ptrs(total, nullptr);
+    for (size_t i = 0; i < total; ++i) {
+        if (!present[i] && (want[i] || (i < k && parity_wanted))) {
+            (*shards)[i].assign(len, '\0');
+        }
+        if (!(*shards)[i].empty()) {
+            ptrs[i] = reinterpret_cast<uint8_t*>(&(*shards)[i][0]);
+        }
+    }
+    if (!codec_.Reconstruct(ptrs.data(), present.get(), len, want.get())) {
+        result.code = rpc::STATUS_IO_ERROR;
+        result.message = "decode failed";
+    }
+    return result;
+}
+
+EcStripe::Result EcStripe::Read(uint64_t chunk_id, uint64_t offset, uint64_t length, std::string* out) {
+    Result result;
+    out->assign(static_cast<size_t>(length), '\0');
+    if (!Valid(&result) || length == 0) {
+        return result;
+    }
+    const size_t k = layout_.k;
+    const size_t total = layout_.k + layout_.m;
+    const uint64_t unit = layout_.unit;
+    const uint64_t stripe = stripe_bytes();
+    const uint64_t end = offset + length;
+    const uint64_t last = (end - 1) / stripe;
+    const uint64_t per_round = std::max<uint64_t>(1, opts_.max_bytes / unit);
+    for (uint64_t s = offset / stripe; s <= last; s += per_round) {
+        const uint64_t n = std::min(per_round, last - s + 1);
+        // The part of each data shard this round needs; only its edges can
+        // be partial units, so it is one extent per shard.
+        std::vector<uint64_t> lo(k, UINT64_MAX);
+        std::vector<uint64_t> hi(k, 0);
+        for (uint64_t t = s; t < s + n; ++t) {
+            for (size_t d = 0; d < k; ++d) {
+                const uint64_t u = (t * k + d) * unit;
+                const uint64_t a = std::max(u, offset);
+                const uint64_t b = std::min(u + unit, end);
+                if (a < b) {
+                    lo[d] = std::min(lo[d], t * unit + (a - u));
+                    hi[d] = std::max(hi[d], t * unit + (b - u));
+                }
+            }
+        }
+        std::vector<ExtentBatch::Read> reads;
+        std::vector<size_t> index;
+        for (size_t d = 0; d < k; ++d) {
+            if (lo[d] < hi[d]) {
+                ExtentBatch::Read r;
+                r.node_id = layout_.nodes[d];
+                r.chunk_id = ShardChunkId(chunk_id, d);
+                r.offset = lo[d];
+                r.length = hi[d] - lo[d];
+                reads.push_back(std::move(r));
+                index.push_back(d);
+            }
+        }
+        ExtentBatch::ReadAll(stub_, &reads, opts_);
+
+        // Where each data shard's bytes for this round come from: its own
+        // read, or a decoded copy of the whole round.
+        std::vector<const std::string*> source(k, nullptr);
+        std::vector<uint64_t> base(k, 0);
+        std::vector<bool> failed(total, false);
+        size_t failures = 0;
+        for (size_t j = 0; j < reads.size(); ++j) {
+            if (reads[j].code == rpc::STATUS_SUCCESS) {
+                source[index[j]] = &reads[j].data;
+                base[index[j]] = lo[index[j]];
+            } else {
+                failed[index[j]] = true;
+                ++failures;
+            }
+        }
+        std::vector<std::string> decoded;
+        if (failures > 0) {
+            Result r = ReadShards(chunk_id, s * unit, n * unit, failed, failed, &decoded);
+            result.degraded = std::max(result.degraded, failures + r.degraded);
+            if (r.code != rpc::STATUS_SUCCESS) {
+                result.code = r.code;
+                result.message = r.message;
+                return result;
+            }
+            for (size_t d = 0; d < k; ++d) {
+                if (failed[d]) {
+                    source[d] = &decoded[d];
+                    base[d] = s * unit;
+                }
+            }
+        }
+        for (uint64_t t = s; t < s + n; ++t) {
+            for (size_t d = 0; d < k; ++d) {
+                const uint64_t u = (t * k + d) * unit;
+                const uint64_t a = std::max(u, offset);
+                const uint64_t b = std::min(u + unit, end);
+                if (a >= b || !source[d]) {
+                    continue;
+                }
+                const uint64_t from = t * unit + (a - u) - base[d];
+                const std::string& src = *source[d];
+                if (from < src.size()) {
+                    const size_t bytes = static_cast<size_t>(std::min<uint64_t>(b - a, src.size() - from));
+                    std::memcpy(&(*out)[a - offset], src.data() + from, bytes);
+                }
+            }
+        }
+    }
+    result.bytes = length;
+    return result;
+}
+
+EcStripe::Result EcStripe::Repair(uint64_t chunk_id, size_t shard, const std::string& new_node, uint64_t shard_size) {
+    Result result;
+    if (!Valid(&result)) {
+        return result;
+    }
+    const size_t total = layout_.k + layout_.m;
+    if (shard >= total) {
+        result.code = rpc::STATUS_INVALID_ARGUMENT;
+        result.message = "no such shard";
+        return result;
+    }
+    for (size_t i = 0; i < total && shard_size == 0; ++i) {
+        if (i == shard) {
+            continue;
+        }
+        storagenode::GetExtentsRequest req;
+        storagenode::GetExtentsReply resp;
+        brpc::Controller cntl;
+        cntl.set_timeout_ms(opts_.timeout_ms);
+        req.set_node_id(layout_.nodes[i]);
+        req.set_chunk_id(ShardChunkId(chunk_id, i));
+        stub_->GetExtents(&cntl, &req, &resp, nullptr);
+        if (!cntl.Failed() && resp.status().code() == rpc::STATUS_SUCCESS) {
+            shard_size = resp.size();
+            break;
+        }
+    }
+    if (shard_size == 0) {
+        result.code = rpc::STATUS_IO_ERROR;
+        result.message = "no surviving shard reports a size";
+        return result;
+    }
+    std::vector<bool> only(total, false);
+    only[shard] = true;
+    const uint64_t per_round = std::max<uint64_t>(1, opts_.max_bytes / layout_.unit) * layout_.unit;
+    std::vector<std::string> shards;
+    for (uint64_t off = 0; off < shard_size; off += per_round) {
+        const uint64_t len = std::min(per_round, shard_size - off);
+        Result r = ReadShards(chunk_id, off, len, only, only, &shards);
+        result.degraded = std::max(result.degraded, r.degraded + 1);
+        if (r.code != rpc::STATUS_SUCCESS) {
+            result.code = r.code;
+            result.message = r.message;
+            return result;
+        }
+        std::vector<ExtentBatch::Write> writes(1);
+        writes[0].node_id = new_node;
+        writes[0].chunk_id = ShardChunkId(chunk_id, shard);
+        writes[0].offset = off;
+        writes[0].data = shards[shard].data();
+        writes[0].size = static_cast<size_t>(len);
+        ExtentBatch::WriteAll(stub_, &writes, opts_);
+        if (writes[0].code != rpc::STATUS_SUCCESS || writes[0].written != len) {
+            result.code = writes[0].code != rpc::STATUS_SUCCESS ? writes[0].code : rpc::STATUS_IO_ERROR;
+            result.message = "writing the rebuilt shard: " + writes[0].message;
+            return result;
+        }
+        result.bytes += len;
+    }
+    layout_.nodes[shard] = new_node;
+    return result;
+}
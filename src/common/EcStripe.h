@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ExtentBatch.h"
+#include "ReedSolomon.h"
+#include "storage_node.pb.h"
+
+// Erasure-coded chunk layout across real nodes, for the cold tier. A chunk
+// is cut into stripes of k units; unit j of a stripe goes to data shard j and
+// the m parity shards hold the code of the k units. Shard i is an ordinary
+// chunk (ShardChunkId) on nodes[i], holding its units of consecutive stripes
+// back to back, so a range of stripes is one contiguous extent per shard.
+//
+// Chunks are written once, front to back: writes start on a stripe boundary
+// and a short last stripe is padded with zeros. Reads take any range; a
+// shard that fails is replaced by parity reads issued together, and the
+// range is decoded from any k shards. Repair rebuilds one shard onto a new
+// node from k surviving shards. All shard IO goes through ExtentBatch, so it
+// works against the gateway and against a real node directly.
+class EcStripe {
+public:
+    struct Layout {
+        size_t k{8};
+        size_t m{3};
+        uint64_t unit{1u << 20};  // bytes of a stripe on each shard
+        std::vector<std::string> nodes;  // k + m; shard i lives on nodes[i]
+    };
+
+    struct Result {
+        rpc::StatusCode code{rpc::STATUS_SUCCESS};
+        std::string message;
+        uint64_t bytes{0};
+        size_t degraded{0};  // shards that failed and were decoded around
+    };
+
+    EcStripe(storagenode::StorageService_Stub* stub, Layout layout, ExtentBatch::Options opts = {});
+
+    // Chunk id of shard i of chunk_id on its node.
+    static uint64_t ShardChunkId(uint64_t chunk_id, size_t shard);
+
+    const Layout& layout() const { return layout_; }
+    uint64_t stripe_bytes() const { return layout_.unit * layout_.k; }
+
+    // offset must be a multiple of stripe_bytes(). Fails if any shard write
+    // fails; the shards that were written stay and can be repaired.
+    Result Write(uint64_t chunk_id, uint64_t offset, const char* data, size_t size);
+
+    // Fills out with length bytes from offset; past the end of the chunk
+    // they read as zeros, so callers clamp to the size they keep.
+    Result Read(uint64_t chunk_id, uint64_t offset, uint64_t length, std::string* out);
+
+    // Rebuilds shard onto new_node, reading k other shards, and points the
+    // layout at it. shard_size is the length of each shard chunk, 0 to ask a
+    // surviving shard.
+    Result Repair(uint64_t chunk_id, size_t shard, const std::string& new_node, uint64_t shard_size = 0);
+
+private:
+    // Reads [offset, offset + length) of every shard not in skip from k
+    // shards and rebuilds the wanted ones into shards (k + m buffers of
+    // length bytes). Starts with the first k usable shards and adds the next
+    // ones, all at once, for each that fails.
+    Result ReadShards(uint64_t chunk_id, uint64_t offset, uint64_t length, const std::vector<bool>& skip,
+                      const std::vector<bool>& wanted, std::vector<std::string>* shards);
+    bool Valid(Result* result) const;
+
+    storagenode::StorageService_Stub* stub_;
+    Layout layout_;
+    ExtentBatch::Options opts_;
+    ReedSolomon codec_;
+};
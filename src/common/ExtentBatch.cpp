@@ -0,0 +1,147 @@
+#include "ExtentBatch.h"
+
+#include <brpc/controller.h>
+#include <bthread/countdown_event.h>
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "StatusUtils.h"
+
+namespace {
+
+// Splits items into per-node batches within the limits; payload(i) is the
+// bytes item i adds to its call.
+template <typename Item, typename Payload>
+std::vector<std::vector<size_t>> Plan(const std::vector<Item>& items, const ExtentBatch::Options& opts,
+                                      Payload payload) {
+    std::vector<std::vector<size_t>> batches;
+    std::unordered_map<std::string, std::pair<size_t, size_t>> open;  // node -> batch, bytes
+    for (size_t i = 0; i < items.size(); ++i) {
+        const size_t bytes = payload(items[i]);
+        auto it = open.find(items[i].node_id);
+        if (it == open.end() || batches[it->second.first].size() >= opts.max_extents ||
+            (it->second.second > 0 && it->second.second + bytes > opts.max_bytes)) {
+            batches.emplace_back();
+            it = open.insert_or_assign(items[i].node_id, std::make_pair(batches.size() - 1, size_t{0})).first;
+        }
+        batches[it->second.first].push_back(i);
+        it->second.second += bytes;
+    }
+    return batches;
+}
+
+template <typename Request, typename Reply>
+struct Call : public ::google::protobuf::Closure {
+    bthread::CountdownEvent* event{nullptr};
+    std::vector<size_t> items;
+    brpc::Controller cntl;
+    Request request;
+    Reply reply;
+
+    void Run() override { event->signal(); }
+
+    // Status of the k-th extent of this call.
+    rpc::StatusCode Result(size_t k, std::string* message) const {
+        if (cntl.Failed()) {
+            *message = cntl.ErrorText();
+            return rpc::STATUS_NETWORK_ERROR;
+        }
+        if (reply.status().code() != rpc::STATUS_SUCCESS) {
+            *message = reply.status().message();
+            return StatusUtils::NormalizeCode(reply.status().code());
+        }
+        if (static_cast<size_t>(reply.results_size()) != items.size()) {
+            *message = "wrong number of results";
+            return rpc::STATUS_UNKNOWN_ERROR;
+        }
+        const auto& st = reply.results(static_cast<int>(k)).status();
+        *message = st.message();
+        return StatusUtils::NormalizeCode(st.code());
+    }
+};
+
+} // namespace
+
+void ExtentBatch::ReadAll(storagenode::StorageService_Stub* stub, std::vector<Read>* reads, const Options& opts) {
+    using ReadCall = Call<storagenode::ReadVRequest, storagenode::ReadVReply>;
+    const auto batches = Plan(*reads, opts, [](const Read& r) { return static_cast<size_t>(r.length); });
+    if (batches.empty()) {
+        return;
+    }
+    bthread::CountdownEvent event(static_cast<int>(batches.size()));
+    std::vector<std::unique_ptr<ReadCall>> calls;
+    for (const auto& batch : batches) {
+        auto call = std::make_unique<ReadCall>();
+        call->event = &event;
+        call->items = batch;
+        call->cntl.set_timeout_ms(opts.timeout_ms);
+        call->request.set_node_id((*reads)[batch.front()].node_id);
+        call->request.set_flags(opts.flags);
+        call->request.set_io_class(opts.io_class);
+        for (size_t i : batch) {
+            auto* e = call->request.add_extents();
+            e->set_chunk_id((*reads)[i].chunk_id);
+            e->set_offset((*reads)[i].offset);
+            e->set_length((*reads)[i].length);
+        }
+        calls.push_back(std::move(call));
+    }
+    for (auto& call : calls) {
+        stub->ReadV(&call->cntl, &call->request, &call->reply, call.get());
+    }
+    event.wait();
+    for (auto& call : calls) {
+        for (size_t k = 0; k < call->items.size(); ++k) {
+            Read& r = (*reads)[call->items[k]];
+            r.code = call->Result(k, &r.message);
+            r.data.clear();
+            if (r.code == rpc::STATUS_SUCCESS) {
+                // payloads follow the extent order
+                call->cntl.response_attachment().cutn(&r.data,
+                                                      static_cast<size_t>(call->reply.results(static_cast<int>(k)).bytes()));
+            }
+        }
+    }
+}
+
+void ExtentBatch::WriteAll(storagenode::StorageService_Stub* stub, std::vector<Write>* writes, const Options& opts) {
+    using WriteCall = Call<storagenode::WriteVRequest, storagenode::WriteVReply>;
+    const auto batches = Plan(*writes, opts, [](const Write& w) { return w.size; });
+    if (batches.empty()) {
+        return;
+    }
+    bthread::CountdownEvent event(static_cast<int>(batches.size()));
+    std::vector<std::unique_ptr<WriteCall>> calls;
+    for (const auto& batch : batches) {
+        auto call = std::make_unique<WriteCall>();
+        call->event = &event;
+        call->items = batch;
+        call->cntl.set_timeout_ms(opts.timeout_ms);
+        call->request.set_node_id((*writes)[batch.front()].node_id);
+        call->request.set_flags(opts.flags);
+        call->request.set_mode(opts.mode);
+        call->request.set_io_class(opts.io_class);
+        for (size_t i : batch) {
+            const Write& w = (*writes)[i];
+            auto* e = call->request.add_extents();
+            e->set_chunk_id(w.chunk_id);
+            e->set_offset(w.offset);
+            e->set_length(w.size);
+            call->cntl.request_attachment().append(w.data, w.size);
+        }
+        calls.push_back(std::move(call));
+    }
+    for (auto& call : calls) {
+        stub->WriteV(&call->cntl, &call->request, &call->reply, call.get());
+    }
+    event.wait();
+    for (auto& call : calls) {
+        for (size_t k = 0; k < call->items.size(); ++k) {
+            Write& w = (*writes)[call->items[k]];
+            w.code = call->Result(k, &w.message);
+            w.written = w.code == rpc::STATUS_SUCCESS ? call->reply.results(static_cast<int>(k)).bytes() : 0;
+        }
+    }
+}
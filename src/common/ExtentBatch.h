@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "storage_node.pb.h"
+
+// Client side of ReadV/WriteV. Takes any number of chunk reads or writes,
+// groups them by destination node, cuts each group into calls of at most
+// max_extents extents and max_bytes of payload, and runs every call at once.
+// Works against the gateway and against a real node directly.
+class ExtentBatch {
+public:
+    struct Options {
+        size_t max_extents{256};
+        size_t max_bytes{8u << 20};
+        int timeout_ms{3000};
+        int32_t flags{0};
+        int32_t mode{0};
+        storagenode::IOClass io_class{storagenode::IO_CLASS_FOREGROUND};
+    };
+
+    struct Read {
+        std::string node_id;
+        uint64_t chunk_id{0};
+        uint64_t offset{0};
+        uint64_t length{0};
+        // filled in
+        rpc::StatusCode code{rpc::STATUS_SUCCESS};
+        std::string message;
+        std::string data;
+    };
+
+    struct Write {
+        std::string node_id;
+        uint64_t chunk_id{0};
+        uint64_t offset{0};
+        const char* data{nullptr};
+        size_t size{0};
+        // filled in
+        rpc::StatusCode code{rpc::STATUS_SUCCESS};
+        std::string message;
+        uint64_t written{0};
+    };
+
+    static void ReadAll(storagenode::StorageService_Stub* stub, std::vector<Read>* reads, const Options& opts);
+    static void WriteAll(storagenode::StorageService_Stub* stub, std::vector<Write>* writes, const Options& opts);
+};
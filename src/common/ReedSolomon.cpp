@@ -0,0 +1,342 @@
+#include "ReedSolomon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZB_RS_X86 1
+#endif
+
+namespace {
+
+// Region pieces processed across all shards before moving on, so the
+// sources stay in cache while every parity row reads them.
+constexpr size_t kBlockBytes = 16u << 10;
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d).
+struct GfTables {
+    uint8_t exp[512];
+    uint8_t log[256];
+    uint8_t mul[256][256];
+
+    GfTables() {
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = static_cast<uint8_t>(x);
+            log[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11d;
+            }
+        }
+        for (int i = 255; i < 512; ++i) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;
+        for (int a = 0; a < 256; ++a) {
+            for (int b = 0; b < 256; ++b) {
+                mul[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+            }
+        }
+    }
+};
+
+const GfTables& Gf() {
+    static const GfTables tables;
+    return tables;
+}
+
+uint8_t GfMul(uint8_t a, uint8_t b) {
+    return Gf().mul[a][b];
+}
+
+uint8_t GfInv(uint8_t a) {
+    return Gf().exp[255 - Gf().log[a]];  // a != 0
+}
+
+// dst = c * src, or dst ^= c * src when accumulate is set.
+using RegionFn = void (*)(uint8_t c, const uint8_t* src, uint8_t* dst, size_t len, bool accumulate);
+
+void MulRegionScalar(uint8_t c, const uint8_t* src, uint8_t* dst, size_t len, bool accumulate) {
+    const uint8_t* row = Gf().mul[c];
+    if (accumulate) {
+        for (size_t i = 0; i < len; ++i) {
+            dst[i] ^= row[src[i]];
+        }
+    } else {
+        for (size_t i = 0; i < len; ++i) {
+            dst[i] = row[src[i]];
+        }
+    }
+}
+
+#ifdef ZB_RS_X86
+// Products of c with every low nibble and every high nibble; a byte's
+// product is the xor of its two lookups.
+void NibbleTables(uint8_t c, uint8_t* lo, uint8_t* hi) {
+    const uint8_t* row = Gf().mul[c];
+    for (int i = 0; i < 16; ++i) {
+        lo[i] = row[i];
+        hi[i] = row[i << 4];
+    }
+}
+
+__attribute__((target("ssse3"))) void MulRegionSsse3(uint8_t c, const uint8_t* src, uint8_t* dst, size_t len,
+                                                      bool accumulate) {
+    alignas(16) uint8_t lo[16];
+    alignas(16) uint8_t hi[16];
+    NibbleTables(c, lo, hi);
+    const __m128i tlo = _mm_load_si128(reinterpret_cast<const __m128i*>(lo));
+    const __m128i thi = _mm_load_si128(reinterpret_cast<const __m128i*>(hi));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i l = _mm_and_si128(v, mask);
+        const __m128i h = _mm_and_si128(_mm_srli_epi64(v, 4), mask);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, l), _mm_shuffle_epi8(thi, h));
+        if (accumulate) {
+            p = _mm_xor_si128(p, _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), p);
+    }
+    MulRegionScalar(c, src + i, dst + i, len - i, accumulate);
+}
+
+__attribute__((target("avx2"))) void MulRegionAvx2(uint8_t c, const uint8_t* src, uint8_t* dst, size_t len,
+                                                    bool accumulate) {
+    alignas(16) uint8_t lo[16];
+    alignas(16) uint8_t hi[16];
+    NibbleTables(c, lo, hi);
+    const __m256i tlo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(lo)));
+    const __m256i thi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(hi)));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i l = _mm256_and_si256(v, mask);
+        const __m256i h = _mm256_and_si256(_mm256_srli_epi64(v, 4), mask);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, l), _mm256_shuffle_epi8(thi, h));
+        if (accumulate) {
+            p = _mm256_xor_si256(p, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+    }
+    MulRegionScalar(c, src + i, dst + i, len - i, accumulate);
+}
+#endif
+
+bool Supported(ReedSolomon::Kernel kernel) {
+#ifdef ZB_RS_X86
+    __builtin_cpu_init();  // may run before main, from a static initializer
+#endif
+    switch (kernel) {
+    case ReedSolomon::Kernel::kScalar:
+        return true;
+#ifdef ZB_RS_X86
+    case ReedSolomon::Kernel::kSsse3:
+        return __builtin_cpu_supports("ssse3");
+    case ReedSolomon::Kernel::kAvx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+RegionFn KernelFn(ReedSolomon::Kernel kernel) {
+    switch (kernel) {
+#ifdef ZB_RS_X86
+    case ReedSolomon::Kernel::kSsse3:
+        return MulRegionSsse3;
+    case ReedSolomon::Kernel::kAvx2:
+        return MulRegionAvx2;
+#endif
+    default:
+        return MulRegionScalar;
+    }
+}
+
+ReedSolomon::Kernel BestKernel() {
+    if (Supported(ReedSolomon::Kernel::kAvx2)) {
+        return ReedSolomon::Kernel::kAvx2;
+    }
+    if (Supported(ReedSolomon::Kernel::kSsse3)) {
+        return ReedSolomon::Kernel::kSsse3;
+    }
+    return ReedSolomon::Kernel::kScalar;
+}
+
+std::atomic<ReedSolomon::Kernel> g_kernel{BestKernel()};
+std::atomic<RegionFn> g_region{KernelFn(BestKernel())};
+
+void MulRegion(uint8_t c, const uint8_t* src, uint8_t* dst, size_t len, bool accumulate) {
+    if (c == 0) {
+        if (!accumulate) {
+            std::memset(dst, 0, len);
+        }
+        return;
+    }
+    if (c == 1 && !accumulate) {
+        std::memcpy(dst, src, len);
+        return;
+    }
+    g_region.load(std::memory_order_relaxed)(c, src, dst, len, accumulate);
+}
+
+// out = sum of coeffs[j] * srcs[j], block by block.
+void Combine(const uint8_t* coeffs, const uint8_t* const* srcs, size_t n, uint8_t* out, size_t len) {
+    for (size_t off = 0; off < len; off += kBlockBytes) {
+        const size_t piece = std::min(kBlockBytes, len - off);
+        for (size_t j = 0; j < n; ++j) {
+            MulRegion(coeffs[j], srcs[j] + off, out + off, piece, j != 0);
+        }
+    }
+}
+
+} // namespace
+
+ReedSolomon::ReedSolomon(size_t k, size_t m) : k_(k), m_(m), matrix_((k + m) * k, 0) {
+    for (size_t i = 0; i < k_; ++i) {
+        matrix_[i * k_ + i] = 1;
+    }
+    // Cauchy rows 1 / (x_i + y_j) with x_i = k + i and y_j = j, all distinct.
+    for (size_t i = 0; i < m_; ++i) {
+        for (size_t j = 0; j < k_; ++j) {
+            matrix_[(k_ + i) * k_ + j] = GfInv(static_cast<uint8_t>((k_ + i) ^ j));
+        }
+    }
+}
+
+void ReedSolomon::Encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const {
+    for (size_t off = 0; off < len; off += kBlockBytes) {
+        const size_t piece = std::min(kBlockBytes, len - off);
+        for (size_t p = 0; p < m_; ++p) {
+            const uint8_t* row = &matrix_[(k_ + p) * k_];
+            for (size_t d = 0; d < k_; ++d) {
+                MulRegion(row[d], data[d] + off, parity[p] + off, piece, d != 0);
+            }
+        }
+    }
+}
+
+std::vector<size_t> ReedSolomon::Survivors(const bool* present) const {
+    std::vector<size_t> survivors;
+    for (size_t i = 0; i < k_ + m_ && survivors.size() < k_; ++i) {
+        if (present[i]) {
+            survivors.push_back(i);
+        }
+    }
+    if (survivors.size() < k_) {
+        survivors.clear();
+    }
+    return survivors;
+}
+
+bool ReedSolomon::DecodeMatrix(const std::vector<size_t>& survivors, std::vector<uint8_t>* out) const {
+    // Gauss-Jordan on [sub | I]; sub is invertible for any k distinct rows.
+    std::vector<uint8_t> sub(k_ * k_);
+    for (size_t r = 0; r < k_; ++r) {
+        std::memcpy(&sub[r * k_], &matrix_[survivors[r] * k_], k_);
+    }
+    std::vector<uint8_t>& inv = *out;
+    inv.assign(k_ * k_, 0);
+    for (size_t i = 0; i < k_; ++i) {
+        inv[i * k_ + i] = 1;
+    }
+    for (size_t col = 0; col < k_; ++col) {
+        size_t pivot = col;
+        while (pivot < k_ && sub[pivot * k_ + col] == 0) {
+            ++pivot;
+        }
+        if (pivot == k_) {
+            return false;
+        }
+        if (pivot != col) {
+            std::swap_ranges(&sub[pivot * k_], &sub[pivot * k_] + k_, &sub[col * k_]);
+            std::swap_ranges(&inv[pivot * k_], &inv[pivot * k_] + k_, &inv[col * k_]);
+        }
+        const uint8_t scale = GfInv(sub[col * k_ + col]);
+        for (size_t j = 0; j < k_; ++j) {
+            sub[col * k_ + j] = GfMul(sub[col * k_ + j], scale);
+            inv[col * k_ + j] = GfMul(inv[col * k_ + j], scale);
+        }
+        for (size_t r = 0; r < k_; ++r) {
+            const uint8_t f = sub[r * k_ + col];
+            if (r == col || f == 0) {
+                continue;
+            }
+            for (size_t j = 0; j < k_; ++j) {
+                sub[r * k_ + j] ^= GfMul(f, sub[col * k_ + j]);
+                inv[r * k_ + j] ^= GfMul(f, inv[col * k_ + j]);
+            }
+        }
+    }
+    return true;
+}
+
+bool ReedSolomon::Reconstruct(uint8_t* const* shards, const bool* present, size_t len,
+                              const bool* wanted) const {
+    const std::vector<size_t> survivors = Survivors(present);
+    if (survivors.empty()) {
+        return false;
+    }
+    // Rebuilding a parity shard needs every data shard.
+    bool parity_wanted = false;
+    for (size_t p = k_; p < k_ + m_; ++p) {
+        parity_wanted = parity_wanted || (!present[p] && (!wanted || wanted[p]));
+    }
+    std::vector<bool> rebuild(k_ + m_);
+    bool data_missing = false;
+    for (size_t i = 0; i < k_ + m_; ++i) {
+        rebuild[i] = !present[i] && (!wanted || wanted[i] || (i < k_ && parity_wanted));
+        data_missing = data_missing || (i < k_ && rebuild[i]);
+    }
+    if (data_missing) {
+        std::vector<uint8_t> inv;
+        if (!DecodeMatrix(survivors, &inv)) {
+            return false;
+        }
+        std::vector<const uint8_t*> srcs(k_);
+        for (size_t j = 0; j < k_; ++j) {
+            srcs[j] = shards[survivors[j]];
+        }
+        for (size_t d = 0; d < k_; ++d) {
+            if (rebuild[d]) {
+                Combine(&inv[d * k_], srcs.data(), k_, shards[d], len);
+            }
+        }
+    }
+    for (size_t p = 0; p < m_; ++p) {
+        if (rebuild[k_ + p]) {
+            Combine(&matrix_[(k_ + p) * k_], shards, k_, shards[k_ + p], len);
+        }
+    }
+    return true;
+}
+
+ReedSolomon::Kernel ReedSolomon::ActiveKernel() {
+    return g_kernel.load(std::memory_order_relaxed);
+}
+
+const char* ReedSolomon::KernelName(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::kAvx2:
+        return "avx2";
+    case Kernel::kSsse3:
+        return "ssse3";
+    default:
+        return "scalar";
+    }
+}
+
+bool ReedSolomon::UseKernel(Kernel kernel) {
+    if (!Supported(kernel)) {
+        return false;
+    }
+    g_kernel.store(kernel, std::memory_order_relaxed);
+    g_region.store(KernelFn(kernel), std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Systematic Reed-Solomon code over GF(2^8): k data shards, m parity shards,
+// any k of the k + m shards rebuild the rest. The generator is the identity
+// on top of a Cauchy matrix, so every k x k submatrix is invertible.
+//
+// The region kernels multiply a buffer by a constant and xor it into
+// another, 32 (AVX2) or 16 (SSSE3) bytes at a time with split-nibble
+// pshufb tables; the scalar kernel uses a full 64 KiB product table. The
+// best kernel the CPU supports is picked at startup.
+class ReedSolomon {
+public:
+    enum class Kernel { kScalar, kSsse3, kAvx2 };
+
+    // k + m must be at most 256; k and m at least 1.
+    ReedSolomon(size_t k, size_t m);
+
+    size_t data_shards() const { return k_; }
+    size_t parity_shards() const { return m_; }
+
+    // parity[i] = row k + i of the generator applied to data[0..k), each
+    // buffer len bytes.
+    void Encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const;
+
+    // shards has k + m buffers of len bytes; present[i] says whether shard i
+    // holds data. Rebuilds the absent shards flagged in wanted, or every
+    // absent shard without it, in place. Other absent shards may be null,
+    // except data shards while a parity shard is wanted: parity is rebuilt
+    // from all the data. Returns false when fewer than k shards are present.
+    bool Reconstruct(uint8_t* const* shards, const bool* present, size_t len,
+                     const bool* wanted = nullptr) const;
+
+    // The present shards Reconstruct reads from: the first k, data shards
+    // first. Empty when fewer than k are present.
+    std::vector<size_t> Survivors(const bool* present) const;
+
+    static Kernel ActiveKernel();
+    static const char* KernelName(Kernel kernel);
+    // Switches every codec to kernel, e.g. for benchmarks; false if the CPU
+    // lacks it.
+    static bool UseKernel(Kernel kernel);
+
+private:
+    // Rows of the inverse of the generator rows picked by survivors, used
+    // to recompute the data shards.
+    bool DecodeMatrix(const std::vector<size_t>& survivors, std::vector<uint8_t>* out) const;
+
+    size_t k_;
+    size_t m_;
+    std::vector<uint8_t> matrix_;  // (k + m) x k generator, row major
+};
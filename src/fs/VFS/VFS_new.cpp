@@ -111,6 +111,7 @@ FileSystem::FileSystem(std::shared_ptr<MdsServer> mds,
 }
 
 FileSystem::~FileSystem() {
+    flush_atime();
     if (handle_observer_) {
         handle_observer_->detach();
     }
@@ -198,6 +199,7 @@ uint64_t FileSystem::get_root_inode() const {
 
 std::vector<uint64_t> FileSystem::collect_cold_inodes(size_t max_candidates,
                                                       size_t min_age_windows) {
+    flush_atime();
     auto list = mds_ ? mds_->CollectColdInodes(max_candidates, min_age_windows)
                      : std::vector<uint64_t>{};
     report_count("collect_cold_inodes", list.size(), max_candidates,
@@ -206,6 +208,7 @@ std::vector<uint64_t> FileSystem::collect_cold_inodes(size_t max_candidates,
 }
 
 std::shared_ptr<boost::dynamic_bitset<>> FileSystem::collect_cold_inodes_bitmap(size_t min_age_windows) {
+    flush_atime();
     auto bitmap = mds_ ? mds_->CollectColdInodesBitmap(min_age_windows)
                        : nullptr;
     size_t size = bitmap ? bitmap->size() : 0;
@@ -216,6 +219,7 @@ std::shared_ptr<boost::dynamic_bitset<>> FileSystem::collect_cold_inodes_bitmap(
 }
 
 std::vector<uint64_t> FileSystem::collect_cold_inodes_by_atime_percent(double percent) {
+    flush_atime();
     auto list = mds_ ? mds_->CollectColdInodesByAtimePercent(percent)
                      : std::vector<uint64_t>{};
     report_count("collect_cold_inodes_by_atime_percent", list.size(),
@@ -224,6 +228,75 @@ std::vector<uint64_t> FileSystem::collect_cold_inodes_by_atime_percent(double pe
     return list;
 }
 
+void FileSystem::set_atime_granularity(uint32_t minutes) {
+    std::lock_guard lk(atime_mutex_);
+    atime_granularity_min_ = minutes;
+}
+
+void FileSystem::set_atime_flush_batch(size_t batch) {
+    std::lock_guard lk(atime_mutex_);
+    atime_flush_batch_ = std::max<size_t>(batch, 1);
+}
+
+bool FileSystem::flush_atime() {
+    std::vector<std::pair<uint64_t, InodeTimestamp>> entries;
+    {
+        std::lock_guard lk(atime_mutex_);
+        entries.assign(atime_dirty_.begin(), atime_dirty_.end());
+        atime_dirty_.clear();
+    }
+    bool ok = persist_atime(entries);
+    report_value("flush_atime", "/", entries.size(), ok,
+                 "pending access times persisted to metadata store");
+    return ok;
+}
+
+bool FileSystem::persist_atime(const std::vector<std::pair<uint64_t, InodeTimestamp>>& entries) {
+    if (!mds_) return entries.empty();
+    bool ok = true;
+    for (const auto& [ino, atime] : entries) {
+        // 只推进 fa_time：以 MDS 上的最新 inode 为基准，避免用 fd 中的旧副本覆盖大小等字段
+        Inode current;
+        if (!mds_->ReadInode(ino, current)) {
+            ok = false;
+            continue;
+        }
+        if (current.fa_time.to_minutes() >= atime.to_minutes()) {
+            continue;
+        }
+        current.setFaTime(atime);
+        ok = mds_->WriteInode(ino, current) && ok;
+    }
+    return ok;
+}
+
+void FileSystem::touch_atime(const std::shared_ptr<Inode>& inode) {
+    InodeTimestamp now;
+    const uint32_t now_min = now.to_minutes();
+    const uint32_t atime_min = inode->fa_time.to_minutes();
+
+    std::vector<std::pair<uint64_t, InodeTimestamp>> batch;
+    {
+        std::lock_guard lk(atime_mutex_);
+        const uint32_t granularity = atime_granularity_min_;
+        // relatime：atime 早于 mtime，或距上次记录超过粒度时才推进
+        const bool stale = atime_min < inode->fm_time.to_minutes() ||
+                           now_min >= atime_min + granularity;
+        if (!stale) {
+            return;
+        }
+        inode->setFaTime(now);
+        atime_dirty_[inode->inode] = now;
+        if (granularity == 0 || atime_dirty_.size() >= atime_flush_batch_) {
+            batch.assign(atime_dirty_.begin(), atime_dirty_.end());
+            atime_dirty_.clear();
+        }
+    }
+    if (!batch.empty()) {
+        persist_atime(batch);
+    }
+}
+
 void FileSystem::rebuild_inode_table() {
     if (mds_) {
         mds_->RebuildInodeTable();
@@ -285,7 +358,7 @@ bool FileSystem::startup() {
 }
 
 bool FileSystem::shutdown() {
-    bool ok = true;
+    bool ok = flush_atime();
     if (auto registry = volume_registry()) {
         ok = registry->shutdown() && ok;
     }
@@ -384,16 +457,35 @@ int FileSystem::close(int fd) {
 }
 
 int FileSystem::shutdown_fd(int fd) {
-    std::lock_guard lk(fd_mutex_);
-    auto it = fd_table_.find(fd);
-    if (it == fd_table_.end()) {
-        report_value("shutdown_fd", std::to_string(fd), -1, false,
-                     "fd must exist before shutdown");
-        return -1;
+    uint64_t closed_ino = static_cast<uint64_t>(-1);
+    {
+        std::lock_guard lk(fd_mutex_);
+        auto it = fd_table_.find(fd);
+        if (it == fd_table_.end()) {
+            report_value("shutdown_fd", std::to_string(fd), -1, false,
+                         "fd must exist before shutdown");
+            return -1;
+        }
+        if (--it->second.ref_count <= 0) {
+            if (it->second.inode) {
+                closed_ino = it->second.inode->inode;
+            }
+            fd_table_.erase(it);
+            release_fd_locked(fd);
+        }
     }
-    if (--it->second.ref_count <= 0) {
-        fd_table_.erase(it);
-        release_fd_locked(fd);
+    // 句柄关闭时落盘该 inode 尚未持久化的 atime
+    if (closed_ino != static_cast<uint64_t>(-1)) {
+        std::vector<std::pair<uint64_t, InodeTimestamp>> pending;
+        {
+            std::lock_guard lk(atime_mutex_);
+            auto it = atime_dirty_.find(closed_ino);
+            if (it != atime_dirty_.end()) {
+                pending.emplace_back(*it);
+                atime_dirty_.erase(it);
+            }
+        }
+        persist_atime(pending);
     }
     report_value("shutdown_fd", std::to_string(fd), 0, true,
                  "no further reads/writes allowed on this fd");
@@ -478,6 +570,11 @@ ssize_t FileSystem::write(int fd, const char* buf, size_t count) {
     inode->setFmTime(now);
     inode->setFaTime(now);
     inode->setFcTime(now);
+    {
+        // 写路径会整体写回 inode（含最新 atime），脏表中的待写条目随之作废
+        std::lock_guard lk(atime_mutex_);
+        atime_dirty_.erase(inode->inode);
+    }
     mds_->WriteInode(inode->inode, *inode);
     report_value("write", std::to_string(fd), written, true,
                  "bytes durable; read should return same count");
@@ -522,9 +619,7 @@ ssize_t FileSystem::read(int fd, char* buf, size_t count) {
         }
     }
 
-    InodeTimestamp now;
-    inode->setFaTime(now);
-    mds_->WriteInode(inode->inode, *inode);
+    touch_atime(inode);
     report_value("read", std::to_string(fd), read_bytes, true,
                  "buffer now holds bytes written earlier");
     return read_bytes;
@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <mutex>
 #include <boost/dynamic_bitset.hpp>
@@ -30,6 +31,25 @@ private:
     mutable std::mutex fd_mutex_;                     ///< 保护 fd_table_ 的互斥量
     std::shared_ptr<FileSystemHandleObserver> handle_observer_;
 
+    // relatime/lazytime：读路径只在内存中推进 atime，待持久化的条目集中到脏表批量回写
+    std::unordered_map<uint64_t, InodeTimestamp> atime_dirty_; ///< inode 号 -> 待写回的访问时间
+    mutable std::mutex atime_mutex_;                           ///< 保护 atime_dirty_
+    uint32_t atime_granularity_min_ = 60;                      ///< atime 持久化粒度（分钟），0 表示每次读都写回
+    size_t atime_flush_batch_ = 256;                           ///< 脏表达到该条目数时触发批量回写
+
+    /**
+     * @brief 读路径调用：按 relatime 规则决定是否推进 atime 并登记到脏表。
+     * @param inode 被读取的 inode（fd 表中的共享对象）。
+     */
+    void touch_atime(const std::shared_ptr<Inode>& inode);
+
+    /**
+     * @brief 回写脏表中的指定条目（读-改-写，只推进 fa_time，不覆盖其他字段）。
+     * @param entries 待回写条目。
+     * @return 全部写回成功返回 true。
+     */
+    bool persist_atime(const std::vector<std::pair<uint64_t, InodeTimestamp>>& entries);
+
     /**
      * @brief 在持锁状态下申请一个空闲 fd。
      * @return 成功返回 fd，失败返回 -1。
@@ -185,6 +205,25 @@ public:
      */
     std::vector<uint64_t> collect_cold_inodes_by_atime_percent(double percent);
 
+    /**
+     * @brief 设置 atime 持久化粒度（relatime）。
+     * @param minutes 仅当新 atime 比已记录值晚至少该分钟数（或早于 mtime）时才更新；0 表示严格 atime。
+     */
+    void set_atime_granularity(uint32_t minutes);
+
+    /**
+     * @brief 设置 atime 脏表的批量回写阈值。
+     * @param batch 脏条目数达到该值时立即批量回写，最小为 1。
+     */
+    void set_atime_flush_batch(size_t batch);
+
+    /**
+     * @brief 将所有尚未持久化的 atime 批量写回 MDS。
+     *        close 最后一个句柄、shutdown 以及冷数据收集前都会自动调用。
+     * @return 全部写回成功返回 true。
+     */
+    bool flush_atime();
+
     /**
      * @brief 重建内存中的路径→inode 映射表。
      */
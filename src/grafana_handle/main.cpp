@@ -49,9 +49,15 @@ int main(int argc, char **argv)
         exporter.setMetricsProvider(provider);
         std::cout << "MetaServer metrics provider attached" << std::endl;
     }
-    else
+    if (const char *mds = std::getenv("METRICS_MDS_ADDR"))
     {
-        std::cout << "MetaServer metrics provider not linked; exporter will expose storage metrics only" << std::endl;
+        exporter.setMdsEndpoint(mds);
+        std::cout << "Scraping MDS metrics from " << mds << std::endl;
+    }
+    else if (!GetMetaServerMetricsProvider())
+    {
+        std::cout << "MetaServer metrics provider not linked and METRICS_MDS_ADDR unset; "
+                     "exporter will expose storage metrics only" << std::endl;
     }
     exporter.start();
 
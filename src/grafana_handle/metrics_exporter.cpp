@@ -13,7 +13,9 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #include <unistd.h>
 
 MetricsExporter::MetricsExporter(unsigned short port, int scrape_interval_seconds)
@@ -29,6 +31,86 @@ void MetricsExporter::setMetricsProvider(const mds::metrics::IMetricsProvider *p
     metrics_provider_ = provider;
 }
 
+void MetricsExporter::setMdsEndpoint(const std::string &host_port)
+{
+    size_t colon = host_port.rfind(':');
+    if (colon == std::string::npos)
+    {
+        mds_host_ = host_port;
+        mds_port_ = "80";
+        return;
+    }
+    mds_host_ = host_port.substr(0, colon);
+    mds_port_ = host_port.substr(colon + 1);
+}
+
+bool MetricsExporter::fetchMdsMetrics(std::string &body, std::string &err)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = nullptr;
+    if (getaddrinfo(mds_host_.c_str(), mds_port_.c_str(), &hints, &res) != 0 || !res)
+    {
+        err = "resolve " + mds_host_ + " failed";
+        return false;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        // Keep a stalled MDS from blocking the storage metrics.
+        struct timeval tv{2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+    {
+        err = "connect " + mds_host_ + ":" + mds_port_ + " failed";
+        return false;
+    }
+
+    // brpc serves the pb method over HTTP; the handler answers with the text snapshot as body.
+    std::string req = "GET /rpc.MdsService/GetMetricsProm HTTP/1.1\r\n"
+                      "Host: " + mds_host_ + "\r\n"
+                      "Connection: close\r\n\r\n";
+    if (send(fd, req.data(), req.size(), 0) != static_cast<ssize_t>(req.size()))
+    {
+        close(fd);
+        err = "send failed";
+        return false;
+    }
+    std::string resp;
+    char buf[8192];
+    ssize_t r;
+    while ((r = recv(fd, buf, sizeof(buf), 0)) > 0)
+        resp.append(buf, static_cast<size_t>(r));
+    close(fd);
+
+    size_t header_end = resp.find("\r\n\r\n");
+    if (header_end == std::string::npos)
+    {
+        err = "truncated response";
+        return false;
+    }
+    size_t sp = resp.find(' ');
+    if (sp == std::string::npos || resp.compare(sp + 1, 3, "200") != 0)
+    {
+        err = "bad status: " + resp.substr(0, resp.find("\r\n"));
+        return false;
+    }
+    body = resp.substr(header_end + 4);
+    return true;
+}
+
 void MetricsExporter::start()
 {
     if (running_.load())
@@ -373,8 +455,26 @@ std::string MetricsExporter::buildMetrics()
         }
     };
 
+    auto appendMdsScrape = [&]()
+    {
+        if (mds_host_.empty())
+            return;
+        std::string body, err;
+        if (!fetchMdsMetrics(body, err))
+        {
+            ss << "# MDS scrape failed: " << err << "\n";
+            emitGauge("zb_mds_scrape_up", "Whether the last MDS metrics scrape succeeded.", 0.0);
+            return;
+        }
+        emitGauge("zb_mds_scrape_up", "Whether the last MDS metrics scrape succeeded.", 1.0);
+        ss << body;
+        if (!body.empty() && body.back() != '\n')
+            ss << "\n";
+    };
+
     appendStorageMetrics();
     appendMetaMetrics();
+    appendMdsScrape();
 
     return ss.str();
 }
@@ -21,12 +21,16 @@ public:
     void stop();
 
     void setMetricsProvider(const mds::metrics::IMetricsProvider *provider);
+    // Scrape the MDS Prometheus endpoint (host:port of its brpc server) on every collection.
+    void setMdsEndpoint(const std::string &host_port);
 
 private:
     unsigned short port_;
     int scrape_interval_seconds_;
 
     const mds::metrics::IMetricsProvider *metrics_provider_ = nullptr;
+    std::string mds_host_;
+    std::string mds_port_;
 
     std::string metrics_; // latest metrics in Prometheus text format
     std::mutex mu_;
@@ -38,6 +42,7 @@ private:
     void collectorLoop();
     void serverLoop();
     std::string buildMetrics();
+    bool fetchMdsMetrics(std::string &body, std::string &err);
     std::string sanitizeLabel(const std::string &s);
 };
 
@@ -2,6 +2,7 @@
 #include <cassert>
 #include <filesystem>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 static void clean_path(const std::string& p) {
@@ -57,6 +58,9 @@ int main() {
     assert(f2_ino == f1_ino);
     assert(mds.RemoveFile("/a/b/f2"));
     assert(mds.Rmdir("/a/b"));
+    // 命名空间计数随增删增量维护：根目录 + /a
+    assert(mds.GetDirectoryCount() == 2);
+    assert(mds.GetFileCount() == 0);
 
     // 路径解析
     /*
@@ -79,6 +83,8 @@ int main() {
         assert(ino_a2 == ino_a);
         auto inode_a2 = mds2.FindInodeByPath("/a");
         assert(inode_a2 && inode_a2->inode == ino_a);
+        assert(mds2.GetDirectoryCount() == mds.GetDirectoryCount());
+        assert(mds2.GetFileCount() == mds.GetFileCount());
     }
 
     // 冷扫描
@@ -123,6 +129,87 @@ int main() {
     }
     assert(mds.Rmdir("/bulk"));
 
+    // 操作指标：失败原因累计，延迟分位数来自对数-线性直方图
+    /*
+        此前 Rmdir("/a/b") 因目录非空失败一次；创建已存在的文件应记为 already_exists。
+    */
+    assert(!mds.CreateFile("/a", 0644));
+    auto snap = mds.collect_snapshot();
+    assert(snap.namespace_scale.total_directories == mds.GetDirectoryCount());
+    assert(snap.operations.rmdir.failure_reasons.at("not_empty") == 1);
+    assert(snap.operations.create.failure_reasons.at("already_exists") == 1);
+    assert(snap.operations.create.latency_percentiles.count("p99") == 1);
+    assert(snap.operations.create.qps > 0.0);
+    // 累计计数不随读取清零：再次读取与按消费者计算的窗口互不干扰
+    auto snap_again = mds.collect_snapshot();
+    assert(snap_again.operations.create.failure_reasons.at("already_exists") == 1);
+    assert(snap_again.operations.create.qps > 0.0);
+    auto ops_before = mds.OperationTotals();
+    assert(mds.LookupIno("/a") != static_cast<uint64_t>(-1));
+    auto window = mds::metrics::OperationRecorder::Window(ops_before, mds.OperationTotals());
+    assert(window.lookup.qps > 0.0 && window.create.qps == 0.0);
+    for (uint64_t ns : {0ull, 7ull, 8ull, 1000ull, 123456789ull}) {
+        auto idx = mds::metrics::LatencyBuckets::IndexOf(ns);
+        assert(mds::metrics::LatencyBuckets::UpperBound(idx) > ns);
+        assert(idx == 0 || mds::metrics::LatencyBuckets::UpperBound(idx - 1) <= ns);
+    }
+
+    // 文件大小组提交与客户端租约
+    /*
+        extend_only 更新只增不减；绝对设置可缩小；并发扩展合并后取最大值。
+        第二个客户端申请租约时召回独占持有者，确认或到期前不授予。
+    */
+    assert(mds.CreateFile("/a/sz", 0644));
+    auto sz_ino = mds.LookupIno("/a/sz");
+    Inode sz_inode;
+    assert(mds.UpdateFileSize(sz_ino, 4096, /*extend_only=*/true));
+    assert(mds.UpdateFileSize(sz_ino, 1024, /*extend_only=*/true));
+    assert(mds.ReadInode(sz_ino, sz_inode) && sz_inode.getFileSize() == 4096);
+    assert(mds.UpdateFileSize(sz_ino, 100, /*extend_only=*/false));
+    assert(mds.ReadInode(sz_ino, sz_inode) && sz_inode.getFileSize() == 100);
+    {
+        std::vector<std::thread> writers;
+        for (uint64_t t = 1; t <= 8; ++t) {
+            writers.emplace_back([&mds, sz_ino, t]() {
+                for (uint64_t i = 1; i <= 50; ++i) {
+                    mds.UpdateFileSize(sz_ino, t * 1000 + i, /*extend_only=*/true);
+                }
+            });
+        }
+        for (auto& w : writers) w.join();
+    }
+    assert(mds.ReadInode(sz_ino, sz_inode) && sz_inode.getFileSize() == 8050);
+
+    // 两个客户端：A 独占并在本地积压大小，B 申请时须等 A 提交并确认后才获授予
+    MdsServer::SizeLeaseGrant grant;
+    const auto lease = std::chrono::milliseconds(5000);
+    assert(mds.AcquireSizeLease(sz_ino, "client-a", lease, false, false, grant));
+    assert(!grant.shared && !grant.pending && grant.size_bytes == 8050);
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, false, false, grant));
+    assert(grant.pending && grant.size_bytes == 0);
+    // A 续约时仍有积压：得知 shared，但尚未交回
+    assert(mds.AcquireSizeLease(sz_ino, "client-a", lease, false, true, grant));
+    assert(grant.shared && !grant.pending);
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, false, false, grant) && grant.pending);
+    // A 提交积压的大小后确认，B 随即拿到授予与最新大小
+    assert(mds.UpdateFileSize(sz_ino, 9000, /*extend_only=*/true));
+    assert(mds.AcquireSizeLease(sz_ino, "client-a", lease, false, false, grant) && grant.shared);
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, false, false, grant));
+    assert(grant.shared && !grant.pending && grant.size_bytes == 9000);
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, true, false, grant));
+    assert(mds.AcquireSizeLease(sz_ino, "client-a", lease, false, false, grant) && !grant.shared);
+    assert(mds.AcquireSizeLease(sz_ino, "client-a", lease, true, false, grant));
+
+    // 独占持有者失联：租约到期后召回自动解除
+    const auto short_lease = std::chrono::milliseconds(50);
+    assert(mds.AcquireSizeLease(sz_ino, "client-a", short_lease, false, true, grant) && !grant.shared);
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, false, false, grant) && grant.pending);
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, false, false, grant));
+    assert(!grant.pending && !grant.shared && grant.size_bytes == 9000);
+    assert(mds.AcquireSizeLease(sz_ino, "client-b", lease, true, false, grant));
+    assert(mds.RemoveFile("/a/sz"));
+
     std::cout << "[MDS UT] all tests passed." << std::endl;
     clean_path(base);
     return 0;
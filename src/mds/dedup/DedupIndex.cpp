@@ -0,0 +1,429 @@
+#include "DedupIndex.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+// 日志记录（每行一条，字段以空格分隔，指纹为十六进制）：
+//   N <namespace> <0|1>                  命名空间开关
+//   E <fp> <size> <node> <chunk>         内容的持有者 chunk（新建或改指继承者）
+//   + <fp> <ino> <node>                  inode 引用该内容
+//   - <fp> <ino>                         inode 解除引用；最后一个引用解除时内容出索引
+
+std::string ToHex(const std::string& bytes) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+        out.push_back(kDigits[c >> 4]);
+        out.push_back(kDigits[c & 0xf]);
+    }
+    return out;
+}
+
+bool FromHex(const std::string& hex, std::string* out) {
+    if (hex.empty() || hex.size() % 2 != 0) {
+        return false;
+    }
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    };
+    out->clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        const int hi = nibble(hex[i]);
+        const int lo = nibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out->push_back(static_cast<char>((hi << 4) | lo));
+    }
+    return true;
+}
+
+bool ValidToken(const std::string& s) {
+    return !s.empty() && std::none_of(s.begin(), s.end(), [](char c) { return c == ' ' || c == '\n' || c == '\t'; });
+}
+
+bool WriteAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string DirOf(const std::string& path) {
+    const auto pos = path.find_last_of('/');
+    return pos == std::string::npos ? "." : (pos == 0 ? "/" : path.substr(0, pos));
+}
+
+} // namespace
+
+DedupIndex::DedupIndex(std::string path, bool create_new, bool default_enabled,
+                       std::chrono::milliseconds copy_timeout)
+    : path_(std::move(path)), default_enabled_(default_enabled), copy_timeout_(copy_timeout) {
+    if (create_new) {
+        ::unlink(path_.c_str());
+    }
+    Load();
+    if (!Compact()) {
+        std::cerr << "[DedupIndex] 压缩日志失败 path=" << path_ << std::endl;
+    }
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "[DedupIndex] 打开日志失败 path=" << path_ << std::endl;
+    }
+}
+
+DedupIndex::~DedupIndex() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void DedupIndex::Load() {
+    std::ifstream in(path_);
+    std::string line;
+    while (std::getline(in, line)) {
+        // 崩溃可能留下半行；回放时忽略无法解析的记录
+        Apply(line);
+    }
+}
+
+void DedupIndex::Apply(const std::string& line) {
+    std::istringstream is(line);
+    char op = 0;
+    std::string hex;
+    is >> op >> hex;
+    std::string fp;
+    if (op == 'N') {
+        int enabled = 0;
+        if (!hex.empty() && (is >> enabled)) {
+            namespaces_[hex] = enabled != 0;
+        }
+        return;
+    }
+    if (!FromHex(hex, &fp)) {
+        return;
+    }
+    if (op == 'E') {
+        Entry e;
+        if (!(is >> e.size_bytes >> e.location.node_id >> e.location.chunk_id)) {
+            return;
+        }
+        auto it = entries_.find(fp);
+        if (it == entries_.end()) {
+            ++stats_.fingerprints;
+            stats_.stored_bytes += e.size_bytes;
+            entries_.emplace(fp, std::move(e));
+        } else {
+            it->second.location = e.location;
+        }
+    } else if (op == '+') {
+        uint64_t ino = 0;
+        std::string node;
+        auto it = entries_.find(fp);
+        if (it == entries_.end() || !(is >> ino >> node) || by_inode_.count(ino) != 0) {
+            return;
+        }
+        it->second.refs[ino] = node;
+        by_inode_[ino] = fp;
+        ++stats_.references;
+        stats_.logical_bytes += it->second.size_bytes;
+    } else if (op == '-') {
+        uint64_t ino = 0;
+        if (is >> ino) {
+            EraseRef(fp, ino);
+        }
+    }
+}
+
+void DedupIndex::EraseRef(const std::string& fingerprint, uint64_t ino) {
+    auto it = entries_.find(fingerprint);
+    if (it == entries_.end() || it->second.refs.erase(ino) == 0) {
+        return;
+    }
+    by_inode_.erase(ino);
+    --stats_.references;
+    stats_.logical_bytes -= it->second.size_bytes;
+    if (it->second.refs.empty()) {
+        --stats_.fingerprints;
+        stats_.stored_bytes -= it->second.size_bytes;
+        entries_.erase(it);
+    }
+}
+
+// 以当前状态重写日志：先写临时文件并落盘，再原子替换
+bool DedupIndex::Compact() {
+    std::ostringstream os;
+    for (const auto& ns : namespaces_) {
+        os << "N " << ns.first << " " << (ns.second ? 1 : 0) << "\n";
+    }
+    for (const auto& kv : entries_) {
+        const std::string hex = ToHex(kv.first);
+        const Entry& e = kv.second;
+        os << "E " << hex << " " << e.size_bytes << " " << e.location.node_id << " " << e.location.chunk_id << "\n";
+        for (const auto& ref : e.refs) {
+            os << "+ " << hex << " " << ref.first << " " << ref.second << "\n";
+        }
+    }
+    const std::string tmp = path_ + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = WriteAll(fd, os.str()) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path_.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    const int dir = ::open(DirOf(path_).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+    }
+    return true;
+}
+
+bool DedupIndex::Append(const std::string& lines) {
+    return fd_ >= 0 && WriteAll(fd_, lines) && ::fdatasync(fd_) == 0;
+}
+
+bool DedupIndex::Add(uint64_t ino, const std::string& node_id, const std::string& fingerprint,
+                     uint64_t size_bytes, AddResult* out) {
+    if (!out || ino == 0 || fingerprint.empty() || !ValidToken(node_id)) {
+        return false;
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(mu_);
+    auto record_latency = [&]() {
+        const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                      std::chrono::steady_clock::now() - begin)
+                                                      .count());
+        ++stats_.lookups;
+        stats_.lookup_ns_total += ns;
+        stats_.lookup_ns_max = std::max(stats_.lookup_ns_max, ns);
+    };
+
+    auto known = by_inode_.find(ino);
+    if (known != by_inode_.end()) {
+        // 重复上报：inode 写入前已 Release，仍在索引中说明内容未变
+        if (known->second != fingerprint) {
+            return false;
+        }
+        const Entry& e = entries_.at(fingerprint);
+        out->duplicate = e.location.chunk_id != ino;
+        out->location = e.location;
+        record_latency();
+        return true;
+    }
+
+    const std::string hex = ToHex(fingerprint);
+    auto it = entries_.find(fingerprint);
+    if (it != entries_.end() && it->second.size_bytes != size_bytes) {
+        // 指纹相同而大小不同，不可能是同一份内容；不去重
+        out->duplicate = false;
+        out->location = Location{node_id, ino};
+        record_latency();
+        return true;
+    }
+    std::ostringstream os;
+    if (it == entries_.end()) {
+        os << "E " << hex << " " << size_bytes << " " << node_id << " " << ino << "\n";
+    }
+    os << "+ " << hex << " " << ino << " " << node_id << "\n";
+    if (!Append(os.str())) {
+        std::cerr << "[DedupIndex] 写日志失败 ino=" << ino << std::endl;
+        return false;
+    }
+    if (it == entries_.end()) {
+        Entry e;
+        e.size_bytes = size_bytes;
+        e.location = Location{node_id, ino};
+        it = entries_.emplace(fingerprint, std::move(e)).first;
+        ++stats_.fingerprints;
+        stats_.stored_bytes += size_bytes;
+    } else {
+        ++stats_.hits;
+    }
+    it->second.refs[ino] = node_id;
+    by_inode_[ino] = fingerprint;
+    ++stats_.references;
+    stats_.logical_bytes += size_bytes;
+    out->duplicate = it->second.location.chunk_id != ino;
+    out->location = it->second.location;
+    record_latency();
+    return true;
+}
+
+bool DedupIndex::Resolve(uint64_t ino, Location* out) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto known = by_inode_.find(ino);
+    if (known == by_inode_.end()) {
+        return false;
+    }
+    if (out) {
+        *out = entries_.at(known->second).location;
+    }
+    return true;
+}
+
+bool DedupIndex::Release(uint64_t ino, bool discard, uint64_t copied_to, ReleasePlan* out,
+                         const std::function<bool(uint64_t)>& in_use) {
+    if (!out) {
+        return false;
+    }
+    *out = ReleasePlan{};
+    std::lock_guard<std::mutex> lk(mu_);
+    auto known = by_inode_.find(ino);
+    if (known == by_inode_.end()) {
+        out->released = true;
+        return true;
+    }
+    const std::string fp = known->second;
+    Entry& e = entries_.at(fp);
+    const std::string hex = ToHex(fp);
+    const auto now = Clock::now();
+    out->size_bytes = e.size_bytes;
+    out->from = e.location;
+
+    if (e.handoff_to == ino && now < e.handoff_until) {
+        // 继承者：持有者交接的数据可能仍在写入本 chunk，解除后本 inode 的写入会被它覆盖
+        out->busy = true;
+        return true;
+    }
+
+    if (e.location.chunk_id != ino) {
+        // 引用者：数据拷回自己的 chunk 后（或不再需要时）解除
+        if (!discard && copied_to != ino) {
+            out->to = Location{e.refs.at(ino), ino};
+            e.copies[ino] = now + copy_timeout_;
+            return true;
+        }
+        if (!Append("- " + hex + " " + std::to_string(ino) + "\n")) {
+            return false;
+        }
+        e.copies.erase(ino);
+        EraseRef(fp, ino);
+        out->released = true;
+        return true;
+    }
+
+    // 持有者：没有其他引用者时直接出索引，否则先把数据交给继承者
+    if (e.refs.size() == 1) {
+        if (!Append("- " + hex + " " + std::to_string(ino) + "\n")) {
+            return false;
+        }
+        EraseRef(fp, ino);
+        out->released = true;
+        return true;
+    }
+    auto heir = e.refs.begin();
+    if (heir->first == ino) {
+        ++heir;
+    }
+    out->to = Location{heir->second, heir->first};
+    // 交接后持有者的 chunk 将被改写或删除：仍在从它拷贝的引用者、仍打开着文件
+    // （按旧位置读持有者 chunk）的引用者都会读到错误数据
+    for (auto it = e.copies.begin(); it != e.copies.end();) {
+        it = it->second <= now ? e.copies.erase(it) : std::next(it);
+    }
+    bool busy = !e.copies.empty();
+    for (auto it = e.refs.begin(); !busy && in_use && it != e.refs.end(); ++it) {
+        busy = it->first != ino && in_use(it->first);
+    }
+    if (busy) {
+        out->busy = true;
+        return true;
+    }
+    if (copied_to != heir->first) {
+        e.handoff_to = heir->first;
+        e.handoff_until = now + copy_timeout_;
+        return true;
+    }
+    std::ostringstream os;
+    os << "E " << hex << " " << e.size_bytes << " " << heir->second << " " << heir->first << "\n";
+    os << "- " << hex << " " << ino << "\n";
+    if (!Append(os.str())) {
+        return false;
+    }
+    e.location = out->to;
+    e.handoff_to = 0;
+    EraseRef(fp, ino);
+    out->released = true;
+    return true;
+}
+
+bool DedupIndex::SetNamespaceEnabled(const std::string& namespace_id, bool enabled) {
+    if (!ValidToken(namespace_id)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!Append("N " + namespace_id + " " + (enabled ? "1" : "0") + "\n")) {
+        return false;
+    }
+    namespaces_[namespace_id] = enabled;
+    return true;
+}
+
+bool DedupIndex::NamespaceEnabled(const std::string& namespace_id) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = namespaces_.find(namespace_id);
+    return it == namespaces_.end() ? default_enabled_ : it->second;
+}
+
+DedupIndex::Stats DedupIndex::GetStats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+void DedupIndex::RenderProm(std::ostream& os) const {
+    const Stats s = GetStats();
+    const double ratio = s.stored_bytes == 0 ? 1.0
+                                             : static_cast<double>(s.logical_bytes) / static_cast<double>(s.stored_bytes);
+    const double avg = s.lookups == 0 ? 0.0 : static_cast<double>(s.lookup_ns_total) / s.lookups / 1e9;
+    os << "# HELP mds_dedup_ratio Logical bytes over stored bytes of indexed content\n";
+    os << "# TYPE mds_dedup_ratio gauge\n";
+    os << "mds_dedup_ratio " << ratio << "\n";
+    os << "# HELP mds_dedup_logical_bytes Bytes seen by the inodes in the dedup index\n";
+    os << "# TYPE mds_dedup_logical_bytes gauge\n";
+    os << "mds_dedup_logical_bytes " << s.logical_bytes << "\n";
+    os << "# HELP mds_dedup_stored_bytes Bytes stored once for the inodes in the dedup index\n";
+    os << "# TYPE mds_dedup_stored_bytes gauge\n";
+    os << "mds_dedup_stored_bytes " << s.stored_bytes << "\n";
+    os << "# HELP mds_dedup_fingerprints Distinct contents in the dedup index\n";
+    os << "# TYPE mds_dedup_fingerprints gauge\n";
+    os << "mds_dedup_fingerprints " << s.fingerprints << "\n";
+    os << "# HELP mds_dedup_references Inodes referencing indexed content\n";
+    os << "# TYPE mds_dedup_references gauge\n";
+    os << "mds_dedup_references " << s.references << "\n";
+    os << "# HELP mds_dedup_lookups_total Fingerprint lookups\n";
+    os << "# TYPE mds_dedup_lookups_total counter\n";
+    os << "mds_dedup_lookups_total " << s.lookups << "\n";
+    os << "# HELP mds_dedup_hits_total Fingerprint lookups that found existing content\n";
+    os << "# TYPE mds_dedup_hits_total counter\n";
+    os << "mds_dedup_hits_total " << s.hits << "\n";
+    os << "# HELP mds_dedup_lookup_latency_seconds Fingerprint lookup latency, including the index log sync\n";
+    os << "# TYPE mds_dedup_lookup_latency_seconds gauge\n";
+    os << "mds_dedup_lookup_latency_seconds{stat=\"avg\"} " << avg << "\n";
+    os << "mds_dedup_lookup_latency_seconds{stat=\"max\"} " << static_cast<double>(s.lookup_ns_max) / 1e9 << "\n";
+}
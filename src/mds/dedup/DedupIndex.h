@@ -0,0 +1,160 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief 集群级内容去重索引：内容指纹 → 存放该内容的 chunk 及引用它的 inode。
+ *
+ * 客户端把文件从头到尾顺序写完后上报其 chunk 的指纹。指纹已存在且大小一致时，该 inode
+ * 改为引用已有 chunk（引用计数加一），客户端随即清空自己的 chunk；否则该 inode 自己的
+ * chunk 成为这份内容的持有者。
+ *
+ * 共享内容只读：inode 写入前须先 Release。引用者按返回的拷贝计划把数据拷回自己的 chunk；
+ * 持有者则先把数据拷给另一个引用者（继承者），索引随之改指继承者的 chunk。
+ *
+ * 每次变更先追加写入日志并 fdatasync，保证客户端清空 chunk 前引用已落盘；启动时回放并压缩日志。
+ */
+class DedupIndex {
+public:
+    /**
+     * @brief chunk 位置：所在节点与 chunk id（即写入它的 inode 号）。
+     */
+    struct Location {
+        std::string node_id;
+        uint64_t chunk_id = 0;
+    };
+
+    /**
+     * @brief Add 的结果。
+     */
+    struct AddResult {
+        bool duplicate = false;  ///< 命中已有内容：inode 改读 location，自己的 chunk 可清空。
+        Location location;       ///< inode 数据所在位置。
+    };
+
+    /**
+     * @brief Release 的结果。released 与 busy 均为 false 时，调用方须先把 from 的 size_bytes
+     *        字节拷贝到 to，再以 copied_to = to.chunk_id 重新调用。
+     */
+    struct ReleasePlan {
+        bool released = false;
+        bool busy = false;       ///< 内容正被其他 inode 使用（打开着或拷贝未完成），稍后以相同参数重试。
+        Location from;
+        Location to;
+        uint64_t size_bytes = 0;
+    };
+
+    /**
+     * @brief 去重效果与查找开销统计。
+     */
+    struct Stats {
+        uint64_t fingerprints = 0;     ///< 索引中的不同内容数。
+        uint64_t references = 0;       ///< 引用这些内容的 inode 数（含持有者）。
+        uint64_t logical_bytes = 0;    ///< 各 inode 所见字节数之和。
+        uint64_t stored_bytes = 0;     ///< 实际存放的字节数。
+        uint64_t lookups = 0;          ///< Add 调用次数。
+        uint64_t hits = 0;             ///< 其中命中已有内容的次数。
+        uint64_t lookup_ns_total = 0;  ///< Add 耗时之和（含日志落盘）。
+        uint64_t lookup_ns_max = 0;
+    };
+
+    /**
+     * @brief 打开 path 处的索引日志并回放。
+     * @param path 日志文件路径。
+     * @param create_new 为 true 时丢弃已有日志。
+     * @param default_enabled 未单独设置开关的命名空间是否去重。
+     * @param copy_timeout 拷贝计划的有效期；调用方在此期间未完成拷贝即视为放弃。
+     */
+    DedupIndex(std::string path, bool create_new, bool default_enabled,
+               std::chrono::milliseconds copy_timeout = std::chrono::seconds(60));
+    ~DedupIndex();
+
+    DedupIndex(const DedupIndex&) = delete;
+    DedupIndex& operator=(const DedupIndex&) = delete;
+
+    /**
+     * @brief 登记 inode 的内容指纹。
+     * @param ino inode 号，也是其 chunk id。
+     * @param node_id inode 的 chunk 所在节点，不含空白字符。
+     * @param fingerprint 内容指纹（原始字节）。
+     * @param size_bytes 内容字节数。
+     * @param out 结果；同一指纹但大小不同时不去重，inode 也不入索引。
+     * @return 参数非法、inode 已以其他指纹入索引或日志写入失败时返回 false，索引不变。
+     */
+    bool Add(uint64_t ino, const std::string& node_id, const std::string& fingerprint,
+             uint64_t size_bytes, AddResult* out);
+
+    /**
+     * @brief 查询 inode 的数据位置。
+     * @return inode 在索引中时返回 true。
+     */
+    bool Resolve(uint64_t ino, Location* out) const;
+
+    /**
+     * @brief 解除 inode 对共享内容的引用，在写入或删除 inode 前调用。
+     * @param ino inode 号。
+     * @param discard 调用方不再需要原有数据（截断为 0、删除），引用者可直接解除。
+     * @param copied_to 已按上一次计划拷贝完成的目标 chunk id，0 表示尚未拷贝。
+     * @param out 结果；inode 不在索引中时 released 为 true。
+     * @param in_use 判断 inode 是否仍被打开；持有者交接时，其他引用者打开着则返回 busy，
+     *        因为它们仍按旧位置读持有者的 chunk。为空表示不检查。在索引锁内调用。
+     * @return 日志写入失败返回 false。
+     */
+    bool Release(uint64_t ino, bool discard, uint64_t copied_to, ReleasePlan* out,
+                 const std::function<bool(uint64_t)>& in_use = nullptr);
+
+    /**
+     * @brief 设置命名空间的去重开关（持久化）。
+     * @param namespace_id 已规整的命名空间标识。
+     */
+    bool SetNamespaceEnabled(const std::string& namespace_id, bool enabled);
+
+    /**
+     * @brief 命名空间是否去重。
+     * @param namespace_id 已规整的命名空间标识。
+     */
+    bool NamespaceEnabled(const std::string& namespace_id) const;
+
+    Stats GetStats() const;
+
+    /**
+     * @brief 以 Prometheus 文本格式输出去重指标。
+     */
+    void RenderProm(std::ostream& os) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        uint64_t size_bytes = 0;
+        Location location;                      ///< 持有者 chunk；location.chunk_id 即持有者 inode。
+        std::map<uint64_t, std::string> refs;  ///< 引用者 inode → 其 chunk 所在节点（含持有者）。
+        // 以下仅在内存中：进行中的拷贝计划，MDS 重启后调用方须重新申请
+        uint64_t handoff_to = 0;                ///< 持有者正把数据交给的继承者，0 表示无。
+        Clock::time_point handoff_until;
+        std::map<uint64_t, Clock::time_point> copies; ///< 正从持有者拷回数据的引用者 → 计划到期时间。
+    };
+
+    void Load();
+    void Apply(const std::string& line);
+    bool Compact();
+    bool Append(const std::string& lines);
+    void EraseRef(const std::string& fingerprint, uint64_t ino);
+
+    std::string path_;
+    bool default_enabled_;
+    std::chrono::milliseconds copy_timeout_;
+    int fd_ = -1;
+
+    mutable std::mutex mu_;
+    std::unordered_map<std::string, Entry> entries_;     ///< 指纹 → 内容。
+    std::unordered_map<uint64_t, std::string> by_inode_; ///< inode → 指纹。
+    std::map<std::string, bool> namespaces_;
+    Stats stats_;
+};
@@ -0,0 +1,147 @@
+#include "DedupIndex.h"
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+
+static void clean_path(const std::string& p) {
+    std::error_code ec;
+    std::filesystem::remove_all(p, ec);
+}
+
+int main() {
+    const std::string base = "./_dedup_ut_tmp";
+    const std::string log_path = base + "/dedup.log";
+    clean_path(base);
+    std::filesystem::create_directories(base);
+
+    const std::string fp_a(32, 'a');
+    const std::string fp_b(32, 'b');
+
+    {
+        DedupIndex index(log_path, /*create_new=*/true, /*default_enabled=*/false);
+        DedupIndex::AddResult add;
+        DedupIndex::Location loc;
+
+        // 新内容：inode 自己的 chunk 成为持有者
+        assert(index.Add(10, "node1", fp_a, 4096, &add));
+        assert(!add.duplicate);
+        assert(add.location.node_id == "node1" && add.location.chunk_id == 10);
+        // 相同指纹与大小：去重，改读持有者的 chunk
+        assert(index.Add(11, "node2", fp_a, 4096, &add));
+        assert(add.duplicate);
+        assert(add.location.node_id == "node1" && add.location.chunk_id == 10);
+        assert(index.Add(12, "node3", fp_a, 4096, &add));
+        assert(add.duplicate);
+        assert(index.Add(13, "node3", fp_a, 4096, &add));
+        assert(index.Resolve(13, &loc) && loc.chunk_id == 10);
+        // 重复上报同一指纹结果不变；inode 已以其他指纹入索引时拒绝
+        assert(index.Add(11, "node2", fp_a, 4096, &add));
+        assert(add.duplicate && add.location.chunk_id == 10);
+        assert(!index.Add(11, "node2", fp_b, 4096, &add));
+        // 指纹相同而大小不同：不去重，也不入索引
+        assert(index.Add(20, "node1", fp_a, 100, &add));
+        assert(!add.duplicate && add.location.chunk_id == 20);
+        assert(!index.Resolve(20, &loc));
+        // 非法参数
+        assert(!index.Add(0, "node1", fp_b, 1, &add));
+        assert(!index.Add(21, "bad node", fp_b, 1, &add));
+
+        auto stats = index.GetStats();
+        assert(stats.fingerprints == 1);
+        assert(stats.references == 4);
+        assert(stats.logical_bytes == 4 * 4096);
+        assert(stats.stored_bytes == 4096);
+        assert(stats.hits == 3);
+
+        // 引用者带 discard：直接解除
+        DedupIndex::ReleasePlan plan;
+        assert(index.Release(13, /*discard=*/true, 0, &plan));
+        assert(plan.released);
+        assert(!index.Resolve(13, &loc));
+
+        // 引用者不带 discard：先拷回自己的 chunk，再确认解除
+        assert(index.Release(12, false, 0, &plan));
+        assert(!plan.released && !plan.busy);
+        assert(plan.from.chunk_id == 10 && plan.to.node_id == "node3" && plan.to.chunk_id == 12);
+        assert(plan.size_bytes == 4096);
+        // 引用者拷贝未完成：持有者不能交接
+        assert(index.Release(10, false, 0, &plan));
+        assert(plan.busy);
+        assert(index.Release(12, false, 12, &plan));
+        assert(plan.released);
+
+        // 其他引用者仍打开着文件：持有者不能交接
+        std::set<uint64_t> open = {11};
+        auto in_use = [&open](uint64_t ino) { return open.count(ino) != 0; };
+        assert(index.Release(10, false, 0, &plan, in_use));
+        assert(plan.busy && !plan.released);
+        open.clear();
+
+        // 持有者交接：数据拷给继承者期间，继承者不能解除
+        assert(index.Release(10, false, 0, &plan, in_use));
+        assert(!plan.released && !plan.busy);
+        assert(plan.from.chunk_id == 10 && plan.to.node_id == "node2" && plan.to.chunk_id == 11);
+        assert(index.Release(11, true, 0, &plan));
+        assert(plan.busy && !plan.released);
+        assert(index.Release(10, false, 11, &plan, in_use));
+        assert(plan.released);
+        assert(!index.Resolve(10, &loc));
+        assert(index.Resolve(11, &loc) && loc.node_id == "node2" && loc.chunk_id == 11);
+
+        // 继承者成为持有者；再有引用者时仍可去重到它
+        assert(index.Add(14, "node1", fp_a, 4096, &add));
+        assert(add.duplicate && add.location.chunk_id == 11);
+        // 不在索引中的 inode 直接视为已解除
+        assert(index.Release(99, false, 0, &plan) && plan.released);
+
+        assert(index.SetNamespaceEnabled("/ns1", true));
+        assert(index.NamespaceEnabled("/ns1"));
+        assert(!index.NamespaceEnabled("/ns2"));
+    }
+
+    // 重新打开：回放日志后引用、持有者与命名空间开关不变
+    {
+        DedupIndex index(log_path, /*create_new=*/false, /*default_enabled=*/false);
+        DedupIndex::Location loc;
+        assert(index.Resolve(11, &loc) && loc.node_id == "node2" && loc.chunk_id == 11);
+        assert(index.Resolve(14, &loc) && loc.chunk_id == 11);
+        assert(!index.Resolve(10, &loc));
+        assert(!index.Resolve(12, &loc));
+        assert(!index.Resolve(13, &loc));
+        auto stats = index.GetStats();
+        assert(stats.fingerprints == 1);
+        assert(stats.references == 2);
+        assert(stats.stored_bytes == 4096);
+        assert(index.NamespaceEnabled("/ns1"));
+
+        // 最后一个引用解除后内容出索引
+        DedupIndex::ReleasePlan plan;
+        assert(index.Release(14, true, 0, &plan) && plan.released);
+        assert(index.Release(11, false, 0, &plan) && plan.released);
+        assert(index.GetStats().fingerprints == 0);
+    }
+
+    // 拷贝计划到期：放弃交接的持有者不再阻塞继承者
+    {
+        DedupIndex index(log_path, /*create_new=*/true, false, std::chrono::milliseconds(20));
+        DedupIndex::AddResult add;
+        DedupIndex::ReleasePlan plan;
+        assert(index.Add(30, "node1", fp_b, 10, &add));
+        assert(index.Add(31, "node1", fp_b, 10, &add) && add.duplicate);
+        assert(index.Release(30, false, 0, &plan) && plan.to.chunk_id == 31);
+        assert(index.Release(31, true, 0, &plan) && plan.busy);
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        assert(index.Release(31, true, 0, &plan) && plan.released);
+        // 拷贝目标已不在索引中，持有者的确认不会改指
+        assert(index.Release(30, false, 31, &plan) && plan.released);
+        assert(index.GetStats().references == 0);
+    }
+
+    clean_path(base);
+    std::cout << "[DEDUP UT] all tests passed." << std::endl;
+    return 0;
+}
@@ -13,6 +13,16 @@ int decode_year_offset(uint32_t stored) {
     return 2000 + static_cast<int>(stored & 0xFF);
 }
 
+// 公历日期 -> 自 1970-01-01 起的天数（Howard Hinnant days_from_civil）
+int64_t days_from_civil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<int64_t>(era) * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
 } // namespace
 
 InodeTimestamp::InodeTimestamp() {
@@ -32,4 +42,13 @@ void InodeTimestamp::print() const {
               << static_cast<int>(day) << " "
               << static_cast<int>(hour) << ":"
               << static_cast<int>(minute) << std::endl;
-}
\ No newline at end of file
+}
+uint32_t InodeTimestamp::to_minutes() const {
+    static const int64_t kEpochDays = days_from_civil(2000, 1, 1);
+    unsigned m = month;
+    unsigned d = day;
+    if (m < 1 || m > 12) m = 1;
+    if (d < 1 || d > 31) d = 1;
+    int64_t days = days_from_civil(decode_year_offset(year), m, d) - kEpochDays;
+    return static_cast<uint32_t>(days * 1440 + static_cast<int64_t>(hour) * 60 + minute);
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <iostream>
 #include <ctime>
 
@@ -13,4 +14,7 @@ public:
 
     InodeTimestamp();
     void print() const;
+
+    // 自 2000-01-01 00:00 起的分钟数，便于按粒度比较时间先后
+    uint32_t to_minutes() const;
 };
@@ -23,16 +23,14 @@ void Inode::setBlockId(uint16_t id) {
     im_time = InodeTimestamp();
 }
 
-namespace {
-std::string NormalizeNamespaceId(const std::string& id) {
-    if (id.size() == Inode::kNamespaceIdLen) {
+std::string Inode::NormalizeNamespaceId(const std::string& id) {
+    if (id.size() == kNamespaceIdLen) {
         return id;
     }
-    if (id.size() > Inode::kNamespaceIdLen) {
-        return id.substr(id.size() - Inode::kNamespaceIdLen);
+    if (id.size() > kNamespaceIdLen) {
+        return id.substr(id.size() - kNamespaceIdLen);
     }
-    return std::string(Inode::kNamespaceIdLen - id.size(), '0') + id;
-}
+    return std::string(kNamespaceIdLen - id.size(), '0') + id;
 }
 
 void Inode::setNamespaceId(const std::string& id) {
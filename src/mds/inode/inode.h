@@ -172,6 +172,13 @@ public:
 
     static constexpr size_t kNamespaceIdLen = 32;
 
+    /**
+     * @brief 将命名空间标识规整为 kNamespaceIdLen 字节（左侧补 '0'，过长保留尾部）。
+     * @param id 命名空间标识
+     * @return 规整后的命名空间标识
+     */
+    static std::string NormalizeNamespaceId(const std::string& id);
+
     /**
      * @brief 设置文件名。
      * @param name 文件名字符串。
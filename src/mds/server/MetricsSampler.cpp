@@ -0,0 +1,161 @@
+#include "MetricsSampler.h"
+#include "Server.h"
+
+#include <sstream>
+#include <utility>
+
+MdsMetricsSampler::MdsMetricsSampler(std::shared_ptr<MdsServer> mds)
+    : MdsMetricsSampler(std::move(mds), Options()) {}
+
+MdsMetricsSampler::MdsMetricsSampler(std::shared_ptr<MdsServer> mds, Options opts)
+    : mds_(std::move(mds)),
+      opts_(opts),
+      snapshot_(std::make_shared<const std::string>()) {
+    if (opts_.refresh_interval.count() <= 0) {
+        opts_.refresh_interval = std::chrono::milliseconds(1000);
+    }
+    if (mds_) {
+        last_ops_ = mds_->OperationTotals();
+    }
+}
+
+MdsMetricsSampler::~MdsMetricsSampler() {
+    Stop();
+}
+
+void MdsMetricsSampler::Start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    RefreshNow();
+    worker_ = std::thread([this]() { Run(); });
+}
+
+void MdsMetricsSampler::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(wait_mu_);
+    }
+    wait_cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+std::shared_ptr<const std::string> MdsMetricsSampler::Snapshot() const {
+    std::lock_guard<std::mutex> lk(snapshot_mu_);
+    return snapshot_;
+}
+
+void MdsMetricsSampler::RefreshNow() {
+    std::lock_guard<std::mutex> refresh_lk(refresh_mu_);
+    MaybeRefreshColdSample(std::chrono::steady_clock::now());
+    auto next = std::make_shared<const std::string>(Render());
+    std::lock_guard<std::mutex> lk(snapshot_mu_);
+    snapshot_ = std::move(next);
+}
+
+void MdsMetricsSampler::Run() {
+    while (running_.load()) {
+        {
+            std::unique_lock<std::mutex> lk(wait_mu_);
+            wait_cv_.wait_for(lk, opts_.refresh_interval, [this]() { return !running_.load(); });
+        }
+        if (!running_.load()) {
+            break;
+        }
+        RefreshNow();
+    }
+}
+
+void MdsMetricsSampler::MaybeRefreshColdSample(std::chrono::steady_clock::time_point now) {
+    if (!mds_ || opts_.cold_sample_interval.count() <= 0 || opts_.cold_sample_size == 0) {
+        return;
+    }
+    if (cold_sampled_ && now - last_cold_scan_ < opts_.cold_sample_interval) {
+        return;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    cold_sample_ = mds_->CollectColdInodes(opts_.cold_sample_size, 0);
+    auto end = std::chrono::steady_clock::now();
+    last_cold_scan_cost_ = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
+    last_cold_scan_ = end;
+    cold_sampled_ = true;
+}
+
+void MdsMetricsSampler::RenderOperations(std::ostream& os,
+                                         const mds::metrics::OperationMetrics& ops) const {
+    const std::pair<const char*, const mds::metrics::OperationTimeline*> timelines[] = {
+        {"mkdir", &ops.mkdir}, {"create", &ops.create}, {"remove", &ops.remove},
+        {"rmdir", &ops.rmdir}, {"lookup", &ops.lookup}, {"ls", &ops.ls}};
+    os << "# HELP mds_operation_qps Operation QPS per verb\n";
+    os << "# TYPE mds_operation_qps gauge\n";
+    for (const auto& t : timelines) {
+        os << "mds_operation_qps{op=\"" << t.first << "\"} " << t.second->qps << "\n";
+    }
+    os << "# HELP mds_operation_success_rate Operation success rate per verb\n";
+    os << "# TYPE mds_operation_success_rate gauge\n";
+    for (const auto& t : timelines) {
+        os << "mds_operation_success_rate{op=\"" << t.first << "\"} " << t.second->success_rate << "\n";
+    }
+    os << "# HELP mds_operation_failures_total Operation failures per reason\n";
+    os << "# TYPE mds_operation_failures_total counter\n";
+    for (const auto& t : timelines) {
+        for (const auto& r : t.second->failure_reasons) {
+            os << "mds_operation_failures_total{op=\"" << t.first << "\",reason=\"" << r.first << "\"} "
+               << r.second << "\n";
+        }
+    }
+    os << "# HELP mds_operation_latency_seconds Operation latency percentiles over the last refresh window\n";
+    os << "# TYPE mds_operation_latency_seconds gauge\n";
+    for (const auto& t : timelines) {
+        for (const auto& q : t.second->latency_percentiles) {
+            os << "mds_operation_latency_seconds{op=\"" << t.first << "\",quantile=\"" << q.first << "\"} "
+               << q.second << "\n";
+        }
+    }
+}
+
+std::string MdsMetricsSampler::Render() {
+    std::ostringstream os;
+    if (!mds_) {
+        return os.str();
+    }
+    os << "# HELP mds_total_inodes Total inodes in MDS\n";
+    os << "# TYPE mds_total_inodes gauge\n";
+    os << "mds_total_inodes " << mds_->GetTotalInodes() << "\n";
+    os << "# HELP mds_root_inode Root inode id\n";
+    os << "# TYPE mds_root_inode gauge\n";
+    os << "mds_root_inode " << mds_->GetRootInode() << "\n";
+    os << "# HELP mds_namespace_files Regular files in namespace\n";
+    os << "# TYPE mds_namespace_files gauge\n";
+    os << "mds_namespace_files " << mds_->GetFileCount() << "\n";
+    os << "# HELP mds_namespace_directories Directories in namespace\n";
+    os << "# TYPE mds_namespace_directories gauge\n";
+    os << "mds_namespace_directories " << mds_->GetDirectoryCount() << "\n";
+    // 窗口由采样器自己保存，其他 collect_snapshot 调用方不会影响 QPS 与分位数
+    auto ops = mds_->OperationTotals();
+    RenderOperations(os, mds::metrics::OperationRecorder::Window(last_ops_, ops));
+    last_ops_ = ops;
+    if (cold_sampled_) {
+        os << "# HELP mds_cold_inode_sample Cold inode sample (value=inode id)\n";
+        os << "# TYPE mds_cold_inode_sample gauge\n";
+        for (size_t i = 0; i < cold_sample_.size(); ++i) {
+            os << "mds_cold_inode_sample{slot=\"" << i << "\"} " << cold_sample_[i] << "\n";
+        }
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - last_cold_scan_);
+        os << "# HELP mds_cold_inode_sample_age_seconds Seconds since the cold inode sample was taken\n";
+        os << "# TYPE mds_cold_inode_sample_age_seconds gauge\n";
+        os << "mds_cold_inode_sample_age_seconds " << age.count() << "\n";
+        os << "# HELP mds_cold_inode_scan_duration_ms Duration of the last cold inode scan (ms)\n";
+        os << "# TYPE mds_cold_inode_scan_duration_ms gauge\n";
+        os << "mds_cold_inode_scan_duration_ms " << last_cold_scan_cost_.count() << "\n";
+    }
+    if (opts_.render_extra) {
+        opts_.render_extra(os);
+    }
+    return os.str();
+}
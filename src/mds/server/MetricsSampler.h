@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OpRecorder.h"
+#include "ServerMetrics.h"
+
+class MdsServer;
+
+/**
+ * @brief MDS 指标后台采样器。
+ *
+ * 廉价指标（inode 槽位、文件/目录计数、操作吞吐与延迟等）由 MdsServer 增量维护，按 refresh_interval
+ * 渲染为 Prometheus 文本快照；需要全量扫描 inode 文件的冷数据样本则单独按
+ * cold_sample_interval 节流刷新。抓取方只需拷贝最近一次发布的快照，不会触发任何扫描。
+ */
+class MdsMetricsSampler {
+public:
+    struct Options {
+        std::chrono::milliseconds refresh_interval{1000};   ///< 快照重新渲染周期。
+        std::chrono::seconds cold_sample_interval{60};      ///< 冷 inode 样本（全量扫描）刷新周期，0 表示关闭。
+        size_t cold_sample_size = 2;                        ///< 冷 inode 样本数量。
+        std::function<void(std::ostream&)> render_extra;    ///< 追加其他模块的指标（如去重索引），在采样线程中调用。
+    };
+
+    explicit MdsMetricsSampler(std::shared_ptr<MdsServer> mds);
+    MdsMetricsSampler(std::shared_ptr<MdsServer> mds, Options opts);
+    ~MdsMetricsSampler();
+
+    MdsMetricsSampler(const MdsMetricsSampler&) = delete;
+    MdsMetricsSampler& operator=(const MdsMetricsSampler&) = delete;
+
+    /**
+     * @brief 启动后台采样线程（会先同步渲染一次，保证首次抓取即有数据）。
+     */
+    void Start();
+
+    /**
+     * @brief 停止后台采样线程。
+     */
+    void Stop();
+
+    /**
+     * @brief 获取最近一次发布的 Prometheus 文本快照。
+     * @return 只读快照，永不为 nullptr。
+     */
+    std::shared_ptr<const std::string> Snapshot() const;
+
+    /**
+     * @brief 立即重新渲染并发布快照（冷数据样本仍受节流约束）。
+     */
+    void RefreshNow();
+
+private:
+    void Run();
+    void MaybeRefreshColdSample(std::chrono::steady_clock::time_point now);
+    std::string Render();
+    void RenderOperations(std::ostream& os, const mds::metrics::OperationMetrics& ops) const;
+
+    std::shared_ptr<MdsServer> mds_;
+    Options opts_;
+
+    mutable std::mutex snapshot_mu_;
+    std::shared_ptr<const std::string> snapshot_;
+
+    // 渲染状态，由 refresh_mu_ 串行化
+    std::mutex refresh_mu_;
+    std::vector<uint64_t> cold_sample_;
+    std::chrono::steady_clock::time_point last_cold_scan_{};
+    std::chrono::milliseconds last_cold_scan_cost_{0};
+    bool cold_sampled_ = false;
+    mds::metrics::OperationRecorder::Totals last_ops_;  ///< 上一次渲染时的操作累计计数，用于计算窗口。
+
+    std::mutex wait_mu_;
+    std::condition_variable wait_cv_;
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+};
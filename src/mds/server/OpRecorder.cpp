@@ -0,0 +1,167 @@
+#include "OpRecorder.h"
+
+#include <utility>
+
+namespace mds::metrics {
+
+namespace {
+
+OperationTimeline& TimelineOf(OperationMetrics& m, OpType op) {
+    switch (op) {
+    case OpType::kMkdir: return m.mkdir;
+    case OpType::kCreate: return m.create;
+    case OpType::kRemove: return m.remove;
+    case OpType::kRmdir: return m.rmdir;
+    case OpType::kLookup: return m.lookup;
+    case OpType::kLs: default: return m.ls;
+    }
+}
+
+} // namespace
+
+const char* OpTypeName(OpType op) {
+    switch (op) {
+    case OpType::kMkdir: return "mkdir";
+    case OpType::kCreate: return "create";
+    case OpType::kRemove: return "remove";
+    case OpType::kRmdir: return "rmdir";
+    case OpType::kLookup: return "lookup";
+    case OpType::kLs: return "ls";
+    default: return "unknown";
+    }
+}
+
+const char* OpFailureName(OpFailure reason) {
+    switch (reason) {
+    case OpFailure::kInvalidPath: return "invalid_path";
+    case OpFailure::kNotFound: return "not_found";
+    case OpFailure::kAlreadyExists: return "already_exists";
+    case OpFailure::kNotEmpty: return "not_empty";
+    case OpFailure::kNotDirectory: return "not_directory";
+    case OpFailure::kInodeExhausted: return "inode_exhausted";
+    case OpFailure::kIoError: return "io_error";
+    default: return "unknown";
+    }
+}
+
+uint64_t LatencyBuckets::UpperBound(size_t index) {
+    if (index < kSubBuckets) return index + 1;
+    const unsigned exp = static_cast<unsigned>(index / kSubBuckets) + kSubBits - 1;
+    const uint64_t sub = index % kSubBuckets;
+    const uint64_t width = uint64_t{1} << (exp - kSubBits);
+    return ((kSubBuckets + sub) << (exp - kSubBits)) + width;
+}
+
+OperationRecorder::OperationRecorder()
+    : shards_(new Shard[kShards]),
+      created_(std::chrono::steady_clock::now()) {
+    for (size_t s = 0; s < kShards; ++s) {
+        Shard& shard = shards_[s];
+        for (size_t op = 0; op < kOps; ++op) {
+            shard.ok[op].store(0, std::memory_order_relaxed);
+            shard.failed[op].store(0, std::memory_order_relaxed);
+            for (auto& c : shard.failures[op]) c.store(0, std::memory_order_relaxed);
+            for (auto& c : shard.latency[op]) c.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t OperationRecorder::ShardIndex() {
+    static std::atomic<size_t> next{0};
+    thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return index;
+}
+
+void OperationRecorder::Record(OpType op, uint64_t latency_ns, bool ok, OpFailure reason) {
+    const size_t o = static_cast<size_t>(op);
+    if (o >= kOps) return;
+    Shard& shard = shards_[ShardIndex()];
+    if (ok) {
+        shard.ok[o].fetch_add(1, std::memory_order_relaxed);
+    } else {
+        shard.failed[o].fetch_add(1, std::memory_order_relaxed);
+        const size_t r = static_cast<size_t>(reason);
+        if (r < kReasons) shard.failures[o][r].fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.latency[o][LatencyBuckets::IndexOf(latency_ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+OperationRecorder::OpTotals OperationRecorder::Merge(size_t op) const {
+    OpTotals totals;
+    for (size_t s = 0; s < kShards; ++s) {
+        const Shard& shard = shards_[s];
+        totals.ok += shard.ok[op].load(std::memory_order_relaxed);
+        totals.failed += shard.failed[op].load(std::memory_order_relaxed);
+        for (size_t r = 0; r < kReasons; ++r) {
+            totals.failures[r] += shard.failures[op][r].load(std::memory_order_relaxed);
+        }
+        for (size_t b = 0; b < LatencyBuckets::kCount; ++b) {
+            totals.latency[b] += shard.latency[op][b].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+OperationRecorder::Totals OperationRecorder::Snapshot() const {
+    Totals totals;
+    totals.at = std::chrono::steady_clock::now();
+    for (size_t op = 0; op < kOps; ++op) {
+        totals.ops[op] = Merge(op);
+    }
+    return totals;
+}
+
+OperationMetrics OperationRecorder::Window(const Totals& prev, const Totals& cur) {
+    static constexpr std::pair<const char*, double> kQuantiles[] = {
+        {"p50", 0.50}, {"p95", 0.95}, {"p99", 0.99}, {"p999", 0.999}};
+
+    OperationMetrics out;
+    const double window_sec = std::chrono::duration<double>(cur.at - prev.at).count();
+    for (size_t op = 0; op < kOps; ++op) {
+        const OpTotals& now = cur.ops[op];
+        const OpTotals& last = prev.ops[op];
+        OperationTimeline& timeline = TimelineOf(out, static_cast<OpType>(op));
+
+        const uint64_t ok = now.ok - last.ok;
+        const uint64_t failed = now.failed - last.failed;
+        const uint64_t total = ok + failed;
+        timeline.qps = window_sec > 0 ? static_cast<double>(total) / window_sec : 0.0;
+        timeline.success_rate = total ? static_cast<double>(ok) / static_cast<double>(total) : 1.0;
+        for (size_t r = 0; r < kReasons; ++r) {
+            if (now.failures[r]) {
+                timeline.failure_reasons[OpFailureName(static_cast<OpFailure>(r))] = now.failures[r];
+            }
+        }
+
+        if (total) {
+            std::array<uint64_t, LatencyBuckets::kCount> window{};
+            uint64_t samples = 0;
+            for (size_t b = 0; b < LatencyBuckets::kCount; ++b) {
+                window[b] = now.latency[b] - last.latency[b];
+                samples += window[b];
+            }
+            for (const auto& q : kQuantiles) {
+                if (samples == 0) break;
+                const uint64_t rank = static_cast<uint64_t>(q.second * static_cast<double>(samples - 1)) + 1;
+                uint64_t seen = 0;
+                for (size_t b = 0; b < LatencyBuckets::kCount; ++b) {
+                    seen += window[b];
+                    if (seen >= rank) {
+                        timeline.latency_percentiles[q.first] =
+                            static_cast<double>(LatencyBuckets::UpperBound(b)) / 1e9;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return out;
+}
+
+OperationMetrics OperationRecorder::Collect() const {
+    Totals start;
+    start.at = created_;
+    return Window(start, Snapshot());
+}
+
+} // namespace mds::metrics
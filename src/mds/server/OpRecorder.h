@@ -0,0 +1,177 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "ServerMetrics.h"
+
+namespace mds::metrics {
+
+/**
+ * @brief 被统计的 MDS 命名空间操作。
+ */
+enum class OpType : uint8_t {
+    kMkdir = 0,
+    kCreate,
+    kRemove,
+    kRmdir,
+    kLookup,
+    kLs,
+    kCount
+};
+
+/**
+ * @brief 操作失败原因分类（对应 OperationTimeline::failure_reasons 的键）。
+ */
+enum class OpFailure : uint8_t {
+    kInvalidPath = 0,   ///< 路径格式非法。
+    kNotFound,          ///< 目标或父目录不存在。
+    kAlreadyExists,     ///< 目标已存在。
+    kNotEmpty,          ///< 目录非空。
+    kNotDirectory,      ///< 目标不是目录。
+    kInodeExhausted,    ///< inode 分配失败。
+    kIoError,           ///< inode/目录项读写失败。
+    kCount
+};
+
+const char* OpTypeName(OpType op);
+const char* OpFailureName(OpFailure reason);
+
+/**
+ * @brief 对数-线性延迟直方图的分桶规则（纳秒）。
+ *
+ * 每个 2 的幂区间再线性切分为 2^kSubBits 个子桶，相对误差不超过 1/2^kSubBits；
+ * 覆盖 0 ~ 2^(kMaxExponent+1) ns（约 137 秒），更大的值落入最后一个桶。
+ */
+struct LatencyBuckets {
+    static constexpr unsigned kSubBits = 3;
+    static constexpr size_t kSubBuckets = size_t{1} << kSubBits;
+    static constexpr unsigned kMaxExponent = 36;
+    static constexpr size_t kCount = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+    static size_t IndexOf(uint64_t ns) {
+        if (ns < kSubBuckets) return static_cast<size_t>(ns);
+        const unsigned exp = 63u - static_cast<unsigned>(__builtin_clzll(ns));
+        if (exp > kMaxExponent) return kCount - 1;
+        const size_t sub = static_cast<size_t>(ns >> (exp - kSubBits)) & (kSubBuckets - 1);
+        return (exp - kSubBits + 1) * kSubBuckets + sub;
+    }
+
+    /// 桶的上界（不含），用于保守地估计分位数。
+    static uint64_t UpperBound(size_t index);
+};
+
+/**
+ * @brief 操作吞吐/失败/延迟记录器。
+ *
+ * 写路径按线程分片：每个线程固定落到一个缓存行对齐的分片上，只做 relaxed 原子自增，
+ * 不加锁、无跨线程共享写；读路径（Totals）合并所有分片，只读不改。计数始终累计，
+ * 窗口由各消费者自行保存上一次的 Totals 并经 Window 计算，多个消费者互不干扰。
+ */
+class OperationRecorder {
+public:
+    static constexpr size_t kShards = 32;
+    static constexpr size_t kOps = static_cast<size_t>(OpType::kCount);
+    static constexpr size_t kReasons = static_cast<size_t>(OpFailure::kCount);
+
+    /**
+     * @brief 单个操作的累计计数。
+     */
+    struct OpTotals {
+        uint64_t ok = 0;
+        uint64_t failed = 0;
+        std::array<uint64_t, kReasons> failures{};
+        std::array<uint64_t, LatencyBuckets::kCount> latency{};
+    };
+
+    /**
+     * @brief 某一时刻所有操作的累计计数。
+     */
+    struct Totals {
+        std::array<OpTotals, kOps> ops{};
+        std::chrono::steady_clock::time_point at{};
+    };
+
+    OperationRecorder();
+
+    OperationRecorder(const OperationRecorder&) = delete;
+    OperationRecorder& operator=(const OperationRecorder&) = delete;
+
+    /**
+     * @brief 记录一次操作。
+     * @param op 操作类型。
+     * @param latency_ns 耗时（纳秒）。
+     * @param ok 是否成功。
+     * @param reason 失败原因（ok 为 true 时忽略）。
+     */
+    void Record(OpType op, uint64_t latency_ns, bool ok, OpFailure reason);
+
+    /**
+     * @brief 合并所有分片，返回当前累计计数。
+     */
+    Totals Snapshot() const;
+
+    /**
+     * @brief 计算 prev 到 cur 之间窗口内的 QPS、成功率与延迟分位数；失败原因取 cur 的累计值。
+     */
+    static OperationMetrics Window(const Totals& prev, const Totals& cur);
+
+    /**
+     * @brief 自创建以来的操作指标（不影响任何消费者的窗口）。
+     */
+    OperationMetrics Collect() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> ok[kOps];
+        std::atomic<uint64_t> failed[kOps];
+        std::atomic<uint64_t> failures[kOps][kReasons];
+        std::atomic<uint64_t> latency[kOps][LatencyBuckets::kCount];
+    };
+
+    static size_t ShardIndex();
+    OpTotals Merge(size_t op) const;
+
+    std::unique_ptr<Shard[]> shards_;
+    std::chrono::steady_clock::time_point created_;
+};
+
+/**
+ * @brief 操作计时器：构造时取时间戳，析构时写入 OperationRecorder。
+ *
+ * 默认按成功记录；失败分支通过 Fail() 标记原因，Fail() 返回 false 以便直接 return。
+ */
+class OpTimer {
+public:
+    OpTimer(OperationRecorder& recorder, OpType op)
+        : recorder_(recorder), op_(op), start_(std::chrono::steady_clock::now()) {}
+
+    ~OpTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        recorder_.Record(op_,
+                         static_cast<uint64_t>(
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+                         ok_, reason_);
+    }
+
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+
+    bool Fail(OpFailure reason) {
+        ok_ = false;
+        reason_ = reason;
+        return false;
+    }
+
+private:
+    OperationRecorder& recorder_;
+    OpType op_;
+    std::chrono::steady_clock::time_point start_;
+    bool ok_ = true;
+    OpFailure reason_ = OpFailure::kIoError;
+};
+
+} // namespace mds::metrics
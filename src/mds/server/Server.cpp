@@ -13,6 +13,7 @@
 using mds::DirectoryLockGuard;
 using mds::DirectoryLockMode;
 using mds::DirectoryLockTable;
+using mds::metrics::OpFailure;
 
 namespace {
 
@@ -151,25 +152,27 @@ bool MdsServer::CreateRoot() {
 
     std::unique_lock<std::shared_mutex> lk(mtx_namespace_);
     inode_table_[root_path] = ino;
+    dir_count_.fetch_add(1, std::memory_order_relaxed);
     return true;
 }
 
 bool MdsServer::Mkdir(const std::string& path, mode_t mode) {
-    if (path.empty() || path[0] != '/') return false;
+    mds::metrics::OpTimer timer(op_metrics_, mds::metrics::OpType::kMkdir);
+    if (path.empty() || path[0] != '/') return timer.Fail(OpFailure::kInvalidPath);
     size_t last_slash = path.find_last_of('/');
-    if (last_slash == std::string::npos || last_slash == path.length() - 1) return false;
+    if (last_slash == std::string::npos || last_slash == path.length() - 1) return timer.Fail(OpFailure::kInvalidPath);
 
     std::string dirname = path.substr(last_slash + 1);
     std::string parent_path = (last_slash == 0) ? "/" : path.substr(0, last_slash);
 
-    auto parent_ino = LookupIno(parent_path);
-    if (parent_ino == static_cast<uint64_t>(-1)) return false;
+    auto parent_ino = ResolveIno(parent_path);
+    if (parent_ino == static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kNotFound);
     auto parent_inode = std::make_shared<Inode>();
     meta_->get_inode_storage()->read_inode(parent_ino, *parent_inode);
 
     {
         std::shared_lock<std::shared_mutex> lk(mtx_namespace_);
-        if (inode_table_.find(path) != inode_table_.end()) return false;
+        if (inode_table_.find(path) != inode_table_.end()) return timer.Fail(OpFailure::kAlreadyExists);
     }
 
     DirectoryLockGuard parent_dir_guard(dir_lock_table_, parent_ino, DirectoryLockMode::kExclusive);
@@ -185,21 +188,21 @@ bool MdsServer::Mkdir(const std::string& path, mode_t mode) {
     dir_inode->setFmTime(now); dir_inode->setFaTime(now); dir_inode->setFcTime(now);
 
     uint64_t new_inode = meta_->allocate_inode(mode);
-    if (new_inode == 0) return false;
+    if (new_inode == 0) return timer.Fail(OpFailure::kInodeExhausted);
     dir_inode->inode = new_inode;
 
     // 初始化 . 和 ..
     DirectoryEntry self_entry(".", dir_inode->inode, FileType::Directory);
     DirectoryEntry parent_entry("..", parent_ino, FileType::Directory);
-    if (!dir_store_->add(new_inode, self_entry)) return false;
-    if (!dir_store_->add(new_inode, parent_entry)) return false;
+    if (!dir_store_->add(new_inode, self_entry)) return timer.Fail(OpFailure::kIoError);
+    if (!dir_store_->add(new_inode, parent_entry)) return timer.Fail(OpFailure::kIoError);
 
     // 在父目录加入子目录项
     DirectoryEntry new_dir_entry(dirname, new_inode, FileType::Directory);
-    if (!dir_store_->add(parent_ino, new_dir_entry)) return false;
+    if (!dir_store_->add(parent_ino, new_dir_entry)) return timer.Fail(OpFailure::kIoError);
 
-    if (!meta_->get_inode_storage()->write_inode(new_inode, *dir_inode)) return false;
-    if (!meta_->get_inode_storage()->write_inode(parent_ino, *parent_inode)) return false;
+    if (!meta_->get_inode_storage()->write_inode(new_inode, *dir_inode)) return timer.Fail(OpFailure::kIoError);
+    if (!meta_->get_inode_storage()->write_inode(parent_ino, *parent_inode)) return timer.Fail(OpFailure::kIoError);
 
     // If KV is enabled, store path -> inode mapping for the new directory
     if (meta_) {
@@ -208,23 +211,25 @@ bool MdsServer::Mkdir(const std::string& path, mode_t mode) {
 
     std::unique_lock<std::shared_mutex> lk(mtx_namespace_);
     inode_table_[path] = new_inode;
+    dir_count_.fetch_add(1, std::memory_order_relaxed);
     return true;
 }
 
 bool MdsServer::Rmdir(const std::string& path) {
-    auto inode_no = LookupIno(path);
-    if (inode_no == static_cast<uint64_t>(-1)) return false;
+    mds::metrics::OpTimer timer(op_metrics_, mds::metrics::OpType::kRmdir);
+    auto inode_no = ResolveIno(path);
+    if (inode_no == static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kNotFound);
 
     auto inode = std::make_shared<Inode>();
-    if (!meta_->get_inode_storage()->read_inode(inode_no, *inode)) return false;
+    if (!meta_->get_inode_storage()->read_inode(inode_no, *inode)) return timer.Fail(OpFailure::kIoError);
 
     size_t last_slash = path.find_last_of('/');
-    if (last_slash == std::string::npos || last_slash == path.length() - 1) return false;
+    if (last_slash == std::string::npos || last_slash == path.length() - 1) return timer.Fail(OpFailure::kInvalidPath);
     std::string dirname = path.substr(last_slash + 1);
     std::string parent_path = (last_slash == 0) ? "/" : path.substr(0, last_slash);
 
-    auto parent_ino = LookupIno(parent_path);
-    if (parent_ino == static_cast<uint64_t>(-1)) return false;
+    auto parent_ino = ResolveIno(parent_path);
+    if (parent_ino == static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kNotFound);
 
     auto parent_inode = std::make_shared<Inode>();
     meta_->get_inode_storage()->read_inode(parent_ino, *parent_inode);
@@ -236,17 +241,17 @@ bool MdsServer::Rmdir(const std::string& path) {
 
     // 必须为空（仅含.和..）
     std::vector<DirectoryEntry> entries;
-    if (!dir_store_->read(inode_no, entries)) return false;
+    if (!dir_store_->read(inode_no, entries)) return timer.Fail(OpFailure::kIoError);
     size_t non_dot = 0;
     for (auto& e : entries) {
         std::string n(e.name, e.name_len);
         if (n != "." && n != "..") ++non_dot;
     }
-    if (non_dot > 0) return false;
+    if (non_dot > 0) return timer.Fail(OpFailure::kNotEmpty);
 
     // 从父目录删除目录项
-    if (!dir_store_->remove(parent_ino, dirname)) return false;
-    if (!dir_store_->reset(inode_no)) return false;
+    if (!dir_store_->remove(parent_ino, dirname)) return timer.Fail(OpFailure::kIoError);
+    if (!dir_store_->reset(inode_no)) return timer.Fail(OpFailure::kIoError);
 
     {
         std::unique_lock<std::shared_mutex> lk(mtx_namespace_);
@@ -257,22 +262,24 @@ bool MdsServer::Rmdir(const std::string& path) {
         meta_->delete_inode_path(path);
         meta_->mark_inode_free(inode_no);
     }
+    dir_count_.fetch_sub(1, std::memory_order_relaxed);
     return true;
 }
 
 bool MdsServer::CreateFile(const std::string& path, mode_t mode) {
-    if ((LookupIno(path)) != static_cast<uint64_t>(-1)) return false;
-    if (path.empty() || path[0] != '/') return false;
+    mds::metrics::OpTimer timer(op_metrics_, mds::metrics::OpType::kCreate);
+    if ((ResolveIno(path)) != static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kAlreadyExists);
+    if (path.empty() || path[0] != '/') return timer.Fail(OpFailure::kInvalidPath);
     size_t last_slash = path.find_last_of('/');
-    if (last_slash == std::string::npos || last_slash == path.length() - 1) return false;
+    if (last_slash == std::string::npos || last_slash == path.length() - 1) return timer.Fail(OpFailure::kInvalidPath);
 
     std::string filename = path.substr(last_slash + 1);
     std::string parent_path = (last_slash == 0) ? "/" : path.substr(0, last_slash);
 
-    auto parent_ino = LookupIno(parent_path);
+    auto parent_ino = ResolveIno(parent_path);
     if (parent_ino == static_cast<uint64_t>(-1)) {
         std::cerr << "[MDS] CreateFile parent missing: " << parent_path << std::endl;
-        return false;
+        return timer.Fail(OpFailure::kNotFound);
     }
 
     auto parent_inode = std::make_shared<Inode>();
@@ -291,7 +298,7 @@ bool MdsServer::CreateFile(const std::string& path, mode_t mode) {
     new_inode->inode = meta_->allocate_inode(mode);
     if (new_inode->inode == static_cast<uint64_t>(-1)) {
         std::cerr << "[MDS] CreateFile allocate_inode failed for " << path << std::endl;
-        return false;
+        return timer.Fail(OpFailure::kInodeExhausted);
     }
 
     // 为 inode 分配卷（如果 MDS 配置了 volume allocator）
@@ -305,14 +312,14 @@ bool MdsServer::CreateFile(const std::string& path, mode_t mode) {
     DirectoryEntry file_entry(filename, new_inode->inode, FileType::Regular);
     if (!dir_store_->add(parent_ino, file_entry)) {
         std::cerr << "[MDS] CreateFile dir_store add failed for " << path << std::endl;
-        return false;
+        return timer.Fail(OpFailure::kIoError);
     }
 
     if (!meta_->get_inode_storage()->write_inode(new_inode->inode, *new_inode)) {
         std::unique_lock<std::shared_mutex> lk(mtx_namespace_);
         inode_table_.erase(path);
         std::cerr << "[MDS] CreateFile write_inode failed for " << path << std::endl;
-        return false;
+        return timer.Fail(OpFailure::kIoError);
     }
 
     // KV sync: store path -> inode mapping when creating a file
@@ -324,30 +331,32 @@ bool MdsServer::CreateFile(const std::string& path, mode_t mode) {
 
     std::unique_lock<std::shared_mutex> lk(mtx_namespace_);
     inode_table_[path] = new_inode->inode;
+    file_count_.fetch_add(1, std::memory_order_relaxed);
     return true;
 }
 
 bool MdsServer::RemoveFile(const std::string& path) {
-    auto inode_no = LookupIno(path);
-    if (inode_no == static_cast<uint64_t>(-1)) return false;
+    mds::metrics::OpTimer timer(op_metrics_, mds::metrics::OpType::kRemove);
+    auto inode_no = ResolveIno(path);
+    if (inode_no == static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kNotFound);
 
     auto inode = std::make_shared<Inode>();
-    if (!meta_->get_inode_storage()->read_inode(inode_no, *inode)) return false;
+    if (!meta_->get_inode_storage()->read_inode(inode_no, *inode)) return timer.Fail(OpFailure::kIoError);
 
     size_t last_slash = path.find_last_of('/');
-    if (last_slash == std::string::npos || last_slash == path.length() - 1) return false;
+    if (last_slash == std::string::npos || last_slash == path.length() - 1) return timer.Fail(OpFailure::kInvalidPath);
     std::string filename = path.substr(last_slash + 1);
     std::string parent_path = (last_slash == 0) ? "/" : path.substr(0, last_slash);
 
-    auto parent_ino = LookupIno(parent_path);
-    if (parent_ino == static_cast<uint64_t>(-1)) return false;
+    auto parent_ino = ResolveIno(parent_path);
+    if (parent_ino == static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kNotFound);
 
     auto parent_inode = std::make_shared<Inode>();
     meta_->get_inode_storage()->read_inode(parent_ino, *parent_inode);
 
     DirectoryLockGuard parent_dir_guard(dir_lock_table_, parent_ino, DirectoryLockMode::kExclusive);
 
-    if (!dir_store_->remove(parent_ino, filename)) return false;
+    if (!dir_store_->remove(parent_ino, filename)) return timer.Fail(OpFailure::kNotFound);
 
     bool released = false;
     if (volume_manager_) {
@@ -367,18 +376,20 @@ bool MdsServer::RemoveFile(const std::string& path) {
         meta_->delete_inode_path(path);
         meta_->mark_inode_free(inode_no);
     }
+    file_count_.fetch_sub(1, std::memory_order_relaxed);
     // NOTE: 文件数据块释放上面已尝试执行
     return true;
 }
 
 bool MdsServer::Ls(const std::string& path) {
-    auto ino = LookupIno(path);
-    if (ino == static_cast<uint64_t>(-1)) return false;
+    mds::metrics::OpTimer timer(op_metrics_, mds::metrics::OpType::kLs);
+    auto ino = ResolveIno(path);
+    if (ino == static_cast<uint64_t>(-1)) return timer.Fail(OpFailure::kNotFound);
 
     auto inode = std::make_shared<Inode>();
-    if (!meta_->get_inode_storage()->read_inode(ino, *inode)) return false;
+    if (!meta_->get_inode_storage()->read_inode(ino, *inode)) return timer.Fail(OpFailure::kIoError);
 
-    if (inode->file_mode.fields.file_type != static_cast<uint8_t>(FileType::Directory)) return false;
+    if (inode->file_mode.fields.file_type != static_cast<uint8_t>(FileType::Directory)) return timer.Fail(OpFailure::kNotDirectory);
 
     auto entries = ReadDirectoryEntries(inode);
     std::cout << "[LS] 目录: " << path << " (inode: " << ino << ")" << std::endl;
@@ -391,6 +402,13 @@ bool MdsServer::Ls(const std::string& path) {
 }
 
 uint64_t MdsServer::LookupIno(const std::string& abs_path) {
+    mds::metrics::OpTimer timer(op_metrics_, mds::metrics::OpType::kLookup);
+    auto ino = ResolveIno(abs_path);
+    if (ino == static_cast<uint64_t>(-1)) timer.Fail(OpFailure::kNotFound);
+    return ino;
+}
+
+uint64_t MdsServer::ResolveIno(const std::string& abs_path) {
     {
         std::shared_lock<std::shared_mutex> lk(mtx_namespace_);
         auto it = inode_table_.find(abs_path);
@@ -468,6 +486,44 @@ uint64_t MdsServer::GetTotalInodes() const {
     return meta_ ? meta_->get_total_inodes() : 0;
 }
 
+uint64_t MdsServer::GetFileCount() const {
+    return file_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t MdsServer::GetDirectoryCount() const {
+    return dir_count_.load(std::memory_order_relaxed);
+}
+
+mds::metrics::ServerMetricsSnapshot MdsServer::collect_snapshot() const {
+    mds::metrics::ServerMetricsSnapshot snapshot;
+    snapshot.namespace_scale.total_files = GetFileCount();
+    snapshot.namespace_scale.total_directories = GetDirectoryCount();
+    snapshot.inode_pool.total_slots = GetTotalInodes();
+    // 每个文件/目录恰占一个 inode，已分配槽位即命名空间规模之和
+    snapshot.inode_pool.allocated_slots =
+        snapshot.namespace_scale.total_files + snapshot.namespace_scale.total_directories;
+    snapshot.operations = op_metrics_.Collect();
+    const char* exhausted = mds::metrics::OpFailureName(OpFailure::kInodeExhausted);
+    uint64_t alloc_failures = 0;
+    for (const auto* timeline : {&snapshot.operations.mkdir, &snapshot.operations.create}) {
+        auto it = timeline->failure_reasons.find(exhausted);
+        if (it != timeline->failure_reasons.end()) alloc_failures += it->second;
+    }
+    snapshot.inode_pool.allocation_failures = alloc_failures;
+    if (alloc_failures) {
+        snapshot.inode_pool.failure_reason_breakdown[exhausted] = alloc_failures;
+    }
+    {
+        std::shared_lock<std::shared_mutex> lk(mtx_namespace_);
+        snapshot.cache.current_entries = inode_table_.size();
+    }
+    return snapshot;
+}
+
+mds::metrics::OperationRecorder::Totals MdsServer::OperationTotals() const {
+    return op_metrics_.Snapshot();
+}
+
 bool MdsServer::IsInodeAllocated(uint64_t ino) {
     return meta_ ? meta_->is_inode_allocated(ino) : false;
 }
@@ -488,6 +544,162 @@ bool MdsServer::WriteInode(uint64_t ino, const Inode& in) {
     return st ? st->write_inode(ino, in) : false;
 }
 
+// ========== 文件大小更新与客户端租约 ==========
+
+namespace {
+
+// 按 inode 的 unit/value 编码写入大小（值向上取整到对应单位）
+void encode_file_size(Inode& inode, uint64_t size_bytes) {
+    uint16_t unit = 0;
+    uint16_t value = 0;
+    if (size_bytes <= 16383ULL) {
+        unit = 0;
+        value = static_cast<uint16_t>(size_bytes);
+    } else if (size_bytes <= 16383ULL * 1024ULL) {
+        unit = 1;
+        value = static_cast<uint16_t>((size_bytes + 1023ULL) / 1024ULL);
+    } else if (size_bytes <= 16383ULL * 1024ULL * 1024ULL) {
+        unit = 2;
+        value = static_cast<uint16_t>((size_bytes + 1024ULL * 1024ULL - 1) / (1024ULL * 1024ULL));
+    } else {
+        unit = 3;
+        uint64_t gb = 1024ULL * 1024ULL * 1024ULL;
+        uint64_t v = (size_bytes + gb - 1) / gb;
+        if (v > 16383ULL) v = 16383ULL;
+        value = static_cast<uint16_t>(v);
+    }
+    inode.setSizeUnit(unit);
+    inode.setFileSize(value);
+}
+
+} // namespace
+
+bool MdsServer::ApplyFileSize(uint64_t ino, uint64_t size_bytes, bool absolute) {
+    Inode inode;
+    if (!ReadInode(ino, inode)) return false;
+    if (!absolute) {
+        if (size_bytes <= inode.getFileSize()) return true;
+    }
+    encode_file_size(inode, size_bytes);
+    inode.setFmTime(InodeTimestamp());
+    return WriteInode(ino, inode);
+}
+
+bool MdsServer::UpdateFileSize(uint64_t ino, uint64_t size_bytes, bool extend_only) {
+    std::unique_lock<std::mutex> lk(size_mu_);
+    auto& pending = pending_sizes_[ino];
+    if (extend_only) {
+        pending.size_bytes = std::max(pending.size_bytes, size_bytes);
+    } else {
+        pending.size_bytes = size_bytes;
+        pending.absolute = true;
+    }
+    const uint64_t my_seq = ++pending.requested;
+    ++pending.waiters;
+    while (pending.committed < my_seq) {
+        if (pending.flushing) {
+            size_cv_.wait(lk);
+            continue;
+        }
+        // 成为本批次的提交者：取走已合并的更新，释放锁后落盘
+        pending.flushing = true;
+        const uint64_t batch_seq = pending.requested;
+        const uint64_t batch_size = pending.size_bytes;
+        const bool batch_absolute = pending.absolute;
+        pending.size_bytes = 0;
+        pending.absolute = false;
+        lk.unlock();
+        bool ok = ApplyFileSize(ino, batch_size, batch_absolute);
+        lk.lock();
+        pending.flushing = false;
+        pending.committed = batch_seq;
+        pending.last_ok = ok;
+        size_cv_.notify_all();
+    }
+    const bool ok = pending.last_ok;
+    if (--pending.waiters == 0 && !pending.flushing && pending.committed == pending.requested) {
+        pending_sizes_.erase(ino);
+    }
+    return ok;
+}
+
+bool MdsServer::AcquireSizeLease(uint64_t ino,
+                                 const std::string& client_id,
+                                 std::chrono::milliseconds lease,
+                                 bool release,
+                                 bool dirty,
+                                 SizeLeaseGrant& out) {
+    out = SizeLeaseGrant{};
+    Inode inode;
+    if (!ReadInode(ino, inode)) return false;
+
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lk(lease_mu_);
+        auto& holders = size_leases_[ino];
+        for (auto it = holders.begin(); it != holders.end();) {
+            if (it->second.expires <= now) {
+                it = holders.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (release) {
+            holders.erase(client_id);
+            out.shared = holders.size() > 1;
+            if (holders.empty()) {
+                size_leases_.erase(ino);
+            }
+            out.size_bytes = inode.getFileSize();
+            return true;
+        }
+
+        auto& self = holders[client_id];
+        self.expires = now + lease;
+        if (holders.size() == 1) {
+            // 唯一持有者：授予（或恢复）独占
+            self.exclusive = true;
+            self.recalled = false;
+            out.shared = false;
+        } else {
+            // 召回其他独占持有者；它们确认之前不向新申请者授予
+            bool blocked = false;
+            for (auto& [id, h] : holders) {
+                if (id == client_id || !h.exclusive) continue;
+                h.recalled = true;
+                blocked = true;
+            }
+            out.shared = true;
+            if (self.exclusive) {
+                // 被召回的持有者续约：提交完积压的大小（dirty=false）才算交回
+                self.recalled = true;
+                if (!dirty) {
+                    self.exclusive = false;
+                    self.recalled = false;
+                }
+            } else if (blocked) {
+                out.pending = true;
+                return true;
+            }
+        }
+    }
+    // 授予后再读大小：被召回的持有者可能刚提交完积压的大小
+    if (!ReadInode(ino, inode)) return false;
+    out.size_bytes = inode.getFileSize();
+    return true;
+}
+
+bool MdsServer::HasSizeLease(uint64_t ino) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(lease_mu_);
+    auto it = size_leases_.find(ino);
+    if (it == size_leases_.end()) return false;
+    for (const auto& kv : it->second) {
+        if (kv.second.expires > now) return true;
+    }
+    return false;
+}
+
 // ========== 冷数据扫描（不依赖客户端 AccessTracker，基于 atime 全量排序） ==========
 
 std::vector<uint64_t> MdsServer::CollectColdInodes(size_t max_candidates, size_t /*min_age_windows*/) {
@@ -573,6 +785,8 @@ std::vector<uint64_t> MdsServer::CollectColdInodesByAtimePercent(double percent)
 
 void MdsServer::RebuildInodeTable() {
     std::unordered_map<std::string, uint64_t> rebuilt;
+    uint64_t files = 0;
+    uint64_t dirs = 0;
     if (meta_) {
         auto inode_storage = meta_->get_inode_storage();
         uint64_t inode_count = meta_->get_total_inodes();
@@ -583,6 +797,11 @@ void MdsServer::RebuildInodeTable() {
             if (!inode_storage->read_inode(i, inode)) continue;
             if (inode.filename.empty()) continue;
             rebuilt[inode.filename] = inode.inode;
+            if (inode.file_mode.fields.file_type == static_cast<uint16_t>(FileType::Directory)) {
+                ++dirs;
+            } else {
+                ++files;
+            }
         }
     }
 
@@ -591,6 +810,9 @@ void MdsServer::RebuildInodeTable() {
         std::unique_lock<std::shared_mutex> lk(mtx_namespace_);
         inode_table_ = std::move(rebuilt);
     }
+    // 重建时顺带校准增量计数
+    file_count_.store(files, std::memory_order_relaxed);
+    dir_count_.store(dirs, std::memory_order_relaxed);
     std::cout << "[MDS] inode_table 重建完成，文件数: " << rebuilt_size << std::endl;
 }
 
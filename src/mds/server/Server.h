@@ -1,5 +1,9 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <shared_mutex>
@@ -9,6 +13,8 @@
 #include "../metadataserver/MetadataManager.h"
 #include "DirStore.h"
 #include "DirectoryLockTable.h"
+#include "OpRecorder.h"
+#include "ServerMetrics.h"
 #include "../../fs/volume/VolumeRegistry.h"
 #include "../../fs/volume/VolumeManager.h"
 #include "../allocator/VolumeAllocator.h"
@@ -34,7 +40,7 @@ public:
     virtual void CloseHandlesForInode(uint64_t inode) = 0;
 };
 
-class MdsServer {
+class MdsServer : public mds::metrics::IMetricsProvider {
 private:
     std::unique_ptr<MetadataManager> meta_;
     std::unique_ptr<DirStore> dir_store_;
@@ -46,6 +52,49 @@ private:
     std::unique_ptr<VolumeAllocator> volume_allocator_;
     std::shared_ptr<VolumeManager> volume_manager_;
     std::weak_ptr<IHandleObserver> handle_observer_;
+    // 命名空间规模计数，随 mkdir/create/remove/rmdir 增量维护，避免指标采集时扫描 inode 文件
+    std::atomic<uint64_t> file_count_{0};
+    std::atomic<uint64_t> dir_count_{0};
+    // 命名空间操作的吞吐/失败/延迟记录（按线程分片）
+    mds::metrics::OperationRecorder op_metrics_;
+
+    /**
+     * @brief 私有：解析路径对应 inode 号，不计入 lookup 指标（供内部复合操作使用）。
+     */
+    uint64_t ResolveIno(const std::string& abs_path);
+
+    // UpdateFileSize 组提交：同一 inode 上并发到达的大小更新合并为一次 inode 读-改-写
+    struct PendingSizeUpdate {
+        uint64_t size_bytes = 0;
+        bool absolute = false;     ///< 批内含绝对设置（截断）时为 true，此时以 size_bytes 覆盖
+        uint64_t requested = 0;    ///< 已登记的请求序号
+        uint64_t committed = 0;    ///< 已落盘覆盖到的请求序号
+        bool flushing = false;     ///< 是否有线程正在落盘本 inode
+        bool last_ok = true;       ///< 最近一次落盘结果
+        size_t waiters = 0;        ///< 正在等待的请求数，为 0 时可回收条目
+    };
+    std::mutex size_mu_;
+    std::condition_variable size_cv_;
+    std::unordered_map<uint64_t, PendingSizeUpdate> pending_sizes_;
+
+    /**
+     * @brief 单个客户端在某 inode 上的大小租约状态。
+     */
+    struct SizeLeaseHolder {
+        std::chrono::steady_clock::time_point expires; ///< 到期时间
+        bool exclusive = false;    ///< 已以独占方式授予，可能在本地积压未提交的大小
+        bool recalled = false;     ///< 有其他客户端申请，等待该持有者提交并确认
+    };
+    // 客户端大小租约：inode -> (client_id -> 持有状态)
+    std::mutex lease_mu_;
+    std::unordered_map<uint64_t,
+        std::unordered_map<std::string, SizeLeaseHolder>> size_leases_;
+
+    /**
+     * @brief 私有：将合并后的大小写入 inode。
+     * @param absolute 为 false 时只允许增大文件。
+     */
+    bool ApplyFileSize(uint64_t ino, uint64_t size_bytes, bool absolute);
 
     /**
      * @brief 私有：通知已注册的句柄观察者关闭 inode 关联句柄。
@@ -118,6 +167,52 @@ public:
      */
     bool TruncateFile(const std::string& path);
 
+    /**
+     * @brief 更新文件大小（组提交）。同一 inode 上并发的多次更新合并为一次 inode 写，
+     *        调用在覆盖本次请求的那次落盘完成后返回。
+     * @param ino inode 号。
+     * @param size_bytes 新大小（字节）。
+     * @param extend_only 为 true 时仅在大于当前大小时生效（写扩展）；为 false 时按绝对值设置（截断）。
+     * @return 成功返回 true。
+     */
+    bool UpdateFileSize(uint64_t ino, uint64_t size_bytes, bool extend_only = false);
+
+    /**
+     * @brief 客户端大小租约的授予结果。
+     */
+    struct SizeLeaseGrant {
+        uint64_t size_bytes = 0;   ///< MDS 当前记录的文件大小。
+        bool shared = false;       ///< 存在其他持有者时为 true，客户端应退化为同步更新大小。
+        bool pending = false;      ///< 独占持有者尚未交回租约，本次不授予、不返回大小，客户端应稍后重试。
+    };
+
+    /**
+     * @brief 申请/续约/释放某 inode 的大小租约。
+     *
+     * 独占持有租约的客户端可在本地累积大小更新并延迟批量提交。其他客户端申请时，
+     * MDS 召回独占租约：新申请者收到 pending，既不获得租约也不拿到大小；独占持有者
+     * 在下一次续约时收到 shared，提交积压的大小后以 dirty=false 再次续约确认，
+     * 此后新申请者重试即可获得授予与最新大小。持有者不再续约时，租约到期同样解除召回。
+     * @param ino inode 号。
+     * @param client_id 客户端标识。
+     * @param lease 租约时长，到期未续约的持有者被视为已释放。
+     * @param release 为 true 时释放租约。
+     * @param dirty 续约的客户端可能仍有未提交的大小更新（仍在本地批量累积时为 true）。
+     * @param out 授予结果。
+     * @return inode 不存在时返回 false。
+     */
+    bool AcquireSizeLease(uint64_t ino,
+                          const std::string& client_id,
+                          std::chrono::milliseconds lease,
+                          bool release,
+                          bool dirty,
+                          SizeLeaseGrant& out);
+
+    /**
+     * @brief inode 是否有未到期的大小租约，即仍有客户端打开着它。
+     */
+    bool HasSizeLease(uint64_t ino);
+
     /**
      * @brief 列目录内容。
      * @param path 绝对路径。
@@ -174,6 +269,29 @@ public:
      */
     uint64_t GetTotalInodes() const;
 
+    /**
+     * @brief 获取当前文件数量（增量维护，O(1)）。
+     * @return 普通文件数。
+     */
+    uint64_t GetFileCount() const;
+
+    /**
+     * @brief 获取当前目录数量（含根目录，增量维护，O(1)）。
+     * @return 目录数。
+     */
+    uint64_t GetDirectoryCount() const;
+
+    /**
+     * @brief 采集指标快照：命名空间规模、inode 槽位、操作吞吐/失败/延迟分位与路径缓存。
+     *        操作指标为自启动以来的累计值；需要滑动窗口的消费者使用 OperationTotals。
+     */
+    mds::metrics::ServerMetricsSnapshot collect_snapshot() const override;
+
+    /**
+     * @brief 操作计数的累计快照，消费者保存上一次的值并经 OperationRecorder::Window 计算窗口。
+     */
+    mds::metrics::OperationRecorder::Totals OperationTotals() const;
+
     /**
      * @brief 注入卷注册中心，供 MDS 在创建/删除文件时进行卷分配与块回收。
      */
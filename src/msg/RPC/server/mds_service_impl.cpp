@@ -11,6 +11,8 @@
 #include <unordered_map>
 #include "mds.pb.h"
 #include "../../../src/mds/server/Server.h"
+#include "../../../src/mds/server/MetricsSampler.h"
+#include "../../../src/mds/dedup/DedupIndex.h"
 #include "../../../src/fs/volume/VolumeRegistry.h"
 #include "common/StatusUtils.h"
 #include "common/LogRedirect.h"
@@ -22,6 +24,11 @@ DEFINE_string(mds_data_dir, "/tmp/mds_rpc", "Base dir for inode/bitmap/dir_store
 DEFINE_bool(mds_create_new, true, "Create new metadata store");
 DEFINE_string(node_alloc_policy, "prefer_real", "Node allocation policy: prefer_real|prefer_virtual|round_robin");
 DEFINE_bool(enable_volume_registry, false, "Enable legacy volume registry/allocator");
+DEFINE_int32(mds_metrics_refresh_ms, 1000, "Interval (ms) to re-render the cached Prometheus snapshot");
+DEFINE_int32(mds_cold_sample_interval_sec, 60, "Interval (s) between cold inode sample scans, 0 disables");
+DEFINE_int32(mds_size_lease_ms, 5000, "Client size lease duration (ms); clients renew before expiry");
+DEFINE_bool(dedup_default, false, "Deduplicate chunks in namespaces without their own SetNamespaceDedup switch");
+DEFINE_int32(dedup_copy_timeout_ms, 60000, "Time (ms) a client gets to finish a ReleaseDedup copy before the plan lapses");
 DEFINE_string(log_file, "", "Log file path (append). Empty = stdout/stderr");
 
 namespace {
@@ -104,6 +111,16 @@ public:
         }
         // Ensure root inode exists to avoid later I/O errors when accessing "/"
         mds_->CreateRoot();
+
+        dedup_ = std::make_unique<DedupIndex>(base_dir_ + "/dedup.log", create_new, FLAGS_dedup_default,
+                                              std::chrono::milliseconds(FLAGS_dedup_copy_timeout_ms));
+
+        MdsMetricsSampler::Options metrics_opts;
+        metrics_opts.refresh_interval = std::chrono::milliseconds(FLAGS_mds_metrics_refresh_ms);
+        metrics_opts.cold_sample_interval = std::chrono::seconds(FLAGS_mds_cold_sample_interval_sec);
+        metrics_opts.render_extra = [this](std::ostream& os) { dedup_->RenderProm(os); };
+        metrics_sampler_ = std::make_unique<MdsMetricsSampler>(mds_, metrics_opts);
+        metrics_sampler_->Start();
     }
 
     void CreateRoot(::google::protobuf::RpcController*,
@@ -171,6 +188,16 @@ public:
                     ::google::protobuf::Closure* done) override {
         brpc::ClosureGuard guard(done);
         uint64_t ino = mds_->LookupIno(request->path());
+        if (ino != static_cast<uint64_t>(-1)) {
+            // 去重内容的持有者须先把数据交给其他引用者（客户端 ReleaseDedup），否则删除会让它们失去数据
+            DedupIndex::ReleasePlan plan;
+            if (!dedup_->Release(ino, true, 0, &plan) || !plan.released) {
+                StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_INVALID_ARGUMENT,
+                                       "content shared; release it first");
+                LogRequest("RemoveFile", request->path(), response->mutable_status());
+                return;
+            }
+        }
         bool ok = mds_->RemoveFile(request->path());
         response->mutable_status()->CopyFrom(ToStatus(ok));
         if (ok && ino != static_cast<uint64_t>(-1)) {
@@ -198,35 +225,13 @@ public:
             LogRequest("UpdateFileSize", "<invalid>", response);
             return;
         }
-        Inode inode;
-        if (!mds_->ReadInode(request->inode(), inode)) {
+        if (!mds_->IsInodeAllocated(request->inode())) {
             StatusUtils::SetStatus(response, rpc::STATUS_NODE_NOT_FOUND, "inode not found");
             LogRequest("UpdateFileSize", std::to_string(request->inode()), response);
             return;
         }
-        const uint64_t size_bytes = request->size_bytes();
-        uint16_t unit = 0;
-        uint16_t value = 0;
-        if (size_bytes <= 16383ULL) {
-            unit = 0;
-            value = static_cast<uint16_t>(size_bytes);
-        } else if (size_bytes <= 16383ULL * 1024ULL) {
-            unit = 1;
-            value = static_cast<uint16_t>((size_bytes + 1023ULL) / 1024ULL);
-        } else if (size_bytes <= 16383ULL * 1024ULL * 1024ULL) {
-            unit = 2;
-            value = static_cast<uint16_t>((size_bytes + 1024ULL * 1024ULL - 1) / (1024ULL * 1024ULL));
-        } else {
-            unit = 3;
-            uint64_t gb = 1024ULL * 1024ULL * 1024ULL;
-            uint64_t v = (size_bytes + gb - 1) / gb;
-            if (v > 16383ULL) v = 16383ULL;
-            value = static_cast<uint16_t>(v);
-        }
-        inode.setSizeUnit(unit);
-        inode.setFileSize(value);
-        inode.setFmTime(InodeTimestamp());
-        if (!mds_->WriteInode(request->inode(), inode)) {
+        // 同一 inode 的并发更新在 MdsServer 内合并为一次 inode 写
+        if (!mds_->UpdateFileSize(request->inode(), request->size_bytes(), request->extend_only())) {
             StatusUtils::SetStatus(response, rpc::STATUS_IO_ERROR, "write inode failed");
             LogRequest("UpdateFileSize", std::to_string(request->inode()), response);
             return;
@@ -235,6 +240,33 @@ public:
         LogRequest("UpdateFileSize", std::to_string(request->inode()), response);
     }
 
+    void AcquireSizeLease(::google::protobuf::RpcController*,
+                          const rpc::SizeLeaseRequest* request,
+                          rpc::SizeLeaseReply* response,
+                          ::google::protobuf::Closure* done) override {
+        brpc::ClosureGuard guard(done);
+        if (!request || request->inode() == 0 || request->client_id().empty()) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_INVALID_ARGUMENT,
+                                   "missing inode or client id");
+            LogRequest("AcquireSizeLease", "<invalid>", response->mutable_status());
+            return;
+        }
+        MdsServer::SizeLeaseGrant grant;
+        const auto lease = std::chrono::milliseconds(FLAGS_mds_size_lease_ms);
+        if (!mds_->AcquireSizeLease(request->inode(), request->client_id(), lease,
+                                    request->release(), request->dirty(), grant)) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_NODE_NOT_FOUND, "inode not found");
+            LogRequest("AcquireSizeLease", std::to_string(request->inode()), response->mutable_status());
+            return;
+        }
+        response->set_size_bytes(grant.size_bytes);
+        response->set_lease_ms(static_cast<uint32_t>(FLAGS_mds_size_lease_ms));
+        response->set_shared(grant.shared);
+        response->set_pending(grant.pending);
+        StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_SUCCESS, "");
+        LogRequest("AcquireSizeLease", std::to_string(request->inode()), response->mutable_status());
+    }
+
     void Ls(::google::protobuf::RpcController*,
             const rpc::PathRequest* request,
             rpc::DirectoryListReply* response,
@@ -292,6 +324,11 @@ public:
         SerializeInode(*inode, response->mutable_inode());
         response->set_volume_id(inode->getVolumeUUID());
         response->set_node_id(inode->getVolumeUUID());
+        DedupIndex::Location data;
+        if (dedup_->Resolve(inode->inode, &data) && data.chunk_id != inode->inode) {
+            response->set_data_node_id(data.node_id);
+            response->set_data_chunk_id(data.chunk_id);
+        }
         StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_SUCCESS, "");
         LogRequest("FindInode", request->path(), response->mutable_status());
     }
@@ -400,37 +437,123 @@ public:
         LogRequest("RebuildInodeTable", "", response);
     }
 
+    void DedupChunk(::google::protobuf::RpcController*,
+                    const rpc::DedupChunkRequest* request,
+                    rpc::DedupChunkReply* response,
+                    ::google::protobuf::Closure* done) override {
+        brpc::ClosureGuard guard(done);
+        const std::string detail = request ? std::to_string(request->inode()) : "<invalid>";
+        if (!request || request->inode() == 0 || request->fingerprint().size() < 16 ||
+            request->fingerprint().size() > 64) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_INVALID_ARGUMENT,
+                                   "missing inode or bad fingerprint");
+            LogRequest("DedupChunk", detail, response->mutable_status());
+            return;
+        }
+        Inode inode;
+        if (!mds_->ReadInode(request->inode(), inode)) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_NODE_NOT_FOUND, "inode not found");
+            LogRequest("DedupChunk", detail, response->mutable_status());
+            return;
+        }
+        const std::string& node_id = inode.getVolumeUUID();
+        if (!dedup_->NamespaceEnabled(inode.getNamespaceId())) {
+            // 命名空间未开启去重：照常使用自己的 chunk
+            response->set_node_id(node_id);
+            response->set_chunk_id(request->inode());
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_SUCCESS, "");
+            LogRequest("DedupChunk", detail + " disabled", response->mutable_status());
+            return;
+        }
+        DedupIndex::AddResult result;
+        if (!dedup_->Add(request->inode(), node_id, request->fingerprint(), request->size_bytes(), &result)) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_IO_ERROR, "dedup index update failed");
+            LogRequest("DedupChunk", detail, response->mutable_status());
+            return;
+        }
+        // digest 仅作记录，索引以 dedup.log 为准
+        inode.setDigest(std::vector<uint8_t>(request->fingerprint().begin(), request->fingerprint().end()));
+        if (!mds_->WriteInode(request->inode(), inode)) {
+            std::cerr << "[MDS RPC] DedupChunk " << detail << " failed to record digest" << std::endl;
+        }
+        response->set_duplicate(result.duplicate);
+        response->set_node_id(result.location.node_id);
+        response->set_chunk_id(result.location.chunk_id);
+        StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_SUCCESS, "");
+        LogRequest("DedupChunk", detail + (result.duplicate ? " duplicate" : " unique"), response->mutable_status());
+    }
+
+    void ReleaseDedup(::google::protobuf::RpcController*,
+                      const rpc::DedupReleaseRequest* request,
+                      rpc::DedupReleaseReply* response,
+                      ::google::protobuf::Closure* done) override {
+        brpc::ClosureGuard guard(done);
+        if (!request || request->inode() == 0) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_INVALID_ARGUMENT, "missing inode");
+            LogRequest("ReleaseDedup", "<invalid>", response->mutable_status());
+            return;
+        }
+        const std::string detail = std::to_string(request->inode());
+        DedupIndex::ReleasePlan plan;
+        // 其他引用者打开文件时持有大小租约；它们仍读持有者的 chunk，不能交接
+        auto in_use = [this](uint64_t ino) { return mds_->HasSizeLease(ino); };
+        if (!dedup_->Release(request->inode(), request->discard(), request->copied_to(), &plan, in_use)) {
+            StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_IO_ERROR, "dedup index update failed");
+            LogRequest("ReleaseDedup", detail, response->mutable_status());
+            return;
+        }
+        response->set_released(plan.released);
+        response->set_busy(plan.busy);
+        if (plan.released) {
+            Inode inode;
+            if (mds_->ReadInode(request->inode(), inode) && !inode.digest.empty()) {
+                inode.setDigest({});
+                mds_->WriteInode(request->inode(), inode);
+            }
+        } else if (!plan.busy) {
+            response->set_from_node_id(plan.from.node_id);
+            response->set_from_chunk_id(plan.from.chunk_id);
+            response->set_to_node_id(plan.to.node_id);
+            response->set_to_chunk_id(plan.to.chunk_id);
+            response->set_size_bytes(plan.size_bytes);
+        }
+        StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_SUCCESS, "");
+        LogRequest("ReleaseDedup", detail + (plan.released ? " released" : (plan.busy ? " busy" : " copy")),
+                   response->mutable_status());
+    }
+
+    void SetNamespaceDedup(::google::protobuf::RpcController*,
+                           const rpc::NamespaceDedupRequest* request,
+                           rpc::Status* response,
+                           ::google::protobuf::Closure* done) override {
+        brpc::ClosureGuard guard(done);
+        const std::string ns = Inode::NormalizeNamespaceId(request->namespace_id());
+        if (!dedup_->SetNamespaceEnabled(ns, request->enabled())) {
+            StatusUtils::SetStatus(response, rpc::STATUS_IO_ERROR, "dedup index update failed");
+        } else {
+            StatusUtils::SetStatus(response, rpc::STATUS_SUCCESS, "");
+        }
+        LogRequest("SetNamespaceDedup", ns + (request->enabled() ? " on" : " off"), response);
+    }
+
     void GetMetricsProm(::google::protobuf::RpcController* controller,
                         const rpc::Empty*,
                         rpc::MetricsReply* response,
                         ::google::protobuf::Closure* done) override {
         brpc::ClosureGuard guard(done);
-        std::ostringstream os;
-        uint64_t total = mds_->GetTotalInodes();
-        uint64_t root = mds_->GetRootInode();
-        os << "# HELP mds_total_inodes Total inodes in MDS\n";
-        os << "# TYPE mds_total_inodes gauge\n";
-        os << "mds_total_inodes " << total << "\n";
-        os << "# HELP mds_root_inode Root inode id\n";
-        os << "# TYPE mds_root_inode gauge\n";
-        os << "mds_root_inode " << root << "\n";
-        auto list = mds_->CollectColdInodes(2, 0);
-        os << "# HELP mds_cold_inode_sample Cold inode sample (value=inode id)\n";
-        os << "# TYPE mds_cold_inode_sample gauge\n";
-        for (size_t i = 0; i < list.size(); ++i) {
-            os << "mds_cold_inode_sample{slot=\"" << i << "\"} " << list[i] << "\n";
-        }
+        // 抓取只拷贝后台采样器发布的快照，不触发 inode 扫描
+        auto text = metrics_sampler_->Snapshot();
         response->mutable_status()->CopyFrom(ToStatus(true));
         bool handled_http = false;
         if (auto* cntl = dynamic_cast<brpc::Controller*>(controller)) {
             if (cntl->has_http_request()) {
                 cntl->http_response().set_content_type("text/plain");
-                cntl->response_attachment().append(os.str());
+                cntl->response_attachment().append(*text);
                 handled_http = true;
             }
         }
         if (!handled_http) {
-            response->set_text(os.str());
+            response->set_text(*text);
         }
     }
 
@@ -468,6 +591,8 @@ private:
 
     std::string base_dir_;
     std::shared_ptr<MdsServer> mds_;
+    std::unique_ptr<DedupIndex> dedup_;
+    std::unique_ptr<MdsMetricsSampler> metrics_sampler_;
     std::mutex node_mu_;
     std::unordered_map<std::string, rpc::NodeInfo> nodes_;
     std::vector<std::string> node_order_;
@@ -101,6 +101,21 @@ void StorageNodeManager::HandleHeartbeat(const storagenode::HeartbeatRequest* re
     response->set_require_rereg(false);
 }
 
+void StorageNodeManager::HandleListNodes(storagenode::ListNodesResponse* response) const {
+    if (!response) {
+        return;
+    }
+    for (const auto& ctx : registry_.Snapshot()) {
+        auto* node = response->add_nodes();
+        node->set_node_id(ctx.node_id);
+        node->set_ip(ctx.ip);
+        node->set_port(ctx.port);
+        node->set_is_virtual(ctx.type == NodeType::Virtual);
+        node->set_online(ctx.state == NodeState::Online);
+    }
+    StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_SUCCESS, "");
+}
+
 void StorageNodeManager::HealthLoop() {
     while (running_) {
         const auto now = std::chrono::steady_clock::now();
@@ -31,6 +31,9 @@ public:
     void HandleHeartbeat(const storagenode::HeartbeatRequest* request,
                          storagenode::HeartbeatResponse* response);
 
+    // Addresses of all registered nodes, for clients that talk to real nodes directly.
+    void HandleListNodes(storagenode::ListNodesResponse* response) const;
+
     bool GetNode(const std::string& node_id, NodeContext& ctx) const;
     // Optional: pre-register a virtual node with simulation parameters.
     void AddVirtualNode(const std::string& node_id, const SimulationParams& params, uint64_t capacity_bytes = 0);
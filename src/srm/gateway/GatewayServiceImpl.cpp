@@ -48,3 +48,115 @@ void GatewayServiceImpl::Truncate(::google::protobuf::RpcController* controller,
     }
     dispatcher_->DispatchTruncate(request, response, static_cast<brpc::Controller*>(controller), done);
 }
+
+void GatewayServiceImpl::GetExtents(::google::protobuf::RpcController* controller,
+                                    const storagenode::GetExtentsRequest* request,
+                                    storagenode::GetExtentsReply* response,
+                                    ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchGetExtents(request, response, static_cast<brpc::Controller*>(controller), done);
+}
+
+void GatewayServiceImpl::TrimChunk(::google::protobuf::RpcController* controller,
+                                   const storagenode::TrimChunkRequest* request,
+                                   storagenode::TrimChunkReply* response,
+                                   ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchTrimChunk(request, response, static_cast<brpc::Controller*>(controller), done);
+}
+
+void GatewayServiceImpl::CompressChunk(::google::protobuf::RpcController* controller,
+                                       const storagenode::CompressChunkRequest* request,
+                                       storagenode::CompressChunkReply* response,
+                                       ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchCompressChunk(request, response, static_cast<brpc::Controller*>(controller), done);
+}
+
+void GatewayServiceImpl::OpenReadStream(::google::protobuf::RpcController* controller,
+                                        const storagenode::OpenStreamRequest* request,
+                                        storagenode::OpenStreamReply* response,
+                                        ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchOpenStream(false, request, response, static_cast<brpc::Controller*>(controller), done);
+}
+
+void GatewayServiceImpl::OpenWriteStream(::google::protobuf::RpcController* controller,
+                                         const storagenode::OpenStreamRequest* request,
+                                         storagenode::OpenStreamReply* response,
+                                         ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchOpenStream(true, request, response, static_cast<brpc::Controller*>(controller), done);
+}
+
+void GatewayServiceImpl::ReadV(::google::protobuf::RpcController* controller,
+                               const storagenode::ReadVRequest* request,
+                               storagenode::ReadVReply* response,
+                               ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchReadV(request, response, static_cast<brpc::Controller*>(controller), done);
+}
+
+void GatewayServiceImpl::WriteV(::google::protobuf::RpcController* controller,
+                                const storagenode::WriteVRequest* request,
+                                storagenode::WriteVReply* response,
+                                ::google::protobuf::Closure* done) {
+    if (!dispatcher_) {
+        if (response) {
+            StatusUtils::SetStatus(response->mutable_status(),
+                                   rpc::STATUS_UNKNOWN_ERROR,
+                                   "Gateway dispatcher not initialized");
+        }
+        if (done) done->Run();
+        return;
+    }
+    dispatcher_->DispatchWriteV(request, response, static_cast<brpc::Controller*>(controller), done);
+}
@@ -26,6 +26,41 @@ public:
                   storagenode::TruncateReply* response,
                   ::google::protobuf::Closure* done) override;
 
+    void GetExtents(::google::protobuf::RpcController* controller,
+                    const storagenode::GetExtentsRequest* request,
+                    storagenode::GetExtentsReply* response,
+                    ::google::protobuf::Closure* done) override;
+
+    void TrimChunk(::google::protobuf::RpcController* controller,
+                   const storagenode::TrimChunkRequest* request,
+                   storagenode::TrimChunkReply* response,
+                   ::google::protobuf::Closure* done) override;
+
+    void CompressChunk(::google::protobuf::RpcController* controller,
+                       const storagenode::CompressChunkRequest* request,
+                       storagenode::CompressChunkReply* response,
+                       ::google::protobuf::Closure* done) override;
+
+    void OpenReadStream(::google::protobuf::RpcController* controller,
+                        const storagenode::OpenStreamRequest* request,
+                        storagenode::OpenStreamReply* response,
+                        ::google::protobuf::Closure* done) override;
+
+    void OpenWriteStream(::google::protobuf::RpcController* controller,
+                         const storagenode::OpenStreamRequest* request,
+                         storagenode::OpenStreamReply* response,
+                         ::google::protobuf::Closure* done) override;
+
+    void ReadV(::google::protobuf::RpcController* controller,
+               const storagenode::ReadVRequest* request,
+               storagenode::ReadVReply* response,
+               ::google::protobuf::Closure* done) override;
+
+    void WriteV(::google::protobuf::RpcController* controller,
+                const storagenode::WriteVRequest* request,
+                storagenode::WriteVReply* response,
+                ::google::protobuf::Closure* done) override;
+
     void UnmountDisk(::google::protobuf::RpcController* controller,
                      const storagenode::UnmountRequest* request,
                      storagenode::UnmountReply* response,
@@ -2,9 +2,18 @@
 
 #include <cerrno>
 #include <cstring>
+#include <atomic>
 #include <iostream>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include <brpc/closure_guard.h>
+#include <brpc/stream.h>
+#include <bthread/countdown_event.h>
+
+#include "common/ChunkStream.h"
 #include "common/StatusUtils.h"
 
 namespace {
@@ -38,6 +47,7 @@ public:
             msg = real_cntl_->ErrorText();
         } else if (real_resp_) {
             client_resp_->set_bytes_written(real_resp_->bytes_written());
+            client_resp_->set_wire_version(real_resp_->wire_version());
             StatusUtils::SetStatus(client_resp_->mutable_status(),
                                    StatusUtils::NormalizeCode(real_resp_->status().code()),
                                    real_resp_->status().message());
@@ -65,10 +75,12 @@ private:
 class RealNodeReadCallback : public ::google::protobuf::Closure {
 public:
     RealNodeReadCallback(storagenode::ReadReply* client_resp,
+                         brpc::Controller* client_cntl,
                          ::google::protobuf::Closure* client_done,
                          std::unique_ptr<brpc::Controller> real_cntl,
                          std::unique_ptr<storagenode::ReadReply> real_resp)
         : client_resp_(client_resp),
+          client_cntl_(client_cntl),
           client_done_(client_done),
           real_cntl_(std::move(real_cntl)),
           real_resp_(std::move(real_resp)) {}
@@ -92,7 +104,13 @@ public:
         } else if (real_resp_) {
             client_resp_->set_bytes_read(real_resp_->bytes_read());
             client_resp_->mutable_data()->swap(*real_resp_->mutable_data());
+            if (client_cntl_) {
+                // attached payloads are handed on without being flattened
+                client_cntl_->response_attachment().swap(real_cntl_->response_attachment());
+            }
+            client_resp_->set_wire_version(real_resp_->wire_version());
             client_resp_->set_checksum(real_resp_->checksum());
+            client_resp_->mutable_holes()->Swap(real_resp_->mutable_holes());
             StatusUtils::SetStatus(client_resp_->mutable_status(),
                                    StatusUtils::NormalizeCode(real_resp_->status().code()),
                                    real_resp_->status().message());
@@ -112,6 +130,7 @@ public:
 
 private:
     storagenode::ReadReply* client_resp_{nullptr};
+    brpc::Controller* client_cntl_{nullptr};
     ::google::protobuf::Closure* client_done_{nullptr};
     std::unique_ptr<brpc::Controller> real_cntl_;
     std::unique_ptr<storagenode::ReadReply> real_resp_;
@@ -168,11 +187,241 @@ private:
     std::unique_ptr<storagenode::TruncateReply> real_resp_;
 };
 
+// The node's reply is parsed straight into the client's; only a failed
+// call needs translating.
+class RealNodeGetExtentsCallback : public ::google::protobuf::Closure {
+public:
+    RealNodeGetExtentsCallback(storagenode::GetExtentsReply* client_resp,
+                               ::google::protobuf::Closure* client_done)
+        : client_resp_(client_resp), client_done_(client_done) {
+        real_cntl_.set_timeout_ms(3000);
+    }
+
+    brpc::Controller* controller() { return &real_cntl_; }
+
+    void Run() override {
+        if (real_cntl_.Failed()) {
+            client_resp_->Clear();
+            StatusUtils::SetStatus(client_resp_->mutable_status(),
+                                   rpc::STATUS_NETWORK_ERROR,
+                                   real_cntl_.ErrorText());
+        }
+        std::cout << "[Gateway] GetExtentsResp(real) extents=" << client_resp_->extents_size()
+                  << " code=" << client_resp_->status().code() << std::endl;
+        if (client_done_) client_done_->Run();
+        delete this;
+    }
+
+private:
+    storagenode::GetExtentsReply* client_resp_;
+    ::google::protobuf::Closure* client_done_;
+    brpc::Controller real_cntl_;
+};
+
+class RealNodeTrimChunkCallback : public ::google::protobuf::Closure {
+public:
+    RealNodeTrimChunkCallback(storagenode::TrimChunkReply* client_resp,
+                              ::google::protobuf::Closure* client_done)
+        : client_resp_(client_resp), client_done_(client_done) {
+        real_cntl_.set_timeout_ms(3000);
+    }
+
+    brpc::Controller* controller() { return &real_cntl_; }
+
+    void Run() override {
+        if (real_cntl_.Failed()) {
+            client_resp_->Clear();
+            StatusUtils::SetStatus(client_resp_->mutable_status(),
+                                   rpc::STATUS_NETWORK_ERROR,
+                                   real_cntl_.ErrorText());
+        }
+        std::cout << "[Gateway] TrimChunkResp(real) released=" << client_resp_->released_bytes()
+                  << " code=" << client_resp_->status().code() << std::endl;
+        if (client_done_) client_done_->Run();
+        delete this;
+    }
+
+private:
+    storagenode::TrimChunkReply* client_resp_;
+    ::google::protobuf::Closure* client_done_;
+    brpc::Controller real_cntl_;
+};
+
+class RealNodeCompressChunkCallback : public ::google::protobuf::Closure {
+public:
+    RealNodeCompressChunkCallback(storagenode::CompressChunkReply* client_resp,
+                                  ::google::protobuf::Closure* client_done)
+        : client_resp_(client_resp), client_done_(client_done) {
+        real_cntl_.set_timeout_ms(30000);  // the node reads and rewrites the whole chunk
+    }
+
+    brpc::Controller* controller() { return &real_cntl_; }
+
+    void Run() override {
+        if (real_cntl_.Failed()) {
+            client_resp_->Clear();
+            StatusUtils::SetStatus(client_resp_->mutable_status(),
+                                   rpc::STATUS_NETWORK_ERROR,
+                                   real_cntl_.ErrorText());
+        }
+        std::cout << "[Gateway] CompressChunkResp(real) raw=" << client_resp_->raw_bytes()
+                  << " stored=" << client_resp_->stored_bytes()
+                  << " code=" << client_resp_->status().code() << std::endl;
+        if (client_done_) client_done_->Run();
+        delete this;
+    }
+
+private:
+    storagenode::CompressChunkReply* client_resp_;
+    ::google::protobuf::Closure* client_done_;
+    brpc::Controller real_cntl_;
+};
+
+// One half of a spliced stream: forwards what arrives on its stream to the
+// peer stream. Waiting for window space on the peer holds back this
+// stream's consumer, so flow control carries through the gateway. The peer
+// is set once both streams exist; a handler that never gets one only waits
+// for its stream to close.
+class StreamRelay : public brpc::StreamInputHandler {
+public:
+    void SetPeer(brpc::StreamId peer) {
+        peer_ = peer;
+        ready_.signal();
+    }
+
+    int on_received_messages(brpc::StreamId id, butil::IOBuf* const messages[], size_t size) override {
+        ready_.wait();
+        for (size_t i = 0; i < size && peer_ != brpc::INVALID_STREAM_ID; ++i) {
+            if (!ChunkStream::Send(peer_, *messages[i], kRelayTimeoutMs)) {
+                brpc::StreamClose(id);
+                break;
+            }
+        }
+        return 0;
+    }
+
+    void on_idle_timeout(brpc::StreamId) override {}
+
+    void on_closed(brpc::StreamId) override {
+        ready_.wait();
+        if (peer_ != brpc::INVALID_STREAM_ID) {
+            brpc::StreamClose(peer_);
+        }
+        delete this;
+    }
+
+private:
+    static constexpr int kRelayTimeoutMs = 30000;
+    brpc::StreamId peer_{brpc::INVALID_STREAM_ID};
+    bthread::CountdownEvent ready_{1};
+};
+
+// Splits a vectored request by destination node and stitches the per-node
+// replies, and read payloads, back into extent order. The dispatcher runs
+// each part and the last one to finish replies to the client and frees this.
+template <typename Request, typename Reply>
+class VectorFanOut {
+public:
+    struct Part : public ::google::protobuf::Closure {
+        VectorFanOut* owner{nullptr};
+        std::vector<int> extents;  // indexes into the client request
+        Request request;
+        Reply reply;
+        brpc::Controller cntl;
+
+        void Run() override { owner->PartDone(); }
+    };
+
+    VectorFanOut(const Request* req, Reply* resp, brpc::Controller* cntl, ::google::protobuf::Closure* done)
+        : req_(req), resp_(resp), cntl_(cntl), done_(done) {
+        std::unordered_map<std::string, size_t> by_node;
+        for (int i = 0; i < req->extents_size(); ++i) {
+            const auto& e = req->extents(i);
+            const std::string& node = e.node_id().empty() ? req->node_id() : e.node_id();
+            auto it = by_node.emplace(node, parts_.size()).first;
+            if (it->second == parts_.size()) {
+                auto part = std::make_unique<Part>();
+                part->owner = this;
+                part->request.CopyFrom(*req);
+                part->request.clear_extents();
+                part->request.set_node_id(node);
+                parts_.push_back(std::move(part));
+            }
+            Part* part = parts_[it->second].get();
+            part->extents.push_back(i);
+            part->request.add_extents()->CopyFrom(e);
+            owner_.push_back(part);
+        }
+        pending_.store(parts_.size() + 1, std::memory_order_relaxed);
+    }
+
+    const std::vector<std::unique_ptr<Part>>& parts() const { return parts_; }
+    Part* part_of(int extent) const { return owner_[static_cast<size_t>(extent)]; }
+
+    // Call once every part has been started.
+    void Launched() { PartDone(); }
+
+    void PartDone() {
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        Merge();
+        if (done_) done_->Run();
+        delete this;
+    }
+
+private:
+    void Merge() {
+        for (int i = 0; i < req_->extents_size(); ++i) {
+            resp_->add_results();
+        }
+        for (const auto& part : parts_) {
+            const bool rpc_failed = part->cntl.Failed();
+            const bool ok = !rpc_failed && part->reply.status().code() == rpc::STATUS_SUCCESS &&
+                            static_cast<size_t>(part->reply.results_size()) == part->extents.size();
+            for (size_t k = 0; k < part->extents.size(); ++k) {
+                auto* result = resp_->mutable_results(part->extents[k]);
+                if (ok) {
+                    result->CopyFrom(part->reply.results(static_cast<int>(k)));
+                } else if (rpc_failed) {
+                    StatusUtils::SetStatus(result->mutable_status(), rpc::STATUS_NETWORK_ERROR, part->cntl.ErrorText());
+                } else if (part->reply.status().code() != rpc::STATUS_SUCCESS) {
+                    result->mutable_status()->CopyFrom(part->reply.status());
+                } else {
+                    StatusUtils::SetStatus(result->mutable_status(), rpc::STATUS_UNKNOWN_ERROR,
+                                           "node returned the wrong number of results");
+                }
+            }
+        }
+        if constexpr (std::is_same_v<Reply, storagenode::ReadVReply>) {
+            // each part's payloads arrive in its extents' order
+            for (int i = 0; i < req_->extents_size(); ++i) {
+                const auto& result = resp_->results(i);
+                if (result.status().code() == rpc::STATUS_SUCCESS) {
+                    part_of(i)->cntl.response_attachment().cutn(&cntl_->response_attachment(),
+                                                                static_cast<size_t>(result.bytes()));
+                }
+            }
+        }
+        StatusUtils::SetStatus(resp_->mutable_status(), rpc::STATUS_SUCCESS, "");
+        std::cout << "[Gateway] VectorResp extents=" << req_->extents_size() << " nodes=" << parts_.size()
+                  << std::endl;
+    }
+
+    const Request* req_;
+    Reply* resp_;
+    brpc::Controller* cntl_;
+    ::google::protobuf::Closure* done_;
+    std::vector<std::unique_ptr<Part>> parts_;
+    std::vector<Part*> owner_;  // part of each client extent
+    std::atomic<size_t> pending_{0};
+};
+
 } // namespace
 
 void RequestDispatcher::DispatchWrite(const storagenode::WriteRequest* req,
                                       storagenode::WriteReply* resp,
-                                      brpc::Controller*,
+                                      brpc::Controller* cntl,
                                       ::google::protobuf::Closure* done) {
     if (!req || !resp) {
         if (done) done->Run();
@@ -183,10 +432,14 @@ void RequestDispatcher::DispatchWrite(const storagenode::WriteRequest* req,
         if (done) done->Run();
         return;
     }
+    butil::IOBuf* attachment = nullptr;
+    if (req->wire_version() == storagenode::WIRE_ATTACHMENT && cntl) {
+        attachment = &cntl->request_attachment();
+    }
     std::cout << "[Gateway] WriteReq node=" << req->node_id()
               << " chunk=" << req->chunk_id()
               << " offset=" << req->offset()
-              << " size=" << req->data().size() << std::endl;
+              << " size=" << (attachment ? attachment->size() : req->data().size()) << std::endl;
     NodeContext ctx;
     if (!manager_ || !manager_->GetNode(req->node_id(), ctx)) {
         FillStatus(resp->mutable_status(), rpc::STATUS_NODE_NOT_FOUND, "unknown node");
@@ -201,7 +454,7 @@ void RequestDispatcher::DispatchWrite(const storagenode::WriteRequest* req,
             if (done) done->Run();
             return;
         }
-        virtual_engine_->SimulateWrite(req, resp);
+        virtual_engine_->SimulateWrite(req, resp, attachment);
         std::cout << "[Gateway] WriteResp node=" << req->node_id()
                   << " chunk=" << req->chunk_id()
                   << " bytes=" << resp->bytes_written()
@@ -220,6 +473,9 @@ void RequestDispatcher::DispatchWrite(const storagenode::WriteRequest* req,
     auto real_cntl = std::make_unique<brpc::Controller>();
     real_cntl->set_timeout_ms(3000);
     auto real_resp = std::make_unique<storagenode::WriteReply>();
+    if (attachment) {
+        real_cntl->request_attachment().swap(*attachment);
+    }
     auto* callback = new RealNodeWriteCallback(resp, done, std::move(real_cntl), std::move(real_resp));
     stub->Write(callback->controller(), req, callback->real_resp(), callback);
     // Ownership of callback and internal state handled within callback.
@@ -227,7 +483,7 @@ void RequestDispatcher::DispatchWrite(const storagenode::WriteRequest* req,
 
 void RequestDispatcher::DispatchRead(const storagenode::ReadRequest* req,
                                      storagenode::ReadReply* resp,
-                                     brpc::Controller*,
+                                     brpc::Controller* cntl,
                                      ::google::protobuf::Closure* done) {
     if (!req || !resp) {
         if (done) done->Run();
@@ -256,7 +512,10 @@ void RequestDispatcher::DispatchRead(const storagenode::ReadRequest* req,
             if (done) done->Run();
             return;
         }
-        virtual_engine_->SimulateRead(req, resp);
+        virtual_engine_->SimulateRead(req, resp,
+                                      req->wire_version() == storagenode::WIRE_ATTACHMENT && cntl
+                                          ? &cntl->response_attachment()
+                                          : nullptr);
         std::cout << "[Gateway] ReadResp node=" << req->node_id()
                   << " chunk=" << req->chunk_id()
                   << " bytes=" << resp->bytes_read()
@@ -275,7 +534,7 @@ void RequestDispatcher::DispatchRead(const storagenode::ReadRequest* req,
     auto real_cntl = std::make_unique<brpc::Controller>();
     real_cntl->set_timeout_ms(3000);
     auto real_resp = std::make_unique<storagenode::ReadReply>();
-    auto* callback = new RealNodeReadCallback(resp, done, std::move(real_cntl), std::move(real_resp));
+    auto* callback = new RealNodeReadCallback(resp, cntl, done, std::move(real_cntl), std::move(real_resp));
     stub->Read(callback->controller(), req, callback->real_resp(), callback);
 }
 
@@ -330,6 +589,281 @@ void RequestDispatcher::DispatchTruncate(const storagenode::TruncateRequest* req
     stub->Truncate(callback->controller(), req, callback->real_resp(), callback);
 }
 
+void RequestDispatcher::DispatchGetExtents(const storagenode::GetExtentsRequest* req,
+                                           storagenode::GetExtentsReply* resp,
+                                           brpc::Controller*,
+                                           ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    if (!req || !resp) {
+        return;
+    }
+    NodeContext ctx;
+    storagenode::StorageService_Stub* stub = nullptr;
+    if (!ResolveNode(req->node_id(), &ctx, &stub, resp->mutable_status())) {
+        return;
+    }
+    if (!stub) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_VIRTUAL_NODE_ERROR, "virtual nodes keep no extent map");
+        return;
+    }
+    auto* callback = new RealNodeGetExtentsCallback(resp, guard.release());
+    stub->GetExtents(callback->controller(), req, resp, callback);
+}
+
+void RequestDispatcher::DispatchTrimChunk(const storagenode::TrimChunkRequest* req,
+                                          storagenode::TrimChunkReply* resp,
+                                          brpc::Controller*,
+                                          ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    if (!req || !resp) {
+        return;
+    }
+    NodeContext ctx;
+    storagenode::StorageService_Stub* stub = nullptr;
+    if (!ResolveNode(req->node_id(), &ctx, &stub, resp->mutable_status())) {
+        return;
+    }
+    if (!stub) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_SUCCESS, "");  // virtual nodes reserve nothing
+        return;
+    }
+    auto* callback = new RealNodeTrimChunkCallback(resp, guard.release());
+    stub->TrimChunk(callback->controller(), req, resp, callback);
+}
+
+void RequestDispatcher::DispatchCompressChunk(const storagenode::CompressChunkRequest* req,
+                                              storagenode::CompressChunkReply* resp,
+                                              brpc::Controller*,
+                                              ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    if (!req || !resp) {
+        return;
+    }
+    NodeContext ctx;
+    storagenode::StorageService_Stub* stub = nullptr;
+    if (!ResolveNode(req->node_id(), &ctx, &stub, resp->mutable_status())) {
+        return;
+    }
+    if (!stub) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_SUCCESS, "");  // virtual nodes store no data
+        return;
+    }
+    auto* callback = new RealNodeCompressChunkCallback(resp, guard.release());
+    stub->CompressChunk(callback->controller(), req, resp, callback);
+}
+
+void RequestDispatcher::DispatchOpenStream(bool write,
+                                           const storagenode::OpenStreamRequest* req,
+                                           storagenode::OpenStreamReply* resp,
+                                           brpc::Controller* cntl,
+                                           ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    if (!req || !resp || !cntl) {
+        return;
+    }
+    if (req->node_id().empty()) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_INVALID_ARGUMENT, "missing node_id");
+        return;
+    }
+    std::cout << "[Gateway] " << (write ? "OpenWriteStream" : "OpenReadStream") << " node=" << req->node_id()
+              << " chunk=" << req->chunk_id()
+              << " offset=" << req->offset() << std::endl;
+    NodeContext ctx;
+    if (!manager_ || !manager_->GetNode(req->node_id(), ctx)) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_NODE_NOT_FOUND, "unknown node");
+        return;
+    }
+    if (ctx.type == NodeType::Virtual) {
+        // callers fall back to unary Read/Write
+        FillStatus(resp->mutable_status(), rpc::STATUS_VIRTUAL_NODE_ERROR, "virtual nodes do not serve streams");
+        return;
+    }
+    auto* stub = GetStub(ctx);
+    if (!stub) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_NETWORK_ERROR, "failed to build channel");
+        return;
+    }
+
+    brpc::StreamOptions opts;
+    opts.max_buf_size = static_cast<int>(ChunkStream::Options().window_bytes);
+    auto* from_node = new StreamRelay();
+    opts.handler = from_node;
+    brpc::Controller node_cntl;
+    node_cntl.set_timeout_ms(3000);
+    brpc::StreamId node_stream;
+    if (brpc::StreamCreate(&node_stream, node_cntl, &opts) != 0) {
+        delete from_node;
+        FillStatus(resp->mutable_status(), rpc::STATUS_NETWORK_ERROR, "failed to create stream");
+        return;
+    }
+    storagenode::OpenStreamReply node_resp;
+    if (write) {
+        stub->OpenWriteStream(&node_cntl, req, &node_resp, nullptr);
+    } else {
+        stub->OpenReadStream(&node_cntl, req, &node_resp, nullptr);
+    }
+    if (node_cntl.Failed()) {
+        from_node->SetPeer(brpc::INVALID_STREAM_ID);
+        FillStatus(resp->mutable_status(), rpc::STATUS_NETWORK_ERROR, node_cntl.ErrorText());
+        return;
+    }
+    if (node_resp.status().code() != rpc::STATUS_SUCCESS) {
+        from_node->SetPeer(brpc::INVALID_STREAM_ID);
+        brpc::StreamClose(node_stream);
+        resp->mutable_status()->CopyFrom(node_resp.status());
+        return;
+    }
+
+    auto* from_client = new StreamRelay();
+    opts.handler = from_client;
+    opts.idle_timeout_ms = -1;
+    brpc::StreamId client_stream;
+    if (brpc::StreamAccept(&client_stream, *cntl, &opts) != 0) {
+        delete from_client;
+        from_node->SetPeer(brpc::INVALID_STREAM_ID);
+        brpc::StreamClose(node_stream);
+        FillStatus(resp->mutable_status(), rpc::STATUS_INVALID_ARGUMENT, "request carries no stream");
+        return;
+    }
+    from_client->SetPeer(node_stream);
+    from_node->SetPeer(client_stream);
+    FillStatus(resp->mutable_status(), rpc::STATUS_SUCCESS, "");
+}
+
+void RequestDispatcher::DispatchReadV(const storagenode::ReadVRequest* req,
+                                      storagenode::ReadVReply* resp,
+                                      brpc::Controller* cntl,
+                                      ::google::protobuf::Closure* done) {
+    if (!req || !resp || !cntl) {
+        if (done) done->Run();
+        return;
+    }
+    std::cout << "[Gateway] ReadVReq extents=" << req->extents_size() << std::endl;
+    using FanOut = VectorFanOut<storagenode::ReadVRequest, storagenode::ReadVReply>;
+    auto* fan = new FanOut(req, resp, cntl, done);
+    for (const auto& part : fan->parts()) {
+        NodeContext ctx;
+        storagenode::StorageService_Stub* stub = nullptr;
+        if (!ResolveNode(part->request.node_id(), &ctx, &stub, part->reply.mutable_status())) {
+            part->Run();
+            continue;
+        }
+        if (!stub) {
+            // the engine models one call per extent
+            for (const auto& e : part->request.extents()) {
+                storagenode::ReadRequest rq;
+                storagenode::ReadReply rp;
+                rq.set_node_id(ctx.node_id);
+                rq.set_chunk_id(e.chunk_id());
+                rq.set_offset(e.offset());
+                rq.set_length(e.length());
+                rq.set_flags(part->request.flags());
+                rq.set_io_class(part->request.io_class());
+                rq.set_wire_version(storagenode::WIRE_ATTACHMENT);
+                virtual_engine_->SimulateRead(&rq, &rp, &part->cntl.response_attachment());
+                auto* result = part->reply.add_results();
+                result->mutable_status()->CopyFrom(rp.status());
+                result->set_bytes(rp.bytes_read());
+                result->set_checksum(rp.checksum());
+            }
+            FillStatus(part->reply.mutable_status(), rpc::STATUS_SUCCESS, "");
+            part->Run();
+            continue;
+        }
+        part->cntl.set_timeout_ms(3000);
+        stub->ReadV(&part->cntl, &part->request, &part->reply, part.get());
+    }
+    fan->Launched();
+}
+
+void RequestDispatcher::DispatchWriteV(const storagenode::WriteVRequest* req,
+                                       storagenode::WriteVReply* resp,
+                                       brpc::Controller* cntl,
+                                       ::google::protobuf::Closure* done) {
+    if (!req || !resp || !cntl) {
+        if (done) done->Run();
+        return;
+    }
+    std::cout << "[Gateway] WriteVReq extents=" << req->extents_size() << std::endl;
+    uint64_t total = 0;
+    for (const auto& e : req->extents()) {
+        total += e.length();
+    }
+    if (cntl->request_attachment().size() != total) {
+        FillStatus(resp->mutable_status(), rpc::STATUS_INVALID_ARGUMENT, "attachment does not match the extent lengths");
+        if (done) done->Run();
+        return;
+    }
+    using FanOut = VectorFanOut<storagenode::WriteVRequest, storagenode::WriteVReply>;
+    auto* fan = new FanOut(req, resp, cntl, done);
+    // hand each node the payloads of its extents, without copying them
+    for (int i = 0; i < req->extents_size(); ++i) {
+        cntl->request_attachment().cutn(&fan->part_of(i)->cntl.request_attachment(),
+                                        static_cast<size_t>(req->extents(i).length()));
+    }
+    for (const auto& part : fan->parts()) {
+        NodeContext ctx;
+        storagenode::StorageService_Stub* stub = nullptr;
+        if (!ResolveNode(part->request.node_id(), &ctx, &stub, part->reply.mutable_status())) {
+            part->Run();
+            continue;
+        }
+        if (!stub) {
+            for (const auto& e : part->request.extents()) {
+                butil::IOBuf payload;
+                part->cntl.request_attachment().cutn(&payload, static_cast<size_t>(e.length()));
+                storagenode::WriteRequest wq;
+                storagenode::WriteReply wp;
+                wq.set_node_id(ctx.node_id);
+                wq.set_chunk_id(e.chunk_id());
+                wq.set_offset(e.offset());
+                wq.set_flags(part->request.flags());
+                wq.set_mode(part->request.mode());
+                wq.set_io_class(part->request.io_class());
+                wq.set_wire_version(storagenode::WIRE_ATTACHMENT);
+                virtual_engine_->SimulateWrite(&wq, &wp, &payload);
+                auto* result = part->reply.add_results();
+                result->mutable_status()->CopyFrom(wp.status());
+                result->set_bytes(wp.bytes_written());
+            }
+            FillStatus(part->reply.mutable_status(), rpc::STATUS_SUCCESS, "");
+            part->Run();
+            continue;
+        }
+        part->cntl.set_timeout_ms(3000);
+        stub->WriteV(&part->cntl, &part->request, &part->reply, part.get());
+    }
+    fan->Launched();
+}
+
+bool RequestDispatcher::ResolveNode(const std::string& node_id,
+                                    NodeContext* ctx,
+                                    storagenode::StorageService_Stub** stub,
+                                    rpc::Status* status) {
+    *stub = nullptr;
+    if (node_id.empty()) {
+        FillStatus(status, rpc::STATUS_INVALID_ARGUMENT, "missing node_id");
+        return false;
+    }
+    if (!manager_ || !manager_->GetNode(node_id, *ctx)) {
+        FillStatus(status, rpc::STATUS_NODE_NOT_FOUND, "unknown node");
+        return false;
+    }
+    if (ctx->type == NodeType::Virtual) {
+        if (!virtual_engine_) {
+            FillStatus(status, rpc::STATUS_VIRTUAL_NODE_ERROR, "virtual engine unavailable");
+            return false;
+        }
+        return true;
+    }
+    *stub = GetStub(*ctx);
+    if (!*stub) {
+        FillStatus(status, rpc::STATUS_NETWORK_ERROR, "failed to build channel");
+        return false;
+    }
+    return true;
+}
+
 storagenode::StorageService_Stub* RequestDispatcher::GetStub(const NodeContext& ctx) {
     const std::string key = ctx.node_id;
     std::lock_guard<std::mutex> lk(stub_mu_);
@@ -33,6 +33,41 @@ public:
                           brpc::Controller* cntl,
                           ::google::protobuf::Closure* done);
 
+    void DispatchGetExtents(const storagenode::GetExtentsRequest* req,
+                            storagenode::GetExtentsReply* resp,
+                            brpc::Controller* cntl,
+                            ::google::protobuf::Closure* done);
+
+    void DispatchTrimChunk(const storagenode::TrimChunkRequest* req,
+                           storagenode::TrimChunkReply* resp,
+                           brpc::Controller* cntl,
+                           ::google::protobuf::Closure* done);
+
+    void DispatchCompressChunk(const storagenode::CompressChunkRequest* req,
+                               storagenode::CompressChunkReply* resp,
+                               brpc::Controller* cntl,
+                               ::google::protobuf::Closure* done);
+
+    // Opens the stream on the node and splices it to the caller's stream;
+    // frames are relayed in both directions without being parsed.
+    void DispatchOpenStream(bool write,
+                            const storagenode::OpenStreamRequest* req,
+                            storagenode::OpenStreamReply* resp,
+                            brpc::Controller* cntl,
+                            ::google::protobuf::Closure* done);
+
+    // Vectored calls are split by destination node (each extent's node_id,
+    // else the request's) and the per-node calls run in parallel.
+    void DispatchReadV(const storagenode::ReadVRequest* req,
+                       storagenode::ReadVReply* resp,
+                       brpc::Controller* cntl,
+                       ::google::protobuf::Closure* done);
+
+    void DispatchWriteV(const storagenode::WriteVRequest* req,
+                        storagenode::WriteVReply* resp,
+                        brpc::Controller* cntl,
+                        ::google::protobuf::Closure* done);
+
 private:
     struct StubEntry {
         std::unique_ptr<brpc::Channel> channel;
@@ -47,5 +82,8 @@ private:
     StubMap stubs_;
 
     storagenode::StorageService_Stub* GetStub(const NodeContext& ctx);
+    // Looks the node up; stub stays null for virtual nodes. False fills status.
+    bool ResolveNode(const std::string& node_id, NodeContext* ctx,
+                     storagenode::StorageService_Stub** stub, rpc::Status* status);
     void FillStatus(rpc::Status* status, rpc::StatusCode code, const std::string& msg);
 };
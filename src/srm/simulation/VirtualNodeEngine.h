@@ -3,6 +3,8 @@
 #include <random>
 #include <string>
 
+#include <butil/iobuf.h>
+
 #include "SimulationConfig.h"
 #include "storage_node.pb.h"
 
@@ -10,11 +12,15 @@ class VirtualNodeEngine {
 public:
     explicit VirtualNodeEngine(SimulationConfig cfg);
 
+    // attachment, when set, holds the payload instead of req->data().
     void SimulateWrite(const storagenode::WriteRequest* req,
-                       storagenode::WriteReply* resp);
+                       storagenode::WriteReply* resp,
+                       const butil::IOBuf* attachment = nullptr);
 
+    // attachment, when set, receives the payload instead of resp->data.
     void SimulateRead(const storagenode::ReadRequest* req,
-                      storagenode::ReadReply* resp);
+                      storagenode::ReadReply* resp,
+                      butil::IOBuf* attachment = nullptr);
 
     void SimulateTruncate(const storagenode::TruncateRequest* req,
                           storagenode::TruncateReply* resp);
@@ -0,0 +1,90 @@
+#include "AlignedBufferPool.h"
+
+#include <cstdlib>
+#include <utility>
+
+namespace {
+
+char* AllocAligned(size_t alignment, size_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, alignment, size) != 0) {
+        return nullptr;
+    }
+    return static_cast<char*>(p);
+}
+
+} // namespace
+
+AlignedBufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : pool_(other.pool_), data_(other.data_), size_(other.size_) {
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+AlignedBufferPool::Buffer& AlignedBufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        pool_ = std::exchange(other.pool_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+AlignedBufferPool::Buffer::~Buffer() {
+    Reset();
+}
+
+void AlignedBufferPool::Buffer::Reset() {
+    if (data_ == nullptr) {
+        return;
+    }
+    if (pool_) {
+        pool_->Release(data_);
+    } else {
+        std::free(data_);
+    }
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t count, size_t buffer_size, size_t alignment)
+    : alignment_(alignment == 0 ? 4096 : alignment) {
+    buffer_size_ = (buffer_size + alignment_ - 1) / alignment_ * alignment_;
+    if (buffer_size_ == 0) {
+        buffer_size_ = alignment_;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        char* p = AllocAligned(alignment_, buffer_size_);
+        if (p == nullptr) {
+            break;
+        }
+        all_.push_back(p);
+        free_.push_back(p);
+    }
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (char* p : all_) {
+        std::free(p);
+    }
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::Acquire() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (!free_.empty()) {
+            char* p = free_.back();
+            free_.pop_back();
+            return Buffer(this, p, buffer_size_);
+        }
+    }
+    return Buffer(nullptr, AllocAligned(alignment_, buffer_size_), buffer_size_);
+}
+
+void AlignedBufferPool::Release(char* data) {
+    std::lock_guard<std::mutex> lk(mu_);
+    free_.push_back(data);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Fixed set of aligned buffers for O_DIRECT IO, allocated once at startup.
+// Acquire never blocks: when every pooled buffer is in use a one-off aligned
+// buffer is allocated and freed again on release.
+class AlignedBufferPool {
+public:
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+        ~Buffer();
+
+        char* data() const { return data_; }
+        size_t size() const { return size_; }
+        explicit operator bool() const { return data_ != nullptr; }
+
+    private:
+        friend class AlignedBufferPool;
+        Buffer(AlignedBufferPool* pool, char* data, size_t size) : pool_(pool), data_(data), size_(size) {}
+        void Reset();
+
+        AlignedBufferPool* pool_{nullptr};  // null for one-off buffers
+        char* data_{nullptr};
+        size_t size_{0};
+    };
+
+    // buffer_size is rounded up to a multiple of alignment.
+    AlignedBufferPool(size_t count, size_t buffer_size, size_t alignment);
+    ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    Buffer Acquire();
+
+    size_t buffer_size() const { return buffer_size_; }
+    size_t alignment() const { return alignment_; }
+
+private:
+    void Release(char* data);
+
+    size_t buffer_size_;
+    size_t alignment_;
+    std::mutex mu_;
+    std::vector<char*> free_;
+    std::vector<char*> all_;
+};
@@ -0,0 +1,240 @@
+#include "BlockCache.h"
+
+#include <butil/crc32c.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr uint8_t kMaxFreq = 3;
+
+} // namespace
+
+BlockCache::Options::Options()
+    : capacity_bytes(256u << 20), block_size(64u << 10), small_ratio(0.1) {}
+
+BlockCache::BlockCache(Options opts) : opts_(opts) {
+    if (opts_.block_size == 0) {
+        opts_.block_size = 64u << 10;
+    }
+    opts_.small_ratio = std::min(0.9, std::max(0.01, opts_.small_ratio));
+    shard_capacity_ = std::max(opts_.capacity_bytes / kShards, opts_.block_size);
+    // remember roughly as many evicted keys as the main queue can hold
+    ghost_limit_ = std::max<size_t>(16, shard_capacity_ / opts_.block_size);
+    block_shift_ = std::make_unique<Crc32cShift>(opts_.block_size);
+}
+
+size_t BlockCache::ShardIndex(uint64_t chunk_id, uint64_t index) {
+    uint64_t h = chunk_id * 0x9e3779b97f4a7c15ULL ^ (index >> kGroupShift) * 0xc2b2ae3d27d4eb4fULL;
+    h ^= h >> 29;
+    return static_cast<size_t>((h * 0xbf58476d1ce4e5b9ULL) >> 60);
+}
+
+BlockCache::Shard& BlockCache::ShardFor(uint64_t chunk_id, uint64_t index) {
+    return shards_[ShardIndex(chunk_id, index)];
+}
+
+const BlockCache::Shard& BlockCache::ShardFor(uint64_t chunk_id, uint64_t index) const {
+    return shards_[ShardIndex(chunk_id, index)];
+}
+
+BlockCache::ChunkShard& BlockCache::ChunkShardFor(uint64_t chunk_id) {
+    return chunk_shards_[(chunk_id * 0x9e3779b97f4a7c15ULL) >> 60];
+}
+
+const BlockCache::ChunkShard& BlockCache::ChunkShardFor(uint64_t chunk_id) const {
+    return chunk_shards_[(chunk_id * 0x9e3779b97f4a7c15ULL) >> 60];
+}
+
+BlockCache::BlockPtr BlockCache::Lookup(uint64_t chunk_id, uint64_t index) {
+    Shard& shard = ShardFor(chunk_id, index);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    auto it = shard.map.find(Key{chunk_id, index});
+    if (it == shard.map.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Node& n = *it->second;
+    if (n.freq < kMaxFreq) {
+        ++n.freq;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return n.block;
+}
+
+bool BlockCache::Contains(uint64_t chunk_id, uint64_t index) const {
+    const Shard& shard = ShardFor(chunk_id, index);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    return shard.map.count(Key{chunk_id, index}) != 0;
+}
+
+uint64_t BlockCache::FillToken(uint64_t chunk_id) const {
+    return ChunkShardFor(chunk_id).epochs[EpochSlot(chunk_id)].load(std::memory_order_acquire);
+}
+
+BlockCache::BlockPtr BlockCache::Insert(uint64_t chunk_id, uint64_t index, std::string data, uint64_t token) {
+    auto block = std::make_shared<Block>();
+    block->crc = butil::crc32c::Value(data.data(), data.size());
+    block->data = std::move(data);
+    BlockPtr result = block;
+    if (block->data.empty()) {
+        return result;
+    }
+
+    ChunkShard& cs = ChunkShardFor(chunk_id);
+    Shard& shard = ShardFor(chunk_id, index);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    if (cs.epochs[EpochSlot(chunk_id)].load(std::memory_order_acquire) != token) {
+        return result;
+    }
+    const Key key{chunk_id, index};
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        EraseLocked(shard, it);
+    }
+    bool to_main = false;
+    auto g = shard.ghost_map.find(key);
+    if (g != shard.ghost_map.end()) {
+        shard.ghost.erase(g->second);
+        shard.ghost_map.erase(g);
+        to_main = true;
+    }
+    NodeList& list = to_main ? shard.main : shard.small;
+    list.push_back(Node{key, result, 0, to_main});
+    auto node = std::prev(list.end());
+    shard.map.emplace(key, node);
+    (to_main ? shard.main_bytes : shard.small_bytes) += Charge(*node);
+    if (result->data.size() < opts_.block_size) {
+        std::lock_guard<std::mutex> clk(cs.mu);
+        cs.tails[chunk_id] = index;
+    }
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+    EvictLocked(shard);
+    return result;
+}
+
+void BlockCache::EraseLocked(Shard& shard, std::unordered_map<Key, NodeList::iterator, KeyHash>::iterator it) {
+    NodeList::iterator node = it->second;
+    (node->main ? shard.main_bytes : shard.small_bytes) -= Charge(*node);
+    if (node->block->data.size() < opts_.block_size) {
+        ChunkShard& cs = ChunkShardFor(node->key.chunk_id);
+        std::lock_guard<std::mutex> clk(cs.mu);
+        auto t = cs.tails.find(node->key.chunk_id);
+        if (t != cs.tails.end() && t->second == node->key.index) {
+            cs.tails.erase(t);
+        }
+    }
+    (node->main ? shard.main : shard.small).erase(node);
+    shard.map.erase(it);
+}
+
+void BlockCache::RememberGhostLocked(Shard& shard, const Key& key) {
+    if (shard.ghost_map.count(key) != 0) {
+        return;
+    }
+    shard.ghost.push_back(key);
+    shard.ghost_map.emplace(key, std::prev(shard.ghost.end()));
+    while (shard.ghost.size() > ghost_limit_) {
+        shard.ghost_map.erase(shard.ghost.front());
+        shard.ghost.pop_front();
+    }
+}
+
+// S3-FIFO: drain the small queue while it is over its share, promoting
+// blocks that were hit while queued; otherwise reinsert-or-evict from main.
+void BlockCache::EvictLocked(Shard& shard) {
+    const size_t small_target = static_cast<size_t>(shard_capacity_ * opts_.small_ratio);
+    while (shard.small_bytes + shard.main_bytes > shard_capacity_) {
+        if (!shard.small.empty() && (shard.small_bytes > small_target || shard.main.empty())) {
+            auto node = shard.small.begin();
+            if (node->freq > 0) {
+                const size_t charge = Charge(*node);
+                shard.small_bytes -= charge;
+                shard.main_bytes += charge;
+                node->freq = 0;
+                node->main = true;
+                shard.main.splice(shard.main.end(), shard.small, node);
+                continue;
+            }
+            const Key key = node->key;
+            EraseLocked(shard, shard.map.find(key));
+            RememberGhostLocked(shard, key);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        auto node = shard.main.begin();
+        if (node->freq > 0) {
+            --node->freq;
+            shard.main.splice(shard.main.end(), shard.main, node);
+            continue;
+        }
+        EraseLocked(shard, shard.map.find(node->key));
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BlockCache::EraseBlock(uint64_t chunk_id, uint64_t index) {
+    Shard& shard = ShardFor(chunk_id, index);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    auto it = shard.map.find(Key{chunk_id, index});
+    if (it != shard.map.end()) {
+        EraseLocked(shard, it);
+    }
+}
+
+// Bumps the chunk's fill epoch first, so a fill that read old data either
+// fails its token check or inserts before the erase below removes it.
+uint64_t BlockCache::BumpEpoch(uint64_t chunk_id) {
+    ChunkShard& cs = ChunkShardFor(chunk_id);
+    std::lock_guard<std::mutex> lk(cs.mu);
+    cs.epochs[EpochSlot(chunk_id)].fetch_add(1, std::memory_order_acq_rel);
+    auto t = cs.tails.find(chunk_id);
+    return t == cs.tails.end() ? UINT64_MAX : t->second;
+}
+
+void BlockCache::Invalidate(uint64_t chunk_id, uint64_t offset, uint64_t length) {
+    const uint64_t tail = BumpEpoch(chunk_id);
+    const uint64_t first = offset / opts_.block_size;
+    const uint64_t last = length == 0 ? first : (offset + length - 1) / opts_.block_size;
+    if (tail < first) {
+        EraseBlock(chunk_id, tail);
+    }
+    for (uint64_t i = first; i <= last; ++i) {
+        EraseBlock(chunk_id, i);
+    }
+}
+
+// Truncate is rare, so this walks every shard instead of keeping a per-chunk index.
+void BlockCache::InvalidateFrom(uint64_t chunk_id, uint64_t offset) {
+    const uint64_t tail = BumpEpoch(chunk_id);
+    const uint64_t first = offset / opts_.block_size;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mu);
+        for (auto it = shard.map.begin(); it != shard.map.end();) {
+            auto cur = it++;
+            if (cur->first.chunk_id == chunk_id && (cur->first.index >= first || cur->first.index == tail)) {
+                EraseLocked(shard, cur);
+            }
+        }
+    }
+}
+
+uint32_t BlockCache::CombineFullBlock(uint32_t crc_a, uint32_t block_crc) const {
+    return block_shift_->Combine(crc_a, block_crc);
+}
+
+BlockCache::Stats BlockCache::GetStats() const {
+    Stats s;
+    s.hits = hits_.load(std::memory_order_relaxed);
+    s.misses = misses_.load(std::memory_order_relaxed);
+    s.inserts = inserts_.load(std::memory_order_relaxed);
+    s.evictions = evictions_.load(std::memory_order_relaxed);
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mu);
+        s.bytes += shard.small_bytes + shard.main_bytes;
+        s.blocks += shard.map.size();
+    }
+    return s;
+}
+
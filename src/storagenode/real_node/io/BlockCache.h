@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "Crc32c.h"
+
+// In-memory cache of fixed-size, block-aligned chunk data keyed by
+// (chunk_id, block index). Each block carries the crc32c of its bytes, so a
+// fully cached read can build its reply checksum by combining block crcs
+// instead of rehashing the payload.
+//
+// Eviction is S3-FIFO per shard: new blocks enter a small FIFO and are only
+// promoted to the main FIFO if they are hit again before leaving it. Blocks
+// touched once, such as migration or scrub scans, churn through the small
+// queue without displacing the hot set. Keys evicted from the small queue
+// are remembered in a ghost FIFO so a quick re-read goes straight to main.
+class BlockCache {
+public:
+    struct Block {
+        std::string data;  // shorter than block_size only for the chunk's last block
+        uint32_t crc{0};
+    };
+    using BlockPtr = std::shared_ptr<const Block>;
+
+    struct Options {
+        Options();
+        size_t capacity_bytes;
+        size_t block_size;
+        double small_ratio;  // share of capacity given to the small FIFO
+    };
+
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t inserts{0};
+        uint64_t evictions{0};
+        uint64_t bytes{0};
+        uint64_t blocks{0};
+    };
+
+    explicit BlockCache(Options opts = Options());
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    size_t block_size() const { return opts_.block_size; }
+
+    BlockPtr Lookup(uint64_t chunk_id, uint64_t index);
+    // Presence check that neither counts as a hit nor bumps the block's frequency.
+    bool Contains(uint64_t chunk_id, uint64_t index) const;
+
+    // Take a token before reading from disk and pass it to Insert; the insert
+    // is skipped if the chunk was invalidated in between, so a read racing a
+    // write cannot cache stale data. The block is returned either way.
+    uint64_t FillToken(uint64_t chunk_id) const;
+    BlockPtr Insert(uint64_t chunk_id, uint64_t index, std::string data, uint64_t token);
+
+    // Drops blocks overlapping [offset, offset + length) plus a cached short
+    // last block before them, since a write past EOF extends it.
+    void Invalidate(uint64_t chunk_id, uint64_t offset, uint64_t length);
+    // Drops every block at or after offset and the short last block (truncate).
+    void InvalidateFrom(uint64_t chunk_id, uint64_t offset);
+
+    Stats GetStats() const;
+
+    // crc32c(A || B) for a B of exactly block_size bytes; a single 32x32
+    // matrix multiply (see Crc32c.h).
+    uint32_t CombineFullBlock(uint32_t crc_a, uint32_t block_crc) const;
+
+private:
+    struct Key {
+        uint64_t chunk_id;
+        uint64_t index;
+        bool operator==(const Key& o) const { return chunk_id == o.chunk_id && index == o.index; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.chunk_id * 0x9e3779b97f4a7c15ULL ^ (k.index + 0x632be59bd9b4e019ULL);
+            h ^= h >> 31;
+            h *= 0xbf58476d1ce4e5b9ULL;
+            h ^= h >> 29;
+            return static_cast<size_t>(h);
+        }
+    };
+    struct Node {
+        Key key;
+        BlockPtr block;
+        uint8_t freq{0};
+        bool main{false};
+    };
+    using NodeList = std::list<Node>;
+
+    static constexpr size_t kShards = 16;
+    static constexpr size_t kGroupShift = 4;  // runs of 16 blocks share a shard
+    static constexpr size_t kEpochSlots = 64;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mu;
+        NodeList small;
+        NodeList main;
+        std::unordered_map<Key, NodeList::iterator, KeyHash> map;
+        std::list<Key> ghost;
+        std::unordered_map<Key, std::list<Key>::iterator, KeyHash> ghost_map;
+        size_t small_bytes{0};
+        size_t main_bytes{0};
+    };
+
+    // Per-chunk state, sharded by chunk id so a large chunk's blocks can
+    // spread over all block shards. Locked after a block shard, never before.
+    struct alignas(64) ChunkShard {
+        std::mutex mu;
+        std::unordered_map<uint64_t, uint64_t> tails;  // chunk -> index of its cached short block
+        std::atomic<uint64_t> epochs[kEpochSlots] = {};
+    };
+
+    Shard& ShardFor(uint64_t chunk_id, uint64_t index);
+    const Shard& ShardFor(uint64_t chunk_id, uint64_t index) const;
+    ChunkShard& ChunkShardFor(uint64_t chunk_id);
+    const ChunkShard& ChunkShardFor(uint64_t chunk_id) const;
+    static size_t ShardIndex(uint64_t chunk_id, uint64_t index);
+    static size_t EpochSlot(uint64_t chunk_id) { return (chunk_id * 0xff51afd7ed558ccdULL) >> 58; }
+    static size_t Charge(const Node& n) { return n.block->data.size() + sizeof(Node) + 64; }
+    void EraseLocked(Shard& shard, std::unordered_map<Key, NodeList::iterator, KeyHash>::iterator it);
+    void EvictLocked(Shard& shard);
+    void EraseBlock(uint64_t chunk_id, uint64_t index);
+    uint64_t BumpEpoch(uint64_t chunk_id);  // returns the chunk's cached tail index or UINT64_MAX
+    void RememberGhostLocked(Shard& shard, const Key& key);
+
+    Options opts_;
+    size_t shard_capacity_;
+    size_t ghost_limit_;
+    std::unique_ptr<Crc32cShift> block_shift_;
+    Shard shards_[kShards];
+    ChunkShard chunk_shards_[kShards];
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> inserts_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
@@ -0,0 +1,301 @@
+#include "ChecksumStore.h"
+
+#include <butil/crc32c.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr size_t kHeaderSize = 16;
+
+bool PreadFull(int fd, void* buf, size_t n, uint64_t off) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t got = ::pread(fd, p, n, static_cast<off_t>(off));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= static_cast<size_t>(got);
+        off += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+bool PwriteFull(int fd, const void* buf, size_t n, uint64_t off) {
+    const char* p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t put = ::pwrite(fd, p, n, static_cast<off_t>(off));
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        n -= static_cast<size_t>(put);
+        off += static_cast<uint64_t>(put);
+    }
+    return true;
+}
+
+// Closes the fd on scope exit.
+struct FdGuard {
+    int fd;
+    explicit FdGuard(int f) : fd(f) {}
+    ~FdGuard() {
+        if (fd >= 0) ::close(fd);
+    }
+    FdGuard(const FdGuard&) = delete;
+    FdGuard& operator=(const FdGuard&) = delete;
+};
+
+} // namespace
+
+ChecksumStore::Options::Options() : block_size(64u << 10), sync(false) {}
+
+ChecksumStore::ChecksumStore(Options opts)
+    : opts_(opts), block_shift_(opts.block_size == 0 ? 64u << 10 : opts.block_size) {
+    opts_.block_size = block_shift_.length();
+    const std::string zeros(opts_.block_size, '\0');
+    zero_block_crc_ = butil::crc32c::Value(zeros.data(), zeros.size());
+}
+
+std::string ChecksumStore::SidecarPath(const std::string& chunk_path) {
+    return chunk_path + ".crc";
+}
+
+bool ChecksumStore::ReadHeader(int fd, Header* h) const {
+    char raw[kHeaderSize];
+    if (!PreadFull(fd, raw, sizeof(raw), 0)) {
+        return false;
+    }
+    std::memcpy(&h->magic, raw, 4);
+    std::memcpy(&h->block_size, raw + 4, 4);
+    std::memcpy(&h->size, raw + 8, 8);
+    return h->magic == kMagic && h->block_size == opts_.block_size;
+}
+
+bool ChecksumStore::StoreBlocks(int sidecar_fd, int data_fd, uint64_t from, uint64_t to, uint64_t size,
+                                const char* known, uint64_t known_off, uint64_t known_len,
+                                uint64_t zero_lo, uint64_t zero_hi) const {
+    const uint64_t bs = opts_.block_size;
+    std::vector<uint32_t> crcs;
+    crcs.reserve(static_cast<size_t>(to - from + 1));
+    std::string buf;
+    for (uint64_t b = from; b <= to; ++b) {
+        const uint64_t lo = b * bs;
+        const uint64_t hi = std::min(lo + bs, size);
+        if (hi <= lo) {
+            break;
+        }
+        if (known != nullptr && lo >= known_off && hi <= known_off + known_len) {
+            crcs.push_back(butil::crc32c::Value(known + (lo - known_off), hi - lo));
+        } else if (hi - lo == bs && lo >= zero_lo && hi <= zero_hi) {
+            crcs.push_back(zero_block_crc_);
+        } else {
+            buf.resize(hi - lo);
+            if (!PreadFull(data_fd, &buf[0], buf.size(), lo)) {
+                return false;
+            }
+            crcs.push_back(butil::crc32c::Value(buf.data(), buf.size()));
+        }
+    }
+    return crcs.empty() ||
+           PwriteFull(sidecar_fd, crcs.data(), crcs.size() * sizeof(uint32_t), kHeaderSize + from * sizeof(uint32_t));
+}
+
+bool ChecksumStore::Fail(const std::string& path) const {
+    ::unlink(SidecarPath(path).c_str());
+    return false;
+}
+
+bool ChecksumStore::Update(uint64_t chunk_id, const std::string& path, uint64_t offset, const void* data,
+                           size_t size) {
+    if (size == 0) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lk(LockFor(chunk_id));
+    FdGuard side(::open(SidecarPath(path).c_str(), O_RDWR));
+    Header h{};
+    if (side.fd < 0 || !ReadHeader(side.fd, &h)) {
+        return RebuildLocked(path);
+    }
+    FdGuard file(::open(path.c_str(), O_RDONLY));
+    if (file.fd < 0) {
+        return Fail(path);
+    }
+    const uint64_t bs = opts_.block_size;
+    const uint64_t end = offset + size;
+    const uint64_t new_size = std::max(h.size, end);
+    // Writing past the old end turns the old short last block and the gap
+    // before offset into zero-filled blocks.
+    const uint64_t from = offset > h.size ? h.size / bs : offset / bs;
+    if (!StoreBlocks(side.fd, file.fd, from, (end - 1) / bs, new_size, static_cast<const char*>(data), offset,
+                     size, h.size, offset)) {
+        return Fail(path);
+    }
+    if (new_size != h.size) {
+        h.size = new_size;
+        if (!PwriteFull(side.fd, &h.size, sizeof(h.size), 8)) {
+            return Fail(path);
+        }
+    }
+    if (opts_.sync && ::fdatasync(side.fd) != 0) {
+        return Fail(path);
+    }
+    return true;
+}
+
+bool ChecksumStore::Truncate(uint64_t chunk_id, const std::string& path, uint64_t size) {
+    std::lock_guard<std::mutex> lk(LockFor(chunk_id));
+    FdGuard side(::open(SidecarPath(path).c_str(), O_RDWR));
+    Header h{};
+    if (side.fd < 0 || !ReadHeader(side.fd, &h)) {
+        return RebuildLocked(path);
+    }
+    FdGuard file(::open(path.c_str(), O_RDONLY));
+    if (file.fd < 0) {
+        return Fail(path);
+    }
+    const uint64_t bs = opts_.block_size;
+    const uint64_t blocks = (size + bs - 1) / bs;
+    if (::ftruncate(side.fd, static_cast<off_t>(kHeaderSize + blocks * sizeof(uint32_t))) != 0) {
+        return Fail(path);
+    }
+    if (size > 0) {
+        // shrinking re-hashes the new short last block; growing also covers
+        // the old short last block and the zeros after it
+        const uint64_t from = size > h.size ? h.size / bs : (size - 1) / bs;
+        if (!StoreBlocks(side.fd, file.fd, from, (size - 1) / bs, size, nullptr, 0, 0, h.size, size)) {
+            return Fail(path);
+        }
+    }
+    h.size = size;
+    if (!PwriteFull(side.fd, &h.size, sizeof(h.size), 8) || (opts_.sync && ::fdatasync(side.fd) != 0)) {
+        return Fail(path);
+    }
+    return true;
+}
+
+bool ChecksumStore::Rebuild(uint64_t chunk_id, const std::string& path) {
+    std::lock_guard<std::mutex> lk(LockFor(chunk_id));
+    return RebuildLocked(path);
+}
+
+// Writes the new sidecar under a temporary name and renames it into place so
+// a reader never sees a half-built one.
+bool ChecksumStore::RebuildLocked(const std::string& path) {
+    FdGuard file(::open(path.c_str(), O_RDONLY));
+    struct stat st {};
+    if (file.fd < 0 || ::fstat(file.fd, &st) != 0) {
+        return Fail(path);
+    }
+    const std::string tmp = SidecarPath(path) + ".tmp";
+    FdGuard side(::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (side.fd < 0) {
+        return Fail(path);
+    }
+    Header h{kMagic, static_cast<uint32_t>(opts_.block_size), static_cast<uint64_t>(st.st_size)};
+    char raw[kHeaderSize];
+    std::memcpy(raw, &h.magic, 4);
+    std::memcpy(raw + 4, &h.block_size, 4);
+    std::memcpy(raw + 8, &h.size, 8);
+    const uint64_t blocks = (h.size + opts_.block_size - 1) / opts_.block_size;
+    bool ok = PwriteFull(side.fd, raw, sizeof(raw), 0) &&
+              (blocks == 0 || StoreBlocks(side.fd, file.fd, 0, blocks - 1, h.size, nullptr, 0, 0, 0, 0)) &&
+              (!opts_.sync || ::fdatasync(side.fd) == 0) &&
+              ::rename(tmp.c_str(), SidecarPath(path).c_str()) == 0;
+    if (!ok) {
+        std::cerr << "[RealNode] checksum sidecar rebuild failed for " << path << ": " << std::strerror(errno)
+                  << std::endl;
+        ::unlink(tmp.c_str());
+        return Fail(path);
+    }
+    return true;
+}
+
+bool ChecksumStore::Checksum(const std::string& path, uint64_t offset, const std::string& data,
+                             uint32_t* crc) const {
+    const uint64_t bs = opts_.block_size;
+    const uint64_t end = offset + data.size();
+    const uint64_t first = (offset + bs - 1) / bs;  // first block starting inside the range
+    if (first * bs >= end) {
+        return false;  // no whole block to reuse
+    }
+    FdGuard side(::open(SidecarPath(path).c_str(), O_RDONLY));
+    Header h{};
+    if (side.fd < 0 || !ReadHeader(side.fd, &h) || end > h.size) {
+        return false;
+    }
+    // whole blocks end inside the range; the chunk's short last block counts
+    // as whole when the range reaches EOF
+    uint64_t last = first;
+    while ((last + 1) * bs <= end || (last * bs < end && end == h.size)) {
+        ++last;
+    }
+    if (last == first) {
+        return false;
+    }
+    std::vector<uint32_t> stored(static_cast<size_t>(last - first));
+    if (!PreadFull(side.fd, stored.data(), stored.size() * sizeof(uint32_t), kHeaderSize + first * sizeof(uint32_t))) {
+        return false;
+    }
+    uint32_t c = butil::crc32c::Value(data.data(), static_cast<size_t>(first * bs - offset));
+    for (uint64_t b = first; b < last; ++b) {
+        const uint64_t len = std::min(bs, h.size - b * bs);
+        const uint32_t block_crc = stored[static_cast<size_t>(b - first)];
+        c = len == bs ? block_shift_.Combine(c, block_crc) : Crc32cCombine(c, block_crc, static_cast<size_t>(len));
+    }
+    const uint64_t tail = std::min(last * bs, end);
+    *crc = butil::crc32c::Extend(c, data.data() + (tail - offset), static_cast<size_t>(end - tail));
+    return true;
+}
+
+ChecksumStore::VerifyResult ChecksumStore::Verify(const std::string& path, uint64_t first_block,
+                                                  size_t count) const {
+    VerifyResult r;
+    FdGuard side(::open(SidecarPath(path).c_str(), O_RDONLY));
+    Header h{};
+    if (side.fd < 0 || !ReadHeader(side.fd, &h)) {
+        r.err = side.fd < 0 ? errno : EINVAL;
+        return r;
+    }
+    const uint64_t bs = opts_.block_size;
+    r.blocks = (h.size + bs - 1) / bs;
+    if (first_block >= r.blocks || count == 0) {
+        return r;
+    }
+    const uint64_t last = std::min<uint64_t>(r.blocks, first_block + count);
+    std::vector<uint32_t> stored(static_cast<size_t>(last - first_block));
+    if (!PreadFull(side.fd, stored.data(), stored.size() * sizeof(uint32_t),
+                   kHeaderSize + first_block * sizeof(uint32_t))) {
+        r.err = EIO;
+        return r;
+    }
+    FdGuard file(::open(path.c_str(), O_RDONLY));
+    if (file.fd < 0) {
+        r.err = errno;
+        return r;
+    }
+    const uint64_t lo = first_block * bs;
+    const uint64_t hi = std::min(last * bs, h.size);
+    std::string buf(static_cast<size_t>(hi - lo), '\0');
+    ssize_t got = ::pread(file.fd, &buf[0], buf.size(), static_cast<off_t>(lo));
+    if (got < 0) {
+        r.err = errno;
+        return r;
+    }
+    r.bytes = static_cast<uint64_t>(got);
+    for (uint64_t b = first_block; b < last; ++b) {
+        const uint64_t off = (b - first_block) * bs;
+        const uint64_t len = std::min(bs, h.size - b * bs);
+        // a chunk file shorter than its sidecar says is as bad as a wrong crc
+        if (off + len > r.bytes ||
+            butil::crc32c::Value(buf.data() + off, static_cast<size_t>(len)) != stored[static_cast<size_t>(b - first_block)]) {
+            r.bad.push_back(b);
+        }
+    }
+    return r;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Crc32c.h"
+
+// Per-block crc32c of chunk files, kept in a sidecar next to each chunk
+// (<chunk path>.crc) so data at rest can be verified and read replies can be
+// checksummed without hashing the whole payload.
+//
+// Sidecar: [magic u32][block_size u32][size u64] followed by one crc32c per
+// block; the last block's crc covers only the bytes before size. A sidecar is
+// updated after the data write it describes, under a per-chunk stripe lock,
+// and recomputes partial blocks from the file, so concurrent writers to one
+// block cannot leave a stale crc behind. A crash between the data write and
+// the update shows up as a mismatch to the scrubber. A failed update removes
+// the sidecar; a missing one is rebuilt from the chunk file.
+class ChecksumStore {
+public:
+    struct Options {
+        Options();
+        size_t block_size;
+        bool sync;  // fdatasync the sidecar after each update
+    };
+
+    struct VerifyResult {
+        int err{0};             // ENOENT when the chunk has no sidecar
+        uint64_t blocks{0};     // blocks in the chunk
+        uint64_t bytes{0};      // bytes read and checked
+        std::vector<uint64_t> bad;
+    };
+
+    explicit ChecksumStore(Options opts = Options());
+
+    size_t block_size() const { return opts_.block_size; }
+    static std::string SidecarPath(const std::string& chunk_path);
+
+    // Call once [offset, offset + size) holding data has reached the chunk file.
+    bool Update(uint64_t chunk_id, const std::string& path, uint64_t offset, const void* data, size_t size);
+    // Call once the chunk file has been truncated or extended to size.
+    bool Truncate(uint64_t chunk_id, const std::string& path, uint64_t size);
+    // Recomputes the whole sidecar from the chunk file.
+    bool Rebuild(uint64_t chunk_id, const std::string& path);
+
+    // crc32c of data, the chunk's bytes at offset, from the stored crcs of the
+    // whole blocks it covers; only partial head/tail slices are hashed.
+    // Returns false when the sidecar is missing or does not cover the range.
+    bool Checksum(const std::string& path, uint64_t offset, const std::string& data, uint32_t* crc) const;
+
+    // Re-reads blocks [first_block, first_block + count) and compares them
+    // with the sidecar.
+    VerifyResult Verify(const std::string& path, uint64_t first_block, size_t count) const;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t block_size;
+        uint64_t size;
+    };
+    static constexpr uint32_t kMagic = 0x5a42434bu;  // "ZBCK"
+    static constexpr size_t kLockStripes = 64;
+
+    std::mutex& LockFor(uint64_t chunk_id) const { return locks_[chunk_id % kLockStripes]; }
+    bool ReadHeader(int fd, Header* h) const;
+    // Stores crcs of blocks [from, to] of a chunk of `size` bytes. Blocks
+    // fully inside [known_off, known_off + known_len) are hashed from known,
+    // full blocks inside [zero_lo, zero_hi) are zero, the rest are read back.
+    bool StoreBlocks(int sidecar_fd, int data_fd, uint64_t from, uint64_t to, uint64_t size,
+                     const char* known, uint64_t known_off, uint64_t known_len,
+                     uint64_t zero_lo, uint64_t zero_hi) const;
+    bool RebuildLocked(const std::string& path);
+    bool Fail(const std::string& path) const;
+
+    Options opts_;
+    Crc32cShift block_shift_;
+    uint32_t zero_block_crc_{0};
+    mutable std::mutex locks_[kLockStripes];
+};
@@ -0,0 +1,850 @@
+#include "ChunkCompressor.h"
+
+#include <butil/crc32c.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifdef ZB_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef ZB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// .z layout: FileHeader, the stored blocks back to back, then one
+// BlockEntry per block at index_offset.
+struct FileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t codec;  // the chunk's codec; blocks may still be stored raw
+    uint8_t reserved;
+    uint32_t block_size;
+    uint32_t blocks;
+    uint64_t size;  // bytes of chunk data
+    uint64_t index_offset;
+};
+static_assert(sizeof(FileHeader) == 32, "FileHeader is part of the on-disk format");
+
+struct BlockEntry {
+    uint64_t offset;
+    uint32_t stored;
+    uint32_t crc;  // crc32c of the block's data
+    uint8_t codec;
+    uint8_t reserved[7];
+};
+static_assert(sizeof(BlockEntry) == 24, "BlockEntry is part of the on-disk format");
+
+constexpr uint32_t kMagic = 0x5a42435au;  // "ZBCZ"
+constexpr uint16_t kVersion = 1;
+// Blocks whose output is flushed, or expanded, per IO.
+constexpr size_t kBatchBytes = 4u << 20;
+
+bool PreadFull(int fd, void* buf, size_t n, uint64_t off) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t got = ::pread(fd, p, n, static_cast<off_t>(off));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= static_cast<size_t>(got);
+        off += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+bool PwriteFull(int fd, const void* buf, size_t n, uint64_t off) {
+    const char* p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t put = ::pwrite(fd, p, n, static_cast<off_t>(off));
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        n -= static_cast<size_t>(put);
+        off += static_cast<uint64_t>(put);
+    }
+    return true;
+}
+
+// Closes the fd on scope exit.
+struct FdGuard {
+    int fd;
+    explicit FdGuard(int f) : fd(f) {}
+    ~FdGuard() {
+        if (fd >= 0) ::close(fd);
+    }
+    FdGuard(const FdGuard&) = delete;
+    FdGuard& operator=(const FdGuard&) = delete;
+};
+
+int Errno(int fallback = EIO) {
+    return errno != 0 ? errno : fallback;
+}
+
+std::string TmpPath(const std::string& path) {
+    return path + ".z.tmp";
+}
+
+// Makes a rename in the chunk's directory durable.
+void SyncDir(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    FdGuard fd(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd.fd >= 0) {
+        ::fsync(fd.fd);
+    }
+}
+
+uint64_t NanosSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+} // namespace
+
+struct ChunkCompressor::Index {
+    Codec codec{Codec::kNone};
+    uint64_t block_size{0};
+    uint64_t size{0};
+    uint64_t stored{0};  // bytes of the .z file
+    std::vector<BlockEntry> blocks;
+
+    size_t BlockBytes(size_t i) const {
+        return static_cast<size_t>(std::min<uint64_t>(block_size, size - i * block_size));
+    }
+};
+
+ChunkCompressor::Options::Options()
+    : block_size(64u << 10),
+      zstd_level(3),
+      min_saving(0.1),
+      sample_blocks(8),
+      warm_codec(Codec::kLz4),
+      cold_codec(Codec::kZstd),
+      warm_after(std::chrono::seconds(600)),
+      cold_after(std::chrono::seconds(86400)),
+      max_chunks(1u << 20) {}
+
+ChunkCompressor::ChunkCompressor(Options opts, CompressFn compress_idle)
+    : opts_(opts), compress_idle_(std::move(compress_idle)) {
+    opts_.block_size = std::max<size_t>(opts_.block_size, 4096);
+    opts_.sample_blocks = std::max<size_t>(opts_.sample_blocks, 1);
+    opts_.min_saving = std::min(std::max(opts_.min_saving, 0.0), 0.99);
+    if (!Supported(opts_.warm_codec)) {
+        opts_.warm_codec = Supported(opts_.cold_codec) ? opts_.cold_codec : Codec::kNone;
+    }
+    if (!Supported(opts_.cold_codec)) {
+        opts_.cold_codec = opts_.warm_codec;
+    }
+    const bool warm = opts_.warm_after.count() > 0 && opts_.warm_codec != Codec::kNone;
+    const bool cold = opts_.cold_after.count() > 0 && opts_.cold_codec != Codec::kNone;
+    if (compress_idle_ && (warm || cold)) {
+        sweeper_ = std::thread([this]() { Sweep(); });
+    }
+}
+
+ChunkCompressor::~ChunkCompressor() {
+    {
+        std::lock_guard<std::mutex> lk(sweep_mu_);
+        stop_ = true;
+    }
+    sweep_cv_.notify_all();
+    if (sweeper_.joinable()) {
+        sweeper_.join();
+    }
+}
+
+bool ChunkCompressor::Supported(Codec codec) {
+    switch (codec) {
+        case Codec::kNone:
+            return true;
+        case Codec::kLz4:
+#ifdef ZB_HAVE_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case Codec::kZstd:
+#ifdef ZB_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+const char* ChunkCompressor::CodecName(Codec codec) {
+    switch (codec) {
+        case Codec::kNone: return "none";
+        case Codec::kLz4: return "lz4";
+        case Codec::kZstd: return "zstd";
+    }
+    return "unknown";
+}
+
+std::string ChunkCompressor::CompressedPath(const std::string& path) {
+    return path + ".z";
+}
+
+ChunkCompressor::Chunk& ChunkCompressor::Lookup(Shard& shard, uint64_t chunk_id, const std::string& path,
+                                                std::unique_lock<std::mutex>& lk) {
+    auto it = shard.chunks.find(chunk_id);
+    if (it != shard.chunks.end()) {
+        return it->second;
+    }
+    lk.unlock();
+    struct stat st;
+    const bool compressed = ::stat(CompressedPath(path).c_str(), &st) == 0;
+    lk.lock();
+    it = shard.chunks.find(chunk_id);
+    if (it == shard.chunks.end()) {
+        if (shard.chunks.size() >= std::max<size_t>(1, opts_.max_chunks / kShards)) {
+            Evict(shard);
+        }
+        it = shard.chunks.emplace(chunk_id, Chunk{}).first;
+        it->second.compressed = compressed;
+        it->second.touched = std::chrono::steady_clock::now();
+    }
+    return it->second;
+}
+
+void ChunkCompressor::Evict(Shard& shard) {
+    for (auto it = shard.chunks.begin(); it != shard.chunks.end(); ++it) {
+        const Chunk& c = it->second;
+        if (c.users == 0 && !c.busy && !c.compressing) {
+            SetIndex(it->second, nullptr);
+            shard.chunks.erase(it);
+            return;
+        }
+    }
+}
+
+void ChunkCompressor::SetIndex(Chunk& c, std::shared_ptr<const Index> index) {
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    if (c.index) {
+        --stats_.chunks;
+        stats_.raw_bytes -= c.index->size;
+        stats_.stored_bytes -= c.index->stored;
+    }
+    c.index = std::move(index);
+    if (c.index) {
+        ++stats_.chunks;
+        stats_.raw_bytes += c.index->size;
+        stats_.stored_bytes += c.index->stored;
+    }
+}
+
+std::shared_ptr<const ChunkCompressor::Index> ChunkCompressor::IndexOf(uint64_t chunk_id, const std::string& path,
+                                                                       int* err) {
+    Shard& s = ShardFor(chunk_id);
+    {
+        std::lock_guard<std::mutex> lk(s.mu);
+        auto it = s.chunks.find(chunk_id);
+        if (it != s.chunks.end() && it->second.index) {
+            return it->second.index;
+        }
+    }
+    auto index = LoadIndex(CompressedPath(path), err);
+    if (index) {
+        std::lock_guard<std::mutex> lk(s.mu);
+        auto it = s.chunks.find(chunk_id);
+        if (it != s.chunks.end() && it->second.compressed && !it->second.index) {
+            SetIndex(it->second, index);
+        }
+    }
+    return index;
+}
+
+bool ChunkCompressor::IsCompressed(uint64_t chunk_id, const std::string& path) {
+    Shard& s = ShardFor(chunk_id);
+    std::unique_lock<std::mutex> lk(s.mu);
+    return Lookup(s, chunk_id, path, lk).compressed;
+}
+
+ChunkCompressor::Access ChunkCompressor::Begin(uint64_t chunk_id, const std::string& path, bool write) {
+    Access access;
+    Shard& s = ShardFor(chunk_id);
+    std::unique_lock<std::mutex> lk(s.mu);
+    for (;;) {
+        Chunk& c = Lookup(s, chunk_id, path, lk);
+        if (c.busy) {
+            s.cv.wait(lk);
+            continue;
+        }
+        c.touched = std::chrono::steady_clock::now();
+        if (write) {
+            ++c.gen;
+            if (c.compressed) {
+                access.err = ExpandLocked(s, c, chunk_id, path, lk);
+                if (access.err != 0) {
+                    return access;
+                }
+                continue;
+            }
+        }
+        ++c.users;
+        access.compressed = c.compressed;
+        return access;
+    }
+}
+
+void ChunkCompressor::End(uint64_t chunk_id, bool write) {
+    Shard& s = ShardFor(chunk_id);
+    std::lock_guard<std::mutex> lk(s.mu);
+    auto it = s.chunks.find(chunk_id);
+    if (it == s.chunks.end()) {
+        return;
+    }
+    Chunk& c = it->second;
+    if (c.users > 0) {
+        --c.users;
+    }
+    if (write) {
+        ++c.gen;  // a compression that read during the write is stale
+        c.written = true;
+    }
+    c.touched = std::chrono::steady_clock::now();
+    if (c.users == 0) {
+        s.cv.notify_all();
+    }
+}
+
+int ChunkCompressor::ExpandLocked(Shard& shard, Chunk& c, uint64_t chunk_id, const std::string& path,
+                                  std::unique_lock<std::mutex>& lk) {
+    c.busy = true;
+    shard.cv.wait(lk, [&c]() { return c.users == 0; });
+    auto index = c.index;
+    lk.unlock();
+    int err = 0;
+    if (!index) {
+        index = LoadIndex(CompressedPath(path), &err);
+    }
+    if (index) {
+        err = Expand(path, *index);
+    }
+    if (err == 0 && opts_.on_switch) {
+        opts_.on_switch(chunk_id, path, false);
+    }
+    lk.lock();
+    c.busy = false;
+    if (err == 0) {
+        c.compressed = false;
+        ++c.gen;
+        SetIndex(c, nullptr);
+        std::lock_guard<std::mutex> st(stats_mu_);
+        ++stats_.expansions;
+    }
+    shard.cv.notify_all();
+    return err;
+}
+
+// Writes the data back into the chunk file, then drops the .z file. A crash
+// in between leaves both, and the .z file still wins.
+int ChunkCompressor::Expand(const std::string& path, const Index& index) {
+    const std::string zpath = CompressedPath(path);
+    FdGuard zfd(::open(zpath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (zfd.fd < 0) {
+        return Errno();
+    }
+    FdGuard fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+    if (fd.fd < 0) {
+        return Errno();
+    }
+    int err = 0;
+    std::string stored;
+    std::string block;
+    std::string out;
+    for (size_t first = 0; first < index.blocks.size() && err == 0;) {
+        // a run of blocks, read with one pread
+        size_t last = first;
+        uint64_t raw = index.BlockBytes(first);
+        while (last + 1 < index.blocks.size() && raw + index.BlockBytes(last + 1) <= kBatchBytes) {
+            raw += index.BlockBytes(++last);
+        }
+        const uint64_t from = index.blocks[first].offset;
+        const uint64_t to = index.blocks[last].offset + index.blocks[last].stored;
+        stored.resize(static_cast<size_t>(to - from));
+        if (!PreadFull(zfd.fd, &stored[0], stored.size(), from)) {
+            err = Errno();
+            break;
+        }
+        out.clear();
+        for (size_t i = first; i <= last && err == 0; ++i) {
+            err = Decode(index, i, stored.data() + (index.blocks[i].offset - from), &block);
+            out.append(block);
+        }
+        if (err == 0 && !PwriteFull(fd.fd, out.data(), out.size(), first * index.block_size)) {
+            err = Errno();
+        }
+        first = last + 1;
+    }
+    if (err == 0 && ::ftruncate(fd.fd, static_cast<off_t>(index.size)) != 0) {
+        err = Errno();
+    }
+    if (err == 0 && ::fdatasync(fd.fd) != 0) {
+        err = Errno();
+    }
+    if (err != 0) {
+        (void)::ftruncate(fd.fd, 0);  // the .z file stays authoritative
+        return err;
+    }
+    if (::unlink(zpath.c_str()) != 0 && errno != ENOENT) {
+        return Errno();
+    }
+    return 0;
+}
+
+IOEngine::Result ChunkCompressor::Read(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                                       std::string* out) {
+    IOEngine::Result res;
+    out->clear();
+    int err = 0;
+    auto index = IndexOf(chunk_id, path, &err);
+    if (!index) {
+        res.bytes = -1;
+        res.err = err;
+        return res;
+    }
+    if (length == 0 || offset >= index->size) {
+        return res;
+    }
+    const uint64_t end = std::min<uint64_t>(offset + length, index->size);
+    const uint64_t bs = index->block_size;
+    const size_t first = static_cast<size_t>(offset / bs);
+    const size_t last = static_cast<size_t>((end - 1) / bs);
+    const uint64_t from = index->blocks[first].offset;
+    const uint64_t to = index->blocks[last].offset + index->blocks[last].stored;
+    std::string stored(static_cast<size_t>(to - from), '\0');
+    {
+        FdGuard fd(::open(CompressedPath(path).c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd.fd < 0 || !PreadFull(fd.fd, &stored[0], stored.size(), from)) {
+            res.bytes = -1;
+            res.err = Errno();
+            return res;
+        }
+    }
+    out->reserve(static_cast<size_t>(end - offset));
+    std::string block;
+    for (size_t i = first; i <= last; ++i) {
+        err = Decode(*index, i, stored.data() + (index->blocks[i].offset - from), &block);
+        if (err != 0) {
+            out->clear();
+            res.bytes = -1;
+            res.err = err;
+            return res;
+        }
+        const uint64_t start = i * bs;
+        const uint64_t lo = std::max(offset, start) - start;
+        const uint64_t hi = std::min(end, start + block.size()) - start;
+        out->append(block, static_cast<size_t>(lo), static_cast<size_t>(hi - lo));
+    }
+    res.bytes = static_cast<ssize_t>(out->size());
+    return res;
+}
+
+int ChunkCompressor::Size(uint64_t chunk_id, const std::string& path, uint64_t* size) {
+    int err = 0;
+    auto index = IndexOf(chunk_id, path, &err);
+    if (!index) {
+        return err;
+    }
+    *size = index->size;
+    return 0;
+}
+
+ChunkCompressor::Codec ChunkCompressor::Encode(Codec codec, const char* data, size_t size, std::string* out) {
+    const auto start = std::chrono::steady_clock::now();
+    size_t n = 0;
+    switch (codec) {
+#ifdef ZB_HAVE_LZ4
+        case Codec::kLz4: {
+            out->resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(size))));
+            const int r = LZ4_compress_default(data, &(*out)[0], static_cast<int>(size), static_cast<int>(out->size()));
+            n = r > 0 ? static_cast<size_t>(r) : 0;
+            break;
+        }
+#endif
+#ifdef ZB_HAVE_ZSTD
+        case Codec::kZstd: {
+            thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> ctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+            out->resize(ZSTD_compressBound(size));
+            const size_t r = ZSTD_compressCCtx(ctx.get(), &(*out)[0], out->size(), data, size, opts_.zstd_level);
+            n = ZSTD_isError(r) ? 0 : r;
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+    {
+        std::lock_guard<std::mutex> lk(stats_mu_);
+        stats_.compress_ns += NanosSince(start);
+    }
+    const size_t limit = size - static_cast<size_t>(static_cast<double>(size) * opts_.min_saving);
+    if (n == 0 || n > limit) {
+        out->assign(data, size);
+        return Codec::kNone;
+    }
+    out->resize(n);
+    return codec;
+}
+
+int ChunkCompressor::Decode(const Index& index, size_t block, const char* stored, std::string* out) {
+    const BlockEntry& e = index.blocks[block];
+    const size_t raw = index.BlockBytes(block);
+    out->resize(raw);
+    const auto start = std::chrono::steady_clock::now();
+    bool ok = false;
+    switch (static_cast<Codec>(e.codec)) {
+        case Codec::kNone:
+            ok = e.stored == raw;
+            if (ok) {
+                std::memcpy(&(*out)[0], stored, raw);
+            }
+            break;
+#ifdef ZB_HAVE_LZ4
+        case Codec::kLz4:
+            ok = LZ4_decompress_safe(stored, &(*out)[0], static_cast<int>(e.stored), static_cast<int>(raw)) ==
+                 static_cast<int>(raw);
+            break;
+#endif
+#ifdef ZB_HAVE_ZSTD
+        case Codec::kZstd: {
+            thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> ctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            ok = ZSTD_decompressDCtx(ctx.get(), &(*out)[0], raw, stored, e.stored) == raw;
+            break;
+        }
+#endif
+        default:
+            return ENOTSUP;  // written by a build with a codec this one lacks
+    }
+    const bool intact = ok && butil::crc32c::Value(out->data(), raw) == e.crc;
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    stats_.decompress_ns += NanosSince(start);
+    if (!intact) {
+        ++stats_.corrupt_blocks;
+        return EIO;
+    }
+    return 0;
+}
+
+ChunkCompressor::Result ChunkCompressor::Compress(uint64_t chunk_id, const std::string& path, Codec codec) {
+    Result result;
+    if (!Supported(codec)) {
+        result.err = ENOTSUP;
+        return result;
+    }
+    Shard& s = ShardFor(chunk_id);
+    std::unique_lock<std::mutex> lk(s.mu);
+    Chunk& c = Lookup(s, chunk_id, path, lk);
+    c.queued = false;
+    if (c.busy || c.compressing) {
+        result.err = EBUSY;
+        return result;
+    }
+    if (codec == Codec::kNone) {
+        if (c.compressed) {
+            result.err = ExpandLocked(s, c, chunk_id, path, lk);
+        }
+        return result;
+    }
+    c.compressing = true;  // keeps the entry, and c, alive
+    const uint64_t gen = c.gen;
+    const bool was_compressed = c.compressed;
+    lk.unlock();
+
+    int err = 0;
+    std::shared_ptr<const Index> source;
+    std::shared_ptr<const Index> built;
+    if (was_compressed) {
+        source = IndexOf(chunk_id, path, &err);
+    }
+    if (err == 0) {
+        if (source && source->codec == codec) {
+            result.codec = codec;
+            result.raw_bytes = source->size;
+            result.stored_bytes = source->stored;
+        } else {
+            err = Build(path, codec, source.get(), &result, &built);
+        }
+    }
+
+    lk.lock();
+    if (err == 0 && built) {
+        if (c.gen != gen) {
+            err = EBUSY;
+        } else {
+            c.busy = true;
+            s.cv.wait(lk, [&c]() { return c.users == 0; });
+            if (c.gen != gen) {
+                err = EBUSY;
+            } else {
+                lk.unlock();
+                err = Commit(path, was_compressed);
+                if (err == 0 && opts_.on_switch) {
+                    opts_.on_switch(chunk_id, path, true);
+                }
+                lk.lock();
+            }
+            c.busy = false;
+            if (err == 0) {
+                c.compressed = true;
+                SetIndex(c, built);
+            }
+            s.cv.notify_all();
+        }
+    }
+    if (err == 0) {
+        c.written = false;
+    }
+    c.compressing = false;
+    lk.unlock();
+    if (err != 0) {
+        if (built) {
+            ::unlink(TmpPath(path).c_str());
+        }
+        Result failed;
+        failed.err = err;
+        return failed;
+    }
+    if (built) {
+        std::lock_guard<std::mutex> st(stats_mu_);
+        ++stats_.compressions;
+    }
+    return result;
+}
+
+// Writes the chunk, read from the chunk file or from source, to the
+// temporary .z file; leaves *built empty when the sample says to keep the
+// chunk as it is.
+int ChunkCompressor::Build(const std::string& path, Codec codec, const Index* source, Result* result,
+                           std::shared_ptr<const Index>* built) {
+    FdGuard src(::open((source ? CompressedPath(path) : path).c_str(), O_RDONLY | O_CLOEXEC));
+    if (src.fd < 0) {
+        return Errno();
+    }
+    uint64_t size = 0;
+    if (source) {
+        size = source->size;
+    } else {
+        struct stat st;
+        if (::fstat(src.fd, &st) != 0) {
+            return Errno();
+        }
+        size = static_cast<uint64_t>(st.st_size);
+    }
+    auto index = std::make_shared<Index>();
+    index->codec = codec;
+    index->block_size = source ? source->block_size : opts_.block_size;
+    index->size = size;
+    const uint64_t bs = index->block_size;
+    const size_t blocks = static_cast<size_t>((size + bs - 1) / bs);
+    // keeping the chunk as it is
+    result->codec = source ? source->codec : Codec::kNone;
+    result->raw_bytes = size;
+    result->stored_bytes = source ? source->stored : size;
+    if (blocks == 0) {
+        return 0;
+    }
+
+    std::string scratch;
+    auto read_block = [&](size_t i, std::string* raw) -> int {
+        if (source) {
+            const BlockEntry& e = source->blocks[i];
+            scratch.resize(e.stored);
+            if (!PreadFull(src.fd, &scratch[0], e.stored, e.offset)) {
+                return Errno();
+            }
+            return Decode(*source, i, scratch.data(), raw);
+        }
+        raw->resize(index->BlockBytes(i));
+        return PreadFull(src.fd, &(*raw)[0], raw->size(), i * bs) ? 0 : Errno();
+    };
+
+    std::string raw;
+    std::string enc;
+    const size_t samples = std::min(opts_.sample_blocks, blocks);
+    uint64_t sampled = 0;
+    uint64_t shrunk = 0;
+    for (size_t k = 0; k < samples; ++k) {
+        const int err = read_block(k * blocks / samples, &raw);
+        if (err != 0) {
+            return err;
+        }
+        Encode(codec, raw.data(), raw.size(), &enc);
+        sampled += raw.size();
+        shrunk += enc.size();
+    }
+    if (static_cast<double>(shrunk) > static_cast<double>(sampled) * (1.0 - opts_.min_saving)) {
+        std::lock_guard<std::mutex> lk(stats_mu_);
+        ++stats_.skipped;
+        return 0;
+    }
+
+    const std::string tmp = TmpPath(path);
+    FdGuard out(::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (out.fd < 0) {
+        return Errno();
+    }
+    index->blocks.resize(blocks);
+    uint64_t raw_blocks = 0;
+    uint64_t pos = sizeof(FileHeader);
+    uint64_t flushed = pos;
+    std::string pending;
+    for (size_t i = 0; i < blocks; ++i) {
+        int err = read_block(i, &raw);
+        if (err != 0) {
+            return err;
+        }
+        BlockEntry& e = index->blocks[i];
+        std::memset(&e, 0, sizeof(e));
+        e.crc = butil::crc32c::Value(raw.data(), raw.size());
+        e.codec = static_cast<uint8_t>(Encode(codec, raw.data(), raw.size(), &enc));
+        e.offset = pos;
+        e.stored = static_cast<uint32_t>(enc.size());
+        raw_blocks += e.codec == static_cast<uint8_t>(Codec::kNone) ? 1 : 0;
+        pending.append(enc);
+        pos += enc.size();
+        if (pending.size() >= kBatchBytes || i + 1 == blocks) {
+            if (!PwriteFull(out.fd, pending.data(), pending.size(), flushed)) {
+                return Errno();
+            }
+            flushed = pos;
+            pending.clear();
+        }
+    }
+    FileHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = kMagic;
+    h.version = kVersion;
+    h.codec = static_cast<uint8_t>(codec);
+    h.block_size = static_cast<uint32_t>(bs);
+    h.blocks = static_cast<uint32_t>(blocks);
+    h.size = size;
+    h.index_offset = pos;
+    if (!PwriteFull(out.fd, index->blocks.data(), blocks * sizeof(BlockEntry), pos) ||
+        !PwriteFull(out.fd, &h, sizeof(h), 0) || ::fdatasync(out.fd) != 0) {
+        return Errno();
+    }
+    index->stored = pos + blocks * sizeof(BlockEntry);
+    result->codec = codec;
+    result->stored_bytes = index->stored;
+    *built = std::move(index);
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    stats_.raw_blocks += raw_blocks;
+    return 0;
+}
+
+// Puts the temporary .z file in place, durably, before the chunk file lets
+// go of its data.
+int ChunkCompressor::Commit(const std::string& path, bool was_compressed) {
+    if (::rename(TmpPath(path).c_str(), CompressedPath(path).c_str()) != 0) {
+        return Errno();
+    }
+    SyncDir(path);
+    if (!was_compressed && ::truncate(path.c_str(), 0) != 0) {
+        std::cerr << "[RealNode] failed to release compressed chunk file " << path << ": "
+                  << std::strerror(errno) << std::endl;
+    }
+    return 0;
+}
+
+ChunkCompressor::Stats ChunkCompressor::GetStats() const {
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    return stats_;
+}
+
+void ChunkCompressor::Sweep() {
+    std::chrono::seconds period = std::chrono::seconds(60);
+    for (auto after : {opts_.warm_after, opts_.cold_after}) {
+        if (after.count() > 0) {
+            period = std::min(period, after / 4);
+        }
+    }
+    period = std::max(period, std::chrono::seconds(1));
+    const bool warm = opts_.warm_after.count() > 0 && opts_.warm_codec != Codec::kNone;
+    const bool cold = opts_.cold_after.count() > 0 && opts_.cold_codec != Codec::kNone;
+
+    std::vector<std::pair<uint64_t, Codec>> due;
+    std::unique_lock<std::mutex> lk(sweep_mu_);
+    while (!sweep_cv_.wait_for(lk, period, [this]() { return stop_; })) {
+        lk.unlock();
+        const auto now = std::chrono::steady_clock::now();
+        due.clear();
+        for (auto& s : shards_) {
+            std::lock_guard<std::mutex> g(s.mu);
+            for (auto& [chunk_id, c] : s.chunks) {
+                if (c.users > 0 || c.busy || c.compressing || c.queued) {
+                    continue;
+                }
+                const auto idle = now - c.touched;
+                if (warm && !c.compressed && c.written && idle >= opts_.warm_after) {
+                    c.queued = true;
+                    due.emplace_back(chunk_id, opts_.warm_codec);
+                } else if (cold && c.compressed && idle >= opts_.cold_after &&
+                           (!c.index || c.index->codec != opts_.cold_codec)) {
+                    c.queued = true;
+                    due.emplace_back(chunk_id, opts_.cold_codec);
+                }
+            }
+        }
+        for (const auto& [chunk_id, codec] : due) {
+            if (!compress_idle_(chunk_id, codec)) {
+                Shard& s = ShardFor(chunk_id);
+                std::lock_guard<std::mutex> g(s.mu);
+                auto it = s.chunks.find(chunk_id);
+                if (it != s.chunks.end()) {
+                    it->second.queued = false;
+                }
+            }
+        }
+        lk.lock();
+    }
+}
+
+std::shared_ptr<const ChunkCompressor::Index> ChunkCompressor::LoadIndex(const std::string& zpath, int* err) {
+    FdGuard fd(::open(zpath.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (fd.fd < 0 || ::fstat(fd.fd, &st) != 0) {
+        *err = Errno();
+        return nullptr;
+    }
+    const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    FileHeader h;
+    if (!PreadFull(fd.fd, &h, sizeof(h), 0) || h.magic != kMagic || h.version != kVersion || h.block_size == 0 ||
+        h.index_offset < sizeof(FileHeader) || h.index_offset > file_size ||
+        (file_size - h.index_offset) / sizeof(BlockEntry) < h.blocks ||
+        (h.size + h.block_size - 1) / h.block_size != h.blocks) {
+        *err = EIO;
+        return nullptr;
+    }
+    auto index = std::make_shared<Index>();
+    index->codec = static_cast<Codec>(h.codec);
+    index->block_size = h.block_size;
+    index->size = h.size;
+    index->stored = file_size;
+    index->blocks.resize(h.blocks);
+    if (h.blocks > 0 && !PreadFull(fd.fd, index->blocks.data(), h.blocks * sizeof(BlockEntry), h.index_offset)) {
+        *err = Errno();
+        return nullptr;
+    }
+    // blocks lie in order between the header and the index
+    uint64_t next = sizeof(FileHeader);
+    for (const auto& e : index->blocks) {
+        if (e.offset != next || e.offset + e.stored > h.index_offset) {
+            *err = EIO;
+            return nullptr;
+        }
+        next = e.offset + e.stored;
+    }
+    return index;
+}
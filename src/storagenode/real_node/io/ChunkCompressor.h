@@ -0,0 +1,174 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "IOEngine.h"
+
+// Block-level compression of file-backed chunks, for warm and cold data.
+//
+// A compressed chunk lives in <chunk path>.z: a header recording the chunk's
+// codec, block size and size, the blocks compressed one by one, and an index
+// of their offsets and crc32c, so a read decompresses only the blocks it
+// covers. Blocks that do not shrink by min_saving are stored raw, and a chunk
+// whose sampled blocks do not shrink is left alone. The chunk file is
+// truncated to zero but kept, so fds cached on it stay valid; while the .z
+// file exists it is authoritative.
+//
+// IO on a chunk file goes between Begin and End. A write to a compressed
+// chunk first expands it back into the chunk file. Compress reads the chunk
+// without holding it and gives up with EBUSY if a write lands meanwhile; the
+// switch to the .z file waits for IO in flight to drain.
+//
+// With warm_after set, chunks that were written and then left alone that
+// long are compressed with warm_codec; with cold_after, compressed chunks
+// untouched that long are recompressed with cold_codec. Only chunks seen
+// since startup are tracked, up to max_chunks.
+class ChunkCompressor {
+public:
+    enum class Codec : uint8_t { kNone = 0, kLz4 = 1, kZstd = 2 };
+
+    struct Options {
+        Options();
+        size_t block_size;
+        int zstd_level;
+        double min_saving;     // fraction a block, or the sample, must shrink by
+        size_t sample_blocks;  // blocks compressed to decide on a chunk
+        Codec warm_codec;
+        Codec cold_codec;
+        std::chrono::seconds warm_after;  // 0 disables
+        std::chrono::seconds cold_after;  // 0 disables
+        size_t max_chunks;
+        // Runs while the chunk is held with no IO on it, once its data has
+        // moved into the .z file (packed) or back out; e.g. to keep per-file
+        // metadata in step.
+        std::function<void(uint64_t chunk_id, const std::string& path, bool packed)> on_switch;
+    };
+
+    // Totals are over the compressed chunks currently tracked.
+    struct Stats {
+        uint64_t chunks{0};
+        uint64_t raw_bytes{0};
+        uint64_t stored_bytes{0};
+        uint64_t compressions{0};
+        uint64_t skipped{0};     // chunks left as they were after sampling
+        uint64_t raw_blocks{0};  // blocks stored raw by compressions
+        uint64_t expansions{0};
+        uint64_t corrupt_blocks{0};
+        uint64_t compress_ns{0};  // time spent in the codecs
+        uint64_t decompress_ns{0};
+    };
+
+    struct Access {
+        int err{0};
+        bool compressed{false};  // read through Read, not the chunk file
+    };
+
+    struct Result {
+        int err{0};
+        Codec codec{Codec::kNone};  // the chunk's codec afterwards
+        uint64_t raw_bytes{0};
+        uint64_t stored_bytes{0};
+    };
+
+    // Queues Compress for an idle chunk on its disk; returns false if it
+    // could not be queued right now, in which case the next sweep retries.
+    using CompressFn = std::function<bool(uint64_t chunk_id, Codec codec)>;
+
+    ChunkCompressor(Options opts, CompressFn compress_idle);
+    ~ChunkCompressor();
+
+    ChunkCompressor(const ChunkCompressor&) = delete;
+    ChunkCompressor& operator=(const ChunkCompressor&) = delete;
+
+    // Whether this build has the codec; kNone always.
+    static bool Supported(Codec codec);
+    static const char* CodecName(Codec codec);
+    static std::string CompressedPath(const std::string& path);
+
+    // A hint for routing; Begin has the final say.
+    bool IsCompressed(uint64_t chunk_id, const std::string& path);
+
+    // Call on the chunk's disk before IO on a file-backed chunk, and End once
+    // it has completed. A write expands a compressed chunk first, so only
+    // reads can be told to go through Read. Waits while the chunk is
+    // switching between the two forms.
+    Access Begin(uint64_t chunk_id, const std::string& path, bool write);
+    void End(uint64_t chunk_id, bool write);
+
+    // Reads a compressed chunk, between Begin and End; short at its end.
+    IOEngine::Result Read(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                          std::string* out);
+    // Size of a compressed chunk.
+    int Size(uint64_t chunk_id, const std::string& path, uint64_t* size);
+
+    // Compresses the chunk with codec, or recompresses it; kNone expands it.
+    // Fails with EBUSY when the chunk was written meanwhile.
+    Result Compress(uint64_t chunk_id, const std::string& path, Codec codec);
+
+    Stats GetStats() const;
+
+private:
+    struct Index;
+
+    struct Chunk {
+        uint32_t users{0};    // IO between Begin and End
+        uint64_t gen{0};      // bumped by writes
+        bool compressed{false};
+        bool busy{false};     // switching between raw and compressed
+        bool compressing{false};
+        bool written{false};  // since the last compression; a warm candidate
+        bool queued{false};   // handed to compress_idle
+        std::chrono::steady_clock::time_point touched;
+        std::shared_ptr<const Index> index;  // of a compressed chunk, once loaded
+    };
+
+    static constexpr size_t kShards = 64;
+
+    struct alignas(64) Shard {
+        std::mutex mu;
+        std::condition_variable cv;
+        std::unordered_map<uint64_t, Chunk> chunks;
+    };
+
+    Shard& ShardFor(uint64_t chunk_id) { return shards_[chunk_id % kShards]; }
+    // Finds or adds the chunk, probing for its .z file without the lock.
+    Chunk& Lookup(Shard& shard, uint64_t chunk_id, const std::string& path, std::unique_lock<std::mutex>& lk);
+    void Evict(Shard& shard);
+    // Swaps the chunk's index and keeps the totals in step; caller holds the lock.
+    void SetIndex(Chunk& c, std::shared_ptr<const Index> index);
+    std::shared_ptr<const Index> IndexOf(uint64_t chunk_id, const std::string& path, int* err);
+    static std::shared_ptr<const Index> LoadIndex(const std::string& zpath, int* err);
+    // Takes the chunk out of use (busy, no users) and expands it; lk is
+    // dropped meanwhile.
+    int ExpandLocked(Shard& shard, Chunk& c, uint64_t chunk_id, const std::string& path,
+                     std::unique_lock<std::mutex>& lk);
+    int Expand(const std::string& path, const Index& index);
+    int Build(const std::string& path, Codec codec, const Index* source, Result* result,
+              std::shared_ptr<const Index>* built);
+    int Commit(const std::string& path, bool was_compressed);
+    Codec Encode(Codec codec, const char* data, size_t size, std::string* out);
+    int Decode(const Index& index, size_t block, const char* stored, std::string* out);
+    void Sweep();
+
+    Options opts_;
+    CompressFn compress_idle_;
+    Shard shards_[kShards];
+
+    mutable std::mutex stats_mu_;
+    Stats stats_;
+
+    std::mutex sweep_mu_;
+    std::condition_variable sweep_cv_;
+    bool stop_{false};
+    std::thread sweeper_;
+};
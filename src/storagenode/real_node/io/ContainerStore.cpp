@@ -0,0 +1,546 @@
+#include "ContainerStore.h"
+
+#include <butil/crc32c.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t crc;  // crc32c of chunk_id, seq and data
+    uint64_t seq;
+    uint64_t chunk_id;
+    uint32_t length;
+    uint32_t pad;
+};
+static_assert(sizeof(RecordHeader) == 32, "record header layout");
+
+bool PreadFull(int fd, void* buf, size_t n, uint64_t off) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t got = ::pread(fd, p, n, static_cast<off_t>(off));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= static_cast<size_t>(got);
+        off += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+IOEngine::Result Failure(int err) {
+    IOEngine::Result r{};
+    r.bytes = -1;
+    r.err = err;
+    return r;
+}
+
+uint32_t RecordCrc(const RecordHeader& h, const char* data) {
+    uint32_t crc = butil::crc32c::Value(reinterpret_cast<const char*>(&h.seq), sizeof(h.seq) + sizeof(h.chunk_id));
+    return butil::crc32c::Extend(crc, data, h.length);
+}
+
+} // namespace
+
+ContainerStore::Options::Options()
+    : small_chunk_limit(64 << 10),
+      container_size(64 << 20),
+      gc_dead_ratio(0.5),
+      gc_interval(30),
+      sync_on_write(false) {}
+
+ContainerStore::Container::~Container() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+ContainerStore::ContainerStore(std::string dir, Options opts)
+    : dir_(std::move(dir)), opts_(opts) {
+    if (opts_.container_size < opts_.small_chunk_limit + kHeaderSize) {
+        opts_.container_size = opts_.small_chunk_limit + kHeaderSize;
+    }
+}
+
+ContainerStore::~ContainerStore() {
+    Stop();
+}
+
+std::string ContainerStore::ContainerPath(uint32_t id) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "container_%08u.dat", id);
+    return dir_ + "/" + name;
+}
+
+std::shared_ptr<ContainerStore::Container> ContainerStore::OpenContainer(uint32_t id, bool create) {
+    int flags = O_RDWR | O_CLOEXEC | (create ? (O_CREAT | O_EXCL) : 0);
+    int fd = ::open(ContainerPath(id).c_str(), flags, 0644);
+    if (fd < 0) {
+        std::cerr << "[RealNode] ContainerStore: open " << ContainerPath(id) << " failed: "
+                  << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    if (create) {
+        // Best effort; filesystems without fallocate just grow the file.
+        (void)::fallocate(fd, 0, 0, static_cast<off_t>(opts_.container_size));
+    }
+    auto c = std::make_shared<Container>();
+    c->id = id;
+    c->fd = fd;
+    return c;
+}
+
+bool ContainerStore::Open(const std::function<bool(uint64_t)>& skip) {
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        std::cerr << "[RealNode] ContainerStore: cannot create " << dir_ << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    std::vector<uint32_t> ids;
+    for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+        unsigned id = 0;
+        if (std::sscanf(entry.path().filename().c_str(), "container_%08u.dat", &id) == 1) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    std::lock_guard<std::mutex> lk(mu_);
+    for (uint32_t id : ids) {
+        auto c = OpenContainer(id, false);
+        if (!c) {
+            return false;
+        }
+        c->sealed = true;
+        containers_[id] = c;
+        ScanContainer(*c, skip);
+        next_container_id_ = std::max(next_container_id_, id + 1);
+    }
+    // containers left with nothing live are dropped right away
+    for (auto it = containers_.begin(); it != containers_.end();) {
+        if (it->second->live_bytes == 0) {
+            ::unlink(ContainerPath(it->first).c_str());
+            it = containers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::cout << "[RealNode] ContainerStore: recovered " << index_.size() << " chunks from "
+              << containers_.size() << " containers" << std::endl;
+    return true;
+}
+
+// Scans records until the first invalid one (preallocated zeros or a torn
+// append); the newest seq per chunk wins.
+bool ContainerStore::ScanContainer(Container& c, const std::function<bool(uint64_t)>& skip) {
+    struct stat st {};
+    if (::fstat(c.fd, &st) != 0) {
+        return false;
+    }
+    const uint64_t limit = static_cast<uint64_t>(st.st_size);
+    uint64_t off = 0;
+    std::string data;
+    while (off + kHeaderSize <= limit) {
+        RecordHeader h{};
+        if (!PreadFull(c.fd, &h, sizeof(h), off) || h.magic != kMagic ||
+            off + kHeaderSize + h.length > limit) {
+            break;
+        }
+        data.resize(h.length);
+        if ((h.length > 0 && !PreadFull(c.fd, data.data(), h.length, off + kHeaderSize)) ||
+            RecordCrc(h, data.data()) != h.crc) {
+            break;
+        }
+        const uint64_t rec = kHeaderSize + h.length;
+        c.total_bytes += rec;
+        next_seq_ = std::max(next_seq_, h.seq + 1);
+        if (!skip || !skip(h.chunk_id)) {
+            auto it = index_.find(h.chunk_id);
+            if (it == index_.end() || it->second.seq < h.seq) {
+                if (it != index_.end()) {
+                    DropLocked(it->second);
+                }
+                Location loc;
+                loc.container = c.id;
+                loc.length = h.length;
+                loc.offset = off;
+                loc.seq = h.seq;
+                index_[h.chunk_id] = loc;
+                c.live_bytes += rec;
+            }
+        }
+        off += rec;
+    }
+    c.tail = off;
+    return true;
+}
+
+void ContainerStore::Start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    gc_thread_ = std::thread([this]() { Run(); });
+}
+
+void ContainerStore::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(gc_mu_);
+    }
+    gc_cv_.notify_all();
+    if (gc_thread_.joinable()) {
+        gc_thread_.join();
+    }
+}
+
+void ContainerStore::Run() {
+    while (running_.load()) {
+        {
+            std::unique_lock<std::mutex> lk(gc_mu_);
+            gc_cv_.wait_for(lk, opts_.gc_interval, [this]() { return !running_.load(); });
+        }
+        if (!running_.load()) {
+            break;
+        }
+        uint64_t reclaimed = CompactOnce();
+        if (reclaimed > 0) {
+            std::cout << "[RealNode] ContainerStore: compaction reclaimed " << reclaimed << " bytes" << std::endl;
+        }
+    }
+}
+
+bool ContainerStore::Contains(uint64_t chunk_id) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return index_.count(chunk_id) != 0;
+}
+
+bool ContainerStore::Size(uint64_t chunk_id, uint64_t* size) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = index_.find(chunk_id);
+    if (it == index_.end()) {
+        return false;
+    }
+    *size = it->second.length;
+    return true;
+}
+
+bool ContainerStore::EnsureActiveLocked(size_t record_size) {
+    if (record_size > opts_.container_size) {
+        return false;
+    }
+    if (active_ && active_->tail + record_size <= opts_.container_size) {
+        return true;
+    }
+    if (active_) {
+        active_->sealed = true;
+    }
+    auto c = OpenContainer(next_container_id_, true);
+    if (!c) {
+        return false;
+    }
+    ++next_container_id_;
+    containers_[c->id] = c;
+    active_ = c;
+    return true;
+}
+
+bool ContainerStore::AppendLocked(uint64_t chunk_id,
+                                  uint64_t seq,
+                                  const char* data,
+                                  uint32_t length,
+                                  Location* loc) {
+    const size_t rec = kHeaderSize + length;
+    if (!EnsureActiveLocked(rec)) {
+        return false;
+    }
+    RecordHeader h{};
+    h.magic = kMagic;
+    h.seq = seq;
+    h.chunk_id = chunk_id;
+    h.length = length;
+    h.crc = RecordCrc(h, data);
+    iovec iov[2] = {{&h, sizeof(h)}, {const_cast<char*>(data), length}};
+    ssize_t n = ::pwritev(active_->fd, iov, length > 0 ? 2 : 1, static_cast<off_t>(active_->tail));
+    if (n != static_cast<ssize_t>(rec)) {
+        // leave the tail where it is; the partial record is overwritten next time
+        return false;
+    }
+    if (opts_.sync_on_write && ::fdatasync(active_->fd) != 0) {
+        return false;
+    }
+    loc->container = active_->id;
+    loc->length = length;
+    loc->offset = active_->tail;
+    loc->seq = seq;
+    active_->tail += rec;
+    active_->live_bytes += rec;
+    active_->total_bytes += rec;
+    return true;
+}
+
+bool ContainerStore::ReadRecordLocked(const Location& loc, std::string& out) const {
+    auto it = containers_.find(loc.container);
+    if (it == containers_.end()) {
+        return false;
+    }
+    out.resize(loc.length);
+    return loc.length == 0 || PreadFull(it->second->fd, out.data(), loc.length, loc.offset + kHeaderSize);
+}
+
+void ContainerStore::DropLocked(const Location& loc) {
+    auto it = containers_.find(loc.container);
+    if (it != containers_.end()) {
+        it->second->live_bytes -= kHeaderSize + loc.length;
+    }
+}
+
+IOEngine::Result ContainerStore::Write(uint64_t chunk_id, uint64_t offset, const void* data, size_t size) {
+    if (offset > opts_.small_chunk_limit || size > opts_.small_chunk_limit - offset) {
+        return Failure(EFBIG);
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    std::string content;
+    auto it = index_.find(chunk_id);
+    if (it != index_.end() && !ReadRecordLocked(it->second, content)) {
+        return Failure(EIO);
+    }
+    if (content.size() < offset + size) {
+        content.resize(offset + size, '\0');
+    }
+    if (size > 0) {
+        std::memcpy(&content[offset], data, size);
+    }
+    Location loc;
+    if (!AppendLocked(chunk_id, next_seq_++, content.data(), static_cast<uint32_t>(content.size()), &loc)) {
+        return Failure(EIO);
+    }
+    if (it != index_.end()) {
+        DropLocked(it->second);
+        it->second = loc;
+    } else {
+        index_.emplace(chunk_id, loc);
+    }
+    IOEngine::Result r{};
+    r.bytes = static_cast<ssize_t>(size);
+    return r;
+}
+
+IOEngine::Result ContainerStore::Read(uint64_t chunk_id, uint64_t offset, size_t length, std::string& out) const {
+    Location loc;
+    std::shared_ptr<Container> c;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = index_.find(chunk_id);
+        if (it == index_.end()) {
+            out.clear();
+            return Failure(ENOENT);
+        }
+        loc = it->second;
+        c = containers_.at(loc.container);
+    }
+    // The container shared_ptr keeps the fd open even if compaction drops it.
+    if (offset >= loc.length) {
+        out.clear();
+        return IOEngine::Result{};
+    }
+    const size_t n = static_cast<size_t>(std::min<uint64_t>(length, loc.length - offset));
+    out.resize(n);
+    if (n > 0 && !PreadFull(c->fd, out.data(), n, loc.offset + kHeaderSize + offset)) {
+        out.clear();
+        return Failure(EIO);
+    }
+    IOEngine::Result r{};
+    r.bytes = static_cast<ssize_t>(n);
+    return r;
+}
+
+IOEngine::Result ContainerStore::Truncate(uint64_t chunk_id, uint64_t size) {
+    if (size > opts_.small_chunk_limit) {
+        return Failure(EFBIG);
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    std::string content;
+    auto it = index_.find(chunk_id);
+    if (it != index_.end() && !ReadRecordLocked(it->second, content)) {
+        return Failure(EIO);
+    }
+    content.resize(static_cast<size_t>(size), '\0');
+    Location loc;
+    if (!AppendLocked(chunk_id, next_seq_++, content.data(), static_cast<uint32_t>(content.size()), &loc)) {
+        return Failure(EIO);
+    }
+    if (it != index_.end()) {
+        DropLocked(it->second);
+        it->second = loc;
+    } else {
+        index_.emplace(chunk_id, loc);
+    }
+    return IOEngine::Result{};
+}
+
+bool ContainerStore::ExportToFile(uint64_t chunk_id, const std::string& path) {
+    std::string content;
+    Location loc;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = index_.find(chunk_id);
+        if (it == index_.end()) {
+            return true;
+        }
+        loc = it->second;
+        if (!ReadRecordLocked(loc, content)) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    const fs::path target(path);
+    fs::create_directories(target.parent_path(), ec);
+    const std::string tmp = path + ".migrating";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = content.empty() ||
+              ::pwrite(fd, content.data(), content.size(), 0) == static_cast<ssize_t>(content.size());
+    ok = ok && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    int dir_fd = ::open(target.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = index_.find(chunk_id);
+    if (it == index_.end() || it->second.seq != loc.seq) {
+        // rewritten while exporting; the caller retries
+        return false;
+    }
+    DropLocked(it->second);
+    index_.erase(it);
+    return true;
+}
+
+uint64_t ContainerStore::CompactOnce() {
+    std::vector<std::pair<uint32_t, uint64_t>> victims;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (const auto& kv : containers_) {
+            const Container& c = *kv.second;
+            if (!c.sealed || c.total_bytes == 0) {
+                continue;
+            }
+            const uint64_t dead = c.total_bytes - c.live_bytes;
+            if (static_cast<double>(dead) >= opts_.gc_dead_ratio * static_cast<double>(c.total_bytes)) {
+                victims.emplace_back(kv.first, dead);
+            }
+        }
+    }
+    uint64_t reclaimed = 0;
+    for (const auto& v : victims) {
+        if (CompactContainer(v.first)) {
+            reclaimed += v.second;
+        }
+    }
+    return reclaimed;
+}
+
+// Copies each still-indexed record of a sealed container to the active one
+// (keeping its seq), syncs the containers it copied into, then deletes the
+// container.
+bool ContainerStore::CompactContainer(uint32_t id) {
+    std::shared_ptr<Container> c;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = containers_.find(id);
+        if (it == containers_.end() || !it->second->sealed) {
+            return false;
+        }
+        c = it->second;
+    }
+
+    uint64_t off = 0;
+    std::string data;
+    // A large victim can roll the active container over more than once.
+    std::map<uint32_t, std::shared_ptr<Container>> targets;
+    while (off + kHeaderSize <= c->tail) {
+        RecordHeader h{};
+        if (!PreadFull(c->fd, &h, sizeof(h), off) || h.magic != kMagic) {
+            break;
+        }
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = index_.find(h.chunk_id);
+        if (it != index_.end() && it->second.container == id && it->second.offset == off) {
+            Location moved;
+            if (!ReadRecordLocked(it->second, data) ||
+                !AppendLocked(h.chunk_id, h.seq, data.data(), h.length, &moved)) {
+                return false;
+            }
+            DropLocked(it->second);
+            it->second = moved;
+            targets.emplace(moved.container, active_);
+        }
+        off += kHeaderSize + h.length;
+    }
+
+    // The victim holds the only durable copy until the moved records are on
+    // disk, even when writes themselves are not synced.
+    for (const auto& kv : targets) {
+        if (::fdatasync(kv.second->fd) != 0) {
+            std::cerr << "[RealNode] ContainerStore: sync " << ContainerPath(kv.first) << " failed: "
+                      << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    if (!targets.empty()) {
+        // containers created while copying must survive a crash too
+        int dir_fd = ::open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+
+    std::lock_guard<std::mutex> lk(mu_);
+    compaction_syncs_ += targets.size();
+    if (c->live_bytes != 0) {
+        return false;
+    }
+    containers_.erase(id);
+    ::unlink(ContainerPath(id).c_str());
+    return true;
+}
+
+ContainerStore::Stats ContainerStore::GetStats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    Stats s;
+    s.chunks = index_.size();
+    s.containers = containers_.size();
+    s.compaction_syncs = compaction_syncs_;
+    for (const auto& kv : containers_) {
+        s.live_bytes += kv.second->live_bytes;
+        s.dead_bytes += kv.second->total_bytes - kv.second->live_bytes;
+    }
+    return s;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "IOEngine.h"
+
+// Log-structured store for small chunks. Instead of one file per chunk, whole
+// chunk versions are appended as records to large preallocated container
+// files, and an in-memory index maps chunk_id -> (container, offset, length).
+// Every write appends a new version; superseded versions become dead space
+// that the background compactor reclaims by copying live records out of
+// mostly-dead containers and deleting them.
+//
+// Record: [magic u32][crc32c u32][seq u64][chunk_id u64][length u32][pad u32][data].
+// The index is rebuilt at startup by scanning containers; the highest seq wins,
+// so records copied by compaction keep their original seq.
+class ContainerStore {
+public:
+    struct Options {
+        Options();
+        size_t small_chunk_limit;    // chunks larger than this live in their own file
+        size_t container_size;       // preallocated bytes per container
+        double gc_dead_ratio;        // compact sealed containers at or above this dead ratio
+        std::chrono::seconds gc_interval;
+        bool sync_on_write;
+    };
+
+    struct Stats {
+        size_t chunks{0};
+        size_t containers{0};
+        uint64_t live_bytes{0};
+        uint64_t dead_bytes{0};
+        uint64_t compaction_syncs{0};  // containers synced by compaction before dropping a victim
+    };
+
+    ContainerStore(std::string dir, Options opts = Options());
+    ~ContainerStore();
+
+    ContainerStore(const ContainerStore&) = delete;
+    ContainerStore& operator=(const ContainerStore&) = delete;
+
+    // Rebuilds the index from existing containers. Chunks for which `skip`
+    // returns true (already migrated to their own file) are treated as dead.
+    bool Open(const std::function<bool(uint64_t)>& skip = nullptr);
+
+    // Starts/stops the background compactor.
+    void Start();
+    void Stop();
+
+    bool Contains(uint64_t chunk_id) const;
+    // Chunks in the store are dense; false for unknown chunks.
+    bool Size(uint64_t chunk_id, uint64_t* size) const;
+
+    // Results follow IOEngine: bytes < 0 with errno in err. Write/Truncate
+    // return EFBIG when the chunk would outgrow small_chunk_limit; Read
+    // returns ENOENT for unknown chunks.
+    IOEngine::Result Write(uint64_t chunk_id, uint64_t offset, const void* data, size_t size);
+    IOEngine::Result Read(uint64_t chunk_id, uint64_t offset, size_t length, std::string& out) const;
+    IOEngine::Result Truncate(uint64_t chunk_id, uint64_t size);
+
+    // Moves a chunk into `path` (written to a temp file, synced, then renamed)
+    // and drops it from the store. Returns true if the chunk was absent.
+    bool ExportToFile(uint64_t chunk_id, const std::string& path);
+
+    // One compaction pass over sealed containers; returns bytes reclaimed.
+    uint64_t CompactOnce();
+
+    Stats GetStats() const;
+
+private:
+    struct Location {
+        uint32_t container{0};
+        uint32_t length{0};
+        uint64_t offset{0};  // record header offset
+        uint64_t seq{0};
+    };
+
+    struct Container {
+        uint32_t id{0};
+        int fd{-1};
+        uint64_t tail{0};       // next append offset
+        uint64_t live_bytes{0};
+        uint64_t total_bytes{0};
+        bool sealed{false};
+        ~Container();
+    };
+
+    static constexpr uint32_t kMagic = 0x5a42434eu;  // "ZBCN"
+    static constexpr size_t kHeaderSize = 32;
+
+    std::string ContainerPath(uint32_t id) const;
+    std::shared_ptr<Container> OpenContainer(uint32_t id, bool create);
+    bool ScanContainer(Container& c, const std::function<bool(uint64_t)>& skip);
+    bool EnsureActiveLocked(size_t record_size);
+    bool AppendLocked(uint64_t chunk_id, uint64_t seq, const char* data, uint32_t length, Location* loc);
+    bool ReadRecordLocked(const Location& loc, std::string& out) const;
+    void DropLocked(const Location& loc);
+    bool CompactContainer(uint32_t id);
+    void Run();
+
+    std::string dir_;
+    Options opts_;
+
+    mutable std::mutex mu_;
+    std::unordered_map<uint64_t, Location> index_;
+    std::map<uint32_t, std::shared_ptr<Container>> containers_;
+    std::shared_ptr<Container> active_;
+    uint32_t next_container_id_{1};
+    uint64_t next_seq_{1};
+    uint64_t compaction_syncs_{0};
+
+    std::mutex gc_mu_;
+    std::condition_variable gc_cv_;
+    std::atomic<bool> running_{false};
+    std::thread gc_thread_;
+};
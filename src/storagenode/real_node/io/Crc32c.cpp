@@ -0,0 +1,67 @@
+#include "Crc32c.h"
+
+namespace {
+
+uint32_t Gf2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        ++mat;
+    }
+    return sum;
+}
+
+void Gf2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; ++n) {
+        square[n] = Gf2MatrixTimes(mat, mat[n]);
+    }
+}
+
+} // namespace
+
+// zlib's crc32_combine with the Castagnoli polynomial: advance crc_a over
+// len_b zero bytes using repeated squaring of the shift operator.
+uint32_t Crc32cCombine(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+    if (len_b == 0) {
+        return crc_a;
+    }
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = 0x82f63b78u;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    Gf2MatrixSquare(even, odd);
+    Gf2MatrixSquare(odd, even);
+    do {
+        Gf2MatrixSquare(even, odd);
+        if (len_b & 1) {
+            crc_a = Gf2MatrixTimes(even, crc_a);
+        }
+        len_b >>= 1;
+        if (len_b == 0) {
+            break;
+        }
+        Gf2MatrixSquare(odd, even);
+        if (len_b & 1) {
+            crc_a = Gf2MatrixTimes(odd, crc_a);
+        }
+        len_b >>= 1;
+    } while (len_b != 0);
+    return crc_a ^ crc_b;
+}
+
+Crc32cShift::Crc32cShift(size_t len_b) : len_(len_b) {
+    for (int j = 0; j < 32; ++j) {
+        mat_[j] = Crc32cCombine(1u << j, 0, len_b);
+    }
+}
+
+uint32_t Crc32cShift::Combine(uint32_t crc_a, uint32_t crc_b) const {
+    return Gf2MatrixTimes(mat_, crc_a) ^ crc_b;
+}
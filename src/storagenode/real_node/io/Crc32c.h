@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// crc32c(A || B) from crc32c(A), crc32c(B) and |B|. Costs O(log |B|) 32x32
+// matrix squarings.
+uint32_t Crc32cCombine(uint32_t crc_a, uint32_t crc_b, size_t len_b);
+
+// Crc32cCombine for one fixed |B|, with the shift operator precomputed so a
+// combine is a single 32x32 matrix multiply.
+class Crc32cShift {
+public:
+    explicit Crc32cShift(size_t len_b);
+
+    uint32_t Combine(uint32_t crc_a, uint32_t crc_b) const;
+    size_t length() const { return len_; }
+
+private:
+    size_t len_;
+    uint32_t mat_[32];  // advances a crc over len_ zero bytes
+};
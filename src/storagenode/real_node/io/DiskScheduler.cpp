@@ -0,0 +1,340 @@
+#include "DiskScheduler.h"
+
+#include <sys/statvfs.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Smallest cost charged per request, so tiny IOs still count against the
+// class's share.
+constexpr uint64_t kMinCost = 4096;
+
+} // namespace
+
+DiskScheduler::Options::Options()
+    : threads_per_disk(4),
+      queue_depth(128),
+      max_inflight(32),
+      min_free_ratio(0.05),
+      stats_interval(std::chrono::seconds(10)) {
+    classes[kForeground].weight = 8;
+    classes[kMigration].weight = 2;
+    classes[kScrub].weight = 1;
+}
+
+DiskScheduler::DiskScheduler(std::vector<std::string> roots, Options opts) : opts_(opts) {
+    opts_.threads_per_disk = std::max<size_t>(opts_.threads_per_disk, 1);
+    opts_.queue_depth = std::max(opts_.queue_depth, opts_.threads_per_disk);
+    opts_.max_inflight = std::max(opts_.max_inflight, opts_.threads_per_disk);
+    for (size_t c = 0; c < kClasses; ++c) {
+        limits_[c] = opts_.classes[c];
+        limits_[c].weight = std::max<uint32_t>(limits_[c].weight, 1);
+    }
+    for (auto& root : roots) {
+        auto d = std::make_unique<Disk>();
+        d->root = std::move(root);
+        disks_.push_back(std::move(d));
+    }
+    RefreshStats();
+    for (auto& d : disks_) {
+        for (size_t i = 0; i < opts_.threads_per_disk; ++i) {
+            Disk* disk = d.get();
+            d->workers.emplace_back([this, disk]() { Worker(*disk); });
+        }
+    }
+    stats_thread_ = std::thread([this]() { StatsLoop(); });
+}
+
+DiskScheduler::~DiskScheduler() {
+    {
+        std::lock_guard<std::mutex> lk(stats_mu_);
+        stop_ = true;
+    }
+    stats_cv_.notify_all();
+    stats_thread_.join();
+    // queued tasks still run so every accepted request gets its reply
+    for (auto& d : disks_) {
+        {
+            std::lock_guard<std::mutex> lk(d->mu);
+            d->stop = true;
+        }
+        d->cv.notify_all();
+        for (auto& t : d->workers) {
+            t.join();
+        }
+        // completions still to come touch the disk's counters
+        std::unique_lock<std::mutex> lk(d->mu);
+        d->cv.wait(lk, [&d]() { return d->inflight == 0; });
+    }
+}
+
+bool DiskScheduler::Submit(size_t disk, std::function<void()> task, Class cls, uint64_t bytes) {
+    return SubmitAsync(
+        disk,
+        [task = std::move(task)](Done done) {
+            task();
+            done();
+        },
+        cls, bytes);
+}
+
+bool DiskScheduler::SubmitAsync(size_t disk, std::function<void(Done)> task, Class cls, uint64_t bytes) {
+    Disk& d = *disks_[disk % disks_.size()];
+    const size_t c = cls < kClasses ? cls : kForeground;
+    uint32_t weight = 1;
+    {
+        std::lock_guard<std::mutex> lk(limits_mu_);
+        weight = limits_[c].weight;
+    }
+    {
+        std::lock_guard<std::mutex> lk(d.mu);
+        if (d.stop || d.class_pending[c] >= opts_.queue_depth) {
+            d.rejected.fetch_add(1, std::memory_order_relaxed);
+            counters_[c].rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        const double start = std::max(d.vtime, d.last_finish[c]);
+        d.last_finish[c] = start + static_cast<double>(std::max(bytes, kMinCost)) / weight;
+        d.queues[c].push_back(Task{std::move(task), bytes, start, std::chrono::steady_clock::now()});
+        ++d.class_pending[c];
+        d.pending.fetch_add(1, std::memory_order_relaxed);
+        counters_[c].queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    d.cv.notify_one();
+    return true;
+}
+
+double DiskScheduler::Score(const Disk& d, bool require_free) const {
+    const uint64_t total = d.total_bytes.load(std::memory_order_relaxed);
+    const uint64_t free = d.free_bytes.load(std::memory_order_relaxed);
+    if (require_free && total > 0 &&
+        static_cast<double>(free) < opts_.min_free_ratio * static_cast<double>(total)) {
+        return -1.0;
+    }
+    return static_cast<double>(free) / static_cast<double>(1 + d.pending.load(std::memory_order_relaxed));
+}
+
+// Power of two choices: cheap, and unlike always taking the best disk it does
+// not pile a burst of creates onto whichever disk looked best a moment ago.
+size_t DiskScheduler::Place(uint64_t chunk_id) {
+    const size_t n = disks_.size();
+    if (n <= 1) {
+        return 0;
+    }
+    uint64_t h = chunk_id + place_seq_.fetch_add(1, std::memory_order_relaxed) * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    const size_t a = static_cast<size_t>(h % n);
+    const size_t b = (a + 1 + static_cast<size_t>((h >> 32) % (n - 1))) % n;
+    const double sa = Score(*disks_[a], true);
+    const double sb = Score(*disks_[b], true);
+    if (sa >= 0 || sb >= 0) {
+        return sa >= sb ? a : b;
+    }
+    // both candidates are nearly full: fall back to the roomiest disk
+    size_t best = 0;
+    double best_score = -1.0;
+    for (size_t i = 0; i < n; ++i) {
+        const double s = Score(*disks_[i], false);
+        if (s > best_score) {
+            best = i;
+            best_score = s;
+        }
+    }
+    return best;
+}
+
+DiskScheduler::DiskLoad DiskScheduler::Load(size_t disk) const {
+    const Disk& d = *disks_[disk % disks_.size()];
+    DiskLoad load;
+    load.root = d.root;
+    load.total_bytes = d.total_bytes.load(std::memory_order_relaxed);
+    load.free_bytes = d.free_bytes.load(std::memory_order_relaxed);
+    load.pending = d.pending.load(std::memory_order_relaxed);
+    load.rejected = d.rejected.load(std::memory_order_relaxed);
+    return load;
+}
+
+bool DiskScheduler::Busy(size_t disk) const {
+    return disks_[disk % disks_.size()]->pending.load(std::memory_order_relaxed) * 2 > opts_.queue_depth;
+}
+
+void DiskScheduler::RefreshStats() {
+    for (auto& d : disks_) {
+        struct statvfs vfs {};
+        if (::statvfs(d->root.c_str(), &vfs) != 0) {
+            continue;
+        }
+        d->total_bytes.store(static_cast<uint64_t>(vfs.f_blocks) * vfs.f_frsize, std::memory_order_relaxed);
+        d->free_bytes.store(static_cast<uint64_t>(vfs.f_bavail) * vfs.f_frsize, std::memory_order_relaxed);
+    }
+}
+
+DiskScheduler::ClassLimits DiskScheduler::GetClassLimits(Class cls) const {
+    std::lock_guard<std::mutex> lk(limits_mu_);
+    return limits_[cls < kClasses ? cls : kForeground];
+}
+
+void DiskScheduler::SetClassLimits(Class cls, const ClassLimits& limits) {
+    {
+        std::lock_guard<std::mutex> lk(limits_mu_);
+        ClassLimits& l = limits_[cls < kClasses ? cls : kForeground];
+        l = limits;
+        l.weight = std::max<uint32_t>(l.weight, 1);
+    }
+    // workers sleeping on the old caps recompute their wait
+    for (auto& d : disks_) {
+        d->cv.notify_all();
+    }
+}
+
+DiskScheduler::ClassStats DiskScheduler::GetClassStats(Class cls) const {
+    const ClassCounters& c = counters_[cls < kClasses ? cls : kForeground];
+    ClassStats stats;
+    stats.queued = c.queued.load(std::memory_order_relaxed);
+    stats.completed = c.completed.load(std::memory_order_relaxed);
+    stats.rejected = c.rejected.load(std::memory_order_relaxed);
+    stats.bytes = c.bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool DiskScheduler::TryAcquire(size_t cls, uint64_t bytes, std::chrono::steady_clock::time_point* retry_at) {
+    std::lock_guard<std::mutex> lk(limits_mu_);
+    const ClassLimits& lim = limits_[cls];
+    if (lim.bytes_per_sec == 0 && lim.iops == 0) {
+        return true;
+    }
+    Bucket& b = buckets_[cls];
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - b.last).count();
+    b.last = now;
+    // refill, keeping at most 100ms of budget for bursts
+    const double bps = static_cast<double>(lim.bytes_per_sec);
+    const double iops = static_cast<double>(lim.iops);
+    b.bytes = std::min(b.bytes + elapsed * bps, bps * 0.1);
+    b.ios = std::min(b.ios + elapsed * iops, std::max(1.0, iops * 0.1));
+    double wait = 0;
+    if (lim.bytes_per_sec > 0 && b.bytes < 0) {
+        wait = -b.bytes / bps;
+    }
+    if (lim.iops > 0 && b.ios < 0) {
+        wait = std::max(wait, -b.ios / iops);
+    }
+    if (wait > 0) {
+        *retry_at = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(wait));
+        return false;
+    }
+    // an uncapped dimension accrues no debt, so setting a cap later starts clean
+    b.bytes = lim.bytes_per_sec > 0 ? b.bytes - static_cast<double>(bytes) : 0;
+    b.ios = lim.iops > 0 ? b.ios - 1 : 0;
+    return true;
+}
+
+// Dispatches the queued task with the smallest start tag whose class is
+// within its caps, while the disk has fewer than max_inflight tasks in flight.
+// Once stopping, caps are ignored so shutdown drains.
+void DiskScheduler::Worker(Disk& d) {
+    std::unique_lock<std::mutex> lk(d.mu);
+    for (;;) {
+        if (d.inflight >= opts_.max_inflight) {
+            d.cv.wait(lk);
+            continue;
+        }
+        size_t order[kClasses];
+        size_t n = 0;
+        for (size_t c = 0; c < kClasses; ++c) {
+            if (!d.queues[c].empty()) {
+                order[n++] = c;
+            }
+        }
+        if (n == 0) {
+            if (d.stop) {
+                return;
+            }
+            d.cv.wait(lk);
+            continue;
+        }
+        std::sort(order, order + n, [&d](size_t a, size_t b) {
+            return d.queues[a].front().start_tag < d.queues[b].front().start_tag;
+        });
+        auto retry_at = std::chrono::steady_clock::time_point::max();
+        size_t pick = kClasses;
+        for (size_t i = 0; i < n; ++i) {
+            auto t = retry_at;
+            if (d.stop || TryAcquire(order[i], d.queues[order[i]].front().bytes, &t)) {
+                pick = order[i];
+                break;
+            }
+            retry_at = std::min(retry_at, t);
+        }
+        if (pick == kClasses) {
+            d.cv.wait_until(lk, retry_at);
+            continue;
+        }
+        Task task = std::move(d.queues[pick].front());
+        d.queues[pick].pop_front();
+        d.vtime = std::max(d.vtime, task.start_tag);
+        ++d.inflight;
+        counters_[pick].queued.fetch_sub(1, std::memory_order_relaxed);
+        lk.unlock();
+
+        // The token completes the task exactly once: when called, or when its
+        // last copy goes away.
+        struct Token {
+            DiskScheduler* self;
+            Disk* disk;
+            size_t cls;
+            uint64_t bytes;
+            std::chrono::steady_clock::time_point submitted;
+            std::atomic<bool> fired{false};
+            void Fire() {
+                if (!fired.exchange(true, std::memory_order_acq_rel)) {
+                    self->Complete(*disk, cls, bytes, submitted);
+                }
+            }
+            ~Token() { Fire(); }
+        };
+        auto token = std::make_shared<Token>();
+        token->self = this;
+        token->disk = &d;
+        token->cls = pick;
+        token->bytes = task.bytes;
+        token->submitted = task.submitted;
+        task.fn([token]() { token->Fire(); });
+        token.reset();
+        task.fn = nullptr;
+
+        lk.lock();
+    }
+}
+
+void DiskScheduler::Complete(Disk& d, size_t cls, uint64_t bytes, std::chrono::steady_clock::time_point submitted) {
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - submitted);
+    counters_[cls].completed.fetch_add(1, std::memory_order_relaxed);
+    counters_[cls].bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (opts_.on_complete) {
+        opts_.on_complete(static_cast<Class>(cls), latency.count());
+    }
+    {
+        std::lock_guard<std::mutex> lk(d.mu);
+        --d.class_pending[cls];
+        --d.inflight;
+        d.pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // wakes a worker waiting for an in-flight slot, and the destructor
+    d.cv.notify_all();
+}
+
+void DiskScheduler::StatsLoop() {
+    std::unique_lock<std::mutex> lk(stats_mu_);
+    while (!stats_cv_.wait_for(lk, opts_.stats_interval, [this]() { return stop_; })) {
+        lk.unlock();
+        RefreshStats();
+        lk.lock();
+    }
+}
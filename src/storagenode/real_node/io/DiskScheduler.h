@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-disk IO queues and load-aware placement for a node with several data
+// roots, one root per disk.
+//
+// Every disk gets its own bounded queue and worker threads, so a slow disk
+// backs up only its own queue and then rejects new work, instead of holding
+// every RPC worker. New chunks go to the better of two sampled disks, scored
+// by free space divided by outstanding requests; disks under min_free_ratio
+// are only used when no other disk qualifies.
+//
+// Requests carry a priority class. Within a disk, classes share the workers
+// by start-time fair queueing on request bytes, weighted per class, and each
+// class can be capped node-wide in bytes/s and IOPS. Weights and caps can be
+// changed while running.
+//
+// A task holds its queue slot until its IO completes, not just until it is
+// submitted to the engine: async tasks get a completion token to call from
+// the engine callback, and each disk dispatches at most max_inflight tasks
+// whose IO is still outstanding. Latency is measured to completion.
+class DiskScheduler {
+public:
+    enum Class : size_t {
+        kForeground = 0,
+        kMigration = 1,
+        kScrub = 2,
+    };
+    static constexpr size_t kClasses = 3;
+
+    struct ClassLimits {
+        uint32_t weight{1};
+        uint64_t bytes_per_sec{0};  // 0 = unlimited
+        uint64_t iops{0};           // 0 = unlimited
+    };
+
+    // Completion token passed to async tasks. Call it once when the IO has
+    // finished; if every copy is dropped uncalled, that counts as completion.
+    using Done = std::function<void()>;
+
+    struct Options {
+        Options();
+        size_t threads_per_disk;
+        size_t queue_depth;      // queued + in-flight tasks per disk and class before Submit rejects
+        size_t max_inflight;     // dispatched tasks per disk whose IO has not completed yet
+        double min_free_ratio;   // placement avoids disks with less free space than this
+        std::chrono::seconds stats_interval;
+        ClassLimits classes[kClasses];
+        // Called after each task with its class and time from Submit to IO completion.
+        std::function<void(Class, int64_t latency_us)> on_complete;
+    };
+
+    struct DiskLoad {
+        std::string root;
+        uint64_t total_bytes{0};
+        uint64_t free_bytes{0};
+        size_t pending{0};
+        uint64_t rejected{0};
+    };
+
+    struct ClassStats {
+        size_t queued{0};      // waiting for a worker, all disks
+        uint64_t completed{0};
+        uint64_t rejected{0};
+        uint64_t bytes{0};
+    };
+
+    DiskScheduler(std::vector<std::string> roots, Options opts = Options());
+    ~DiskScheduler();
+
+    DiskScheduler(const DiskScheduler&) = delete;
+    DiskScheduler& operator=(const DiskScheduler&) = delete;
+
+    size_t disks() const { return disks_.size(); }
+
+    // Queues task on the disk's workers. Returns false, without running the
+    // task, when the disk already has queue_depth tasks of this class
+    // outstanding. bytes is the request size used for fair sharing and caps.
+    bool Submit(size_t disk, std::function<void()> task, Class cls = kForeground, uint64_t bytes = 0);
+    // Like Submit, for a task that only starts its IO: the slot stays taken
+    // until the task calls (or drops) the completion token.
+    bool SubmitAsync(size_t disk, std::function<void(Done)> task, Class cls = kForeground, uint64_t bytes = 0);
+
+    // Picks the disk for a new chunk.
+    size_t Place(uint64_t chunk_id);
+
+    DiskLoad Load(size_t disk) const;
+    // More than half of the disk's queue is in use; optional work should wait.
+    bool Busy(size_t disk) const;
+    // Re-reads free space of every disk; also runs every stats_interval.
+    void RefreshStats();
+
+    ClassLimits GetClassLimits(Class cls) const;
+    void SetClassLimits(Class cls, const ClassLimits& limits);
+    ClassStats GetClassStats(Class cls) const;
+
+private:
+    struct Task {
+        std::function<void(Done)> fn;
+        uint64_t bytes;
+        double start_tag;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    struct Disk {
+        std::string root;
+        std::mutex mu;
+        std::condition_variable cv;
+        std::deque<Task> queues[kClasses];
+        size_t class_pending[kClasses] = {};
+        double last_finish[kClasses] = {};  // finish tag of each class's newest task
+        double vtime{0};                     // start tag of the task last dispatched
+        size_t inflight{0};                  // dispatched tasks whose IO has not completed
+        bool stop{false};
+        std::atomic<size_t> pending{0};
+        std::atomic<uint64_t> total_bytes{0};
+        std::atomic<uint64_t> free_bytes{0};
+        std::atomic<uint64_t> rejected{0};
+        std::vector<std::thread> workers;
+    };
+
+    // Node-wide token buckets; tokens may go negative so a large request is
+    // admitted and paid off later instead of starving.
+    struct Bucket {
+        double bytes{0};
+        double ios{0};
+        std::chrono::steady_clock::time_point last;
+    };
+
+    struct ClassCounters {
+        std::atomic<size_t> queued{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    double Score(const Disk& d, bool require_free) const;
+    // Takes tokens for a request, or returns false with the time to retry.
+    bool TryAcquire(size_t cls, uint64_t bytes, std::chrono::steady_clock::time_point* retry_at);
+    void Worker(Disk& d);
+    void Complete(Disk& d, size_t cls, uint64_t bytes, std::chrono::steady_clock::time_point submitted);
+    void StatsLoop();
+
+    Options opts_;
+    std::vector<std::unique_ptr<Disk>> disks_;
+    std::atomic<uint64_t> place_seq_{0};
+
+    mutable std::mutex limits_mu_;  // taken after a disk's mu, never before
+    ClassLimits limits_[kClasses];
+    Bucket buckets_[kClasses];
+    ClassCounters counters_[kClasses];
+
+    std::mutex stats_mu_;
+    std::condition_variable stats_cv_;
+    bool stop_{false};
+    std::thread stats_thread_;
+};
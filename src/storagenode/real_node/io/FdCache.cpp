@@ -0,0 +1,103 @@
+#include "FdCache.h"
+
+#include <unistd.h>
+
+#include <utility>
+
+FdCache::FdCache(size_t capacity, std::function<void(int)> on_close)
+    : shard_capacity_((capacity + kShards - 1) / kShards),
+      on_close_(std::move(on_close)) {
+    if (shard_capacity_ == 0) {
+        shard_capacity_ = 1;
+    }
+}
+
+FdCache::~FdCache() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mu);
+        for (auto& kv : shard.map) {
+            if (kv.second.fd >= 0) {
+                ::close(kv.second.fd);
+            }
+        }
+        shard.map.clear();
+        shard.clock.clear();
+    }
+}
+
+FdCache::Shard& FdCache::ShardFor(uint64_t chunk_id) {
+    uint64_t h = chunk_id * 0x9e3779b97f4a7c15ULL;
+    return shards_[(h >> 60) & (kShards - 1)];
+}
+
+FdCache::Handle FdCache::Lookup(const Key& key) {
+    Shard& shard = ShardFor(key.chunk_id);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        return Handle();
+    }
+    Entry& e = it->second;
+    e.refs.fetch_add(1, std::memory_order_relaxed);
+    e.referenced.store(true, std::memory_order_relaxed);
+    return Handle(&e);
+}
+
+FdCache::Handle FdCache::Insert(const Key& key, int fd) {
+    Shard& shard = ShardFor(key.chunk_id);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    auto res = shard.map.try_emplace(key);
+    Entry& e = res.first->second;
+    if (!res.second) {
+        ::close(fd);
+    } else {
+        e.fd = fd;
+        e.slot = shard.clock.size();
+        shard.clock.push_back(key);
+    }
+    e.refs.fetch_add(1, std::memory_order_relaxed);
+    e.referenced.store(true, std::memory_order_relaxed);
+    EvictLocked(shard);
+    return Handle(&e);
+}
+
+size_t FdCache::size() const {
+    size_t n = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mu);
+        n += shard.map.size();
+    }
+    return n;
+}
+
+// CLOCK sweep: referenced entries get a second chance, pinned ones are
+// skipped. If everything is pinned the shard stays over capacity until a
+// later insert.
+void FdCache::EvictLocked(Shard& shard) {
+    size_t budget = 2 * shard.clock.size();
+    while (shard.map.size() > shard_capacity_ && budget-- > 0) {
+        if (shard.hand >= shard.clock.size()) {
+            shard.hand = 0;
+        }
+        const Key victim = shard.clock[shard.hand];
+        auto it = shard.map.find(victim);
+        Entry& e = it->second;
+        if (e.refs.load(std::memory_order_acquire) != 0 ||
+            e.referenced.exchange(false, std::memory_order_relaxed)) {
+            ++shard.hand;
+            continue;
+        }
+        if (on_close_) {
+            on_close_(e.fd);
+        }
+        ::close(e.fd);
+        // swap-remove from the clock; the hand now points at the moved key
+        const size_t slot = e.slot;
+        shard.clock[slot] = shard.clock.back();
+        shard.clock.pop_back();
+        if (slot < shard.clock.size()) {
+            shard.map.find(shard.clock[slot])->second.slot = slot;
+        }
+        shard.map.erase(it);
+    }
+}
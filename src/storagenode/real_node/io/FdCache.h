@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Open-fd cache keyed by (chunk_id, normalized open flags).
+//
+// The table is split into shards by chunk id; each shard has its own lock and
+// evicts with CLOCK, so a hit only sets a reference bit and bumps a pin count
+// instead of splicing an LRU list. Lookups build no strings, and handles are
+// released without taking any lock.
+class FdCache {
+public:
+    struct Key {
+        uint64_t chunk_id;
+        int flags;
+        bool operator==(const Key& o) const { return chunk_id == o.chunk_id && flags == o.flags; }
+    };
+
+private:
+    struct Entry {
+        int fd{-1};
+        std::atomic<uint32_t> refs{0};
+        std::atomic<bool> referenced{false};
+        size_t slot{0};
+    };
+
+public:
+    // Pins a cached fd; the fd stays open until the handle is destroyed.
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(Handle&& other) noexcept : entry_(other.entry_) { other.entry_ = nullptr; }
+        Handle& operator=(Handle&& other) noexcept {
+            if (this != &other) {
+                Reset();
+                entry_ = other.entry_;
+                other.entry_ = nullptr;
+            }
+            return *this;
+        }
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        ~Handle() { Reset(); }
+
+        int fd() const { return entry_ ? entry_->fd : -1; }
+        explicit operator bool() const { return entry_ != nullptr; }
+        void Reset() {
+            if (entry_) {
+                entry_->refs.fetch_sub(1, std::memory_order_release);
+                entry_ = nullptr;
+            }
+        }
+
+    private:
+        friend class FdCache;
+        explicit Handle(Entry* e) : entry_(e) {}
+        Entry* entry_{nullptr};
+    };
+
+    static constexpr size_t kShards = 16;
+
+    // on_close runs under the shard lock just before a cached fd is closed.
+    FdCache(size_t capacity, std::function<void(int)> on_close = nullptr);
+    ~FdCache();
+
+    FdCache(const FdCache&) = delete;
+    FdCache& operator=(const FdCache&) = delete;
+
+    // Returns an empty handle on miss.
+    Handle Lookup(const Key& key);
+
+    // Caches an fd the caller just opened. If another thread cached the same
+    // key first, `fd` is closed and the existing entry is returned.
+    Handle Insert(const Key& key, int fd);
+
+    size_t size() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.chunk_id ^ (static_cast<uint64_t>(static_cast<uint32_t>(k.flags)) << 32);
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return static_cast<size_t>(h);
+        }
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mu;
+        std::unordered_map<Key, Entry, KeyHash> map;
+        std::vector<Key> clock;  // slot -> key
+        size_t hand{0};
+    };
+
+    Shard& ShardFor(uint64_t chunk_id);
+    void EvictLocked(Shard& shard);
+
+    size_t shard_capacity_;
+    std::function<void(int)> on_close_;
+    Shard shards_[kShards];
+};
@@ -1,44 +1,70 @@
 #include "IOEngine.h"
+#include "UringIOEngine.h"
 
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
 #include <filesystem>
+#include <future>
+#include <iostream>
 #include <system_error>
 
 namespace fs = std::filesystem;
 
 namespace {
 
-std::string MakeKey(const std::string& path, int flags) {
-    return path + "#" + std::to_string(flags);
+uint64_t AlignDown(uint64_t v, uint64_t a) {
+    return v / a * a;
+}
+
+uint64_t AlignUp(uint64_t v, uint64_t a) {
+    return (v + a - 1) / a * a;
 }
 
 } // namespace
 
 IOEngine::Options::Options()
     : max_open_files(128),
-      sync_on_write(false) {}
+      sync_on_write(false),
+      sync_batching(true),
+      sync_batch_window_us(50),
+      sync_batch_max(64),
+      sync_batch_syncfs(false),
+      direct_io_threshold(0),
+      direct_io_alignment(4096),
+      direct_buffers(8),
+      direct_buffer_size(4 << 20),
+      uring_queue_depth(256),
+      uring_registered_files(128),
+      uring_fixed_buffers(0),
+      uring_fixed_buffer_size(1 << 20) {}
 
 IOEngine::IOEngine(std::string base_path, Options opts)
-    : base_path_(std::move(base_path)), opts_(opts) {
+    : opts_(opts), base_path_(std::move(base_path)) {
     if (opts_.max_open_files == 0) {
         opts_.max_open_files = 1;
     }
-}
-
-IOEngine::~IOEngine() {
-    std::lock_guard<std::mutex> lk(fd_mu_);
-    for (auto& kv : fd_cache_) {
-        if (kv.second.fd >= 0) {
-            ::close(kv.second.fd);
-        }
+    fd_cache_ = std::make_unique<FdCache>(opts_.max_open_files, [this](int fd) { OnFdClosed(fd); });
+    if (opts_.sync_on_write && opts_.sync_batching) {
+        SyncCoordinator::Options sync_opts;
+        sync_opts.window = std::chrono::microseconds(opts_.sync_batch_window_us);
+        sync_opts.max_batch = opts_.sync_batch_max;
+        sync_opts.use_syncfs = opts_.sync_batch_syncfs;
+        sync_ = std::make_unique<SyncCoordinator>(sync_opts);
+        dsync_on_open_ = false;
+    }
+    if (opts_.direct_io_threshold > 0) {
+        direct_pool_ = std::make_unique<AlignedBufferPool>(
+            opts_.direct_buffers, opts_.direct_buffer_size, opts_.direct_io_alignment);
+        opts_.direct_io_alignment = direct_pool_->alignment();
     }
-    fd_cache_.clear();
-    lru_.clear();
 }
 
+IOEngine::~IOEngine() = default;
+
 int IOEngine::NormalizeFlags(int flags, bool write_access) const {
     int f = flags;
     if (f == 0) {
@@ -47,31 +73,27 @@ int IOEngine::NormalizeFlags(int flags, bool write_access) const {
     if ((f & (O_WRONLY | O_RDWR)) == 0 && write_access) {
         f |= O_WRONLY;
     }
-    if (opts_.sync_on_write && write_access) {
+    if (opts_.sync_on_write && dsync_on_open_ && write_access) {
         f |= O_DSYNC;
     }
     f |= O_CLOEXEC;
     return f;
 }
 
-int IOEngine::AcquireFd(const std::string& path,
-                        int flags,
-                        bool create_if_missing,
-                        int mode,
-                        int& err) {
+FdCache::Handle IOEngine::AcquireFd(uint64_t chunk_id,
+                                    const std::string& path,
+                                    int flags,
+                                    bool create_if_missing,
+                                    int mode,
+                                    int& err) {
     bool write_access = (flags & (O_WRONLY | O_RDWR)) != 0;
     int normalized = NormalizeFlags(flags, write_access);
-    int cache_flags = normalized & ~O_CREAT;
-    const std::string key = MakeKey(path, cache_flags);
-
-    std::lock_guard<std::mutex> lk(fd_mu_);
-    auto it = fd_cache_.find(key);
-    if (it != fd_cache_.end()) {
-        lru_.splice(lru_.begin(), lru_, it->second.lru_it);
-        it->second.lru_it = lru_.begin();
-        ++it->second.ref_count;
+    const FdCache::Key key{chunk_id, normalized & ~O_CREAT};
+
+    FdCache::Handle handle = fd_cache_->Lookup(key);
+    if (handle) {
         err = 0;
-        return it->second.fd;
+        return handle;
     }
 
     if (create_if_missing) {
@@ -85,140 +107,342 @@ int IOEngine::AcquireFd(const std::string& path,
     int fd = ::open(path.c_str(), normalized, mode);
     if (fd < 0) {
         err = errno;
-        return -1;
+        return handle;
     }
-
-    lru_.push_front(key);
-    FDEntry entry;
-    entry.fd = fd;
-    entry.writable = write_access;
-    entry.lru_it = lru_.begin();
-    entry.ref_count = 1;
-    fd_cache_.emplace(key, entry);
-
-    EvictIfNeeded();
     err = 0;
-    return fd;
+    return fd_cache_->Insert(key, fd);
 }
 
-void IOEngine::ReleaseFd(const std::string& path, int flags) {
-    bool write_access = (flags & (O_WRONLY | O_RDWR)) != 0;
-    int normalized = NormalizeFlags(flags, write_access);
-    int cache_flags = normalized & ~O_CREAT;
-    const std::string key = MakeKey(path, cache_flags);
+namespace {
 
-    std::lock_guard<std::mutex> lk(fd_mu_);
-    auto it = fd_cache_.find(key);
-    if (it == fd_cache_.end()) {
-        return;
-    }
-    if (it->second.ref_count > 0) {
-        --it->second.ref_count;
-    }
-    if (it->second.ref_count == 0) {
-        EvictIfNeeded();
-    }
+IOEngine::Result Failure(int err) {
+    IOEngine::Result r{};
+    r.bytes = -1;
+    r.err = err;
+    return r;
 }
 
-void IOEngine::EvictIfNeeded() {
-    while (fd_cache_.size() > opts_.max_open_files && !lru_.empty()) {
-        const std::string& victim = lru_.back();
-        auto it = fd_cache_.find(victim);
-        if (it != fd_cache_.end()) {
-            if (it->second.ref_count > 0) {
-                lru_.splice(lru_.begin(), lru_, it->second.lru_it);
-                it->second.lru_it = lru_.begin();
-                return;
-            }
-            ::close(it->second.fd);
-            fd_cache_.erase(it);
-        }
-        lru_.pop_back();
-    }
-}
+} // namespace
 
-IOEngine::Result IOEngine::Write(const std::string& path,
+IOEngine::Result IOEngine::Write(uint64_t chunk_id,
+                                 const std::string& path,
                                  const void* data,
                                  size_t size,
                                  uint64_t offset,
                                  int flags,
                                  int mode) {
-    Result r{};
-    int err = 0;
-    int fd = AcquireFd(path, flags, /*create_if_missing=*/true, mode, err);
-    if (fd < 0) {
-        r.bytes = -1;
-        r.err = err;
+    if (!sync_) {
+        // O_DSYNC already makes the pwrite durable; only backends that turned
+        // it off need an explicit sync here.
+        return WriteData(chunk_id, path, data, size, offset, flags, mode,
+                         opts_.sync_on_write && !dsync_on_open_);
+    }
+    Result r = WriteData(chunk_id, path, data, size, offset, flags, mode, false);
+    if (r.bytes < 0) {
         return r;
     }
+    std::promise<Result> synced;
+    std::future<Result> f = synced.get_future();
+    QueueSync(chunk_id, path, flags, r, [&synced](const Result& res) { synced.set_value(res); });
+    return f.get();
+}
 
-    ssize_t n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
-    if (n < 0) {
-        r.bytes = -1;
-        r.err = errno;
-        ReleaseFd(path, flags);
-        return r;
+IOEngine::Result IOEngine::WriteData(uint64_t chunk_id,
+                                     const std::string& path,
+                                     const void* data,
+                                     size_t size,
+                                     uint64_t offset,
+                                     int flags,
+                                     int mode,
+                                     bool sync) {
+    if (UseDirectIO(size)) {
+        return DirectWrite(chunk_id, path, data, size, offset, flags, mode, sync);
     }
-    r.bytes = n;
-    if (opts_.sync_on_write) {
-        if (::fsync(fd) != 0) {
-            r.err = errno;
-        }
+    return BufferedWrite(chunk_id, path, data, size, offset, flags, mode, sync);
+}
+
+void IOEngine::QueueSync(uint64_t chunk_id, const std::string& path, int flags, Result r, Callback cb) {
+    int err = 0;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/false, 0, err);
+    if (!fd) {
+        r.err = err;
+        if (cb) cb(r);
+        return;
     }
-    ReleaseFd(path, flags);
-    return r;
+    CompleteAfterSync(std::move(fd), r, std::move(cb));
+}
+
+void IOEngine::CompleteAfterSync(FdCache::Handle fd, Result r, Callback cb) {
+    sync_->Submit(std::move(fd), [r, cb = std::move(cb)](int err) mutable {
+        if (err != 0 && r.err == 0) {
+            r.err = err;
+        }
+        if (cb) cb(r);
+    });
 }
 
-IOEngine::Result IOEngine::Read(const std::string& path,
+IOEngine::Result IOEngine::Read(uint64_t chunk_id,
+                                const std::string& path,
                                 uint64_t offset,
                                 size_t length,
                                 std::string& out,
                                 int flags) {
+    if (UseDirectIO(length)) {
+        return DirectRead(chunk_id, path, offset, length, out, flags);
+    }
+    return BufferedRead(chunk_id, path, offset, length, out, flags);
+}
+
+IOEngine::Result IOEngine::BufferedWrite(uint64_t chunk_id,
+                                         const std::string& path,
+                                         const void* data,
+                                         size_t size,
+                                         uint64_t offset,
+                                         int flags,
+                                         int mode,
+                                         bool sync) {
+    int err = 0;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/true, mode, err);
+    if (!fd) {
+        return Failure(err);
+    }
+
+    ssize_t n = ::pwrite(fd.fd(), data, size, static_cast<off_t>(offset));
+    if (n < 0) {
+        return Failure(errno);
+    }
     Result r{};
+    r.bytes = n;
+    if (sync && ::fdatasync(fd.fd()) != 0) {
+        r.err = errno;
+    }
+    return r;
+}
+
+IOEngine::Result IOEngine::BufferedRead(uint64_t chunk_id,
+                                        const std::string& path,
+                                        uint64_t offset,
+                                        size_t length,
+                                        std::string& out,
+                                        int flags) {
     out.resize(length);
 
     int err = 0;
-    int fd = AcquireFd(path, flags, /*create_if_missing=*/false, 0, err);
-    if (fd < 0) {
-        r.bytes = -1;
-        r.err = err;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/false, 0, err);
+    if (!fd) {
         out.clear();
-        return r;
+        return Failure(err);
     }
 
-    ssize_t n = ::pread(fd, out.data(), length, static_cast<off_t>(offset));
+    ssize_t n = ::pread(fd.fd(), out.data(), length, static_cast<off_t>(offset));
     if (n < 0) {
-        r.bytes = -1;
-        r.err = errno;
         out.clear();
-        ReleaseFd(path, flags);
-        return r;
+        return Failure(errno);
     }
+    Result r{};
     r.bytes = n;
     out.resize(static_cast<size_t>(n));
-    ReleaseFd(path, flags);
     return r;
 }
 
-IOEngine::Result IOEngine::Truncate(const std::string& path,
+// The aligned middle goes through an O_DIRECT fd from a pooled buffer; the
+// unaligned head and tail are written through the regular fd so no
+// read-modify-write of partial blocks is needed.
+IOEngine::Result IOEngine::DirectWrite(uint64_t chunk_id,
+                                       const std::string& path,
+                                       const void* data,
+                                       size_t size,
+                                       uint64_t offset,
+                                       int flags,
+                                       int mode,
+                                       bool sync) {
+    const uint64_t align = opts_.direct_io_alignment;
+    const uint64_t end = offset + size;
+    const uint64_t mid_begin = AlignUp(offset, align);
+    const uint64_t mid_end = AlignDown(end, align);
+    if (mid_end <= mid_begin) {
+        return BufferedWrite(chunk_id, path, data, size, offset, flags, mode, sync);
+    }
+
+    int err = 0;
+    FdCache::Handle dfd = AcquireFd(chunk_id, path, flags | O_DIRECT, /*create_if_missing=*/true, mode, err);
+    if (!dfd) {
+        if (err == EINVAL) {
+            // filesystem without O_DIRECT support (e.g. tmpfs)
+            return BufferedWrite(chunk_id, path, data, size, offset, flags, mode, sync);
+        }
+        return Failure(err);
+    }
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/true, mode, err);
+    if (!fd) {
+        return Failure(err);
+    }
+
+    const char* src = static_cast<const char*>(data);
+    if (mid_begin > offset) {
+        size_t n = static_cast<size_t>(mid_begin - offset);
+        ssize_t w = ::pwrite(fd.fd(), src, n, static_cast<off_t>(offset));
+        if (w < 0) return Failure(errno);
+        if (static_cast<size_t>(w) != n) return Failure(EIO);
+    }
+
+    AlignedBufferPool::Buffer buf = direct_pool_->Acquire();
+    if (!buf) return Failure(ENOMEM);
+    uint64_t pos = mid_begin;
+    while (pos < mid_end) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(buf.size(), mid_end - pos));
+        std::memcpy(buf.data(), src + (pos - offset), n);
+        ssize_t w = ::pwrite(dfd.fd(), buf.data(), n, static_cast<off_t>(pos));
+        if (w < 0) return Failure(errno);
+        if (static_cast<size_t>(w) != n) return Failure(EIO);
+        pos += n;
+    }
+
+    if (end > mid_end) {
+        size_t n = static_cast<size_t>(end - mid_end);
+        ssize_t w = ::pwrite(fd.fd(), src + (mid_end - offset), n, static_cast<off_t>(mid_end));
+        if (w < 0) return Failure(errno);
+        if (static_cast<size_t>(w) != n) return Failure(EIO);
+    }
+
+    Result r{};
+    r.bytes = static_cast<ssize_t>(size);
+    if (sync && ::fdatasync(fd.fd()) != 0) {
+        r.err = errno;
+    }
+    return r;
+}
+
+// Reads the enclosing aligned range with O_DIRECT and copies out the
+// requested slice; a short read means EOF.
+IOEngine::Result IOEngine::DirectRead(uint64_t chunk_id,
+                                      const std::string& path,
+                                      uint64_t offset,
+                                      size_t length,
+                                      std::string& out,
+                                      int flags) {
+    const uint64_t align = opts_.direct_io_alignment;
+    const uint64_t end = offset + length;
+    int err = 0;
+    FdCache::Handle dfd = AcquireFd(chunk_id, path, flags | O_DIRECT, /*create_if_missing=*/false, 0, err);
+    if (!dfd) {
+        if (err == EINVAL) {
+            return BufferedRead(chunk_id, path, offset, length, out, flags);
+        }
+        out.clear();
+        return Failure(err);
+    }
+
+    AlignedBufferPool::Buffer buf = direct_pool_->Acquire();
+    if (!buf) {
+        out.clear();
+        return Failure(ENOMEM);
+    }
+
+    out.resize(length);
+    uint64_t copied_end = offset;
+    uint64_t pos = AlignDown(offset, align);
+    const uint64_t aligned_end = AlignUp(end, align);
+    while (pos < aligned_end) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(buf.size(), aligned_end - pos));
+        ssize_t got = ::pread(dfd.fd(), buf.data(), n, static_cast<off_t>(pos));
+        if (got < 0) {
+            out.clear();
+            return Failure(errno);
+        }
+        uint64_t lo = std::max(pos, offset);
+        uint64_t hi = std::min(pos + static_cast<uint64_t>(got), end);
+        if (hi > lo) {
+            std::memcpy(&out[lo - offset], buf.data() + (lo - pos), static_cast<size_t>(hi - lo));
+            copied_end = hi;
+        }
+        if (static_cast<size_t>(got) < n) {
+            break;
+        }
+        pos += n;
+    }
+    out.resize(static_cast<size_t>(copied_end - offset));
+    Result r{};
+    r.bytes = static_cast<ssize_t>(out.size());
+    return r;
+}
+
+IOEngine::Result IOEngine::Truncate(uint64_t chunk_id,
+                                    const std::string& path,
                                     uint64_t size,
                                     int flags,
                                     int mode) {
-    Result r{};
     int err = 0;
-    int fd = AcquireFd(path, flags, /*create_if_missing=*/true, mode, err);
-    if (fd < 0) {
-        r.bytes = -1;
-        r.err = err;
-        return r;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/true, mode, err);
+    if (!fd) {
+        return Failure(err);
     }
-    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
-        r.bytes = -1;
-        r.err = errno;
-        ReleaseFd(path, flags);
-        return r;
+    if (::ftruncate(fd.fd(), static_cast<off_t>(size)) != 0) {
+        return Failure(errno);
     }
-    r.bytes = 0;
-    ReleaseFd(path, flags);
-    return r;
+    return Result{};
+}
+
+IOEngine::Result IOEngine::Prefetch(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length) {
+    int err = 0;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, O_RDONLY, /*create_if_missing=*/false, 0, err);
+    if (!fd) {
+        return Failure(err);
+    }
+    int rc = ::posix_fadvise(fd.fd(), static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+    if (rc != 0) {
+        return Failure(rc);
+    }
+    return Result{};
+}
+
+void IOEngine::AsyncWrite(uint64_t chunk_id,
+                          const std::string& path,
+                          const void* data,
+                          size_t size,
+                          uint64_t offset,
+                          int flags,
+                          int mode,
+                          Callback cb) {
+    if (!sync_) {
+        Result r = Write(chunk_id, path, data, size, offset, flags, mode);
+        if (cb) cb(r);
+        return;
+    }
+    Result r = WriteData(chunk_id, path, data, size, offset, flags, mode, false);
+    if (r.bytes < 0) {
+        if (cb) cb(r);
+        return;
+    }
+    QueueSync(chunk_id, path, flags, r, std::move(cb));
+}
+
+void IOEngine::AsyncRead(uint64_t chunk_id,
+                         const std::string& path,
+                         uint64_t offset,
+                         size_t length,
+                         std::string* out,
+                         int flags,
+                         Callback cb) {
+    Result r = Read(chunk_id, path, offset, length, *out, flags);
+    if (cb) cb(r);
+}
+
+std::shared_ptr<IOEngine> MakeIOEngine(const std::string& backend,
+                                       std::string base_path,
+                                       IOEngine::Options opts) {
+    if (backend == "io_uring") {
+#ifdef ZB_HAVE_LIBURING
+        auto engine = std::make_shared<UringIOEngine>(base_path, opts);
+        if (engine->ok()) {
+            return engine;
+        }
+        std::cerr << "[IOEngine] io_uring setup failed, falling back to pread" << std::endl;
+#else
+        std::cerr << "[IOEngine] built without liburing, falling back to pread" << std::endl;
+#endif
+    } else if (backend != "pread") {
+        std::cerr << "[IOEngine] unknown backend '" << backend << "', using pread" << std::endl;
+    }
+    return std::make_shared<IOEngine>(std::move(base_path), opts);
 }
@@ -2,10 +2,13 @@
 
 #include <cstdint>
 #include <sys/types.h>
-#include <list>
-#include <mutex>
+#include <functional>
+#include <memory>
 #include <string>
-#include <unordered_map>
+
+#include "AlignedBufferPool.h"
+#include "FdCache.h"
+#include "SyncCoordinator.h"
 
 class IOEngine {
 public:
@@ -14,36 +17,101 @@ public:
         int err{0};
     };
 
+    using Callback = std::function<void(const Result&)>;
+
     struct Options {
         Options();
         size_t max_open_files;
         bool sync_on_write;
+        // With sync_on_write, batch the data syncs of concurrent writes
+        // through a SyncCoordinator instead of O_DSYNC per write.
+        bool sync_batching;
+        uint32_t sync_batch_window_us;
+        size_t sync_batch_max;
+        bool sync_batch_syncfs;
+        // Requests of at least this many bytes bypass the page cache with
+        // O_DIRECT; unaligned heads/tails stay buffered. 0 disables.
+        size_t direct_io_threshold;
+        size_t direct_io_alignment;
+        size_t direct_buffers;        // pooled aligned buffers
+        size_t direct_buffer_size;    // bytes per pooled buffer
+        // io_uring backend only.
+        unsigned uring_queue_depth;
+        unsigned uring_registered_files;  // fixed-file table slots, 0 disables
+        unsigned uring_fixed_buffers;     // registered buffers, 0 disables
+        size_t uring_fixed_buffer_size;
     };
 
     IOEngine(std::string base_path, Options opts = Options());
-    ~IOEngine();
+    virtual ~IOEngine();
+
+    // Open fds are cached per (chunk_id, flags); path is only used to open on a miss.
+    Result Write(uint64_t chunk_id, const std::string& path, const void* data, size_t size, uint64_t offset,
+                 int flags, int mode);
+    Result Read(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length, std::string& out,
+                int flags);
+    Result Truncate(uint64_t chunk_id, const std::string& path, uint64_t size, int flags, int mode);
+    // Asks the kernel to start reading the range into the page cache; does not wait.
+    Result Prefetch(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length);
+
+    // Async variants: cb runs once the IO completes (inline for the pread backend,
+    // on the completion thread for io_uring). data/out must stay valid until cb runs.
+    virtual void AsyncWrite(uint64_t chunk_id, const std::string& path, const void* data, size_t size,
+                            uint64_t offset, int flags, int mode, Callback cb);
+    virtual void AsyncRead(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                           std::string* out, int flags, Callback cb);
+
+    virtual const char* BackendName() const { return "pread"; }
+
+protected:
+    // Returns an empty handle and sets err on failure; the fd stays pinned
+    // until the handle is dropped.
+    FdCache::Handle AcquireFd(uint64_t chunk_id, const std::string& path, int flags, bool create_if_missing,
+                              int mode, int& err);
+    // Called under the fd cache shard lock just before a cached fd is closed.
+    virtual void OnFdClosed(int fd) { (void)fd; }
+
+    bool UseDirectIO(size_t size) const {
+        return direct_pool_ != nullptr && size >= opts_.direct_io_threshold;
+    }
 
-    Result Write(const std::string& path, const void* data, size_t size, uint64_t offset, int flags, int mode);
-    Result Read(const std::string& path, uint64_t offset, size_t length, std::string& out, int flags);
-    Result Truncate(const std::string& path, uint64_t size, int flags, int mode);
+    // True when writes are made durable by the group-commit coordinator.
+    bool BatchedSync() const { return sync_ != nullptr; }
+    // Hands the write's fd to the coordinator; cb gets r once its data is durable.
+    void CompleteAfterSync(FdCache::Handle fd, Result r, Callback cb);
+
+    Options opts_;
+    // Open writable fds with O_DSYNC when sync_on_write is set; backends that
+    // issue their own data sync per write turn this off.
+    bool dsync_on_open_{true};
+
+private:
+    Result WriteData(uint64_t chunk_id, const std::string& path, const void* data, size_t size,
+                     uint64_t offset, int flags, int mode, bool sync);
+    void QueueSync(uint64_t chunk_id, const std::string& path, int flags, Result r, Callback cb);
 
 private:
-    int AcquireFd(const std::string& path, int flags, bool create_if_missing, int mode, int& err);
-    void ReleaseFd(const std::string& path, int flags);
-    void EvictIfNeeded();
+    Result BufferedWrite(uint64_t chunk_id, const std::string& path, const void* data, size_t size,
+                         uint64_t offset, int flags, int mode, bool sync);
+    Result BufferedRead(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                        std::string& out, int flags);
+    Result DirectWrite(uint64_t chunk_id, const std::string& path, const void* data, size_t size,
+                       uint64_t offset, int flags, int mode, bool sync);
+    Result DirectRead(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                      std::string& out, int flags);
     int NormalizeFlags(int flags, bool write_access) const;
 
-    struct FDEntry {
-        int fd{-1};
-        bool writable{false};
-        std::list<std::string>::iterator lru_it;
-        size_t ref_count{0};
-    };
+    std::unique_ptr<FdCache> fd_cache_;
+    // Declared after fd_cache_ so queued handles are released before the cache goes.
+    std::unique_ptr<SyncCoordinator> sync_;
 
-    std::mutex fd_mu_;
-    std::list<std::string> lru_;
-    std::unordered_map<std::string, FDEntry> fd_cache_;
+    std::unique_ptr<AlignedBufferPool> direct_pool_;
 
     std::string base_path_;
-    Options opts_;
 };
+
+// Builds the engine for `backend` ("pread" or "io_uring"); falls back to pread
+// when io_uring is unavailable in this build or on this kernel.
+std::shared_ptr<IOEngine> MakeIOEngine(const std::string& backend,
+                                       std::string base_path,
+                                       IOEngine::Options opts = IOEngine::Options());
@@ -0,0 +1,226 @@
+#include "Preallocator.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <utility>
+
+#include "SparseFile.h"
+
+Preallocator::Options::Options()
+    : first_window(1u << 20),
+      max_window(64u << 20),
+      max_hint(4ull << 30),
+      idle_trim(std::chrono::seconds(60)),
+      max_chunks(65536) {}
+
+Preallocator::Preallocator(Options opts, TrimFn trim_idle)
+    : opts_(opts), trim_idle_(std::move(trim_idle)) {
+    opts_.first_window = std::max<uint64_t>(opts_.first_window, 4096);
+    opts_.max_window = std::max(opts_.max_window, opts_.first_window);
+    if (opts_.idle_trim.count() > 0 && trim_idle_) {
+        sweeper_ = std::thread([this]() { Sweep(); });
+    }
+}
+
+Preallocator::~Preallocator() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (sweeper_.joinable()) {
+        sweeper_.join();
+    }
+}
+
+void Preallocator::BeforeWrite(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length,
+                               uint64_t size_hint, int mode) {
+    if (length == 0) {
+        return;
+    }
+    const uint64_t end = offset + length;
+    uint64_t from = 0;
+    uint64_t to = 0;
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        auto it = chunks_.find(chunk_id);
+        while (it != chunks_.end() && it->second.trimming) {
+            trimmed_cv_.wait(lk);
+            it = chunks_.find(chunk_id);
+        }
+        if (it == chunks_.end()) {
+            if (chunks_.size() >= opts_.max_chunks) {
+                Evict();
+            }
+            it = chunks_.emplace(chunk_id, Chunk{}).first;
+        }
+        Chunk& c = it->second;
+        ++c.inflight;
+        c.touched = std::chrono::steady_clock::now();
+        if (!supported_) {
+            return;
+        }
+        const bool appending = offset <= c.written && end > c.written;
+        c.written = std::max(c.written, end);
+        const uint64_t hint = std::min(size_hint, opts_.max_hint);
+        if (hint >= end && hint > c.reserved) {
+            from = std::max(c.reserved, offset);
+            to = hint;
+        } else if (appending && end > c.reserved && end >= opts_.first_window) {
+            c.window = c.window == 0 ? opts_.first_window : std::min(c.window * 2, opts_.max_window);
+            from = std::max(c.reserved, offset);
+            to = end + c.window;
+        }
+        if (to <= from) {
+            return;
+        }
+        // a failed reservation is not retried until the writer moves past it
+        c.reserved = to;
+    }
+    int err = 0;
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, mode == 0 ? 0644 : mode);
+    if (fd < 0) {
+        err = errno;
+    } else {
+        if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(from), static_cast<off_t>(to - from)) != 0) {
+            err = errno;
+        }
+        ::close(fd);
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    if (err == 0) {
+        stats_.reserved_bytes += to - from;
+        return;
+    }
+    ++stats_.failures;
+    if (err == EOPNOTSUPP || err == ENOSYS) {
+        supported_ = false;
+        std::cerr << "[RealNode] fallocate not supported, chunk preallocation disabled" << std::endl;
+    }
+}
+
+void Preallocator::AfterWrite(uint64_t chunk_id) {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = chunks_.find(chunk_id);
+    if (it != chunks_.end() && it->second.inflight > 0) {
+        --it->second.inflight;
+        it->second.touched = std::chrono::steady_clock::now();
+    }
+}
+
+Preallocator::TrimResult Preallocator::Trim(uint64_t chunk_id, const std::string& path) {
+    TrimResult result;
+    uint64_t reserved = 0;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = chunks_.find(chunk_id);
+        if (it == chunks_.end()) {
+            it = chunks_.emplace(chunk_id, Chunk{}).first;
+        } else if (it->second.inflight > 0 || it->second.trimming) {
+            result.err = EBUSY;
+            return result;
+        }
+        reserved = it->second.reserved;
+        it->second.trimming = true;  // holds off writes until the end is settled
+    }
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        result.err = errno == ENOENT ? 0 : errno;  // never written, nothing reserved
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        Finish(chunk_id);
+        return result;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    const uint64_t allocated = static_cast<uint64_t>(st.st_blocks) * 512;
+    // Untracked reservations (made before a restart) lie within allocated
+    // bytes of the end; tracked ones end at reserved.
+    const uint64_t size_blocks = (size + 4095) / 4096 * 4096;
+    const uint64_t past_end =
+        std::max(reserved > size ? reserved - size : 0, allocated > size_blocks ? allocated : 0);
+    if (past_end > 0) {
+        // Truncating to the current size frees the blocks past it; ext4
+        // ignores a hole punched beyond the end. No write can move the end
+        // meanwhile, so this never cuts off data.
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0 &&
+            ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(size),
+                        static_cast<off_t>(past_end)) != 0) {
+            result.err = errno;
+        }
+        struct stat after {};
+        if (::fstat(fd, &after) == 0 && after.st_blocks < st.st_blocks) {
+            result.released = static_cast<uint64_t>(st.st_blocks - after.st_blocks) * 512;
+        }
+    }
+    SparseFile::CountExtents(fd, &result.extents);
+    ::close(fd);
+    Finish(chunk_id);
+
+    std::lock_guard<std::mutex> lk(mu_);
+    ++stats_.trims;
+    stats_.released_bytes += result.released;
+    stats_.trimmed_extents += result.extents;
+    stats_.max_extents = std::max<uint64_t>(stats_.max_extents, result.extents);
+    return result;
+}
+
+void Preallocator::Reset(uint64_t chunk_id) {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = chunks_.find(chunk_id);
+    if (it != chunks_.end() && it->second.inflight == 0 && !it->second.trimming) {
+        chunks_.erase(it);
+    }
+}
+
+void Preallocator::Finish(uint64_t chunk_id) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        chunks_.erase(chunk_id);
+    }
+    trimmed_cv_.notify_all();
+}
+
+void Preallocator::Evict() {
+    for (auto it = chunks_.begin(); it != chunks_.end(); ++it) {
+        if (it->second.inflight == 0 && !it->second.trimming) {
+            chunks_.erase(it);  // its reservation waits for a trim on close
+            return;
+        }
+    }
+}
+
+Preallocator::Stats Preallocator::GetStats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+void Preallocator::Sweep() {
+    const auto period = std::max<std::chrono::seconds>(opts_.idle_trim / 2, std::chrono::seconds(1));
+    std::unique_lock<std::mutex> lk(mu_);
+    while (!cv_.wait_for(lk, period, [this]() { return stop_; })) {
+        const auto idle_since = std::chrono::steady_clock::now() - opts_.idle_trim;
+        std::vector<uint64_t> idle;
+        for (auto it = chunks_.begin(); it != chunks_.end();) {
+            if (it->second.touched > idle_since || it->second.inflight > 0 || it->second.trimming) {
+                ++it;
+            } else if (it->second.reserved <= it->second.written) {
+                it = chunks_.erase(it);  // nothing past the end
+            } else {
+                idle.push_back(it->first);
+                ++it;
+            }
+        }
+        lk.unlock();
+        for (uint64_t chunk_id : idle) {
+            trim_idle_(chunk_id);
+        }
+        lk.lock();
+    }
+}
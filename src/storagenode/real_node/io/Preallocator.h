@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Reserves space for file-backed chunks ahead of their writes so that
+// concurrently growing chunks do not interleave their blocks on disk.
+//
+// A write carrying a size hint reserves the chunk up to the hint. Without
+// one, a chunk that keeps growing at its end past first_window gets a
+// speculative window beyond the write, doubling up to max_window each time
+// the writer runs into it. Space is taken with fallocate(FALLOC_FL_KEEP_SIZE),
+// so the chunk's size only changes through writes. Trim gives back whatever
+// lies past the end of the chunk; it runs when a writer closes the chunk and,
+// for writers that never do, once the chunk has been idle for idle_trim.
+class Preallocator {
+public:
+    struct Options {
+        Options();
+        uint64_t first_window;
+        uint64_t max_window;
+        uint64_t max_hint;  // larger hints are clamped to this
+        std::chrono::seconds idle_trim;  // 0 disables the idle sweep
+        size_t max_chunks;  // tracked chunks; arbitrary ones are dropped beyond this
+    };
+
+    struct Stats {
+        uint64_t reserved_bytes{0};
+        uint64_t released_bytes{0};
+        uint64_t failures{0};
+        uint64_t trims{0};
+        uint64_t trimmed_extents{0};  // extents of the trimmed chunks, summed
+        uint64_t max_extents{0};      // most extents seen in one trimmed chunk
+    };
+
+    struct TrimResult {
+        int err{0};
+        uint64_t released{0};
+        uint32_t extents{0};
+    };
+
+    // Queues Trim for an idle chunk on its disk; returns false if it could
+    // not be queued right now, in which case the next sweep retries.
+    using TrimFn = std::function<bool(uint64_t chunk_id)>;
+
+    Preallocator(Options opts, TrimFn trim_idle);
+    ~Preallocator();
+
+    Preallocator(const Preallocator&) = delete;
+    Preallocator& operator=(const Preallocator&) = delete;
+
+    // Call on the chunk's disk before writing [offset, offset + length), and
+    // AfterWrite once that write has completed. Waits while the chunk is
+    // being trimmed.
+    void BeforeWrite(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length,
+                     uint64_t size_hint, int mode);
+    void AfterWrite(uint64_t chunk_id);
+    // Releases the space reserved past the end of the chunk and counts its
+    // extents. Also catches reservations made before a restart. Fails with
+    // EBUSY while writes to the chunk are in flight, since the end may move.
+    TrimResult Trim(uint64_t chunk_id, const std::string& path);
+    // Forget the chunk without touching its file, e.g. after a truncate.
+    void Reset(uint64_t chunk_id);
+
+    Stats GetStats() const;
+
+private:
+    struct Chunk {
+        uint64_t reserved{0};  // end of the reserved range
+        uint64_t written{0};   // highest end written
+        uint64_t window{0};
+        uint32_t inflight{0};  // writes between BeforeWrite and AfterWrite
+        bool trimming{false};
+        std::chrono::steady_clock::time_point touched;
+    };
+
+    void Finish(uint64_t chunk_id);  // ends a trim and wakes the writers it held
+    void Evict();  // drops one idle chunk; caller holds mu_
+    void Sweep();
+
+    Options opts_;
+    TrimFn trim_idle_;
+    mutable std::mutex mu_;
+    std::unordered_map<uint64_t, Chunk> chunks_;
+    Stats stats_;
+    bool supported_{true};
+
+    std::condition_variable trimmed_cv_;
+    std::condition_variable cv_;
+    bool stop_{false};
+    std::thread sweeper_;
+};
@@ -0,0 +1,113 @@
+#include "Readahead.h"
+
+#include <algorithm>
+#include <utility>
+
+ReadaheadManager::Options::Options()
+    : initial_window(128u << 10),
+      max_window(4u << 20),
+      min_sequential(2),
+      max_streams(4096),
+      threads(2),
+      max_queued(64) {}
+
+ReadaheadManager::ReadaheadManager(Options opts, FetchFn fetch)
+    : opts_(opts), fetch_(std::move(fetch)) {
+    opts_.initial_window = std::max<uint64_t>(opts_.initial_window, 4096);
+    opts_.max_window = std::max(opts_.max_window, opts_.initial_window);
+    opts_.min_sequential = std::max<uint32_t>(opts_.min_sequential, 1);
+    for (size_t i = 0; i < std::max<size_t>(opts_.threads, 1); ++i) {
+        workers_.emplace_back([this]() { Worker(); });
+    }
+}
+
+ReadaheadManager::~ReadaheadManager() {
+    {
+        std::lock_guard<std::mutex> lk(queue_mu_);
+        stop_ = true;
+        queue_.clear();
+    }
+    queue_cv_.notify_all();
+    for (auto& t : workers_) {
+        t.join();
+    }
+}
+
+void ReadaheadManager::OnRead(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length) {
+    if (length == 0) {
+        return;
+    }
+    const uint64_t end = offset + length;
+    Task task{chunk_id, std::string(), 0, 0};
+    {
+        Shard& shard = ShardFor(chunk_id);
+        std::lock_guard<std::mutex> lk(shard.mu);
+        auto it = shard.streams.find(chunk_id);
+        if (it == shard.streams.end()) {
+            if (shard.streams.size() > opts_.max_streams / kShards) {
+                shard.streams.erase(shard.streams.begin());
+            }
+            it = shard.streams.emplace(chunk_id, Stream{}).first;
+            it->second.next = offset;
+        }
+        Stream& s = it->second;
+        // Concurrent FUSE reads can arrive slightly out of order; accept a
+        // request that starts anywhere within one request length of next.
+        const bool in_order = offset <= s.next + length && end > s.next;
+        if (!in_order) {
+            s = Stream{};
+            s.next = end;
+            return;
+        }
+        s.next = std::max(s.next, end);
+        if (++s.sequential < opts_.min_sequential) {
+            return;
+        }
+        if (s.window == 0) {
+            s.window = opts_.initial_window;
+            s.ahead = s.next;
+        } else if (s.next + s.window / 2 < s.ahead) {
+            return;  // still well inside the prefetched window
+        } else {
+            s.window = std::min(s.window * 2, opts_.max_window);
+        }
+        task.offset = std::max(s.ahead, s.next);
+        task.length = s.window;
+        s.ahead = task.offset + task.length;
+    }
+    task.path = path;
+    Enqueue(std::move(task));
+}
+
+void ReadaheadManager::Reset(uint64_t chunk_id) {
+    Shard& shard = ShardFor(chunk_id);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    shard.streams.erase(chunk_id);
+}
+
+void ReadaheadManager::Enqueue(Task task) {
+    {
+        std::lock_guard<std::mutex> lk(queue_mu_);
+        if (queue_.size() >= opts_.max_queued) {
+            return;
+        }
+        queue_.push_back(std::move(task));
+    }
+    queue_cv_.notify_one();
+}
+
+void ReadaheadManager::Worker() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lk(queue_mu_);
+            queue_cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+            if (stop_) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        fetch_(task.chunk_id, task.path, task.offset, task.length);
+    }
+}
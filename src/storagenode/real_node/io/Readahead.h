@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Per-chunk sequential stream detection with asynchronous readahead.
+//
+// Every read reports (chunk, offset, length). Once a chunk has been read
+// front to back for min_sequential requests in a row, a prefetch window
+// ahead of the reader is handed to the fetch callback on a small worker pool.
+// The next window is issued when the reader crosses the middle of the
+// current one, and each window doubles up to max_window. A read that jumps
+// elsewhere drops the stream back to untracked.
+class ReadaheadManager {
+public:
+    struct Options {
+        Options();
+        uint64_t initial_window;
+        uint64_t max_window;
+        uint32_t min_sequential;
+        size_t max_streams;   // tracked chunks; arbitrary ones are dropped beyond this
+        size_t threads;
+        size_t max_queued;    // prefetches beyond this are dropped, not queued
+    };
+
+    // Reads [offset, offset + length) of the chunk into whatever cache the caller uses.
+    using FetchFn = std::function<void(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length)>;
+
+    ReadaheadManager(Options opts, FetchFn fetch);
+    ~ReadaheadManager();
+
+    ReadaheadManager(const ReadaheadManager&) = delete;
+    ReadaheadManager& operator=(const ReadaheadManager&) = delete;
+
+    void OnRead(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length);
+    // Forget the stream, e.g. after a truncate.
+    void Reset(uint64_t chunk_id);
+
+private:
+    struct Stream {
+        uint64_t next{0};        // offset right after the last read
+        uint32_t sequential{0};  // consecutive in-order reads
+        uint64_t window{0};
+        uint64_t ahead{0};       // end of the last issued prefetch
+    };
+    struct Task {
+        uint64_t chunk_id;
+        std::string path;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    static constexpr size_t kShards = 16;
+    struct alignas(64) Shard {
+        std::mutex mu;
+        std::unordered_map<uint64_t, Stream> streams;
+    };
+
+    Shard& ShardFor(uint64_t chunk_id) { return shards_[(chunk_id * 0x9e3779b97f4a7c15ULL) >> 60]; }
+    void Enqueue(Task task);
+    void Worker();
+
+    Options opts_;
+    FetchFn fetch_;
+    Shard shards_[kShards];
+
+    std::mutex queue_mu_;
+    std::condition_variable queue_cv_;
+    std::deque<Task> queue_;
+    bool stop_{false};
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,175 @@
+#include "Scrubber.h"
+
+#include <cerrno>
+#include <future>
+#include <iostream>
+#include <utility>
+
+Scrubber::Options::Options()
+    : bytes_per_sec(16u << 20),
+      batch_blocks(16),
+      pass_interval(std::chrono::hours(24)),
+      recheck_delay(std::chrono::milliseconds(1000)) {}
+
+Scrubber::Scrubber(Options opts, std::shared_ptr<ChecksumStore> checksums, Hooks hooks)
+    : opts_(opts), checksums_(std::move(checksums)), hooks_(std::move(hooks)) {
+    if (opts_.batch_blocks == 0) {
+        opts_.batch_blocks = 1;
+    }
+}
+
+Scrubber::~Scrubber() {
+    Stop();
+}
+
+void Scrubber::Start() {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (thread_.joinable()) {
+        return;
+    }
+    stop_ = false;
+    thread_ = std::thread([this]() { Run(); });
+}
+
+void Scrubber::Stop() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+Scrubber::Stats Scrubber::GetStats() const {
+    Stats s;
+    s.passes = passes_.load(std::memory_order_relaxed);
+    s.chunks = chunks_.load(std::memory_order_relaxed);
+    s.bytes = bytes_.load(std::memory_order_relaxed);
+    s.corrupt_blocks = corrupt_blocks_.load(std::memory_order_relaxed);
+    s.rebuilt = rebuilt_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void Scrubber::Run() {
+    do {
+        if (!ScrubOnce()) {
+            return;
+        }
+    } while (SleepFor(opts_.pass_interval));
+}
+
+bool Scrubber::ScrubOnce() {
+    pace_start_ = std::chrono::steady_clock::now();
+    pace_bytes_ = 0;
+    for (uint64_t chunk_id : hooks_.list_chunks()) {
+        const std::string path = hooks_.chunk_path(chunk_id);
+        if (path.empty()) {
+            continue;
+        }
+        if (!ScrubChunk(chunk_id, path)) {
+            return false;
+        }
+        chunks_.fetch_add(1, std::memory_order_relaxed);
+    }
+    passes_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool Scrubber::ScrubChunk(uint64_t chunk_id, const std::string& path) {
+    const size_t batch = opts_.batch_blocks;
+    const uint64_t batch_bytes = static_cast<uint64_t>(batch) * checksums_->block_size();
+    uint64_t block = 0;
+    for (;;) {
+        ChecksumStore::VerifyResult r;
+        if (!RunIO(chunk_id, batch_bytes, [&]() { r = checksums_->Verify(path, block, batch); })) {
+            return false;
+        }
+        if (r.err == ENOENT) {
+            bool ok = false;
+            if (!RunIO(chunk_id, 0, [&]() { ok = checksums_->Rebuild(chunk_id, path); })) {
+                return false;
+            }
+            if (ok) {
+                rebuilt_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        if (r.err != 0) {
+            return true;  // deleted or unreadable; the next pass tries again
+        }
+        bytes_.fetch_add(r.bytes, std::memory_order_relaxed);
+        if (!r.bad.empty() && !SleepFor(opts_.recheck_delay)) {
+            return false;
+        }
+        for (uint64_t bad : r.bad) {
+            ChecksumStore::VerifyResult again;
+            if (!RunIO(chunk_id, checksums_->block_size(), [&]() { again = checksums_->Verify(path, bad, 1); })) {
+                return false;
+            }
+            if (again.err != 0 || again.bad.empty()) {
+                continue;
+            }
+            corrupt_blocks_.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "[RealNode] scrub: chunk=" << chunk_id << " block=" << bad
+                      << " offset=" << bad * checksums_->block_size() << " checksum mismatch in " << path
+                      << std::endl;
+            if (hooks_.on_corrupt) {
+                hooks_.on_corrupt(chunk_id, bad);
+            }
+        }
+        if (!Pace(r.bytes)) {
+            return false;
+        }
+        block += batch;
+        if (block >= r.blocks) {
+            return true;
+        }
+    }
+}
+
+bool Scrubber::RunIO(uint64_t chunk_id, uint64_t bytes, const std::function<void()>& io) {
+    if (!hooks_.submit) {
+        io();
+        return true;
+    }
+    for (;;) {
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> finished = done->get_future();
+        if (hooks_.submit(chunk_id, bytes, [&io, done]() {
+                io();
+                done->set_value();
+            })) {
+            finished.wait();
+            return true;
+        }
+        // disk queue full: back off rather than compete with client IO
+        if (!SleepFor(std::chrono::milliseconds(100))) {
+            return false;
+        }
+    }
+}
+
+bool Scrubber::Pace(uint64_t bytes) {
+    if (opts_.bytes_per_sec == 0) {
+        return true;
+    }
+    pace_bytes_ += bytes;
+    const auto due = pace_start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                       std::chrono::duration<double>(static_cast<double>(pace_bytes_) /
+                                                                     static_cast<double>(opts_.bytes_per_sec)));
+    const auto now = std::chrono::steady_clock::now();
+    if (due + std::chrono::seconds(1) < now) {
+        // idle stretches (tiny chunks, gaps) do not bank budget for a burst
+        pace_start_ = now;
+        pace_bytes_ = 0;
+        return true;
+    }
+    return due <= now || SleepFor(due - now);
+}
+
+bool Scrubber::SleepFor(std::chrono::steady_clock::duration d) {
+    std::unique_lock<std::mutex> lk(mu_);
+    return !cv_.wait_for(lk, d, [this]() { return stop_; });
+}
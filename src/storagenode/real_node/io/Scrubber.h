@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChecksumStore.h"
+
+// Background scrubber: walks every chunk, re-reads it in batches of blocks
+// and compares each block with its stored crc32c. Reads are paced to
+// bytes_per_sec and, when a submit hook is set, queued as scrub-class IO on
+// the chunk's disk. A mismatch is re-checked after recheck_delay, so a write
+// whose sidecar update is still in flight is not reported; one that persists
+// is logged and passed to on_corrupt. Chunks without a sidecar (written
+// before checksums were enabled) get one built from their current data.
+class Scrubber {
+public:
+    struct Options {
+        Options();
+        uint64_t bytes_per_sec;
+        size_t batch_blocks;  // blocks read per IO
+        std::chrono::seconds pass_interval;  // pause between full passes
+        std::chrono::milliseconds recheck_delay;
+    };
+
+    struct Hooks {
+        std::function<std::vector<uint64_t>()> list_chunks;
+        std::function<std::string(uint64_t chunk_id)> chunk_path;  // empty once the chunk is gone
+        // Runs io for the chunk and returns true, or returns false if it
+        // could not be queued right now. Unset runs io inline.
+        std::function<bool(uint64_t chunk_id, uint64_t bytes, std::function<void()> io)> submit;
+        std::function<void(uint64_t chunk_id, uint64_t block)> on_corrupt;
+    };
+
+    struct Stats {
+        uint64_t passes{0};
+        uint64_t chunks{0};
+        uint64_t bytes{0};
+        uint64_t corrupt_blocks{0};
+        uint64_t rebuilt{0};  // sidecars created for chunks that had none
+    };
+
+    Scrubber(Options opts, std::shared_ptr<ChecksumStore> checksums, Hooks hooks);
+    ~Scrubber();
+
+    Scrubber(const Scrubber&) = delete;
+    Scrubber& operator=(const Scrubber&) = delete;
+
+    void Start();
+    void Stop();
+
+    // One full pass over all chunks; returns false if stopped midway.
+    bool ScrubOnce();
+
+    Stats GetStats() const;
+
+private:
+    bool ScrubChunk(uint64_t chunk_id, const std::string& path);
+    // Runs io through the submit hook and waits for it; false if stopped.
+    bool RunIO(uint64_t chunk_id, uint64_t bytes, const std::function<void()>& io);
+    // Sleeps as long as needed to keep the scrub rate; false if stopped.
+    bool Pace(uint64_t bytes);
+    bool SleepFor(std::chrono::steady_clock::duration d);
+    void Run();
+
+    Options opts_;
+    std::shared_ptr<ChecksumStore> checksums_;
+    Hooks hooks_;
+
+    std::chrono::steady_clock::time_point pace_start_;
+    uint64_t pace_bytes_{0};
+
+    std::atomic<uint64_t> passes_{0};
+    std::atomic<uint64_t> chunks_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> corrupt_blocks_{0};
+    std::atomic<uint64_t> rebuilt_{0};
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_{false};
+    std::thread thread_;
+};
@@ -0,0 +1,96 @@
+#include "SparseFile.h"
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+int SparseFile::DataExtents(const std::string& path, uint64_t offset, uint64_t length,
+                            std::vector<Extent>* out, uint64_t* file_size) {
+    out->clear();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        return err;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (file_size) {
+        *file_size = size;
+    }
+    const uint64_t end = length == 0 ? size : std::min(size, offset + length);
+    uint64_t pos = offset;
+    int err = 0;
+    while (pos < end) {
+        const off_t data = ::lseek(fd, static_cast<off_t>(pos), SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) {
+                break;  // only a hole up to EOF is left
+            }
+            if (errno == EINVAL) {
+                out->push_back(Extent{pos, end - pos});  // no SEEK_DATA here
+                break;
+            }
+            err = errno;
+            break;
+        }
+        const uint64_t start = static_cast<uint64_t>(data);
+        if (start >= end) {
+            break;
+        }
+        off_t hole = ::lseek(fd, data, SEEK_HOLE);
+        // without SEEK_HOLE the data runs to EOF; still stop at the requested range
+        const uint64_t stop = std::min(end, hole < 0 ? size : static_cast<uint64_t>(hole));
+        out->push_back(Extent{start, stop - start});
+        pos = stop;
+    }
+    ::close(fd);
+    if (err != 0) {
+        out->clear();
+    }
+    return err;
+}
+
+int SparseFile::CountExtents(int fd, uint32_t* count) {
+    *count = 0;
+    struct fiemap fm {};
+    fm.fm_start = 0;
+    fm.fm_length = FIEMAP_MAX_OFFSET;
+    fm.fm_extent_count = 0;  // only count them
+    if (::ioctl(fd, FS_IOC_FIEMAP, &fm) != 0) {
+        return errno;
+    }
+    *count = fm.fm_mapped_extents;
+    return 0;
+}
+
+std::vector<SparseFile::Extent> SparseFile::Holes(const std::vector<Extent>& data, uint64_t offset,
+                                                  uint64_t length, uint64_t min_hole) {
+    std::vector<Extent> holes;
+    const uint64_t end = offset + length;
+    uint64_t pos = offset;
+    auto add = [&](uint64_t stop) {
+        if (stop > pos && stop - pos >= min_hole) {
+            holes.push_back(Extent{pos, stop - pos});
+        }
+    };
+    for (const auto& e : data) {
+        if (e.offset >= end) {
+            break;
+        }
+        add(std::min(end, e.offset));
+        pos = std::max(pos, e.offset + e.length);
+    }
+    add(end);
+    return holes;
+}
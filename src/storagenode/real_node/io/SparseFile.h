@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Data/hole layout of a chunk file from lseek(SEEK_DATA / SEEK_HOLE).
+// Filesystems without them report the whole file as data, which is always
+// a correct answer, just not a compact one.
+class SparseFile {
+public:
+    struct Extent {
+        uint64_t offset{0};
+        uint64_t length{0};
+    };
+
+    // Data extents within [offset, offset + length), clipped to that range
+    // and to the file size; length 0 means to the end of the file. Returns 0
+    // or an errno.
+    static int DataExtents(const std::string& path, uint64_t offset, uint64_t length,
+                           std::vector<Extent>* out, uint64_t* file_size = nullptr);
+
+    // Number of physical extents backing the open file, from FIEMAP,
+    // including space reserved past its end. Returns 0 or an errno.
+    static int CountExtents(int fd, uint32_t* count);
+
+    // The gaps of at least min_hole bytes between sorted data extents within
+    // [offset, offset + length).
+    static std::vector<Extent> Holes(const std::vector<Extent>& data, uint64_t offset, uint64_t length,
+                                     uint64_t min_hole);
+};
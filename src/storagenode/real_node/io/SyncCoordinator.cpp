@@ -0,0 +1,96 @@
+#include "SyncCoordinator.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <map>
+#include <utility>
+
+SyncCoordinator::Options::Options()
+    : window(std::chrono::microseconds(50)), max_batch(64), use_syncfs(false) {}
+
+SyncCoordinator::SyncCoordinator(Options opts) : opts_(opts) {
+    if (opts_.max_batch == 0) {
+        opts_.max_batch = 1;
+    }
+    thread_ = std::thread([this]() { Run(); });
+}
+
+SyncCoordinator::~SyncCoordinator() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SyncCoordinator::Submit(FdCache::Handle fd, Done done) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        queue_.push_back(Pending{std::move(fd), std::move(done)});
+        wake = queue_.size() == 1 || queue_.size() >= opts_.max_batch;
+    }
+    if (wake) {
+        cv_.notify_one();
+    }
+}
+
+void SyncCoordinator::Run() {
+    std::vector<Pending> batch;
+    std::unique_lock<std::mutex> lk(mu_);
+    while (true) {
+        cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            break;  // stopping and drained
+        }
+        if (!stop_ && opts_.window.count() > 0 && queue_.size() < opts_.max_batch) {
+            cv_.wait_for(lk, opts_.window, [this] { return stop_ || queue_.size() >= opts_.max_batch; });
+        }
+        batch.swap(queue_);
+        lk.unlock();
+        Flush(batch);
+        batch.clear();
+        lk.lock();
+    }
+}
+
+// Files are identified by (dev, ino) so the buffered and O_DIRECT fds of one
+// chunk share a single fdatasync.
+void SyncCoordinator::Flush(std::vector<Pending>& batch) {
+    std::map<std::pair<dev_t, ino_t>, int> file_err;
+    std::map<dev_t, int> fs_err;
+    std::vector<int> errs(batch.size(), 0);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const int fd = batch[i].fd.fd();
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            errs[i] = errno;
+            continue;
+        }
+        if (opts_.use_syncfs) {
+            auto it = fs_err.find(st.st_dev);
+            if (it == fs_err.end()) {
+                it = fs_err.emplace(st.st_dev, ::syncfs(fd) == 0 ? 0 : errno).first;
+            }
+            errs[i] = it->second;
+        } else {
+            auto key = std::make_pair(st.st_dev, st.st_ino);
+            auto it = file_err.find(key);
+            if (it == file_err.end()) {
+                it = file_err.emplace(key, ::fdatasync(fd) == 0 ? 0 : errno).first;
+            }
+            errs[i] = it->second;
+        }
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i].fd.Reset();
+        if (batch[i].done) {
+            batch[i].done(errs[i]);
+        }
+    }
+}
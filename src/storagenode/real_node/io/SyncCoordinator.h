@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FdCache.h"
+
+// Group commit for sync_on_write. Writers hand over a pinned fd after their
+// pwrite returns; a flusher thread collects everything that arrives within a
+// short window (or until max_batch), issues one fdatasync per distinct file
+// (or one syncfs per filesystem) and then runs all callbacks. Writes that
+// queue up while a flush is running go out together in the next one, so the
+// number of device flushes grows with batches rather than with writers.
+class SyncCoordinator {
+public:
+    using Done = std::function<void(int err)>;
+
+    struct Options {
+        Options();
+        std::chrono::microseconds window;  // extra wait after the first arrival
+        size_t max_batch;                  // flush early once this many are queued
+        bool use_syncfs;                   // one syncfs per filesystem instead of fdatasync per file
+    };
+
+    explicit SyncCoordinator(Options opts = Options());
+    ~SyncCoordinator();  // flushes whatever is queued
+
+    SyncCoordinator(const SyncCoordinator&) = delete;
+    SyncCoordinator& operator=(const SyncCoordinator&) = delete;
+
+    // `done` runs on the flusher thread with 0 or the sync errno.
+    void Submit(FdCache::Handle fd, Done done);
+
+private:
+    struct Pending {
+        FdCache::Handle fd;
+        Done done;
+    };
+
+    void Run();
+    void Flush(std::vector<Pending>& batch);
+
+    Options opts_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::vector<Pending> queue_;
+    bool stop_{false};
+    std::thread thread_;
+};
@@ -0,0 +1,396 @@
+#include "UringIOEngine.h"
+
+#ifdef ZB_HAVE_LIBURING
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+UringIOEngine::UringIOEngine(std::string base_path, Options opts)
+    : IOEngine(std::move(base_path), opts) {
+    unsigned depth = opts_.uring_queue_depth ? opts_.uring_queue_depth : 256;
+    int rc = io_uring_queue_init(depth, &ring_, 0);
+    if (rc < 0) {
+        std::cerr << "[RealNode] io_uring_queue_init failed: " << std::strerror(-rc) << std::endl;
+        return;
+    }
+    event_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        std::cerr << "[RealNode] eventfd failed: " << std::strerror(errno) << std::endl;
+        io_uring_queue_exit(&ring_);
+        return;
+    }
+    SetupFixedFiles();
+    SetupFixedBuffers();
+    // Writes are followed by a linked fdatasync, so O_DSYNC would only double the flushes.
+    dsync_on_open_ = false;
+    ready_ = true;
+    worker_ = std::thread([this]() { Run(); });
+}
+
+UringIOEngine::~UringIOEngine() {
+    if (!ready_) {
+        return;
+    }
+    stopping_.store(true);
+    uint64_t one = 1;
+    (void)::write(event_fd_, &one, sizeof(one));
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    io_uring_queue_exit(&ring_);
+    ::close(event_fd_);
+    for (void* buf : buffers_) {
+        std::free(buf);
+    }
+}
+
+void UringIOEngine::SetupFixedFiles() {
+    if (opts_.uring_registered_files == 0) {
+        return;
+    }
+    std::vector<int> fds(opts_.uring_registered_files, -1);
+    int rc = io_uring_register_files(&ring_, fds.data(), static_cast<unsigned>(fds.size()));
+    if (rc < 0) {
+        std::cerr << "[RealNode] io_uring fixed files disabled: " << std::strerror(-rc) << std::endl;
+        return;
+    }
+    slot_fds_.assign(fds.size(), -1);
+    slot_refs_.assign(fds.size(), 0);
+}
+
+void UringIOEngine::SetupFixedBuffers() {
+    if (opts_.uring_fixed_buffers == 0 || opts_.uring_fixed_buffer_size == 0) {
+        return;
+    }
+    std::vector<iovec> iovs;
+    for (unsigned i = 0; i < opts_.uring_fixed_buffers; ++i) {
+        void* buf = nullptr;
+        if (posix_memalign(&buf, 4096, opts_.uring_fixed_buffer_size) != 0) {
+            break;
+        }
+        buffers_.push_back(buf);
+        iovs.push_back(iovec{buf, opts_.uring_fixed_buffer_size});
+    }
+    int rc = iovs.empty() ? -ENOMEM
+                          : io_uring_register_buffers(&ring_, iovs.data(), static_cast<unsigned>(iovs.size()));
+    if (rc < 0) {
+        std::cerr << "[RealNode] io_uring fixed buffers disabled: " << std::strerror(-rc) << std::endl;
+        for (void* buf : buffers_) {
+            std::free(buf);
+        }
+        buffers_.clear();
+        return;
+    }
+    for (int i = static_cast<int>(buffers_.size()) - 1; i >= 0; --i) {
+        free_buffers_.push_back(i);
+    }
+}
+
+void UringIOEngine::AsyncWrite(uint64_t chunk_id,
+                               const std::string& path,
+                               const void* data,
+                               size_t size,
+                               uint64_t offset,
+                               int flags,
+                               int mode,
+                               Callback cb) {
+    if (UseDirectIO(size)) {
+        // Large streams take the O_DIRECT path with its pooled buffers.
+        IOEngine::AsyncWrite(chunk_id, path, data, size, offset, flags, mode, std::move(cb));
+        return;
+    }
+    int err = 0;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/true, mode, err);
+    if (!fd) {
+        if (cb) cb(Result{-1, err});
+        return;
+    }
+    Op* op = new Op;
+    op->kind = OpKind::kWrite;
+    op->fd = fd.fd();
+    op->fd_ref = std::move(fd);
+    op->wdata = data;
+    op->length = size;
+    op->offset = offset;
+    op->sync = opts_.sync_on_write && !BatchedSync();
+    op->cb = std::move(cb);
+    Enqueue(op);
+}
+
+void UringIOEngine::AsyncRead(uint64_t chunk_id,
+                              const std::string& path,
+                              uint64_t offset,
+                              size_t length,
+                              std::string* out,
+                              int flags,
+                              Callback cb) {
+    if (UseDirectIO(length)) {
+        IOEngine::AsyncRead(chunk_id, path, offset, length, out, flags, std::move(cb));
+        return;
+    }
+    int err = 0;
+    FdCache::Handle fd = AcquireFd(chunk_id, path, flags, /*create_if_missing=*/false, 0, err);
+    if (!fd) {
+        out->clear();
+        if (cb) cb(Result{-1, err});
+        return;
+    }
+    Op* op = new Op;
+    op->kind = OpKind::kRead;
+    op->fd = fd.fd();
+    op->fd_ref = std::move(fd);
+    op->out = out;
+    op->length = length;
+    op->offset = offset;
+    op->cb = std::move(cb);
+    Enqueue(op);
+}
+
+void UringIOEngine::OnFdClosed(int fd) {
+    std::lock_guard<std::mutex> lk(queue_mu_);
+    closed_fds_.push_back(fd);
+}
+
+void UringIOEngine::Enqueue(Op* op) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lk(queue_mu_);
+        if (!stopping_.load()) {
+            // Only the first producer of a batch needs to kick the ring thread.
+            wake = queue_.empty();
+            queue_.push_back(op);
+            op = nullptr;
+        }
+    }
+    if (op != nullptr) {
+        Callback cb = std::move(op->cb);
+        delete op;
+        if (cb) cb(Result{-1, ESHUTDOWN});
+        return;
+    }
+    if (wake) {
+        uint64_t one = 1;
+        (void)::write(event_fd_, &one, sizeof(one));
+    }
+}
+
+void UringIOEngine::ArmEventFd() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (sqe == nullptr) {
+        io_uring_submit(&ring_);
+        sqe = io_uring_get_sqe(&ring_);
+    }
+    io_uring_prep_read(sqe, event_fd_, &event_value_, sizeof(event_value_), 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+}
+
+void UringIOEngine::DrainQueue() {
+    std::vector<Op*> ops;
+    std::vector<int> closed;
+    {
+        std::lock_guard<std::mutex> lk(queue_mu_);
+        ops.swap(queue_);
+        closed.swap(closed_fds_);
+    }
+    // Closed fds first: a number reused by a queued op must not hit the old slot.
+    for (int fd : closed) {
+        auto it = fd_slots_.find(fd);
+        if (it == fd_slots_.end()) {
+            continue;
+        }
+        int empty = -1;
+        io_uring_register_files_update(&ring_, static_cast<unsigned>(it->second), &empty, 1);
+        slot_fds_[it->second] = -1;
+        fd_slots_.erase(it);
+    }
+    for (Op* op : ops) {
+        backlog_.push_back(op);
+    }
+}
+
+int UringIOEngine::FixedFileSlot(int fd) {
+    if (slot_fds_.empty()) {
+        return -1;
+    }
+    auto it = fd_slots_.find(fd);
+    if (it != fd_slots_.end()) {
+        return it->second;
+    }
+    // Replace a slot no in-flight op refers to; a linked fsync may resolve its
+    // file only after the preceding write completes.
+    const size_t n = slot_fds_.size();
+    for (size_t i = 0; i < n; ++i) {
+        size_t slot = (next_slot_ + i) % n;
+        if (slot_refs_[slot] != 0) {
+            continue;
+        }
+        int rc = io_uring_register_files_update(&ring_, static_cast<unsigned>(slot), &fd, 1);
+        if (rc < 0) {
+            return -1;
+        }
+        if (slot_fds_[slot] >= 0) {
+            fd_slots_.erase(slot_fds_[slot]);
+        }
+        slot_fds_[slot] = fd;
+        fd_slots_[fd] = static_cast<int>(slot);
+        next_slot_ = (slot + 1) % n;
+        return static_cast<int>(slot);
+    }
+    return -1;
+}
+
+bool UringIOEngine::Prepare(Op* op) {
+    const unsigned need = op->sync ? 2 : 1;
+    // One CQ entry stays reserved for the eventfd read.
+    if (inflight_ + need + 1 > ring_.cq.ring_entries || io_uring_sq_space_left(&ring_) < need) {
+        return false;
+    }
+
+    op->slot = FixedFileSlot(op->fd);
+    const int target = op->slot >= 0 ? op->slot : op->fd;
+    unsigned sqe_flags = op->slot >= 0 ? IOSQE_FIXED_FILE : 0;
+    if (op->slot >= 0) {
+        ++slot_refs_[op->slot];
+    }
+
+    if (!free_buffers_.empty() && op->length > 0 && op->length <= opts_.uring_fixed_buffer_size) {
+        op->buf_index = free_buffers_.back();
+        free_buffers_.pop_back();
+    }
+
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (op->kind == OpKind::kWrite) {
+        if (op->buf_index >= 0) {
+            void* buf = buffers_[op->buf_index];
+            std::memcpy(buf, op->wdata, op->length);
+            io_uring_prep_write_fixed(sqe, target, buf, static_cast<unsigned>(op->length), op->offset,
+                                      op->buf_index);
+        } else {
+            io_uring_prep_write(sqe, target, op->wdata, static_cast<unsigned>(op->length), op->offset);
+        }
+    } else {
+        if (op->buf_index >= 0) {
+            io_uring_prep_read_fixed(sqe, target, buffers_[op->buf_index], static_cast<unsigned>(op->length),
+                                     op->offset, op->buf_index);
+        } else {
+            op->out->resize(op->length);
+            io_uring_prep_read(sqe, target, op->out->data(), static_cast<unsigned>(op->length), op->offset);
+        }
+    }
+    io_uring_sqe_set_data(sqe, op);
+
+    if (op->sync) {
+        io_uring_sqe_set_flags(sqe, sqe_flags | IOSQE_IO_LINK);
+        io_uring_sqe* fsync_sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_fsync(fsync_sqe, target, IORING_FSYNC_DATASYNC);
+        io_uring_sqe_set_flags(fsync_sqe, sqe_flags);
+        io_uring_sqe_set_data(fsync_sqe, op);
+    } else {
+        io_uring_sqe_set_flags(sqe, sqe_flags);
+    }
+    op->pending_cqes = static_cast<int>(need);
+    inflight_ += need;
+    return true;
+}
+
+void UringIOEngine::HandleCqe(io_uring_cqe* cqe) {
+    Op* op = static_cast<Op*>(io_uring_cqe_get_data(cqe));
+    if (op == nullptr) {
+        if (!stopping_.load()) {
+            ArmEventFd();
+        }
+        return;
+    }
+    --inflight_;
+    const int res = cqe->res;
+    if (!op->io_done) {
+        // Linked CQEs arrive in chain order, so the first one is the read/write.
+        op->io_done = true;
+        if (res < 0) {
+            op->result.bytes = -1;
+            op->result.err = -res;
+        } else {
+            op->result.bytes = res;
+        }
+    } else if (op->result.bytes >= 0) {
+        if (res == -ECANCELED) {
+            // A short write breaks the link; sync what was written.
+            if (::fdatasync(op->fd) != 0) {
+                op->result.err = errno;
+            }
+        } else if (res < 0) {
+            op->result.err = -res;
+        }
+    }
+    if (--op->pending_cqes == 0) {
+        Complete(op);
+    }
+}
+
+void UringIOEngine::Complete(Op* op) {
+    if (op->kind == OpKind::kRead) {
+        if (op->result.bytes < 0) {
+            op->out->clear();
+        } else if (op->buf_index >= 0) {
+            op->out->assign(static_cast<const char*>(buffers_[op->buf_index]),
+                            static_cast<size_t>(op->result.bytes));
+        } else {
+            op->out->resize(static_cast<size_t>(op->result.bytes));
+        }
+    }
+    if (op->buf_index >= 0) {
+        free_buffers_.push_back(op->buf_index);
+    }
+    if (op->slot >= 0) {
+        --slot_refs_[op->slot];
+    }
+    Callback cb = std::move(op->cb);
+    Result r = op->result;
+    if (op->kind == OpKind::kWrite && opts_.sync_on_write && BatchedSync() && r.bytes >= 0) {
+        FdCache::Handle fd = std::move(op->fd_ref);
+        delete op;
+        CompleteAfterSync(std::move(fd), r, std::move(cb));
+        return;
+    }
+    delete op;
+    if (cb) cb(r);
+}
+
+void UringIOEngine::Run() {
+    ArmEventFd();
+    while (true) {
+        DrainQueue();
+        while (!backlog_.empty() && Prepare(backlog_.front())) {
+            backlog_.pop_front();
+        }
+        if (stopping_.load() && inflight_ == 0 && backlog_.empty()) {
+            std::lock_guard<std::mutex> lk(queue_mu_);
+            if (queue_.empty()) {
+                break;
+            }
+            continue;
+        }
+
+        // One syscall submits the whole batch and waits for at least one completion.
+        int rc = io_uring_submit_and_wait(&ring_, 1);
+        if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+            std::cerr << "[RealNode] io_uring_submit_and_wait failed: " << std::strerror(-rc) << std::endl;
+        }
+
+        unsigned head = 0;
+        unsigned seen = 0;
+        io_uring_cqe* cqe = nullptr;
+        io_uring_for_each_cqe(&ring_, head, cqe) {
+            HandleCqe(cqe);
+            ++seen;
+        }
+        io_uring_cq_advance(&ring_, seen);
+    }
+}
+
+#endif  // ZB_HAVE_LIBURING
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "IOEngine.h"
+
+#ifdef ZB_HAVE_LIBURING
+
+#include <liburing.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// io_uring backend. Requests are queued by RPC threads and picked up by a
+// single ring thread that batches them into one io_uring_submit, reaps
+// completions and runs the callbacks. Cached fds are installed into a fixed
+// file table, small IOs can go through registered buffers, and with
+// sync_on_write each write is either handed to the group-commit coordinator
+// or, with batching off, linked to an fdatasync instead of O_DSYNC.
+class UringIOEngine : public IOEngine {
+public:
+    UringIOEngine(std::string base_path, Options opts = Options());
+    ~UringIOEngine() override;
+
+    // False when the ring could not be created (old kernel, seccomp, ...).
+    bool ok() const { return ready_; }
+
+    void AsyncWrite(uint64_t chunk_id, const std::string& path, const void* data, size_t size,
+                    uint64_t offset, int flags, int mode, Callback cb) override;
+    void AsyncRead(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                   std::string* out, int flags, Callback cb) override;
+
+    const char* BackendName() const override { return "io_uring"; }
+
+protected:
+    void OnFdClosed(int fd) override;
+
+private:
+    enum class OpKind { kRead, kWrite };
+
+    struct Op {
+        OpKind kind;
+        FdCache::Handle fd_ref;  // keeps fd open until the op is deleted
+        int fd = -1;
+        const void* wdata = nullptr;
+        std::string* out = nullptr;
+        size_t length = 0;
+        uint64_t offset = 0;
+        Callback cb;
+        int buf_index = -1;
+        int slot = -1;
+        bool sync = false;
+        bool io_done = false;
+        int pending_cqes = 1;
+        Result result{0, 0};
+    };
+
+    void Enqueue(Op* op);
+    void Run();
+    void ArmEventFd();
+    void DrainQueue();
+    bool Prepare(Op* op);
+    void HandleCqe(io_uring_cqe* cqe);
+    void Complete(Op* op);
+    int FixedFileSlot(int fd);
+    void SetupFixedFiles();
+    void SetupFixedBuffers();
+
+    io_uring ring_{};
+    bool ready_ = false;
+    int event_fd_ = -1;
+    uint64_t event_value_ = 0;
+
+    std::mutex queue_mu_;
+    std::vector<Op*> queue_;
+    std::vector<int> closed_fds_;
+    std::atomic<bool> stopping_{false};
+    std::thread worker_;
+
+    // Ring-thread-only state.
+    std::deque<Op*> backlog_;
+    size_t inflight_ = 0;
+    std::unordered_map<int, int> fd_slots_;
+    std::vector<int> slot_fds_;
+    std::vector<int> slot_refs_;
+    size_t next_slot_ = 0;
+    std::vector<void*> buffers_;
+    std::vector<int> free_buffers_;
+};
+
+#endif  // ZB_HAVE_LIBURING
@@ -0,0 +1,120 @@
+#include "ChunkLocationMap.h"
+
+#include <utility>
+
+namespace {
+
+// Grow past 80% occupancy; linear probing stays short well below that.
+constexpr size_t kLoadNum = 4;
+constexpr size_t kLoadDen = 5;
+constexpr size_t kMinCapacity = 16;
+
+size_t RoundUpPow2(size_t n) {
+    size_t c = kMinCapacity;
+    while (c < n) {
+        c <<= 1;
+    }
+    return c;
+}
+
+} // namespace
+
+size_t ChunkLocationMap::Hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+}
+
+size_t ChunkLocationMap::FindSlot(uint64_t key) const {
+    if (roots_.empty()) {
+        return npos;
+    }
+    for (size_t i = Hash(key) & mask_;; i = (i + 1) & mask_) {
+        if (roots_[i] == kEmpty) {
+            return npos;
+        }
+        if (keys_[i] == key) {
+            return i;
+        }
+    }
+}
+
+bool ChunkLocationMap::Find(uint64_t chunk_id, uint16_t* root) const {
+    size_t i = FindSlot(chunk_id);
+    if (i == npos) {
+        return false;
+    }
+    *root = roots_[i];
+    return true;
+}
+
+bool ChunkLocationMap::Contains(uint64_t chunk_id) const {
+    return FindSlot(chunk_id) != npos;
+}
+
+void ChunkLocationMap::Set(uint64_t chunk_id, uint16_t root) {
+    if ((size_ + 1) * kLoadDen > roots_.size() * kLoadNum) {
+        Rehash(roots_.empty() ? kMinCapacity : roots_.size() * 2);
+    }
+    size_t i = Hash(chunk_id) & mask_;
+    while (roots_[i] != kEmpty) {
+        if (keys_[i] == chunk_id) {
+            roots_[i] = root;
+            return;
+        }
+        i = (i + 1) & mask_;
+    }
+    keys_[i] = chunk_id;
+    roots_[i] = root;
+    ++size_;
+}
+
+// Backward-shift deletion: pull later members of the probe run into the hole
+// so lookups never need tombstones.
+bool ChunkLocationMap::Erase(uint64_t chunk_id) {
+    size_t hole = FindSlot(chunk_id);
+    if (hole == npos) {
+        return false;
+    }
+    for (size_t i = (hole + 1) & mask_; roots_[i] != kEmpty; i = (i + 1) & mask_) {
+        const size_t home = Hash(keys_[i]) & mask_;
+        // move i into the hole unless its home lies cyclically in (hole, i]
+        if (((i - home) & mask_) >= ((i - hole) & mask_)) {
+            keys_[hole] = keys_[i];
+            roots_[hole] = roots_[i];
+            hole = i;
+        }
+    }
+    roots_[hole] = kEmpty;
+    --size_;
+    return true;
+}
+
+void ChunkLocationMap::Reserve(size_t n) {
+    const size_t want = RoundUpPow2((n * kLoadDen + kLoadNum - 1) / kLoadNum);
+    if (want > roots_.size()) {
+        Rehash(want);
+    }
+}
+
+void ChunkLocationMap::Rehash(size_t capacity) {
+    std::vector<uint64_t> old_keys(capacity);
+    std::vector<uint16_t> old_roots(capacity, kEmpty);
+    old_keys.swap(keys_);
+    old_roots.swap(roots_);
+    mask_ = capacity - 1;
+    for (size_t j = 0; j < old_roots.size(); ++j) {
+        if (old_roots[j] == kEmpty) {
+            continue;
+        }
+        size_t i = Hash(old_keys[j]) & mask_;
+        while (roots_[i] != kEmpty) {
+            i = (i + 1) & mask_;
+        }
+        keys_[i] = old_keys[j];
+        roots_[i] = old_roots[j];
+    }
+}
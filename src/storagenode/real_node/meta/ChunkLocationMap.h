@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash table from chunk_id to data-root index.
+//
+// Keys and roots live in two parallel arrays (10 bytes per slot) with linear
+// probing and backward-shift deletion, so there are no tombstones and no
+// per-entry heap nodes. Not thread-safe; callers shard and lock it.
+class ChunkLocationMap {
+public:
+    static constexpr uint16_t kEmpty = 0xffff;  // never a valid root index
+
+    ChunkLocationMap() = default;
+
+    // Returns false if absent.
+    bool Find(uint64_t chunk_id, uint16_t* root) const;
+    bool Contains(uint64_t chunk_id) const;
+    // Inserts or overwrites.
+    void Set(uint64_t chunk_id, uint16_t root);
+    // Returns false if absent.
+    bool Erase(uint64_t chunk_id);
+    void Reserve(size_t n);
+
+    size_t size() const { return size_; }
+    size_t MemoryBytes() const { return keys_.capacity() * sizeof(uint64_t) + roots_.capacity() * sizeof(uint16_t); }
+
+    template <typename Fn>
+    void ForEach(Fn fn) const {
+        for (size_t i = 0; i < roots_.size(); ++i) {
+            if (roots_[i] != kEmpty) {
+                fn(keys_[i], roots_[i]);
+            }
+        }
+    }
+
+private:
+    static size_t Hash(uint64_t key);
+    size_t FindSlot(uint64_t key) const;  // slot holding key or npos
+    void Rehash(size_t capacity);
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    std::vector<uint64_t> keys_;
+    std::vector<uint16_t> roots_;
+    size_t mask_{0};
+    size_t size_{0};
+};
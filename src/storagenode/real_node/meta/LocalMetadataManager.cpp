@@ -1,8 +1,21 @@
 #include "LocalMetadataManager.h"
 
+#include <butil/crc32c.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
 #include <iostream>
 #include <mutex>
 #include <sstream>
@@ -12,6 +25,44 @@ namespace fs = std::filesystem;
 
 namespace {
 
+constexpr uint8_t kOpAdd = 1;
+constexpr uint8_t kOpDel = 2;
+constexpr uint32_t kSnapMagic = 0x5a424d46u;  // "ZBMF"
+constexpr uint32_t kSnapVersion = 1;
+
+// Shared by WAL and snapshot; a snapshot holds only ADD records.
+struct Record {
+    uint64_t chunk_id;
+    uint16_t root;
+    uint8_t op;
+    uint8_t pad;
+    uint32_t crc;  // crc32c of the preceding 12 bytes
+};
+static_assert(sizeof(Record) == 16, "manifest record must be 16 bytes");
+
+struct SnapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t wal_gen;  // first WAL generation to replay on top
+    uint64_t count;
+    uint32_t roots;
+    uint32_t crc;  // crc32c of the preceding 28 bytes
+};
+static_assert(sizeof(SnapHeader) == 32, "manifest snapshot header must be 32 bytes");
+
+Record MakeRecord(uint8_t op, uint64_t chunk_id, uint16_t root) {
+    Record r{};
+    r.chunk_id = chunk_id;
+    r.root = root;
+    r.op = op;
+    r.crc = butil::crc32c::Value(reinterpret_cast<const char*>(&r), offsetof(Record, crc));
+    return r;
+}
+
+bool RecordValid(const Record& r) {
+    return r.crc == butil::crc32c::Value(reinterpret_cast<const char*>(&r), offsetof(Record, crc));
+}
+
 std::string EnsureTrailingSlash(const std::string& s) {
     if (!s.empty() && s.back() == '/') {
         return s.substr(0, s.size() - 1);
@@ -19,10 +70,39 @@ std::string EnsureTrailingSlash(const std::string& s) {
     return s;
 }
 
+void SyncDir(const std::string& path) {
+    int fd = ::open(fs::path(path).parent_path().c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+template <typename Fn>
+void RunParallel(unsigned n, Fn fn) {
+    if (n <= 1) {
+        fn(0u);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(n);
+    for (unsigned t = 0; t < n; ++t) {
+        threads.emplace_back([&fn, t] { fn(t); });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+}
+
 } // namespace
 
-LocalMetadataManager::LocalMetadataManager(std::vector<std::string> data_roots, std::string manifest_path)
-    : data_roots_(std::move(data_roots)) {
+LocalMetadataManager::Options::Options()
+    : checkpoint_records(1u << 20), sync(false), replay_threads(0) {}
+
+LocalMetadataManager::LocalMetadataManager(std::vector<std::string> data_roots,
+                                           std::string manifest_prefix,
+                                           Options opts)
+    : data_roots_(std::move(data_roots)), opts_(opts) {
     for (auto& root : data_roots_) {
         root = EnsureTrailingSlash(root);
         std::error_code ec;
@@ -32,109 +112,612 @@ LocalMetadataManager::LocalMetadataManager(std::vector<std::string> data_roots,
         std::cerr << "LocalMetadataManager: no data roots configured" << std::endl;
         return;
     }
-    if (manifest_path.empty()) {
-        manifest_path_ = data_roots_[0] + "/chunk_manifest.log";
+    if (data_roots_.size() > UINT16_MAX) {
+        std::cerr << "LocalMetadataManager: too many data roots" << std::endl;
+        data_roots_.resize(UINT16_MAX);
+    }
+    if (manifest_prefix.empty()) {
+        manifest_prefix_ = data_roots_[0] + "/chunk_manifest";
     } else {
-        manifest_path_ = manifest_path;
+        manifest_prefix_ = manifest_prefix;
     }
-    LoadManifest();
-    manifest_out_.open(manifest_path_, std::ios::out | std::ios::app);
-    if (!manifest_out_.is_open()) {
-        std::cerr << "LocalMetadataManager: failed to open manifest " << manifest_path_ << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    if (!LoadManifest()) {
+        // Leave the on-disk manifest untouched rather than overwrite it with a partial view.
+        std::cerr << "LocalMetadataManager: failed to load manifest " << manifest_prefix_
+                  << ", mappings will not be persisted" << std::endl;
+        return;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start).count();
+    std::cout << "[RealNode] manifest loaded: chunks=" << size() << " index_bytes=" << IndexMemoryBytes()
+              << " wal_gen=" << wal_gen_ << " wal_records=" << wal_records_.load() << " in " << ms << "ms" << std::endl;
+    if (opts_.checkpoint_records > 0) {
+        ckpt_thread_ = std::thread(&LocalMetadataManager::CheckpointLoop, this);
     }
 }
 
 LocalMetadataManager::~LocalMetadataManager() {
-    if (manifest_out_.is_open()) {
-        manifest_out_.flush();
-        manifest_out_.close();
+    {
+        std::lock_guard<std::mutex> lk(ckpt_wait_mu_);
+        stop_ = true;
+    }
+    ckpt_cv_.notify_all();
+    if (ckpt_thread_.joinable()) {
+        ckpt_thread_.join();
+    }
+    std::lock_guard<std::mutex> lk(log_mu_);
+    if (wal_fd_ >= 0) {
+        if (!pending_.empty()) {
+            WriteAll(wal_fd_, pending_.data(), pending_.size());
+        }
+        ::fdatasync(wal_fd_);
+        ::close(wal_fd_);
+        wal_fd_ = -1;
+    }
+}
+
+size_t LocalMetadataManager::ShardIndex(uint64_t chunk_id) {
+    return static_cast<size_t>((chunk_id * 0x9e3779b97f4a7c15ULL) >> 58) & (kShards - 1);
+}
+
+LocalMetadataManager::Shard& LocalMetadataManager::ShardFor(uint64_t chunk_id) {
+    return shards_[ShardIndex(chunk_id)];
+}
+
+const LocalMetadataManager::Shard& LocalMetadataManager::ShardFor(uint64_t chunk_id) const {
+    return shards_[ShardIndex(chunk_id)];
+}
+
+std::string LocalMetadataManager::WalPath(uint64_t gen) const {
+    return manifest_prefix_ + "." + std::to_string(gen) + ".wal";
+}
+
+std::string LocalMetadataManager::SnapshotPath() const {
+    return manifest_prefix_ + ".snap";
+}
+
+unsigned LocalMetadataManager::ReplayThreads() const {
+    unsigned n = opts_.replay_threads;
+    if (n == 0) {
+        n = std::max(1u, std::thread::hardware_concurrency());
     }
+    return std::min<unsigned>(n, kShards);
 }
 
+// Startup: legacy text log or snapshot, then every WAL generation from the
+// snapshot's on, in order. The last generation is reopened for appends with
+// any torn tail cut off.
 bool LocalMetadataManager::LoadManifest() {
     std::error_code ec;
-    if (!fs::exists(manifest_path_, ec)) {
-        return true;
+    const std::string text_path = manifest_prefix_ + ".log";
+    const bool migrate = !fs::exists(SnapshotPath(), ec) && fs::exists(text_path, ec);
+    if (migrate) {
+        if (!LoadTextManifest(text_path)) {
+            return false;
+        }
+    } else if (fs::exists(SnapshotPath(), ec) && !LoadSnapshot()) {
+        return false;
+    }
+
+    uint64_t gen = first_wal_gen_;
+    uint64_t last_valid = 0;
+    size_t records = 0;
+    while (fs::exists(WalPath(gen), ec)) {
+        uint64_t valid = 0;
+        size_t n = 0;
+        if (!ReplayWal(gen, &valid, &n)) {
+            return false;
+        }
+        records += n;
+        last_valid = valid;
+        if (!fs::exists(WalPath(gen + 1), ec)) {
+            break;
+        }
+        ++gen;
+    }
+    wal_records_.store(records);
+    if (!OpenWal(gen, last_valid)) {
+        return false;
+    }
+    if (migrate && Checkpoint()) {
+        fs::rename(text_path, text_path + ".migrated", ec);
+        std::cout << "[RealNode] migrated text manifest " << text_path << " to binary format" << std::endl;
     }
-    std::ifstream in(manifest_path_);
+    return true;
+}
+
+bool LocalMetadataManager::LoadTextManifest(const std::string& text_path) {
+    std::ifstream in(text_path);
     if (!in.is_open()) {
-        std::cerr << "LocalMetadataManager: failed to read manifest " << manifest_path_ << std::endl;
+        std::cerr << "LocalMetadataManager: failed to read manifest " << text_path << std::endl;
         return false;
     }
     std::string op;
     uint64_t chunk_id = 0;
     std::string path;
-    while (in >> op >> chunk_id >> path) {
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream iss(line);
+        path.clear();
+        if (!(iss >> op >> chunk_id)) {
+            continue;
+        }
+        iss >> path;
+        Shard& shard = ShardFor(chunk_id);
         if (op == "ADD") {
-            path_map_[chunk_id] = path;
+            int root = RootIndex(path, chunk_id);
+            if (root < 0) {
+                std::cerr << "LocalMetadataManager: dropping unplaceable legacy entry " << chunk_id
+                          << " -> " << path << std::endl;
+                continue;
+            }
+            shard.map.Set(chunk_id, static_cast<uint16_t>(root));
         } else if (op == "DEL") {
-            path_map_.erase(chunk_id);
+            shard.map.Erase(chunk_id);
+        }
+    }
+    return true;
+}
+
+// Decodes `count` records in parallel into per-thread shard buckets. Returns
+// the number of leading valid records; anything after the first bad record is
+// discarded.
+size_t LocalMetadataManager::DecodeRecords(const char* base, size_t count, bool snapshot,
+                                           std::vector<ShardBuckets>* buckets) const {
+    const unsigned threads = static_cast<unsigned>(
+        std::max<size_t>(1, std::min<size_t>(ReplayThreads(), count / 4096 + 1)));
+    const size_t per = (count + threads - 1) / threads;
+    buckets->assign(threads, ShardBuckets(kShards));
+    std::vector<size_t> first_bad(threads, count);
+    RunParallel(threads, [&](unsigned t) {
+        const size_t begin = std::min(count, t * per);
+        const size_t end = std::min(count, begin + per);
+        ShardBuckets& out = (*buckets)[t];
+        for (size_t i = begin; i < end; ++i) {
+            Record r;
+            std::memcpy(&r, base + i * sizeof(Record), sizeof(Record));
+            if (!RecordValid(r) || r.root >= data_roots_.size() ||
+                (r.op != kOpAdd && r.op != kOpDel) || (snapshot && r.op != kOpAdd)) {
+                first_bad[t] = i;
+                return;
+            }
+            out[ShardIndex(r.chunk_id)].emplace_back(r.chunk_id, r.op == kOpAdd ? r.root : -1);
+        }
+    });
+    const size_t valid = *std::min_element(first_bad.begin(), first_bad.end());
+    for (unsigned t = 0; t < threads; ++t) {
+        if (std::min(count, t * per) >= valid) {
+            (*buckets)[t].assign(kShards, {});
+        }
+    }
+    return valid;
+}
+
+// Applies decoded buckets shard-parallel; within a shard, thread buckets are
+// applied in file order so later records win.
+void LocalMetadataManager::ApplyBuckets(const std::vector<ShardBuckets>& buckets) {
+    const unsigned threads = ReplayThreads();
+    RunParallel(threads, [&](unsigned t) {
+        for (size_t s = t; s < kShards; s += threads) {
+            auto& map = shards_[s].map;
+            size_t n = 0;
+            for (const auto& b : buckets) {
+                n += b[s].size();
+            }
+            map.Reserve(map.size() + n);
+            for (const auto& b : buckets) {
+                for (const auto& e : b[s]) {
+                    if (e.second < 0) {
+                        map.Erase(e.first);
+                    } else {
+                        map.Set(e.first, static_cast<uint16_t>(e.second));
+                    }
+                }
+            }
+        }
+    });
+}
+
+bool LocalMetadataManager::LoadSnapshot() {
+    const std::string path = SnapshotPath();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "LocalMetadataManager: failed to open snapshot " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st {};
+    SnapHeader h{};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(h) ||
+        ::pread(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)) ||
+        h.magic != kSnapMagic || h.version != kSnapVersion ||
+        h.crc != butil::crc32c::Value(reinterpret_cast<const char*>(&h), offsetof(SnapHeader, crc)) ||
+        static_cast<uint64_t>(st.st_size) != sizeof(h) + h.count * sizeof(Record)) {
+        std::cerr << "LocalMetadataManager: bad snapshot header in " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if (h.roots != data_roots_.size()) {
+        std::cerr << "LocalMetadataManager: snapshot was written with " << h.roots
+                  << " data roots, now " << data_roots_.size() << std::endl;
+    }
+    bool ok = true;
+    if (h.count > 0) {
+        void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "LocalMetadataManager: mmap snapshot failed: " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+        ::madvise(map, st.st_size, MADV_SEQUENTIAL);
+        std::vector<ShardBuckets> buckets;
+        const char* base = static_cast<const char*>(map) + sizeof(h);
+        if (DecodeRecords(base, h.count, true, &buckets) != h.count) {
+            std::cerr << "LocalMetadataManager: corrupt record in snapshot " << path << std::endl;
+            ok = false;
+        } else {
+            ApplyBuckets(buckets);
+        }
+        ::munmap(map, st.st_size);
+    }
+    ::close(fd);
+    if (ok) {
+        first_wal_gen_ = h.wal_gen;
+        wal_gen_ = h.wal_gen;
+    }
+    return ok;
+}
+
+bool LocalMetadataManager::ReplayWal(uint64_t gen, uint64_t* valid_bytes, size_t* records) {
+    const std::string path = WalPath(gen);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "LocalMetadataManager: failed to read wal " << path << std::endl;
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const size_t count = data.size() / sizeof(Record);
+    std::vector<ShardBuckets> buckets;
+    const size_t valid = DecodeRecords(data.data(), count, false, &buckets);
+    ApplyBuckets(buckets);
+    if (valid * sizeof(Record) != data.size()) {
+        std::cerr << "[RealNode] manifest wal " << path << ": dropping torn tail at record " << valid
+                  << std::endl;
+    }
+    *valid_bytes = valid * sizeof(Record);
+    *records = valid;
+    return true;
+}
+
+bool LocalMetadataManager::OpenWal(uint64_t gen, uint64_t truncate_to) {
+    const std::string path = WalPath(gen);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        std::cerr << "LocalMetadataManager: failed to open manifest " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) > truncate_to) {
+        if (::ftruncate(fd, static_cast<off_t>(truncate_to)) != 0) {
+            std::cerr << "LocalMetadataManager: failed to truncate " << path << ": "
+                      << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
         }
     }
+    SyncDir(path);
+    wal_fd_ = fd;
+    wal_gen_ = gen;
     return true;
 }
 
 std::string LocalMetadataManager::GetPath(uint64_t chunk_id) const {
-    std::shared_lock<std::shared_mutex> lk(mu_);
-    auto it = path_map_.find(chunk_id);
-    if (it != path_map_.end()) {
-        return it->second;
+    const Shard& shard = ShardFor(chunk_id);
+    uint16_t root = 0;
+    {
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        if (!shard.map.Find(chunk_id, &root)) {
+            return {};
+        }
     }
-    return {};
+    return BuildPath(root, chunk_id);
 }
 
-std::string LocalMetadataManager::AllocPath(uint64_t chunk_id) {
-    std::unique_lock<std::shared_mutex> lk(mu_);
-    auto it = path_map_.find(chunk_id);
-    if (it != path_map_.end()) {
-        return it->second;
+bool LocalMetadataManager::HasPath(uint64_t chunk_id) const {
+    const Shard& shard = ShardFor(chunk_id);
+    std::shared_lock<std::shared_mutex> lk(shard.mu);
+    return shard.map.Contains(chunk_id);
+}
+
+std::vector<uint64_t> LocalMetadataManager::ListChunks() const {
+    std::vector<uint64_t> ids;
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        ids.reserve(ids.size() + shard.map.size());
+        shard.map.ForEach([&ids](uint64_t chunk_id, uint16_t) { ids.push_back(chunk_id); });
     }
+    return ids;
+}
+
+int LocalMetadataManager::RootOf(uint64_t chunk_id) const {
+    const Shard& shard = ShardFor(chunk_id);
+    uint16_t root = 0;
+    std::shared_lock<std::shared_mutex> lk(shard.mu);
+    return shard.map.Find(chunk_id, &root) ? root : -1;
+}
+
+std::string LocalMetadataManager::AllocPath(uint64_t chunk_id) {
     if (data_roots_.empty()) {
         return {};
     }
-    const std::string& root = data_roots_[next_root_ % data_roots_.size()];
-    ++next_root_;
-    std::string rel = ShardedRelativePath(chunk_id);
-    std::string full_path = root + "/" + rel;
+    Shard& shard = ShardFor(chunk_id);
+    std::string full_path;
+    uint64_t seq = 0;
+    {
+        std::unique_lock<std::shared_mutex> lk(shard.mu);
+        uint16_t root = 0;
+        if (shard.map.Find(chunk_id, &root)) {
+            lk.unlock();
+            return BuildPath(root, chunk_id);
+        }
+        const size_t pick = opts_.placement ? opts_.placement(chunk_id)
+                                            : next_root_.fetch_add(1, std::memory_order_relaxed);
+        root = static_cast<uint16_t>(pick % data_roots_.size());
+        full_path = BuildPath(root, chunk_id);
+        if (full_path.empty()) {
+            return {};
+        }
 
-    std::error_code ec;
-    fs::create_directories(fs::path(full_path).parent_path(), ec);
+        std::error_code ec;
+        fs::create_directories(fs::path(full_path).parent_path(), ec);
 
-    path_map_[chunk_id] = full_path;
-    AppendRecord("ADD", chunk_id, full_path);
+        shard.map.Set(chunk_id, root);
+        seq = EnqueueRecord(kOpAdd, chunk_id, root);
+    }
+    WaitDurable(seq);
     return full_path;
 }
 
 void LocalMetadataManager::DeletePath(uint64_t chunk_id) {
-    std::unique_lock<std::shared_mutex> lk(mu_);
-    auto it = path_map_.find(chunk_id);
-    if (it == path_map_.end()) {
-        return;
+    Shard& shard = ShardFor(chunk_id);
+    uint64_t seq = 0;
+    {
+        std::unique_lock<std::shared_mutex> lk(shard.mu);
+        if (!shard.map.Erase(chunk_id)) {
+            return;
+        }
+        seq = EnqueueRecord(kOpDel, chunk_id, 0);
+    }
+    WaitDurable(seq);
+}
+
+size_t LocalMetadataManager::size() const {
+    size_t n = 0;
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        n += shard.map.size();
     }
-    path_map_.erase(it);
-    AppendRecord("DEL", chunk_id, "");
+    return n;
 }
 
-bool LocalMetadataManager::AppendRecord(const std::string& op, uint64_t chunk_id, const std::string& path) {
-    if (!manifest_out_.is_open()) {
+size_t LocalMetadataManager::IndexMemoryBytes() const {
+    size_t n = 0;
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        n += shard.map.MemoryBytes();
+    }
+    return n;
+}
+
+uint64_t LocalMetadataManager::EnqueueRecord(uint8_t op, uint64_t chunk_id, uint16_t root) {
+    const Record r = MakeRecord(op, chunk_id, root);
+    std::lock_guard<std::mutex> lk(log_mu_);
+    if (wal_fd_ < 0) {
+        return 0;
+    }
+    const char* p = reinterpret_cast<const char*>(&r);
+    pending_.insert(pending_.end(), p, p + sizeof(r));
+    return next_seq_++;
+}
+
+// Group commit: the first waiter to find no flush in progress writes out
+// everything queued so far; later arrivals either ride along or wait for the
+// next round.
+bool LocalMetadataManager::WaitDurable(uint64_t seq) {
+    if (seq == 0) {
         return false;
     }
-    manifest_out_ << op << ' ' << chunk_id << ' ' << path << '\n';
-    manifest_out_.flush();
+    std::unique_lock<std::mutex> lk(log_mu_);
+    while (durable_seq_ < seq) {
+        if (flushing_) {
+            log_cv_.wait(lk);
+            continue;
+        }
+        flushing_ = true;
+        std::vector<char> batch;
+        batch.swap(pending_);
+        const uint64_t upto = next_seq_ - 1;
+        const int fd = wal_fd_;
+        lk.unlock();
+        bool ok = WriteAll(fd, batch.data(), batch.size()) && (!opts_.sync || ::fdatasync(fd) == 0);
+        lk.lock();
+        flushing_ = false;
+        durable_seq_ = upto;
+        wal_records_.fetch_add(batch.size() / sizeof(Record), std::memory_order_relaxed);
+        if (!ok && !log_error_) {
+            std::cerr << "LocalMetadataManager: manifest append failed: " << std::strerror(errno) << std::endl;
+            log_error_ = true;
+        }
+        log_cv_.notify_all();
+    }
+    const bool ok = !log_error_;
+    lk.unlock();
+    MaybeKickCheckpoint();
+    return ok;
+}
+
+void LocalMetadataManager::MaybeKickCheckpoint() {
+    if (opts_.checkpoint_records > 0 &&
+        wal_records_.load(std::memory_order_relaxed) >= opts_.checkpoint_records) {
+        ckpt_cv_.notify_one();
+    }
+}
+
+bool LocalMetadataManager::WriteAll(int fd, const void* data, size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Rotates to a new WAL generation, then copies the map shard by shard while
+// writers continue. A chunk changed during the copy has its record in the new
+// generation, and replaying it over either the old or the new value gives the
+// same result.
+bool LocalMetadataManager::Checkpoint() {
+    std::lock_guard<std::mutex> ck(ckpt_mu_);
+    uint64_t new_gen = 0;
+    uint64_t old_first = 0;
+    {
+        std::unique_lock<std::mutex> lk(log_mu_);
+        if (wal_fd_ < 0) {
+            return false;
+        }
+        log_cv_.wait(lk, [this] { return !flushing_; });
+        new_gen = wal_gen_ + 1;
+        int fd = ::open(WalPath(new_gen).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "LocalMetadataManager: failed to create " << WalPath(new_gen) << ": "
+                      << std::strerror(errno) << std::endl;
+            return false;
+        }
+        // queued records belong to the old generation
+        if (!pending_.empty()) {
+            WriteAll(wal_fd_, pending_.data(), pending_.size());
+            pending_.clear();
+            durable_seq_ = next_seq_ - 1;
+            log_cv_.notify_all();
+        }
+        ::fdatasync(wal_fd_);
+        ::close(wal_fd_);
+        SyncDir(WalPath(new_gen));
+        wal_fd_ = fd;
+        wal_gen_ = new_gen;
+        old_first = first_wal_gen_;
+        wal_records_.store(0);
+    }
+
+    // Records go straight to the file shard by shard, so a checkpoint needs
+    // no copy of the map; the header's count is filled in at the end.
+    SnapHeader h{};
+    h.magic = kSnapMagic;
+    h.version = kSnapVersion;
+    h.wal_gen = new_gen;
+    h.roots = static_cast<uint32_t>(data_roots_.size());
+
+    const std::string path = SnapshotPath();
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0 && WriteAll(fd, &h, sizeof(h));
+    uint64_t count = 0;
+    std::vector<Record> buf;
+    buf.reserve(4096);
+    auto flush = [&]() {
+        ok = ok && WriteAll(fd, buf.data(), buf.size() * sizeof(Record));
+        buf.clear();
+    };
+    for (auto& shard : shards_) {
+        if (!ok) {
+            break;
+        }
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        shard.map.ForEach([&](uint64_t chunk_id, uint16_t root) {
+            buf.push_back(MakeRecord(kOpAdd, chunk_id, root));
+            ++count;
+            if (buf.size() == buf.capacity()) {
+                flush();
+            }
+        });
+        flush();
+    }
+    h.count = count;
+    h.crc = butil::crc32c::Value(reinterpret_cast<const char*>(&h), offsetof(SnapHeader, crc));
+    ok = ok && ::pwrite(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) && ::fdatasync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "LocalMetadataManager: failed to write snapshot " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    SyncDir(path);
+    for (uint64_t g = old_first; g < new_gen; ++g) {
+        ::unlink(WalPath(g).c_str());
+    }
+    first_wal_gen_ = new_gen;
+    std::cout << "[RealNode] manifest checkpoint: chunks=" << count << " wal_gen=" << new_gen
+              << std::endl;
     return true;
 }
 
-std::string LocalMetadataManager::ShardedRelativePath(uint64_t chunk_id) const {
-    std::ostringstream oss;
-    oss << std::hex << std::setw(16) << std::setfill('0') << chunk_id;
-    const std::string hex = oss.str();
-    std::string rel;
-    rel.reserve(2 + 1 + 2 + 1 + 6 + 20);
-    rel.append(hex, 0, 2);
-    rel.push_back('/');
-    rel.append(hex, 2, 2);
-    rel.push_back('/');
-    rel.append("chunk_");
-    rel.append(std::to_string(chunk_id));
-    return rel;
+void LocalMetadataManager::CheckpointLoop() {
+    std::unique_lock<std::mutex> lk(ckpt_wait_mu_);
+    while (!stop_) {
+        ckpt_cv_.wait_for(lk, std::chrono::seconds(1));
+        if (stop_) {
+            break;
+        }
+        if (wal_records_.load(std::memory_order_relaxed) < opts_.checkpoint_records) {
+            continue;
+        }
+        lk.unlock();
+        Checkpoint();
+        lk.lock();
+    }
+}
+
+// Index of the data root `path` was allocated under, or -1 if the path does
+// not follow the root/<hh>/<hh>/chunk_<id> layout.
+int LocalMetadataManager::RootIndex(const std::string& path, uint64_t chunk_id) const {
+    char buf[PATH_MAX];
+    for (size_t i = 0; i < data_roots_.size(); ++i) {
+        size_t n = FormatPath(static_cast<uint16_t>(i), chunk_id, buf, sizeof(buf));
+        if (n != 0 && path.size() == n && path.compare(0, n, buf, n) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// The two directory levels are the top two bytes of the 16-digit hex id.
+size_t LocalMetadataManager::FormatPath(uint16_t root, uint64_t chunk_id, char* buf, size_t cap) const {
+    if (root >= data_roots_.size()) {
+        return 0;
+    }
+    int n = std::snprintf(buf, cap, "%s/%02x/%02x/chunk_%" PRIu64, data_roots_[root].c_str(),
+                          static_cast<unsigned>((chunk_id >> 56) & 0xff),
+                          static_cast<unsigned>((chunk_id >> 48) & 0xff), chunk_id);
+    if (n <= 0 || static_cast<size_t>(n) >= cap) {
+        return 0;
+    }
+    return static_cast<size_t>(n);
+}
+
+std::string LocalMetadataManager::BuildPath(uint16_t root, uint64_t chunk_id) const {
+    char buf[PATH_MAX];
+    size_t n = FormatPath(root, chunk_id, buf, sizeof(buf));
+    return std::string(buf, n);
 }
@@ -1,34 +1,124 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
-#include <fstream>
+#include <functional>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
-// Manages chunk_id -> local path mapping with a simple manifest log for persistence.
+#include "ChunkLocationMap.h"
+
+// Manages chunk_id -> local path mapping, persisted as a binary manifest.
+//
+// The manifest is a compact snapshot (<prefix>.snap) plus write-ahead logs
+// (<prefix>.<gen>.wal) of fixed-size ADD/DEL records. Paths are not stored,
+// neither on disk nor in memory: a chunk maps to its data-root index and the
+// path is rebuilt on demand from the sharded layout. Concurrent appends are group-committed by whichever
+// caller gets to the log first. Once the live WAL holds checkpoint_records
+// records, a background thread rotates to a new WAL generation, writes a fresh
+// snapshot and drops the old logs, so startup reads one snapshot plus a
+// bounded tail. Records are full-state assignments, which lets the snapshot
+// be taken shard by shard without stopping writers.
 class LocalMetadataManager {
 public:
-    LocalMetadataManager(std::vector<std::string> data_roots, std::string manifest_path = "");
+    struct Options {
+        Options();
+        size_t checkpoint_records;  // WAL records that trigger a snapshot; 0 disables
+        bool sync;                  // fdatasync each group commit
+        unsigned replay_threads;    // 0 = hardware concurrency
+        // Picks the data root for a new chunk; round-robin when unset.
+        std::function<size_t(uint64_t chunk_id)> placement;
+    };
+
+    LocalMetadataManager(std::vector<std::string> data_roots,
+                         std::string manifest_prefix = "",
+                         Options opts = Options());
     ~LocalMetadataManager();
 
     // Returns the full path if present, otherwise empty.
     std::string GetPath(uint64_t chunk_id) const;
+    // Same as !GetPath(chunk_id).empty() without building the path.
+    bool HasPath(uint64_t chunk_id) const;
+    // Index into data_roots of the chunk's root, or -1 if unmapped.
+    int RootOf(uint64_t chunk_id) const;
+    // Ids of all mapped chunks, in no particular order.
+    std::vector<uint64_t> ListChunks() const;
     // Allocates a new path for the chunk and persists the mapping; returns empty on failure.
     std::string AllocPath(uint64_t chunk_id);
     // Removes mapping (best-effort) and records a delete marker.
     void DeletePath(uint64_t chunk_id);
 
+    // Writes a snapshot and drops WAL generations it covers.
+    bool Checkpoint();
+
+    size_t size() const;
+    size_t IndexMemoryBytes() const;
+
 private:
+    static constexpr size_t kShards = 64;
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mu;
+        ChunkLocationMap map;
+    };
+
+    // (chunk_id, root) pairs bucketed by shard, in log order.
+    using ShardBuckets = std::vector<std::vector<std::pair<uint64_t, int32_t>>>;
+
+    Shard& ShardFor(uint64_t chunk_id);
+    const Shard& ShardFor(uint64_t chunk_id) const;
+    static size_t ShardIndex(uint64_t chunk_id);
+
     bool LoadManifest();
-    bool AppendRecord(const std::string& op, uint64_t chunk_id, const std::string& path);
-    std::string ShardedRelativePath(uint64_t chunk_id) const;
+    bool LoadSnapshot();
+    bool ReplayWal(uint64_t gen, uint64_t* valid_bytes, size_t* records);
+    bool LoadTextManifest(const std::string& text_path);
+    size_t DecodeRecords(const char* base, size_t count, bool snapshot,
+                         std::vector<ShardBuckets>* buckets) const;
+    void ApplyBuckets(const std::vector<ShardBuckets>& buckets);
+    bool OpenWal(uint64_t gen, uint64_t truncate_to);
+    // EnqueueRecord runs under the chunk's shard lock so the log order of a
+    // chunk matches its map order; WaitDurable runs after the lock is dropped.
+    uint64_t EnqueueRecord(uint8_t op, uint64_t chunk_id, uint16_t root);
+    bool WaitDurable(uint64_t seq);
+    void MaybeKickCheckpoint();
+    bool WriteAll(int fd, const void* data, size_t len);
+    std::string WalPath(uint64_t gen) const;
+    std::string SnapshotPath() const;
+    int RootIndex(const std::string& path, uint64_t chunk_id) const;
+    // Writes <root>/<hh>/<hh>/chunk_<id> into buf; returns its length, or 0 if it does not fit.
+    size_t FormatPath(uint16_t root, uint64_t chunk_id, char* buf, size_t cap) const;
+    std::string BuildPath(uint16_t root, uint64_t chunk_id) const;
+    unsigned ReplayThreads() const;
+    void CheckpointLoop();
 
     std::vector<std::string> data_roots_;
-    std::string manifest_path_;
-    mutable std::shared_mutex mu_;
-    std::unordered_map<uint64_t, std::string> path_map_;
-    size_t next_root_{0};
-    std::ofstream manifest_out_;
+    std::string manifest_prefix_;
+    Options opts_;
+    Shard shards_[kShards];
+    std::atomic<size_t> next_root_{0};
+
+    // Group commit state. pending_ is written by whichever waiter finds no
+    // flush in progress; log_cv_ wakes the rest once their seq is durable.
+    std::mutex log_mu_;
+    std::condition_variable log_cv_;
+    std::vector<char> pending_;
+    uint64_t next_seq_{1};
+    uint64_t durable_seq_{0};
+    bool flushing_{false};
+    bool log_error_{false};
+    int wal_fd_{-1};
+    uint64_t wal_gen_{1};
+    uint64_t first_wal_gen_{1};  // oldest generation not covered by the snapshot
+    std::atomic<size_t> wal_records_{0};
+
+    std::mutex ckpt_mu_;  // serializes checkpoints
+    std::mutex ckpt_wait_mu_;
+    std::condition_variable ckpt_cv_;
+    bool stop_{false};
+    std::thread ckpt_thread_;
 };
@@ -2,15 +2,22 @@
 
 #include <brpc/closure_guard.h>
 #include <brpc/controller.h>
+#include <brpc/stream.h>
 #include <butil/crc32c.h>
 
 #include <fcntl.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <utility>
 
+#include "StreamSessions.h"
+#include "VectoredIO.h"
+#include "common/ChunkStream.h"
+
 namespace {
 
 rpc::Status* Ok(rpc::Status* status) {
@@ -18,14 +25,136 @@ rpc::Status* Ok(rpc::Status* status) {
     return status;
 }
 
+DiskScheduler::Class SchedulerClass(storagenode::IOClass io_class) {
+    switch (io_class) {
+        case storagenode::IO_CLASS_MIGRATION: return DiskScheduler::kMigration;
+        case storagenode::IO_CLASS_SCRUB: return DiskScheduler::kScrub;
+        default: return DiskScheduler::kForeground;
+    }
+}
+
+void ReplyDiskBusy(rpc::Status* status, ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk queue full");
+}
+
+// Moves the read payload into the brpc attachment just before the reply is
+// sent, for callers that asked for WIRE_ATTACHMENT.
+class AttachPayloadClosure : public ::google::protobuf::Closure {
+public:
+    AttachPayloadClosure(brpc::Controller* cntl, storagenode::ReadReply* response,
+                         ::google::protobuf::Closure* done)
+        : cntl_(cntl), response_(response), done_(done) {}
+
+    void Run() override {
+        cntl_->response_attachment().append(response_->data());
+        response_->clear_data();
+        response_->set_wire_version(storagenode::WIRE_ATTACHMENT);
+        done_->Run();
+        delete this;
+    }
+
+private:
+    brpc::Controller* cntl_;
+    storagenode::ReadReply* response_;
+    ::google::protobuf::Closure* done_;
+};
+
+// Sparse reads leave out holes of at least this size; smaller reads are
+// sent whole.
+constexpr uint64_t kMinHole = 4096;
+
+bool AllZero(const char* p, size_t n) {
+    return n == 0 || (p[0] == 0 && std::memcmp(p, p + 1, n - 1) == 0);
+}
+
+// For sparse reads: swaps the zero ranges that the file's hole map reports
+// for hole descriptors before the reply goes out. Each range is checked to
+// still be zero in the payload, so a write racing the lookup cannot be lost.
+class SparseReplyClosure : public ::google::protobuf::Closure {
+public:
+    SparseReplyClosure(std::shared_ptr<LocalMetadataManager> metadata, const storagenode::ReadRequest* request,
+                       storagenode::ReadReply* response, ::google::protobuf::Closure* done)
+        : metadata_(std::move(metadata)), request_(request), response_(response), done_(done) {}
+
+    void Run() override {
+        if (response_->status().code() == rpc::STATUS_SUCCESS) {
+            Compact();
+        }
+        done_->Run();
+        delete this;
+    }
+
+private:
+    void Compact() {
+        const uint64_t n = response_->bytes_read();
+        if (n < 2 * kMinHole || response_->data().size() != n) {
+            return;
+        }
+        const std::string path = metadata_->GetPath(request_->chunk_id());
+        std::vector<SparseFile::Extent> data;
+        if (path.empty() || SparseFile::DataExtents(path, request_->offset(), n, &data) != 0) {
+            return;
+        }
+        const std::string& full = response_->data();
+        std::string compact;
+        uint64_t pos = 0;  // next payload byte not yet copied
+        for (const auto& hole : SparseFile::Holes(data, request_->offset(), n, kMinHole)) {
+            const uint64_t at = hole.offset - request_->offset();
+            if (!AllZero(full.data() + at, static_cast<size_t>(hole.length))) {
+                continue;
+            }
+            if (compact.empty()) {
+                compact.reserve(static_cast<size_t>(n));
+            }
+            compact.append(full, static_cast<size_t>(pos), static_cast<size_t>(at - pos));
+            pos = at + hole.length;
+            auto* h = response_->add_holes();
+            h->set_offset(hole.offset);
+            h->set_length(hole.length);
+        }
+        if (response_->holes_size() == 0) {
+            return;
+        }
+        compact.append(full, static_cast<size_t>(pos), std::string::npos);
+        response_->mutable_data()->swap(compact);
+    }
+
+    std::shared_ptr<LocalMetadataManager> metadata_;
+    const storagenode::ReadRequest* request_;
+    storagenode::ReadReply* response_;
+    ::google::protobuf::Closure* done_;
+};
+
+// A client that stops sending mid-stream for this long is dropped.
+constexpr long kWriteStreamIdleMs = 60000;
+
+bool AcceptStream(brpc::Controller* cntl, brpc::StreamInputHandler* handler, long idle_timeout_ms,
+                  brpc::StreamId* id) {
+    if (!cntl) {
+        return false;
+    }
+    brpc::StreamOptions opts;
+    opts.handler = handler;
+    opts.max_buf_size = static_cast<int>(ChunkStream::Options().window_bytes);
+    opts.idle_timeout_ms = idle_timeout_ms;
+    return brpc::StreamAccept(id, *cntl, &opts) == 0;
+}
+
 } // namespace
 
 StorageServiceImpl::StorageServiceImpl(std::shared_ptr<DiskManager> disk_manager,
                                        std::shared_ptr<LocalMetadataManager> metadata_mgr,
-                                       std::shared_ptr<IOEngine> io_engine)
+                                       std::shared_ptr<IOEngine> io_engine,
+                                       std::shared_ptr<ContainerStore> container_store,
+                                       std::shared_ptr<BlockCache> block_cache,
+                                       std::shared_ptr<DiskScheduler> disk_scheduler)
     : disk_manager_(std::move(disk_manager)),
       metadata_mgr_(std::move(metadata_mgr)),
-      io_engine_(std::move(io_engine)) {
+      io_engine_(std::move(io_engine)),
+      container_store_(std::move(container_store)),
+      block_cache_(std::move(block_cache)),
+      disk_scheduler_(std::move(disk_scheduler)) {
     if (disk_manager_) {
         ready_ = disk_manager_->Prepare();
     } else {
@@ -37,9 +166,18 @@ void StorageServiceImpl::Write(::google::protobuf::RpcController* controller,
                                const storagenode::WriteRequest* request,
                                storagenode::WriteReply* response,
                                ::google::protobuf::Closure* done) {
-    (void)controller;
     brpc::ClosureGuard guard(done);
     auto* status = response->mutable_status();
+    // An attached payload arrives as socket-sized IOBuf blocks; flattening it
+    // here is its only copy, in place of the protobuf parse.
+    auto* cntl = static_cast<brpc::Controller*>(controller);
+    std::shared_ptr<std::string> attached;
+    if (request->wire_version() == storagenode::WIRE_ATTACHMENT && cntl) {
+        attached = std::make_shared<std::string>();
+        cntl->request_attachment().copy_to(attached.get());
+        response->set_wire_version(storagenode::WIRE_ATTACHMENT);
+    }
+    const std::string* data = attached ? attached.get() : &request->data();
     if (!ready_) {
         StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk not ready");
         return;
@@ -54,14 +192,48 @@ void StorageServiceImpl::Write(::google::protobuf::RpcController* controller,
     }
     std::cout << "[RealNode] WriteReq chunk=" << request->chunk_id()
               << " offset=" << request->offset()
-              << " size=" << request->data().size() << std::endl;
+              << " size=" << data->size() << std::endl;
     if (request->checksum() != 0) {
-        uint64_t actual = ComputeChecksum(request->data().data(), request->data().size());
+        uint64_t actual = ComputeChecksum(data->data(), data->size());
         if (actual != request->checksum()) {
             StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "payload checksum mismatch");
             return;
         }
     }
+    // The reply is sent from the completion; the payload stays alive until done runs.
+    auto on_done = [this, request, response, done, data, attached](const IOEngine::Result& res) {
+        brpc::ClosureGuard done_guard(done);
+        if (block_cache_) {
+            block_cache_->Invalidate(request->chunk_id(), request->offset(), data->size());
+        }
+        auto* st = response->mutable_status();
+        if (res.bytes < 0 || res.err != 0) {
+            int err = res.err != 0 ? res.err : EIO;
+            StatusUtils::SetStatus(st, StatusUtils::FromErrno(err),
+                                   res.err != 0 ? std::strerror(err) : "write failed");
+            return;
+        }
+        response->set_bytes_written(static_cast<uint64_t>(res.bytes));
+        Ok(st);
+        std::cout << "[RealNode] WriteResp chunk=" << request->chunk_id()
+                  << " bytes=" << response->bytes_written()
+                  << " code=" << response->status().code() << std::endl;
+    };
+
+    if (UseContainer(request->chunk_id())) {
+        auto res = container_store_->Write(request->chunk_id(), request->offset(),
+                                           data->data(), data->size());
+        if (res.err != EFBIG) {
+            guard.release();
+            on_done(res);
+            return;
+        }
+        if (!MigrateToFile(request->chunk_id())) {
+            StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "failed to migrate chunk out of container");
+            return;
+        }
+    }
+
     std::string path = metadata_mgr_->GetPath(request->chunk_id());
     if (path.empty()) {
         path = metadata_mgr_->AllocPath(request->chunk_id());
@@ -80,30 +252,61 @@ void StorageServiceImpl::Write(::google::protobuf::RpcController* controller,
     }
     int mode = request->mode() == 0 ? 0644 : request->mode();
 
-    auto res = io_engine_->Write(path,
-                                 request->data().data(),
-                                 request->data().size(),
-                                 request->offset(),
-                                 flags,
-                                 mode);
-    if (res.bytes < 0 || res.err != 0) {
-        int err = res.err != 0 ? res.err : EIO;
-        StatusUtils::SetStatus(status, StatusUtils::FromErrno(err),
-                               res.err != 0 ? std::strerror(err) : "write failed");
-        return;
+    guard.release();
+    auto io = [this, request, data, path, flags, mode, on_done](DiskScheduler::Done disk_done) mutable {
+        if (compressor_) {
+            auto access = compressor_->Begin(request->chunk_id(), path, true);
+            if (access.err != 0) {
+                disk_done();
+                on_done(IOEngine::Result{-1, access.err});
+                return;
+            }
+        }
+        if (preallocator_) {
+            preallocator_->BeforeWrite(request->chunk_id(), path, request->offset(), data->size(),
+                                       request->size_hint(), mode);
+        }
+        auto on_written = [this, request, data, path, on_done, disk_done](const IOEngine::Result& res) mutable {
+            disk_done();
+            if (compressor_) {
+                compressor_->End(request->chunk_id(), true);
+            }
+            if (preallocator_) {
+                preallocator_->AfterWrite(request->chunk_id());
+            }
+            if (checksums_ && res.bytes >= 0 && res.err == 0 &&
+                !checksums_->Update(request->chunk_id(), path, request->offset(),
+                                    data->data(), data->size())) {
+                // the data is durable; the scrubber rebuilds the sidecar later
+                std::cerr << "[RealNode] checksum update failed chunk=" << request->chunk_id() << std::endl;
+            }
+            on_done(res);
+        };
+        io_engine_->AsyncWrite(request->chunk_id(),
+                               path,
+                               data->data(),
+                               data->size(),
+                               request->offset(),
+                               flags,
+                               mode,
+                               std::move(on_written));
+    };
+    if (!RunOnDiskAsync(request->chunk_id(), std::move(io), request->io_class(), data->size())) {
+        ReplyDiskBusy(status, done);
     }
-    response->set_bytes_written(static_cast<uint64_t>(res.bytes));
-    Ok(status);
-    std::cout << "[RealNode] WriteResp chunk=" << request->chunk_id()
-              << " bytes=" << response->bytes_written()
-              << " code=" << response->status().code() << std::endl;
 }
 
 void StorageServiceImpl::Read(::google::protobuf::RpcController* controller,
                               const storagenode::ReadRequest* request,
                               storagenode::ReadReply* response,
                               ::google::protobuf::Closure* done) {
-    (void)controller;
+    auto* cntl = static_cast<brpc::Controller*>(controller);
+    if (request->wire_version() == storagenode::WIRE_ATTACHMENT && cntl) {
+        done = new AttachPayloadClosure(cntl, response, done);
+    }
+    if (request->sparse() && metadata_mgr_) {
+        done = new SparseReplyClosure(metadata_mgr_, request, response, done);  // runs before the attach
+    }
     brpc::ClosureGuard guard(done);
     auto* status = response->mutable_status();
     if (!ready_) {
@@ -122,10 +325,13 @@ void StorageServiceImpl::Read(::google::protobuf::RpcController* controller,
               << " offset=" << request->offset()
               << " length=" << request->length() << std::endl;
 
-    std::string path = metadata_mgr_->GetPath(request->chunk_id());
-    if (path.empty()) {
-        StatusUtils::SetStatus(status, rpc::STATUS_NODE_NOT_FOUND, "chunk not found");
-        return;
+    std::string path;
+    if (!container_store_ || !container_store_->Contains(request->chunk_id())) {
+        path = metadata_mgr_->GetPath(request->chunk_id());
+        if (path.empty()) {
+            StatusUtils::SetStatus(status, rpc::STATUS_NODE_NOT_FOUND, "chunk not found");
+            return;
+        }
     }
 
     int flags = request->flags();
@@ -138,27 +344,68 @@ void StorageServiceImpl::Read(::google::protobuf::RpcController* controller,
         flags |= O_RDONLY;
     }
 
-    std::string buffer;
-    auto res = io_engine_->Read(path,
-                                request->offset(),
-                                static_cast<size_t>(request->length()),
-                                buffer,
-                                flags);
-    if (res.bytes < 0 || res.err != 0) {
-        int err = res.err != 0 ? res.err : EIO;
-        StatusUtils::SetStatus(status, StatusUtils::FromErrno(err),
-                               res.err != 0 ? std::strerror(err) : "read failed");
+    // read straight into the reply buffer; it lives until done runs
+    std::string* buffer = response->mutable_data();
+    auto finish = [this, request, response, done](const IOEngine::Result& res, const std::string& path) {
+        brpc::ClosureGuard done_guard(done);
+        auto* st = response->mutable_status();
+        if (res.bytes < 0 || res.err != 0) {
+            int err = res.err != 0 ? res.err : EIO;
+            response->clear_data();
+            StatusUtils::SetStatus(st, StatusUtils::FromErrno(err),
+                                   res.err != 0 ? std::strerror(err) : "read failed");
+            return;
+        }
+        response->set_bytes_read(static_cast<uint64_t>(res.bytes));
+        uint32_t crc = 0;
+        if (checksums_ && !path.empty() && checksums_->Checksum(path, request->offset(), response->data(), &crc)) {
+            response->set_checksum(crc);
+        } else {
+            response->set_checksum(ComputeChecksum(response->data().data(),
+                                                   static_cast<size_t>(res.bytes)));
+        }
+        Ok(st);
+        std::cout << "[RealNode] ReadResp chunk=" << request->chunk_id()
+                  << " bytes=" << response->bytes_read()
+                  << " code=" << response->status().code() << std::endl;
+    };
+    if (path.empty()) {
+        auto res = container_store_->Read(request->chunk_id(), request->offset(),
+                                          static_cast<size_t>(request->length()), *buffer);
+        if (res.err != ENOENT) {
+            guard.release();
+            finish(res, std::string());
+            return;
+        }
+        // migrated to its own file in the meantime
+        path = metadata_mgr_->GetPath(request->chunk_id());
+        if (path.empty()) {
+            StatusUtils::SetStatus(status, rpc::STATUS_NODE_NOT_FOUND, "chunk not found");
+            return;
+        }
+    }
+    // background scans read around the cache and readahead so they do not
+    // evict what foreground clients are using
+    const bool foreground = request->io_class() == storagenode::IO_CLASS_FOREGROUND;
+    const bool compressed = compressor_ && compressor_->IsCompressed(request->chunk_id(), path);
+    if (readahead_ && foreground && !compressed) {
+        readahead_->OnRead(request->chunk_id(), path, request->offset(), request->length());
+    }
+    guard.release();
+    if (block_cache_ && foreground) {
+        ReadThroughCache(request, response, done, path, flags);
         return;
     }
-    response->set_bytes_read(static_cast<uint64_t>(res.bytes));
-    // avoid extra copy inside protobuf by swapping buffers
-    response->mutable_data()->swap(buffer);
-    response->set_checksum(ComputeChecksum(response->data().data(),
-                                           static_cast<size_t>(res.bytes)));
-    Ok(status);
-    std::cout << "[RealNode] ReadResp chunk=" << request->chunk_id()
-              << " bytes=" << response->bytes_read()
-              << " code=" << response->status().code() << std::endl;
+    auto io = [this, request, path, buffer, flags, finish](DiskScheduler::Done disk_done) mutable {
+        ReadFile(request->chunk_id(), path, request->offset(), static_cast<size_t>(request->length()), buffer,
+                 flags, [finish, path, disk_done](const IOEngine::Result& res) {
+                     disk_done();
+                     finish(res, path);
+                 });
+    };
+    if (!RunOnDiskAsync(request->chunk_id(), std::move(io), request->io_class(), request->length())) {
+        ReplyDiskBusy(status, done);
+    }
 }
 
 void StorageServiceImpl::Truncate(::google::protobuf::RpcController* controller,
@@ -183,6 +430,31 @@ void StorageServiceImpl::Truncate(::google::protobuf::RpcController* controller,
     std::cout << "[RealNode] TruncateReq chunk=" << request->chunk_id()
               << " size=" << request->size() << std::endl;
 
+    if (readahead_) {
+        readahead_->Reset(request->chunk_id());
+    }
+    if (preallocator_) {
+        preallocator_->Reset(request->chunk_id());
+    }
+    if (UseContainer(request->chunk_id())) {
+        auto res = container_store_->Truncate(request->chunk_id(), request->size());
+        if (res.err != EFBIG && block_cache_) {
+            block_cache_->InvalidateFrom(request->chunk_id(), request->size());
+        }
+        if (res.err == 0) {
+            Ok(status);
+            return;
+        }
+        if (res.err != EFBIG) {
+            StatusUtils::SetStatus(status, StatusUtils::FromErrno(res.err), std::strerror(res.err));
+            return;
+        }
+        if (!MigrateToFile(request->chunk_id())) {
+            StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "failed to migrate chunk out of container");
+            return;
+        }
+    }
+
     std::string path = metadata_mgr_->GetPath(request->chunk_id());
     if (path.empty()) {
         path = metadata_mgr_->AllocPath(request->chunk_id());
@@ -192,17 +464,184 @@ void StorageServiceImpl::Truncate(::google::protobuf::RpcController* controller,
         }
     }
 
-    int flags = O_WRONLY | O_CREAT;
-    auto res = io_engine_->Truncate(path, request->size(), flags, 0644);
-    if (res.bytes < 0 || res.err != 0) {
-        int err = res.err != 0 ? res.err : EIO;
-        StatusUtils::SetStatus(status, StatusUtils::FromErrno(err),
-                               res.err != 0 ? std::strerror(err) : "truncate failed");
+    guard.release();
+    auto io = [this, request, response, done, path]() {
+        brpc::ClosureGuard done_guard(done);
+        auto* st = response->mutable_status();
+        int flags = O_WRONLY | O_CREAT;
+        IOEngine::Result res;
+        if (compressor_) {
+            res.err = compressor_->Begin(request->chunk_id(), path, true).err;
+        }
+        if (res.err == 0) {
+            res = io_engine_->Truncate(request->chunk_id(), path, request->size(), flags, 0644);
+            if (compressor_) {
+                compressor_->End(request->chunk_id(), true);
+            }
+        }
+        // Invalidate once the truncate has landed, so a read in between cannot
+        // refill the cache with the bytes being cut off.
+        if (block_cache_) {
+            block_cache_->InvalidateFrom(request->chunk_id(), request->size());
+        }
+        if (res.bytes < 0 || res.err != 0) {
+            int err = res.err != 0 ? res.err : EIO;
+            StatusUtils::SetStatus(st, StatusUtils::FromErrno(err),
+                                   res.err != 0 ? std::strerror(err) : "truncate failed");
+            return;
+        }
+        if (checksums_ && !checksums_->Truncate(request->chunk_id(), path, request->size())) {
+            std::cerr << "[RealNode] checksum truncate failed chunk=" << request->chunk_id() << std::endl;
+        }
+        Ok(st);
+        std::cout << "[RealNode] TruncateResp chunk=" << request->chunk_id()
+                  << " code=" << response->status().code() << std::endl;
+    };
+    if (!RunOnDisk(request->chunk_id(), std::move(io))) {
+        ReplyDiskBusy(status, done);
+    }
+}
+
+void StorageServiceImpl::TrimChunk(::google::protobuf::RpcController* controller,
+                                   const storagenode::TrimChunkRequest* request,
+                                   storagenode::TrimChunkReply* response,
+                                   ::google::protobuf::Closure* done) {
+    (void)controller;
+    brpc::ClosureGuard guard(done);
+    auto* status = response->mutable_status();
+    if (!ready_) {
+        StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk not ready");
+        return;
+    }
+    const uint64_t chunk_id = request->chunk_id();
+    // container chunks and chunks never written have nothing reserved
+    const std::string path =
+        preallocator_ && metadata_mgr_ && !UseContainer(chunk_id) ? metadata_mgr_->GetPath(chunk_id) : "";
+    if (path.empty()) {
+        Ok(status);
+        return;
+    }
+    guard.release();
+    auto io = [this, chunk_id, response, done, path]() {
+        brpc::ClosureGuard done_guard(done);
+        auto res = TrimReserved(chunk_id, path);
+        if (res.err != 0 && res.err != EBUSY) {
+            StatusUtils::SetStatus(response->mutable_status(), StatusUtils::FromErrno(res.err),
+                                   std::strerror(res.err));
+            return;
+        }
+        // EBUSY: another writer is still at it; the idle sweep trims later
+        response->set_released_bytes(res.released);
+        response->set_extents(res.extents);
+        Ok(response->mutable_status());
+        std::cout << "[RealNode] TrimChunk chunk=" << chunk_id << " released=" << res.released
+                  << " extents=" << res.extents << (res.err == EBUSY ? " busy" : "") << std::endl;
+    };
+    if (!RunOnDisk(chunk_id, std::move(io))) {
+        ReplyDiskBusy(status, done);
+    }
+}
+
+void StorageServiceImpl::CompressChunk(::google::protobuf::RpcController* controller,
+                                       const storagenode::CompressChunkRequest* request,
+                                       storagenode::CompressChunkReply* response,
+                                       ::google::protobuf::Closure* done) {
+    (void)controller;
+    brpc::ClosureGuard guard(done);
+    auto* status = response->mutable_status();
+    if (!ready_) {
+        StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk not ready");
+        return;
+    }
+    if (!compressor_ || !metadata_mgr_) {
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "compression not enabled");
+        return;
+    }
+    const auto codec = static_cast<ChunkCompressor::Codec>(request->codec());
+    if (!ChunkCompressor::Supported(codec)) {
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "codec not built in");
+        return;
+    }
+    const uint64_t chunk_id = request->chunk_id();
+    // container chunks are small and stay as they are
+    if (UseContainer(chunk_id)) {
+        response->set_codec(storagenode::CHUNK_CODEC_NONE);
+        Ok(status);
+        return;
+    }
+    const std::string path = metadata_mgr_->GetPath(chunk_id);
+    if (path.empty()) {
+        StatusUtils::SetStatus(status, rpc::STATUS_NODE_NOT_FOUND, "chunk not found");
+        return;
+    }
+    guard.release();
+    auto io = [this, chunk_id, path, codec, response, done]() {
+        brpc::ClosureGuard done_guard(done);
+        auto res = CompressOnDisk(chunk_id, path, codec);
+        if (res.err != 0) {
+            StatusUtils::SetStatus(response->mutable_status(), StatusUtils::FromErrno(res.err),
+                                   std::strerror(res.err));
+            return;
+        }
+        response->set_codec(static_cast<storagenode::ChunkCodec>(res.codec));
+        response->set_raw_bytes(res.raw_bytes);
+        response->set_stored_bytes(res.stored_bytes);
+        Ok(response->mutable_status());
+    };
+    if (!RunOnDisk(chunk_id, std::move(io), request->io_class())) {
+        ReplyDiskBusy(status, done);
+    }
+}
+
+void StorageServiceImpl::GetExtents(::google::protobuf::RpcController* controller,
+                                    const storagenode::GetExtentsRequest* request,
+                                    storagenode::GetExtentsReply* response,
+                                    ::google::protobuf::Closure* done) {
+    (void)controller;
+    brpc::ClosureGuard guard(done);
+    auto* status = response->mutable_status();
+    if (!ready_) {
+        StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk not ready");
         return;
     }
+    const uint64_t chunk_id = request->chunk_id();
+    uint64_t size = 0;
+    std::vector<SparseFile::Extent> extents;
+    if (container_store_ && container_store_->Size(chunk_id, &size)) {
+        const uint64_t end = request->length() == 0 ? size : std::min(size, request->offset() + request->length());
+        if (request->offset() < end) {
+            extents.push_back(SparseFile::Extent{request->offset(), end - request->offset()});
+        }
+    } else {
+        const std::string path = metadata_mgr_->GetPath(chunk_id);
+        if (path.empty()) {
+            StatusUtils::SetStatus(status, rpc::STATUS_NODE_NOT_FOUND, "chunk not found");
+            return;
+        }
+        int err = 0;
+        if (compressor_ && compressor_->IsCompressed(chunk_id, path)) {
+            // compressed chunks keep no hole map; their data is one extent
+            err = compressor_->Size(chunk_id, path, &size);
+            const uint64_t end =
+                request->length() == 0 ? size : std::min(size, request->offset() + request->length());
+            if (err == 0 && request->offset() < end) {
+                extents.push_back(SparseFile::Extent{request->offset(), end - request->offset()});
+            }
+        } else {
+            err = SparseFile::DataExtents(path, request->offset(), request->length(), &extents, &size);
+        }
+        if (err != 0) {
+            StatusUtils::SetStatus(status, StatusUtils::FromErrno(err), std::strerror(err));
+            return;
+        }
+    }
+    for (const auto& e : extents) {
+        auto* out = response->add_extents();
+        out->set_offset(e.offset);
+        out->set_length(e.length);
+    }
+    response->set_size(size);
     Ok(status);
-    std::cout << "[RealNode] TruncateResp chunk=" << request->chunk_id()
-              << " code=" << response->status().code() << std::endl;
 }
 
 void StorageServiceImpl::UnmountDisk(::google::protobuf::RpcController* controller,
@@ -224,6 +663,381 @@ void StorageServiceImpl::UnmountDisk(::google::protobuf::RpcController* controll
     Ok(status);
 }
 
+void StorageServiceImpl::OpenReadStream(::google::protobuf::RpcController* controller,
+                                        const storagenode::OpenStreamRequest* request,
+                                        storagenode::OpenStreamReply* response,
+                                        ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    auto* status = response->mutable_status();
+    if (!ready_) {
+        StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk not ready");
+        return;
+    }
+    const uint64_t chunk_id = request->chunk_id();
+    if (!metadata_mgr_->HasPath(chunk_id) && !(container_store_ && container_store_->Contains(chunk_id))) {
+        StatusUtils::SetStatus(status, rpc::STATUS_NODE_NOT_FOUND, "chunk not found");
+        return;
+    }
+    std::cout << "[RealNode] OpenReadStream chunk=" << chunk_id << " offset=" << request->offset()
+              << " length=" << request->length() << std::endl;
+    auto* session = new ReadStreamSession(this, *request);
+    brpc::StreamId id;
+    if (!AcceptStream(static_cast<brpc::Controller*>(controller), session, -1, &id)) {
+        delete session;
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "request carries no stream");
+        return;
+    }
+    Ok(status);
+    // frames may only follow the reply
+    guard.release()->Run();
+    session->Start(id);
+}
+
+void StorageServiceImpl::OpenWriteStream(::google::protobuf::RpcController* controller,
+                                         const storagenode::OpenStreamRequest* request,
+                                         storagenode::OpenStreamReply* response,
+                                         ::google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    auto* status = response->mutable_status();
+    if (!ready_) {
+        StatusUtils::SetStatus(status, rpc::STATUS_IO_ERROR, "disk not ready");
+        return;
+    }
+    std::cout << "[RealNode] OpenWriteStream chunk=" << request->chunk_id() << " offset=" << request->offset()
+              << std::endl;
+    auto* session = new WriteStreamSession(this, *request);
+    brpc::StreamId id;
+    if (!AcceptStream(static_cast<brpc::Controller*>(controller), session, kWriteStreamIdleMs, &id)) {
+        delete session;
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "request carries no stream");
+        return;
+    }
+    Ok(status);
+}
+
+void StorageServiceImpl::ReadV(::google::protobuf::RpcController* controller,
+                               const storagenode::ReadVRequest* request,
+                               storagenode::ReadVReply* response,
+                               ::google::protobuf::Closure* done) {
+    if (!ready_) {
+        brpc::ClosureGuard guard(done);
+        StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_IO_ERROR, "disk not ready");
+        return;
+    }
+    VectoredIO::ReadV(this, static_cast<brpc::Controller*>(controller), request, response, done);
+}
+
+void StorageServiceImpl::WriteV(::google::protobuf::RpcController* controller,
+                                const storagenode::WriteVRequest* request,
+                                storagenode::WriteVReply* response,
+                                ::google::protobuf::Closure* done) {
+    if (!ready_) {
+        brpc::ClosureGuard guard(done);
+        StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_IO_ERROR, "disk not ready");
+        return;
+    }
+    VectoredIO::WriteV(this, static_cast<brpc::Controller*>(controller), request, response, done);
+}
+
+void StorageServiceImpl::EnableReadahead(const ReadaheadManager::Options& opts) {
+    readahead_ = std::make_unique<ReadaheadManager>(
+        opts, [this](uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length) {
+            Prefetch(chunk_id, path, offset, length);
+        });
+}
+
+void StorageServiceImpl::EnableChecksums(std::shared_ptr<ChecksumStore> checksums) {
+    checksums_ = std::move(checksums);
+}
+
+void StorageServiceImpl::EnablePreallocation(const Preallocator::Options& opts) {
+    preallocator_ = std::make_unique<Preallocator>(opts, [this](uint64_t chunk_id) {
+        const std::string path = metadata_mgr_->GetPath(chunk_id);
+        if (path.empty()) {
+            preallocator_->Reset(chunk_id);
+            return true;
+        }
+        return RunOnDisk(
+            chunk_id, [this, chunk_id, path]() { TrimReserved(chunk_id, path); }, storagenode::IO_CLASS_SCRUB);
+    });
+}
+
+Preallocator::Stats StorageServiceImpl::PreallocStats() const {
+    return preallocator_ ? preallocator_->GetStats() : Preallocator::Stats{};
+}
+
+void StorageServiceImpl::EnableCompression(const ChunkCompressor::Options& opts) {
+    ChunkCompressor::Options options = opts;
+    // the sidecar follows the chunk file, which a compressed chunk leaves empty
+    options.on_switch = [this](uint64_t chunk_id, const std::string& path, bool packed) {
+        if (checksums_ &&
+            !(packed ? checksums_->Truncate(chunk_id, path, 0) : checksums_->Rebuild(chunk_id, path))) {
+            std::cerr << "[RealNode] checksum " << (packed ? "truncate" : "rebuild")
+                      << " failed chunk=" << chunk_id << std::endl;
+        }
+    };
+    compressor_ = std::make_unique<ChunkCompressor>(options, [this](uint64_t chunk_id, ChunkCompressor::Codec codec) {
+        const std::string path = metadata_mgr_->GetPath(chunk_id);
+        if (path.empty()) {
+            return true;
+        }
+        return RunOnDisk(
+            chunk_id, [this, chunk_id, path, codec]() { CompressOnDisk(chunk_id, path, codec); },
+            storagenode::IO_CLASS_SCRUB);
+    });
+}
+
+ChunkCompressor::Stats StorageServiceImpl::CompressionStats() const {
+    return compressor_ ? compressor_->GetStats() : ChunkCompressor::Stats{};
+}
+
+// Runs on a readahead worker. Blocks already cached are skipped so a
+// prefetch never resets the frequency of hot blocks, and a busy disk gets
+// no prefetch at all.
+void StorageServiceImpl::Prefetch(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length) {
+    if (disk_scheduler_) {
+        const int root = metadata_mgr_->RootOf(chunk_id);
+        if (disk_scheduler_->Busy(root < 0 ? 0 : static_cast<size_t>(root))) {
+            return;
+        }
+    }
+    if (!block_cache_) {
+        if (!compressor_ || !compressor_->IsCompressed(chunk_id, path)) {
+            io_engine_->Prefetch(chunk_id, path, offset, static_cast<size_t>(length));
+        }
+        return;
+    }
+    const uint64_t bs = block_cache_->block_size();
+    uint64_t first = offset / bs;
+    const uint64_t last = (offset + length - 1) / bs;
+    while (first <= last && block_cache_->Contains(chunk_id, first)) {
+        ++first;
+    }
+    if (first > last) {
+        return;
+    }
+    // compressed chunks are not read ahead; their reads decode whole blocks anyway
+    if (compressor_ && compressor_->Begin(chunk_id, path, false).compressed) {
+        compressor_->End(chunk_id, false);
+        return;
+    }
+    const uint64_t token = block_cache_->FillToken(chunk_id);
+    std::string buf;
+    auto res = io_engine_->Read(chunk_id, path, first * bs, static_cast<size_t>((last + 1 - first) * bs), buf,
+                                O_RDONLY);
+    if (compressor_) {
+        compressor_->End(chunk_id, false);
+    }
+    if (res.bytes <= 0 || res.err != 0) {
+        return;
+    }
+    for (size_t pos = 0; pos < buf.size(); pos += bs) {
+        const uint64_t index = first + pos / bs;
+        if (!block_cache_->Contains(chunk_id, index)) {
+            block_cache_->Insert(chunk_id, index, buf.substr(pos, bs), token);
+        }
+    }
+}
+
+// Small chunks live in the container store until they outgrow it; chunks
+// that already have their own file never move back.
+bool StorageServiceImpl::UseContainer(uint64_t chunk_id) const {
+    if (!container_store_) {
+        return false;
+    }
+    return container_store_->Contains(chunk_id) || !metadata_mgr_->HasPath(chunk_id);
+}
+
+bool StorageServiceImpl::MigrateToFile(uint64_t chunk_id) {
+    if (!container_store_->Contains(chunk_id)) {
+        return true;
+    }
+    std::string path = metadata_mgr_->AllocPath(chunk_id);
+    if (path.empty()) {
+        return false;
+    }
+    std::cout << "[RealNode] migrating chunk=" << chunk_id << " from container to " << path << std::endl;
+    if (!container_store_->ExportToFile(chunk_id, path)) {
+        return false;
+    }
+    if (checksums_ && !checksums_->Rebuild(chunk_id, path)) {
+        std::cerr << "[RealNode] checksum rebuild failed chunk=" << chunk_id << std::endl;
+    }
+    return true;
+}
+
+void StorageServiceImpl::ReadFile(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length,
+                                  std::string* out, int flags, IOEngine::Callback cb) {
+    if (!compressor_) {
+        io_engine_->AsyncRead(chunk_id, path, offset, length, out, flags, std::move(cb));
+        return;
+    }
+    if (compressor_->Begin(chunk_id, path, false).compressed) {
+        auto res = compressor_->Read(chunk_id, path, offset, length, out);
+        compressor_->End(chunk_id, false);
+        cb(res);
+        return;
+    }
+    io_engine_->AsyncRead(chunk_id, path, offset, length, out, flags,
+                          [this, chunk_id, cb = std::move(cb)](const IOEngine::Result& res) {
+                              compressor_->End(chunk_id, false);
+                              cb(res);
+                          });
+}
+
+// A compressed chunk has nothing reserved, and holding it keeps the trim's
+// look at the file's end clear of an expansion.
+Preallocator::TrimResult StorageServiceImpl::TrimReserved(uint64_t chunk_id, const std::string& path) {
+    if (!compressor_) {
+        return preallocator_->Trim(chunk_id, path);
+    }
+    Preallocator::TrimResult res;
+    if (!compressor_->Begin(chunk_id, path, false).compressed) {
+        res = preallocator_->Trim(chunk_id, path);
+    }
+    compressor_->End(chunk_id, false);
+    return res;
+}
+
+ChunkCompressor::Result StorageServiceImpl::CompressOnDisk(uint64_t chunk_id, const std::string& path,
+                                                           ChunkCompressor::Codec codec) {
+    auto res = compressor_->Compress(chunk_id, path, codec);
+    if (res.err != 0) {
+        // EBUSY: written meanwhile; it is idle again before the next sweep
+        if (res.err != EBUSY) {
+            std::cerr << "[RealNode] compress failed chunk=" << chunk_id << " codec="
+                      << ChunkCompressor::CodecName(codec) << ": " << std::strerror(res.err) << std::endl;
+        }
+        return res;
+    }
+    std::cout << "[RealNode] CompressChunk chunk=" << chunk_id << " codec=" << ChunkCompressor::CodecName(res.codec)
+              << " raw=" << res.raw_bytes << " stored=" << res.stored_bytes << std::endl;
+    return res;
+}
+
+bool StorageServiceImpl::RunOnDisk(uint64_t chunk_id, std::function<void()> io,
+                                   storagenode::IOClass io_class, uint64_t bytes) {
+    if (!disk_scheduler_) {
+        io();
+        return true;
+    }
+    const int root = metadata_mgr_->RootOf(chunk_id);
+    return disk_scheduler_->Submit(root < 0 ? 0 : static_cast<size_t>(root), std::move(io),
+                                   SchedulerClass(io_class), bytes);
+}
+
+bool StorageServiceImpl::RunOnDiskAsync(uint64_t chunk_id, std::function<void(DiskScheduler::Done)> io,
+                                        storagenode::IOClass io_class, uint64_t bytes) {
+    if (!disk_scheduler_) {
+        io([]() {});
+        return true;
+    }
+    const int root = metadata_mgr_->RootOf(chunk_id);
+    return disk_scheduler_->SubmitAsync(root < 0 ? 0 : static_cast<size_t>(root), std::move(io),
+                                        SchedulerClass(io_class), bytes);
+}
+
+// Serves a read from cached blocks when every block in range is present;
+// otherwise reads the enclosing block-aligned range, caches it and replies
+// from the new blocks.
+void StorageServiceImpl::ReadThroughCache(const storagenode::ReadRequest* request,
+                                          storagenode::ReadReply* response,
+                                          ::google::protobuf::Closure* done,
+                                          const std::string& path,
+                                          int flags) {
+    const uint64_t bs = block_cache_->block_size();
+    const uint64_t chunk_id = request->chunk_id();
+    const uint64_t offset = request->offset();
+    const uint64_t end = offset + request->length();
+    const uint64_t first = offset / bs;
+    const uint64_t last = end > offset ? (end - 1) / bs : first;
+
+    std::vector<BlockCache::BlockPtr> blocks;
+    bool complete = false;
+    for (uint64_t i = first; i <= last; ++i) {
+        BlockCache::BlockPtr block = block_cache_->Lookup(chunk_id, i);
+        if (!block) {
+            break;
+        }
+        blocks.push_back(std::move(block));
+        if (blocks.back()->data.size() < bs || i == last) {
+            complete = true;  // reached EOF or the end of the request
+            break;
+        }
+    }
+    if (complete) {
+        FinishCachedRead(request, response, done, blocks, first);
+        return;
+    }
+
+    auto fill = std::make_shared<std::string>();
+    const uint64_t token = block_cache_->FillToken(chunk_id);
+    auto on_done = [this, request, response, done, fill, token, first, bs](const IOEngine::Result& res) {
+        if (res.bytes < 0 || res.err != 0) {
+            brpc::ClosureGuard done_guard(done);
+            int err = res.err != 0 ? res.err : EIO;
+            StatusUtils::SetStatus(response->mutable_status(), StatusUtils::FromErrno(err),
+                                   res.err != 0 ? std::strerror(err) : "read failed");
+            return;
+        }
+        std::vector<BlockCache::BlockPtr> filled;
+        for (size_t pos = 0; pos < fill->size(); pos += bs) {
+            filled.push_back(block_cache_->Insert(request->chunk_id(), first + pos / bs,
+                                                  fill->substr(pos, bs), token));
+        }
+        FinishCachedRead(request, response, done, filled, first);
+    };
+    auto io = [this, chunk_id, path, first, last, bs, fill, flags, on_done](DiskScheduler::Done disk_done) mutable {
+        ReadFile(chunk_id, path, first * bs, static_cast<size_t>((last + 1 - first) * bs), fill.get(), flags,
+                 [on_done = std::move(on_done), disk_done](const IOEngine::Result& res) {
+                     disk_done();
+                     on_done(res);
+                 });
+    };
+    if (!RunOnDiskAsync(chunk_id, std::move(io), request->io_class(), (last + 1 - first) * bs)) {
+        ReplyDiskBusy(response->mutable_status(), done);
+    }
+}
+
+// Copies the requested slice out of the blocks. Whole blocks contribute their
+// cached crc; only partial head/tail slices are hashed.
+void StorageServiceImpl::FinishCachedRead(const storagenode::ReadRequest* request,
+                                          storagenode::ReadReply* response,
+                                          ::google::protobuf::Closure* done,
+                                          const std::vector<BlockCache::BlockPtr>& blocks,
+                                          uint64_t first_block) {
+    brpc::ClosureGuard done_guard(done);
+    const uint64_t bs = block_cache_->block_size();
+    const uint64_t offset = request->offset();
+    const uint64_t end = offset + request->length();
+    std::string* out = response->mutable_data();
+    out->clear();
+    uint32_t crc = 0;
+    for (size_t k = 0; k < blocks.size(); ++k) {
+        const std::string& data = blocks[k]->data;
+        const uint64_t block_start = (first_block + k) * bs;
+        const uint64_t lo = std::max(offset, block_start);
+        const uint64_t hi = std::min(end, block_start + data.size());
+        if (hi <= lo) {
+            break;
+        }
+        const char* p = data.data() + (lo - block_start);
+        const size_t n = static_cast<size_t>(hi - lo);
+        if (n == bs) {
+            crc = block_cache_->CombineFullBlock(crc, blocks[k]->crc);
+        } else {
+            crc = butil::crc32c::Extend(crc, p, n);
+        }
+        out->append(p, n);
+    }
+    response->set_bytes_read(out->size());
+    response->set_checksum(crc);
+    Ok(response->mutable_status());
+    std::cout << "[RealNode] ReadResp chunk=" << request->chunk_id()
+              << " bytes=" << response->bytes_read()
+              << " code=" << response->status().code() << std::endl;
+}
+
 uint64_t StorageServiceImpl::ComputeChecksum(const void* data, size_t len) const {
     return butil::crc32c::Value(static_cast<const char*>(data), len);
 }
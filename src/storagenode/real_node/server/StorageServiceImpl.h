@@ -1,20 +1,33 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "storage_node.pb.h"
 #include "common/StatusUtils.h"
+#include "../io/BlockCache.h"
+#include "../io/ChecksumStore.h"
+#include "../io/ChunkCompressor.h"
+#include "../io/ContainerStore.h"
 #include "../io/DiskManager.h"
+#include "../io/DiskScheduler.h"
 #include "../io/IOEngine.h"
+#include "../io/Preallocator.h"
+#include "../io/Readahead.h"
+#include "../io/SparseFile.h"
 #include "../meta/LocalMetadataManager.h"
 
 class StorageServiceImpl : public storagenode::StorageService {
 public:
     StorageServiceImpl(std::shared_ptr<DiskManager> disk_manager,
                        std::shared_ptr<LocalMetadataManager> metadata_mgr,
-                       std::shared_ptr<IOEngine> io_engine);
+                       std::shared_ptr<IOEngine> io_engine,
+                       std::shared_ptr<ContainerStore> container_store = nullptr,
+                       std::shared_ptr<BlockCache> block_cache = nullptr,
+                       std::shared_ptr<DiskScheduler> disk_scheduler = nullptr);
 
     void Write(::google::protobuf::RpcController* controller,
                const storagenode::WriteRequest* request,
@@ -31,16 +44,103 @@ public:
                   storagenode::TruncateReply* response,
                   ::google::protobuf::Closure* done) override;
 
+    void GetExtents(::google::protobuf::RpcController* controller,
+                    const storagenode::GetExtentsRequest* request,
+                    storagenode::GetExtentsReply* response,
+                    ::google::protobuf::Closure* done) override;
+
+    void TrimChunk(::google::protobuf::RpcController* controller,
+                   const storagenode::TrimChunkRequest* request,
+                   storagenode::TrimChunkReply* response,
+                   ::google::protobuf::Closure* done) override;
+
+    void CompressChunk(::google::protobuf::RpcController* controller,
+                       const storagenode::CompressChunkRequest* request,
+                       storagenode::CompressChunkReply* response,
+                       ::google::protobuf::Closure* done) override;
+
     void UnmountDisk(::google::protobuf::RpcController* controller,
                      const storagenode::UnmountRequest* request,
                      storagenode::UnmountReply* response,
                      ::google::protobuf::Closure* done) override;
 
+    void OpenReadStream(::google::protobuf::RpcController* controller,
+                        const storagenode::OpenStreamRequest* request,
+                        storagenode::OpenStreamReply* response,
+                        ::google::protobuf::Closure* done) override;
+
+    void OpenWriteStream(::google::protobuf::RpcController* controller,
+                         const storagenode::OpenStreamRequest* request,
+                         storagenode::OpenStreamReply* response,
+                         ::google::protobuf::Closure* done) override;
+
+    void ReadV(::google::protobuf::RpcController* controller,
+               const storagenode::ReadVRequest* request,
+               storagenode::ReadVReply* response,
+               ::google::protobuf::Closure* done) override;
+
+    void WriteV(::google::protobuf::RpcController* controller,
+                const storagenode::WriteVRequest* request,
+                storagenode::WriteVReply* response,
+                ::google::protobuf::Closure* done) override;
+
+    // Detect sequential reads per chunk and prefetch ahead of them, into the
+    // block cache when there is one and the page cache otherwise.
+    void EnableReadahead(const ReadaheadManager::Options& opts);
+    // Keep per-block crc32c sidecars for file-backed chunks; read replies
+    // then combine stored crcs instead of hashing the whole payload.
+    void EnableChecksums(std::shared_ptr<ChecksumStore> checksums);
+    // Reserve space for file-backed chunks ahead of their writes, from the
+    // writers' size hints or speculative growth windows; TrimChunk and an
+    // idle sweep give back what is left past the end.
+    void EnablePreallocation(const Preallocator::Options& opts);
+    Preallocator::Stats PreallocStats() const;
+    // Compress file-backed chunks block by block: idle ones with the warm
+    // codec, long-idle ones with the cold codec, any one on CompressChunk.
+    void EnableCompression(const ChunkCompressor::Options& opts);
+    ChunkCompressor::Stats CompressionStats() const;
+
 private:
     uint64_t ComputeChecksum(const void* data, size_t len) const;
+    bool UseContainer(uint64_t chunk_id) const;
+    void Prefetch(uint64_t chunk_id, const std::string& path, uint64_t offset, uint64_t length);
+    bool MigrateToFile(uint64_t chunk_id);
+    // Reads a file-backed chunk, decompressing it if it is compressed.
+    void ReadFile(uint64_t chunk_id, const std::string& path, uint64_t offset, size_t length, std::string* out,
+                  int flags, IOEngine::Callback cb);
+    Preallocator::TrimResult TrimReserved(uint64_t chunk_id, const std::string& path);
+    ChunkCompressor::Result CompressOnDisk(uint64_t chunk_id, const std::string& path,
+                                           ChunkCompressor::Codec codec);
+    // Runs io on the queue of the disk holding the chunk, or inline without a
+    // scheduler. Returns false, without running io, when that queue is full.
+    bool RunOnDisk(uint64_t chunk_id, std::function<void()> io,
+                   storagenode::IOClass io_class = storagenode::IO_CLASS_FOREGROUND, uint64_t bytes = 0);
+    // For io that only starts an async engine call: it keeps the disk slot
+    // until it calls the token from the engine callback.
+    bool RunOnDiskAsync(uint64_t chunk_id, std::function<void(DiskScheduler::Done)> io,
+                        storagenode::IOClass io_class = storagenode::IO_CLASS_FOREGROUND, uint64_t bytes = 0);
+    void ReadThroughCache(const storagenode::ReadRequest* request,
+                          storagenode::ReadReply* response,
+                          ::google::protobuf::Closure* done,
+                          const std::string& path,
+                          int flags);
+    void FinishCachedRead(const storagenode::ReadRequest* request,
+                          storagenode::ReadReply* response,
+                          ::google::protobuf::Closure* done,
+                          const std::vector<BlockCache::BlockPtr>& blocks,
+                          uint64_t first_block);
 
     std::shared_ptr<DiskManager> disk_manager_;
     std::shared_ptr<LocalMetadataManager> metadata_mgr_;
     std::shared_ptr<IOEngine> io_engine_;
+    std::shared_ptr<ContainerStore> container_store_;
+    std::shared_ptr<BlockCache> block_cache_;
+    std::shared_ptr<DiskScheduler> disk_scheduler_;
+    std::shared_ptr<ChecksumStore> checksums_;
     bool ready_{false};
+    // Last members: their workers call back into the engine and cache above,
+    // and readahead and trims into the compressor.
+    std::unique_ptr<ChunkCompressor> compressor_;
+    std::unique_ptr<ReadaheadManager> readahead_;
+    std::unique_ptr<Preallocator> preallocator_;
 };
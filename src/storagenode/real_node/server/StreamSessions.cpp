@@ -0,0 +1,199 @@
+#include "StreamSessions.h"
+
+#include <brpc/controller.h>
+#include <bthread/bthread.h>
+#include <butil/time.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "StorageServiceImpl.h"
+#include "common/ChunkStream.h"
+
+namespace {
+
+constexpr uint64_t kDefaultBlock = 1u << 20;
+constexpr uint64_t kMinBlock = 4096;
+constexpr uint64_t kMaxBlock = 8u << 20;
+// How long a sender waits for window space, and for the client to close
+// after the end frame.
+constexpr int kSendTimeoutMs = 30000;
+
+// Lets a bthread wait for a service call that completes asynchronously.
+class BlockingClosure : public ::google::protobuf::Closure {
+public:
+    void Run() override { event_.signal(); }
+    void Wait() { event_.wait(); }
+
+private:
+    bthread::CountdownEvent event_{1};
+};
+
+} // namespace
+
+ReadStreamSession::ReadStreamSession(StorageServiceImpl* service, const storagenode::OpenStreamRequest& request)
+    : service_(service), request_(request) {}
+
+void ReadStreamSession::Start(brpc::StreamId id) {
+    id_ = id;
+    bthread_t tid;
+    if (bthread_start_background(&tid, nullptr, RunThunk, this) != 0) {
+        RunThunk(this);
+    }
+}
+
+void* ReadStreamSession::RunThunk(void* arg) {
+    auto* self = static_cast<ReadStreamSession*>(arg);
+    self->Run();
+    self->Unref();
+    return nullptr;
+}
+
+void ReadStreamSession::Run() {
+    const uint64_t block = std::min(kMaxBlock, std::max(kMinBlock, request_.block_size() == 0
+                                                                       ? kDefaultBlock
+                                                                       : static_cast<uint64_t>(request_.block_size())));
+    uint64_t offset = request_.offset();
+    const uint64_t end = request_.length() == 0 ? UINT64_MAX : offset + request_.length();
+    int32_t code = rpc::STATUS_SUCCESS;
+    while (offset < end && !closed_.load(std::memory_order_relaxed)) {
+        storagenode::ReadRequest rq;
+        rq.set_chunk_id(request_.chunk_id());
+        rq.set_offset(offset);
+        rq.set_length(std::min(block, end - offset));
+        rq.set_flags(request_.flags());
+        rq.set_io_class(request_.io_class());
+        rq.set_wire_version(storagenode::WIRE_ATTACHMENT);
+        storagenode::ReadReply rp;
+        brpc::Controller cntl;
+        BlockingClosure done;
+        service_->Read(&cntl, &rq, &rp, &done);
+        done.Wait();
+        if (rp.status().code() != rpc::STATUS_SUCCESS) {
+            code = rp.status().code();
+            break;
+        }
+        const uint64_t n = rp.bytes_read();
+        if (n == 0) {
+            break;
+        }
+        butil::IOBuf msg;
+        ChunkStream::AppendHeader(ChunkStream::Frame{offset, static_cast<uint32_t>(n), 0}, &msg);
+        msg.append(cntl.response_attachment());
+        if (!ChunkStream::Send(id_, msg, kSendTimeoutMs)) {
+            std::cerr << "[RealNode] read stream chunk=" << request_.chunk_id() << " dropped at offset=" << offset
+                      << std::endl;
+            brpc::StreamClose(id_);
+            return;
+        }
+        offset += n;
+        if (n < rq.length()) {
+            break;  // end of chunk
+        }
+    }
+    butil::IOBuf end_frame;
+    ChunkStream::AppendHeader(ChunkStream::Frame{offset, 0, code}, &end_frame);
+    if (!closed_.load(std::memory_order_relaxed) && ChunkStream::Send(id_, end_frame, kSendTimeoutMs)) {
+        // the client closes once it has the end frame
+        const timespec due = butil::milliseconds_from_now(kSendTimeoutMs);
+        closed_event_.timed_wait(due);
+    }
+    brpc::StreamClose(id_);
+}
+
+void ReadStreamSession::Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+int ReadStreamSession::on_received_messages(brpc::StreamId, butil::IOBuf* const[], size_t) {
+    return 0;
+}
+
+void ReadStreamSession::on_idle_timeout(brpc::StreamId) {}
+
+void ReadStreamSession::on_closed(brpc::StreamId) {
+    closed_.store(true, std::memory_order_relaxed);
+    closed_event_.signal();
+    Unref();
+}
+
+WriteStreamSession::WriteStreamSession(StorageServiceImpl* service, const storagenode::OpenStreamRequest& request)
+    : service_(service), request_(request) {}
+
+int WriteStreamSession::on_received_messages(brpc::StreamId id, butil::IOBuf* const messages[], size_t size) {
+    struct Pending {
+        storagenode::WriteRequest request;
+        storagenode::WriteReply reply;
+        brpc::Controller cntl;
+        BlockingClosure done;
+    };
+    std::vector<std::unique_ptr<Pending>> pending;
+    bool end = false;
+    for (size_t i = 0; i < size && !end; ++i) {
+        ChunkStream::Frame frame;
+        if (!ChunkStream::CutHeader(messages[i], &frame) || messages[i]->size() != frame.length) {
+            code_ = code_ != 0 ? code_ : rpc::STATUS_INVALID_ARGUMENT;
+            continue;
+        }
+        if (frame.length == 0) {
+            end = true;
+            continue;
+        }
+        if (code_ != 0) {
+            continue;  // already failed; drop the rest until the client stops
+        }
+        auto p = std::make_unique<Pending>();
+        p->request.set_chunk_id(request_.chunk_id());
+        p->request.set_offset(frame.offset);
+        p->request.set_flags(request_.flags());
+        p->request.set_mode(request_.mode());
+        p->request.set_io_class(request_.io_class());
+        p->request.set_size_hint(request_.size_hint());
+        p->request.set_wire_version(storagenode::WIRE_ATTACHMENT);
+        p->cntl.request_attachment().swap(*messages[i]);
+        service_->Write(&p->cntl, &p->request, &p->reply, &p->done);
+        pending.push_back(std::move(p));
+    }
+    for (auto& p : pending) {
+        p->done.Wait();
+        if (p->reply.status().code() != rpc::STATUS_SUCCESS) {
+            if (code_ == 0) {
+                code_ = p->reply.status().code();
+                std::cerr << "[RealNode] write stream chunk=" << request_.chunk_id()
+                          << " failed at offset=" << p->request.offset() << ": " << p->reply.status().message()
+                          << std::endl;
+            }
+        } else {
+            written_ += p->reply.bytes_written();
+        }
+    }
+    if (end || code_ != 0) {
+        SendEnd(id);
+    }
+    return 0;
+}
+
+void WriteStreamSession::SendEnd(brpc::StreamId id) {
+    if (end_sent_) {
+        return;
+    }
+    end_sent_ = true;
+    butil::IOBuf msg;
+    ChunkStream::AppendHeader(ChunkStream::Frame{request_.offset() + written_, 0, code_}, &msg);
+    if (!ChunkStream::Send(id, msg, kSendTimeoutMs)) {
+        brpc::StreamClose(id);
+    }
+}
+
+void WriteStreamSession::on_idle_timeout(brpc::StreamId id) {
+    // the client went quiet without ending the stream
+    brpc::StreamClose(id);
+}
+
+void WriteStreamSession::on_closed(brpc::StreamId) {
+    delete this;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <brpc/stream.h>
+#include <bthread/countdown_event.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "storage_node.pb.h"
+
+class StorageServiceImpl;
+
+// Node side of OpenReadStream. A bthread reads the range one block at a
+// time through the service's Read, so the block cache, readahead and disk
+// queues apply as for unary reads, and sends each block as a frame; the
+// stream's window stops it while the client lags. Frees itself once the
+// sender has finished and the stream is closed.
+class ReadStreamSession : public brpc::StreamInputHandler {
+public:
+    ReadStreamSession(StorageServiceImpl* service, const storagenode::OpenStreamRequest& request);
+
+    // Call after the OpenReadStream reply has been sent.
+    void Start(brpc::StreamId id);
+
+    int on_received_messages(brpc::StreamId id, butil::IOBuf* const messages[], size_t size) override;
+    void on_idle_timeout(brpc::StreamId id) override;
+    void on_closed(brpc::StreamId id) override;
+
+private:
+    static void* RunThunk(void* arg);
+    void Run();
+    void Unref();
+
+    StorageServiceImpl* service_;
+    storagenode::OpenStreamRequest request_;
+    brpc::StreamId id_{brpc::INVALID_STREAM_ID};
+    std::atomic<bool> closed_{false};
+    bthread::CountdownEvent closed_event_{1};
+    std::atomic<int> refs_{2};  // sender + stream
+};
+
+// Node side of OpenWriteStream. Each batch of frames is written through the
+// service's Write in parallel and the batch is only consumed once all of it
+// is on disk, which is what holds the client to the stream window. The first
+// failure is reported at once in an end frame; the client's end frame is
+// answered with the bytes written. Frees itself when the stream closes.
+class WriteStreamSession : public brpc::StreamInputHandler {
+public:
+    WriteStreamSession(StorageServiceImpl* service, const storagenode::OpenStreamRequest& request);
+
+    int on_received_messages(brpc::StreamId id, butil::IOBuf* const messages[], size_t size) override;
+    void on_idle_timeout(brpc::StreamId id) override;
+    void on_closed(brpc::StreamId id) override;
+
+private:
+    void SendEnd(brpc::StreamId id);
+
+    StorageServiceImpl* service_;
+    storagenode::OpenStreamRequest request_;
+    int32_t code_{0};
+    uint64_t written_{0};
+    bool end_sent_{false};
+};
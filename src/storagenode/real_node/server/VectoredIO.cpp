@@ -0,0 +1,308 @@
+#include "VectoredIO.h"
+
+#include <brpc/closure_guard.h>
+#include <butil/crc32c.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <utility>
+
+#include "StorageServiceImpl.h"
+#include "common/StatusUtils.h"
+
+namespace {
+
+// brpc's default body limit; a vector never asks for more in either direction.
+constexpr uint64_t kMaxTotalBytes = 64u << 20;
+
+// Runs a planned vector, keeping up to kMaxInflight groups in flight, and
+// calls Finish once every group has completed. Frees itself afterwards.
+class VectorCall {
+public:
+    explicit VectorCall(std::vector<VectoredIO::Group> groups) : groups_(std::move(groups)) {}
+    virtual ~VectorCall() = default;
+
+    // Starts as many groups as the limit allows. Completions that arrive
+    // while another thread is pumping are picked up by that thread.
+    void Pump() {
+        std::unique_lock<std::mutex> lk(mu_);
+        if (pumping_) {
+            return;
+        }
+        pumping_ = true;
+        while (next_ < groups_.size() && inflight_ < VectoredIO::kMaxInflight) {
+            const size_t g = next_++;
+            ++inflight_;
+            lk.unlock();
+            StartGroup(g);
+            lk.lock();
+        }
+        pumping_ = false;
+        const bool finish = !finished_ && next_ == groups_.size() && inflight_ == 0;
+        finished_ = finished_ || finish;
+        lk.unlock();
+        if (finish) {
+            Finish();
+            delete this;
+        }
+    }
+
+    void OnGroupDone() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            --inflight_;
+        }
+        Pump();
+    }
+
+protected:
+    virtual void StartGroup(size_t g) = 0;
+    virtual void Finish() = 0;
+
+    std::vector<VectoredIO::Group> groups_;
+
+private:
+    std::mutex mu_;
+    size_t next_{0};
+    size_t inflight_{0};
+    bool pumping_{false};
+    bool finished_{false};
+};
+
+// One group's call into the service; its completion reports back to the vector.
+template <typename Request, typename Reply>
+struct GroupOp : public ::google::protobuf::Closure {
+    VectorCall* call{nullptr};
+    Request request;
+    Reply reply;
+
+    void Run() override { call->OnGroupDone(); }
+};
+
+class ReadVCall : public VectorCall {
+public:
+    ReadVCall(StorageServiceImpl* service, brpc::Controller* cntl, const storagenode::ReadVRequest* request,
+              storagenode::ReadVReply* response, ::google::protobuf::Closure* done,
+              std::vector<VectoredIO::Group> groups)
+        : VectorCall(std::move(groups)), service_(service), cntl_(cntl), request_(request), response_(response),
+          done_(done) {
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            ops_.push_back(std::make_unique<Op>());
+            ops_.back()->call = this;
+        }
+    }
+
+private:
+    using Op = GroupOp<storagenode::ReadRequest, storagenode::ReadReply>;
+
+    void StartGroup(size_t g) override {
+        Op* op = ops_[g].get();
+        op->request.set_chunk_id(groups_[g].chunk_id);
+        op->request.set_offset(groups_[g].offset);
+        op->request.set_length(groups_[g].length);
+        op->request.set_flags(request_->flags());
+        op->request.set_io_class(request_->io_class());
+        service_->Read(nullptr, &op->request, &op->reply, op);
+    }
+
+    void Finish() override {
+        brpc::ClosureGuard guard(done_);
+        const auto& extents = request_->extents();
+        // where each extent's bytes sit in its group's reply
+        std::vector<std::pair<size_t, uint64_t>> source(static_cast<size_t>(extents.size()));
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            for (size_t m : groups_[g].members) {
+                source[m] = {g, extents[static_cast<int>(m)].offset() - groups_[g].offset};
+            }
+        }
+        for (int i = 0; i < extents.size(); ++i) {
+            const auto& [g, start] = source[static_cast<size_t>(i)];
+            const storagenode::ReadReply& rep = ops_[g]->reply;
+            auto* result = response_->add_results();
+            result->mutable_status()->CopyFrom(rep.status());
+            if (rep.status().code() != rpc::STATUS_SUCCESS) {
+                continue;
+            }
+            const uint64_t got = rep.bytes_read();
+            const uint64_t n = start < got ? std::min<uint64_t>(extents[i].length(), got - start) : 0;
+            const char* data = rep.data().data() + start;
+            result->set_bytes(n);
+            if (n == got) {
+                result->set_checksum(rep.checksum());  // the extent is the whole group
+            } else {
+                result->set_checksum(butil::crc32c::Value(data, static_cast<size_t>(n)));
+            }
+            cntl_->response_attachment().append(data, static_cast<size_t>(n));
+        }
+        StatusUtils::SetStatus(response_->mutable_status(), rpc::STATUS_SUCCESS, "");
+    }
+
+    StorageServiceImpl* service_;
+    brpc::Controller* cntl_;
+    const storagenode::ReadVRequest* request_;
+    storagenode::ReadVReply* response_;
+    ::google::protobuf::Closure* done_;
+    std::vector<std::unique_ptr<Op>> ops_;
+};
+
+class WriteVCall : public VectorCall {
+public:
+    WriteVCall(StorageServiceImpl* service, std::string payload, const storagenode::WriteVRequest* request,
+               storagenode::WriteVReply* response, ::google::protobuf::Closure* done,
+               std::vector<VectoredIO::Group> groups)
+        : VectorCall(std::move(groups)), service_(service), payload_(std::move(payload)), request_(request),
+          response_(response), done_(done) {
+        uint64_t pos = 0;
+        for (const auto& e : request_->extents()) {
+            payload_pos_.push_back(pos);
+            pos += e.length();
+        }
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            ops_.push_back(std::make_unique<Op>());
+            ops_.back()->call = this;
+        }
+    }
+
+private:
+    using Op = GroupOp<storagenode::WriteRequest, storagenode::WriteReply>;
+
+    void StartGroup(size_t g) override {
+        Op* op = ops_[g].get();
+        std::string* data = op->request.mutable_data();
+        data->reserve(static_cast<size_t>(groups_[g].length));
+        for (size_t m : groups_[g].members) {
+            data->append(payload_, static_cast<size_t>(payload_pos_[m]),
+                         static_cast<size_t>(request_->extents(static_cast<int>(m)).length()));
+        }
+        op->request.set_chunk_id(groups_[g].chunk_id);
+        op->request.set_offset(groups_[g].offset);
+        op->request.set_flags(request_->flags());
+        op->request.set_mode(request_->mode());
+        op->request.set_io_class(request_->io_class());
+        service_->Write(nullptr, &op->request, &op->reply, op);
+    }
+
+    void Finish() override {
+        brpc::ClosureGuard guard(done_);
+        const auto& extents = request_->extents();
+        for (int i = 0; i < extents.size(); ++i) {
+            response_->add_results();
+        }
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            const storagenode::WriteReply& rep = ops_[g]->reply;
+            const bool ok = rep.status().code() == rpc::STATUS_SUCCESS;
+            for (size_t m : groups_[g].members) {
+                const int i = static_cast<int>(m);
+                auto* result = response_->mutable_results(i);
+                result->mutable_status()->CopyFrom(rep.status());
+                const uint64_t start = extents[i].offset() - groups_[g].offset;
+                const uint64_t written = rep.bytes_written();
+                if (ok && start < written) {
+                    result->set_bytes(std::min<uint64_t>(extents[i].length(), written - start));
+                }
+            }
+        }
+        StatusUtils::SetStatus(response_->mutable_status(), rpc::STATUS_SUCCESS, "");
+    }
+
+    StorageServiceImpl* service_;
+    std::string payload_;
+    std::vector<uint64_t> payload_pos_;  // start of each extent's bytes in payload_
+    const storagenode::WriteVRequest* request_;
+    storagenode::WriteVReply* response_;
+    ::google::protobuf::Closure* done_;
+    std::vector<std::unique_ptr<Op>> ops_;
+};
+
+// Shared request checks; false leaves status describing the problem.
+bool CheckVector(const google::protobuf::RepeatedPtrField<storagenode::IoExtent>& extents,
+                 brpc::Controller* cntl, rpc::Status* status) {
+    if (!cntl) {
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "vectored calls need an rpc controller");
+        return false;
+    }
+    if (static_cast<size_t>(extents.size()) > VectoredIO::kMaxExtents) {
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "too many extents");
+        return false;
+    }
+    uint64_t total = 0;
+    for (const auto& e : extents) {
+        total += e.length();
+    }
+    if (total > kMaxTotalBytes) {
+        StatusUtils::SetStatus(status, rpc::STATUS_INVALID_ARGUMENT, "vector too large");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<VectoredIO::Group> VectoredIO::Plan(
+    const google::protobuf::RepeatedPtrField<storagenode::IoExtent>& extents, bool merge_overlaps,
+    uint64_t max_bytes) {
+    std::vector<size_t> order(static_cast<size_t>(extents.size()));
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&extents](size_t a, size_t b) {
+        const auto& x = extents[static_cast<int>(a)];
+        const auto& y = extents[static_cast<int>(b)];
+        return x.chunk_id() != y.chunk_id() ? x.chunk_id() < y.chunk_id() : x.offset() < y.offset();
+    });
+    std::vector<Group> groups;
+    for (size_t idx : order) {
+        const auto& e = extents[static_cast<int>(idx)];
+        if (!groups.empty()) {
+            Group& g = groups.back();
+            const uint64_t g_end = g.offset + g.length;
+            const bool touches = merge_overlaps ? e.offset() <= g_end : e.offset() == g_end;
+            const uint64_t end = std::max(g_end, e.offset() + e.length());
+            if (g.chunk_id == e.chunk_id() && touches && end - g.offset <= max_bytes) {
+                g.length = end - g.offset;
+                g.members.push_back(idx);
+                continue;
+            }
+        }
+        groups.push_back(Group{e.chunk_id(), e.offset(), e.length(), {idx}});
+    }
+    return groups;
+}
+
+void VectoredIO::ReadV(StorageServiceImpl* service, brpc::Controller* cntl, const storagenode::ReadVRequest* request,
+                       storagenode::ReadVReply* response, google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    if (!CheckVector(request->extents(), cntl, response->mutable_status())) {
+        return;
+    }
+    auto groups = Plan(request->extents(), true, kMaxMergedBytes);
+    std::cout << "[RealNode] ReadV extents=" << request->extents_size() << " ios=" << groups.size() << std::endl;
+    auto* call = new ReadVCall(service, cntl, request, response, guard.release(), std::move(groups));
+    call->Pump();
+}
+
+void VectoredIO::WriteV(StorageServiceImpl* service, brpc::Controller* cntl,
+                        const storagenode::WriteVRequest* request, storagenode::WriteVReply* response,
+                        google::protobuf::Closure* done) {
+    brpc::ClosureGuard guard(done);
+    if (!CheckVector(request->extents(), cntl, response->mutable_status())) {
+        return;
+    }
+    uint64_t total = 0;
+    for (const auto& e : request->extents()) {
+        total += e.length();
+    }
+    if (cntl->request_attachment().size() != total) {
+        StatusUtils::SetStatus(response->mutable_status(), rpc::STATUS_INVALID_ARGUMENT,
+                               "attachment does not match the extent lengths");
+        return;
+    }
+    std::string payload;
+    cntl->request_attachment().copy_to(&payload);
+    auto groups = Plan(request->extents(), false, kMaxMergedBytes);
+    std::cout << "[RealNode] WriteV extents=" << request->extents_size() << " ios=" << groups.size() << std::endl;
+    auto* call = new WriteVCall(service, std::move(payload), request, response, guard.release(), std::move(groups));
+    call->Pump();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <brpc/controller.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "storage_node.pb.h"
+
+class StorageServiceImpl;
+
+// Node side of ReadV/WriteV. Extents are sorted by chunk and offset and runs
+// that touch are merged into one Read/Write of the service, so the cache,
+// disk queues and checksums apply as for unary calls. Merged IOs run in
+// parallel, a bounded number at a time so one large vector does not fill the
+// disk queues on its own; every extent gets the status of the IO carrying it.
+class VectoredIO {
+public:
+    static constexpr size_t kMaxExtents = 4096;
+    static constexpr uint64_t kMaxMergedBytes = 4u << 20;
+    static constexpr size_t kMaxInflight = 32;
+
+    struct Group {
+        uint64_t chunk_id{0};
+        uint64_t offset{0};
+        uint64_t length{0};
+        std::vector<size_t> members;  // extent indexes, by offset
+    };
+
+    // Reads may also merge overlapping extents; writes only merge extents
+    // that follow each other exactly.
+    static std::vector<Group> Plan(const google::protobuf::RepeatedPtrField<storagenode::IoExtent>& extents,
+                                   bool merge_overlaps, uint64_t max_bytes);
+
+    static void ReadV(StorageServiceImpl* service, brpc::Controller* cntl, const storagenode::ReadVRequest* request,
+                      storagenode::ReadVReply* response, google::protobuf::Closure* done);
+    static void WriteV(StorageServiceImpl* service, brpc::Controller* cntl, const storagenode::WriteVRequest* request,
+                       storagenode::WriteVReply* response, google::protobuf::Closure* done);
+};
@@ -1,13 +1,24 @@
 #include <brpc/server.h>
+#include <bvar/bvar.h>
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include "StorageServiceImpl.h"
+#include "../io/BlockCache.h"
+#include "../io/ChecksumStore.h"
+#include "../io/ContainerStore.h"
 #include "../io/DiskManager.h"
+#include "../io/DiskScheduler.h"
 #include "../io/IOEngine.h"
+#include "../io/Preallocator.h"
+#include "../io/Scrubber.h"
 #include "../meta/LocalMetadataManager.h"
 #include "../agent/NodeAgent.h"
 #include "common/LogRedirect.h"
@@ -18,8 +29,62 @@ DEFINE_string(mount_point, "/tmp/realnode_disk", "Mount point or existing data d
 DEFINE_string(fs_type, "ext4", "Filesystem type used when auto-mounting");
 DEFINE_bool(auto_mount, false, "Whether to auto-mount device_path to mount_point");
 DEFINE_bool(sync_on_write, false, "Whether to fsync after writes");
+DEFINE_bool(sync_batch, true, "Group-commit the data syncs of concurrent writes when sync_on_write is set");
+DEFINE_int32(sync_batch_window_us, 50, "How long a sync batch waits for more writes after the first one");
+DEFINE_int32(sync_batch_max, 64, "Flush a sync batch early once it holds this many writes");
+DEFINE_bool(sync_batch_syncfs, false, "Sync a batch with one syncfs per filesystem instead of fdatasync per file");
+DEFINE_int32(direct_io_threshold_kb, 0, "Requests of at least this size (KiB) use O_DIRECT; 0 disables");
+DEFINE_int32(direct_buffers, 8, "Aligned buffers pooled for O_DIRECT IO");
+DEFINE_int32(direct_buffer_kb, 4096, "Size of each pooled O_DIRECT buffer in KiB");
+DEFINE_int64(manifest_checkpoint_records, 1 << 20, "Snapshot the chunk manifest after this many log records (0 disables)");
+DEFINE_bool(manifest_sync, false, "fdatasync each group of chunk manifest appends");
+DEFINE_bool(container_store, false, "Pack small chunks into shared container files instead of one file per chunk");
+DEFINE_int32(small_chunk_kb, 64, "Chunks up to this size (KiB) are kept in the container store");
+DEFINE_int32(container_mb, 64, "Preallocated size of each container file in MiB");
+DEFINE_double(container_gc_ratio, 0.5, "Compact sealed containers whose dead fraction reaches this ratio");
+DEFINE_int32(container_gc_interval_sec, 30, "Interval between container compaction passes");
+DEFINE_int32(block_cache_mb, 256, "In-memory block cache for chunk reads in MiB (0 disables)");
+DEFINE_int32(block_cache_block_kb, 64, "Block cache block size in KiB");
+DEFINE_bool(readahead, true, "Prefetch ahead of sequential chunk reads");
+DEFINE_int32(readahead_initial_kb, 128, "First readahead window once a sequential stream is detected");
+DEFINE_int32(readahead_max_kb, 4096, "Largest readahead window; windows double up to this");
+DEFINE_int32(readahead_threads, 2, "Threads issuing readahead IO");
+DEFINE_bool(checksum_sidecar, true, "Keep per-block crc32c sidecars next to chunk files");
+DEFINE_int32(checksum_block_kb, 64, "Bytes covered by each stored crc32c in KiB");
+DEFINE_bool(scrub, true, "Re-read chunks in the background and verify them against their sidecars");
+DEFINE_int32(scrub_mbps, 16, "Scrub read rate in MiB/s (0 = as fast as the scrub IO class allows)");
+DEFINE_int32(scrub_interval_hours, 24, "Pause between full scrub passes");
+DEFINE_bool(prealloc, true, "Reserve chunk space ahead of writes from size hints and speculative growth windows");
+DEFINE_int32(prealloc_window_kb, 1024, "First speculative window, reserved once a chunk has grown this large");
+DEFINE_int32(prealloc_max_window_mb, 64, "Largest speculative window; windows double up to this");
+DEFINE_int32(prealloc_max_hint_mb, 4096, "Size hints above this are clamped");
+DEFINE_int32(prealloc_idle_trim_sec, 60, "Give back reserved space of chunks idle this long (0 = only on close)");
+DEFINE_bool(compress, false, "Compress idle file-backed chunks block by block: LZ4 when warm, zstd when cold");
+DEFINE_int32(compress_block_kb, 64, "Bytes compressed as one unit in KiB; a random read decodes the units it covers");
+DEFINE_int32(compress_zstd_level, 3, "zstd level for cold chunks");
+DEFINE_double(compress_min_saving, 0.1, "Blocks, and chunks going by a sample of blocks, that shrink less than this fraction stay raw");
+DEFINE_int32(compress_warm_sec, 600, "Compress chunks with LZ4 once unwritten this long (0 disables)");
+DEFINE_int32(compress_cold_sec, 86400, "Recompress chunks with zstd once untouched this long (0 disables)");
+DEFINE_int32(optical_disc_gb, 100, "Disc capacity (GB) used to report how many discs compressed chunks fill");
+DEFINE_string(io_backend, "pread", "Data IO backend: pread | io_uring");
+DEFINE_int32(uring_depth, 256, "io_uring submission queue depth");
+DEFINE_int32(uring_fixed_buffers, 0, "Registered io_uring buffers (0 disables)");
+DEFINE_int32(uring_fixed_buffer_kb, 1024, "Size of each registered io_uring buffer in KiB");
 DEFINE_bool(skip_mount, false, "Skip mounting/device checks and use mount_point/base_path directly");
 DEFINE_string(base_path, "", "Data root; default uses mount_point if empty");
+DEFINE_string(data_roots, "", "Comma-separated data roots, one per disk; default is base_path alone");
+DEFINE_int32(disk_threads, 4, "IO threads per data root (0 runs IO on the RPC workers)");
+DEFINE_int32(disk_queue_depth, 128, "Outstanding requests per data root before new ones are rejected");
+DEFINE_int32(disk_max_inflight, 32, "Requests per data root whose IO is in progress at once; the rest wait in the fair queues");
+DEFINE_double(disk_min_free_pct, 5, "New chunks avoid data roots with less free space than this percentage");
+// The io_* weights and caps can be changed at runtime through the /flags page.
+DEFINE_int32(io_weight_foreground, 8, "Fair-share weight of foreground client IO on each disk");
+DEFINE_int32(io_weight_migration, 2, "Fair-share weight of migration IO on each disk");
+DEFINE_int32(io_weight_scrub, 1, "Fair-share weight of scrub IO on each disk");
+DEFINE_int32(io_migration_mbps, 0, "Node-wide cap on migration IO in MiB/s (0 = unlimited)");
+DEFINE_int32(io_migration_iops, 0, "Node-wide cap on migration IO requests per second (0 = unlimited)");
+DEFINE_int32(io_scrub_mbps, 0, "Node-wide cap on scrub IO in MiB/s (0 = unlimited)");
+DEFINE_int32(io_scrub_iops, 0, "Node-wide cap on scrub IO requests per second (0 = unlimited)");
 DEFINE_string(srm_addr, "", "SRM ClusterManagerService address host:port for registration/heartbeat");
 DEFINE_string(advertise_ip, "", "IP address to advertise to SRM (defaults to 127.0.0.1 if empty)");
 DEFINE_string(agent_hostname, "", "Optional hostname override reported to SRM");
@@ -27,6 +92,159 @@ DEFINE_int32(agent_heartbeat_ms, 3000, "Heartbeat interval in milliseconds");
 DEFINE_int32(agent_register_backoff_ms, 5000, "Backoff between failed registrations in milliseconds");
 DEFINE_string(log_file, "", "Log file path (append). Empty = stdout/stderr");
 
+namespace {
+
+double BlockCacheHitRatio(void* arg) {
+    BlockCache::Stats s = static_cast<BlockCache*>(arg)->GetStats();
+    const uint64_t total = s.hits + s.misses;
+    return total == 0 ? 0.0 : static_cast<double>(s.hits) / static_cast<double>(total);
+}
+
+double BlockCacheBytes(void* arg) {
+    return static_cast<double>(static_cast<BlockCache*>(arg)->GetStats().bytes);
+}
+
+double BlockCacheEvictions(void* arg) {
+    return static_cast<double>(static_cast<BlockCache*>(arg)->GetStats().evictions);
+}
+
+double ScrubCorruptBlocks(void* arg) {
+    return static_cast<double>(static_cast<Scrubber*>(arg)->GetStats().corrupt_blocks);
+}
+
+double ScrubBytes(void* arg) {
+    return static_cast<double>(static_cast<Scrubber*>(arg)->GetStats().bytes);
+}
+
+double PreallocReservedBytes(void* arg) {
+    return static_cast<double>(static_cast<StorageServiceImpl*>(arg)->PreallocStats().reserved_bytes);
+}
+
+double PreallocReleasedBytes(void* arg) {
+    return static_cast<double>(static_cast<StorageServiceImpl*>(arg)->PreallocStats().released_bytes);
+}
+
+// Mean physical extents per chunk, over the chunks trimmed so far.
+double ChunkExtentsAvg(void* arg) {
+    Preallocator::Stats s = static_cast<StorageServiceImpl*>(arg)->PreallocStats();
+    return s.trims == 0 ? 0.0 : static_cast<double>(s.trimmed_extents) / static_cast<double>(s.trims);
+}
+
+double ChunkExtentsMax(void* arg) {
+    return static_cast<double>(static_cast<StorageServiceImpl*>(arg)->PreallocStats().max_extents);
+}
+
+struct CompressVarArg {
+    StorageServiceImpl* service;
+    uint64_t disc_bytes;
+};
+
+double CompressRawBytes(void* arg) {
+    return static_cast<double>(static_cast<CompressVarArg*>(arg)->service->CompressionStats().raw_bytes);
+}
+
+double CompressStoredBytes(void* arg) {
+    return static_cast<double>(static_cast<CompressVarArg*>(arg)->service->CompressionStats().stored_bytes);
+}
+
+double CompressRatio(void* arg) {
+    ChunkCompressor::Stats s = static_cast<CompressVarArg*>(arg)->service->CompressionStats();
+    return s.stored_bytes == 0 ? 0.0 : static_cast<double>(s.raw_bytes) / static_cast<double>(s.stored_bytes);
+}
+
+// Discs the compressed chunks would fill as they are and uncompressed.
+double CompressDiscsRaw(void* arg) {
+    auto* a = static_cast<CompressVarArg*>(arg);
+    return static_cast<double>((a->service->CompressionStats().raw_bytes + a->disc_bytes - 1) / a->disc_bytes);
+}
+
+double CompressDiscsStored(void* arg) {
+    auto* a = static_cast<CompressVarArg*>(arg);
+    return static_cast<double>((a->service->CompressionStats().stored_bytes + a->disc_bytes - 1) / a->disc_bytes);
+}
+
+double CompressCpuMs(void* arg) {
+    return static_cast<double>(static_cast<CompressVarArg*>(arg)->service->CompressionStats().compress_ns) / 1e6;
+}
+
+double DecompressCpuMs(void* arg) {
+    return static_cast<double>(static_cast<CompressVarArg*>(arg)->service->CompressionStats().decompress_ns) / 1e6;
+}
+
+double CompressSkippedChunks(void* arg) {
+    return static_cast<double>(static_cast<CompressVarArg*>(arg)->service->CompressionStats().skipped);
+}
+
+struct DiskVarArg {
+    DiskScheduler* scheduler;
+    size_t disk;
+};
+
+double DiskPending(void* arg) {
+    auto* a = static_cast<DiskVarArg*>(arg);
+    return static_cast<double>(a->scheduler->Load(a->disk).pending);
+}
+
+double DiskRejected(void* arg) {
+    auto* a = static_cast<DiskVarArg*>(arg);
+    return static_cast<double>(a->scheduler->Load(a->disk).rejected);
+}
+
+// Set once the scheduler exists; the io_* flag validators push changes into it.
+DiskScheduler* g_disk_scheduler = nullptr;
+
+double IOClassQueued(void* arg) {
+    auto cls = static_cast<DiskScheduler::Class>(reinterpret_cast<uintptr_t>(arg));
+    return static_cast<double>(g_disk_scheduler->GetClassStats(cls).queued);
+}
+
+bool UpdateClassLimit(DiskScheduler::Class cls, int32_t value, int32_t min_value,
+                      void (*apply)(DiskScheduler::ClassLimits*, uint64_t)) {
+    if (value < min_value) {
+        return false;
+    }
+    if (g_disk_scheduler) {
+        DiskScheduler::ClassLimits limits = g_disk_scheduler->GetClassLimits(cls);
+        apply(&limits, static_cast<uint64_t>(value));
+        g_disk_scheduler->SetClassLimits(cls, limits);
+    }
+    return true;
+}
+
+void ApplyWeight(DiskScheduler::ClassLimits* l, uint64_t v) { l->weight = static_cast<uint32_t>(v); }
+void ApplyMbps(DiskScheduler::ClassLimits* l, uint64_t v) { l->bytes_per_sec = v << 20; }
+void ApplyIops(DiskScheduler::ClassLimits* l, uint64_t v) { l->iops = v; }
+
+bool ValidateForegroundWeight(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kForeground, v, 1, ApplyWeight); }
+bool ValidateMigrationWeight(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kMigration, v, 1, ApplyWeight); }
+bool ValidateScrubWeight(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kScrub, v, 1, ApplyWeight); }
+bool ValidateMigrationMbps(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kMigration, v, 0, ApplyMbps); }
+bool ValidateMigrationIops(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kMigration, v, 0, ApplyIops); }
+bool ValidateScrubMbps(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kScrub, v, 0, ApplyMbps); }
+bool ValidateScrubIops(const char*, int32_t v) { return UpdateClassLimit(DiskScheduler::kScrub, v, 0, ApplyIops); }
+
+std::vector<std::string> SplitRoots(const std::string& list) {
+    std::vector<std::string> roots;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            roots.push_back(item);
+        }
+    }
+    return roots;
+}
+
+} // namespace
+
+DEFINE_validator(io_weight_foreground, ValidateForegroundWeight);
+DEFINE_validator(io_weight_migration, ValidateMigrationWeight);
+DEFINE_validator(io_weight_scrub, ValidateScrubWeight);
+DEFINE_validator(io_migration_mbps, ValidateMigrationMbps);
+DEFINE_validator(io_migration_iops, ValidateMigrationIops);
+DEFINE_validator(io_scrub_mbps, ValidateScrubMbps);
+DEFINE_validator(io_scrub_iops, ValidateScrubIops);
+
 int main(int argc, char** argv) {
     gflags::ParseCommandLineFlags(&argc, &argv, true);
     if (!RedirectLogs(FLAGS_log_file)) {
@@ -44,11 +262,183 @@ int main(int argc, char** argv) {
     auto disk_mgr = std::make_shared<DiskManager>(cfg);
     IOEngine::Options io_opts;
     io_opts.sync_on_write = FLAGS_sync_on_write;
+    io_opts.sync_batching = FLAGS_sync_batch;
+    io_opts.sync_batch_window_us = static_cast<uint32_t>(std::max(0, FLAGS_sync_batch_window_us));
+    io_opts.sync_batch_max = static_cast<size_t>(std::max(1, FLAGS_sync_batch_max));
+    io_opts.sync_batch_syncfs = FLAGS_sync_batch_syncfs;
+    io_opts.direct_io_threshold = static_cast<size_t>(std::max(0, FLAGS_direct_io_threshold_kb)) * 1024;
+    io_opts.direct_buffers = static_cast<size_t>(std::max(0, FLAGS_direct_buffers));
+    io_opts.direct_buffer_size = static_cast<size_t>(std::max(4, FLAGS_direct_buffer_kb)) * 1024;
+    io_opts.uring_queue_depth = static_cast<unsigned>(std::max(1, FLAGS_uring_depth));
+    io_opts.uring_fixed_buffers = static_cast<unsigned>(std::max(0, FLAGS_uring_fixed_buffers));
+    io_opts.uring_fixed_buffer_size = static_cast<size_t>(std::max(4, FLAGS_uring_fixed_buffer_kb)) * 1024;
     std::string data_root = FLAGS_base_path.empty() ? FLAGS_mount_point : FLAGS_base_path;
-    auto io_engine = std::make_shared<IOEngine>(data_root, io_opts);
-    auto metadata_mgr = std::make_shared<LocalMetadataManager>(std::vector<std::string>{data_root});
+    std::vector<std::string> data_roots = SplitRoots(FLAGS_data_roots);
+    if (data_roots.empty()) {
+        data_roots.push_back(data_root);
+    }
+    // the first root also holds the manifest and the container store
+    data_root = data_roots[0];
+
+    auto io_engine = MakeIOEngine(FLAGS_io_backend, data_root, io_opts);
+    std::cout << "[RealNode] IO backend: " << io_engine->BackendName() << std::endl;
+    // declared first: scheduler workers report into these until the scheduler is gone
+    std::vector<std::unique_ptr<bvar::LatencyRecorder>> class_latency;
+    std::shared_ptr<DiskScheduler> disk_scheduler;
+    std::vector<std::unique_ptr<DiskVarArg>> disk_var_args;
+    std::vector<std::unique_ptr<bvar::PassiveStatus<double>>> disk_vars;
+    if (FLAGS_disk_threads > 0) {
+        static const char* const kClassNames[DiskScheduler::kClasses] = {"foreground", "migration", "scrub"};
+        for (size_t c = 0; c < DiskScheduler::kClasses; ++c) {
+            class_latency.emplace_back(new bvar::LatencyRecorder(std::string("real_node_io_") + kClassNames[c]));
+        }
+        DiskScheduler::Options ds_opts;
+        ds_opts.threads_per_disk = static_cast<size_t>(FLAGS_disk_threads);
+        ds_opts.queue_depth = static_cast<size_t>(std::max(1, FLAGS_disk_queue_depth));
+        ds_opts.max_inflight = static_cast<size_t>(std::max(1, FLAGS_disk_max_inflight));
+        ds_opts.min_free_ratio = std::max(0.0, FLAGS_disk_min_free_pct) / 100.0;
+        ApplyWeight(&ds_opts.classes[DiskScheduler::kForeground], static_cast<uint64_t>(std::max(1, FLAGS_io_weight_foreground)));
+        ApplyWeight(&ds_opts.classes[DiskScheduler::kMigration], static_cast<uint64_t>(std::max(1, FLAGS_io_weight_migration)));
+        ApplyWeight(&ds_opts.classes[DiskScheduler::kScrub], static_cast<uint64_t>(std::max(1, FLAGS_io_weight_scrub)));
+        ApplyMbps(&ds_opts.classes[DiskScheduler::kMigration], static_cast<uint64_t>(std::max(0, FLAGS_io_migration_mbps)));
+        ApplyIops(&ds_opts.classes[DiskScheduler::kMigration], static_cast<uint64_t>(std::max(0, FLAGS_io_migration_iops)));
+        ApplyMbps(&ds_opts.classes[DiskScheduler::kScrub], static_cast<uint64_t>(std::max(0, FLAGS_io_scrub_mbps)));
+        ApplyIops(&ds_opts.classes[DiskScheduler::kScrub], static_cast<uint64_t>(std::max(0, FLAGS_io_scrub_iops)));
+        auto* latency = &class_latency;
+        ds_opts.on_complete = [latency](DiskScheduler::Class cls, int64_t us) { *(*latency)[cls] << us; };
+        disk_scheduler = std::make_shared<DiskScheduler>(data_roots, ds_opts);
+        g_disk_scheduler = disk_scheduler.get();
+        for (size_t c = 0; c < DiskScheduler::kClasses; ++c) {
+            disk_vars.emplace_back(new bvar::PassiveStatus<double>(std::string("real_node_io_") + kClassNames[c] + "_queued",
+                                                                   IOClassQueued, reinterpret_cast<void*>(c)));
+        }
+        for (size_t i = 0; i < data_roots.size(); ++i) {
+            disk_var_args.emplace_back(new DiskVarArg{disk_scheduler.get(), i});
+            const std::string prefix = "real_node_disk" + std::to_string(i);
+            disk_vars.emplace_back(new bvar::PassiveStatus<double>(prefix + "_pending", DiskPending, disk_var_args.back().get()));
+            disk_vars.emplace_back(new bvar::PassiveStatus<double>(prefix + "_rejected", DiskRejected, disk_var_args.back().get()));
+        }
+    }
+
+    LocalMetadataManager::Options meta_opts;
+    meta_opts.checkpoint_records = static_cast<size_t>(std::max<int64_t>(0, FLAGS_manifest_checkpoint_records));
+    meta_opts.sync = FLAGS_manifest_sync;
+    if (disk_scheduler && data_roots.size() > 1) {
+        DiskScheduler* scheduler = disk_scheduler.get();
+        meta_opts.placement = [scheduler](uint64_t chunk_id) { return scheduler->Place(chunk_id); };
+    }
+    auto metadata_mgr = std::make_shared<LocalMetadataManager>(data_roots, "", meta_opts);
+
+    std::shared_ptr<ContainerStore> container_store;
+    if (FLAGS_container_store) {
+        ContainerStore::Options cs_opts;
+        cs_opts.small_chunk_limit = static_cast<size_t>(std::max(1, FLAGS_small_chunk_kb)) * 1024;
+        cs_opts.container_size = static_cast<size_t>(std::max(1, FLAGS_container_mb)) << 20;
+        cs_opts.gc_dead_ratio = FLAGS_container_gc_ratio;
+        cs_opts.gc_interval = std::chrono::seconds(std::max(1, FLAGS_container_gc_interval_sec));
+        cs_opts.sync_on_write = FLAGS_sync_on_write;
+        container_store = std::make_shared<ContainerStore>(data_root + "/containers", cs_opts);
+        // chunks whose own file exists were migrated; their container copies are stale
+        auto migrated = [&metadata_mgr](uint64_t chunk_id) {
+            std::string path = metadata_mgr->GetPath(chunk_id);
+            std::error_code ec;
+            return !path.empty() && std::filesystem::exists(path, ec);
+        };
+        if (!container_store->Open(migrated)) {
+            std::cerr << "Failed to open container store under " << data_root << std::endl;
+            return -1;
+        }
+        container_store->Start();
+    }
+
+    std::shared_ptr<BlockCache> block_cache;
+    std::vector<std::unique_ptr<bvar::PassiveStatus<double>>> cache_vars;
+    if (FLAGS_block_cache_mb > 0) {
+        BlockCache::Options bc_opts;
+        bc_opts.capacity_bytes = static_cast<size_t>(FLAGS_block_cache_mb) << 20;
+        bc_opts.block_size = static_cast<size_t>(std::max(4, FLAGS_block_cache_block_kb)) * 1024;
+        block_cache = std::make_shared<BlockCache>(bc_opts);
+        // exported on the builtin /vars page
+        cache_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_block_cache_hit_ratio", BlockCacheHitRatio, block_cache.get()));
+        cache_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_block_cache_bytes", BlockCacheBytes, block_cache.get()));
+        cache_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_block_cache_evictions", BlockCacheEvictions, block_cache.get()));
+    }
+
+    StorageServiceImpl service(disk_mgr, metadata_mgr, io_engine, container_store, block_cache, disk_scheduler);
+    if (FLAGS_readahead) {
+        ReadaheadManager::Options ra_opts;
+        ra_opts.initial_window = static_cast<uint64_t>(std::max(4, FLAGS_readahead_initial_kb)) * 1024;
+        ra_opts.max_window = static_cast<uint64_t>(std::max(4, FLAGS_readahead_max_kb)) * 1024;
+        ra_opts.threads = static_cast<size_t>(std::max(1, FLAGS_readahead_threads));
+        service.EnableReadahead(ra_opts);
+    }
+
+    std::vector<std::unique_ptr<bvar::PassiveStatus<double>>> prealloc_vars;
+    if (FLAGS_prealloc) {
+        Preallocator::Options pa_opts;
+        pa_opts.first_window = static_cast<uint64_t>(std::max(4, FLAGS_prealloc_window_kb)) * 1024;
+        pa_opts.max_window = static_cast<uint64_t>(std::max(1, FLAGS_prealloc_max_window_mb)) << 20;
+        pa_opts.max_hint = static_cast<uint64_t>(std::max(0, FLAGS_prealloc_max_hint_mb)) << 20;
+        pa_opts.idle_trim = std::chrono::seconds(std::max(0, FLAGS_prealloc_idle_trim_sec));
+        service.EnablePreallocation(pa_opts);
+        prealloc_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_prealloc_reserved_bytes", PreallocReservedBytes, &service));
+        prealloc_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_prealloc_released_bytes", PreallocReleasedBytes, &service));
+        prealloc_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_chunk_extents_avg", ChunkExtentsAvg, &service));
+        prealloc_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_chunk_extents_max", ChunkExtentsMax, &service));
+    }
 
-    StorageServiceImpl service(disk_mgr, metadata_mgr, io_engine);
+    CompressVarArg compress_var_arg{&service, static_cast<uint64_t>(std::max(1, FLAGS_optical_disc_gb)) * 1000000000ull};
+    std::vector<std::unique_ptr<bvar::PassiveStatus<double>>> compress_vars;
+    if (FLAGS_compress) {
+        ChunkCompressor::Options cc_opts;
+        cc_opts.block_size = static_cast<size_t>(std::max(4, FLAGS_compress_block_kb)) * 1024;
+        cc_opts.zstd_level = FLAGS_compress_zstd_level;
+        cc_opts.min_saving = FLAGS_compress_min_saving;
+        cc_opts.warm_after = std::chrono::seconds(std::max(0, FLAGS_compress_warm_sec));
+        cc_opts.cold_after = std::chrono::seconds(std::max(0, FLAGS_compress_cold_sec));
+        if (!ChunkCompressor::Supported(cc_opts.warm_codec) || !ChunkCompressor::Supported(cc_opts.cold_codec)) {
+            std::cerr << "[RealNode] built without lz4 or zstd; compressing with what is available" << std::endl;
+        }
+        service.EnableCompression(cc_opts);
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_raw_bytes", CompressRawBytes, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_stored_bytes", CompressStoredBytes, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_ratio", CompressRatio, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_discs_raw", CompressDiscsRaw, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_discs_stored", CompressDiscsStored, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_cpu_ms", CompressCpuMs, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_decompress_cpu_ms", DecompressCpuMs, &compress_var_arg));
+        compress_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_compress_skipped_chunks", CompressSkippedChunks, &compress_var_arg));
+    }
+
+    std::unique_ptr<Scrubber> scrubber;
+    std::vector<std::unique_ptr<bvar::PassiveStatus<double>>> scrub_vars;
+    if (FLAGS_checksum_sidecar) {
+        ChecksumStore::Options ck_opts;
+        ck_opts.block_size = static_cast<size_t>(std::max(4, FLAGS_checksum_block_kb)) * 1024;
+        ck_opts.sync = FLAGS_sync_on_write;
+        auto checksums = std::make_shared<ChecksumStore>(ck_opts);
+        service.EnableChecksums(checksums);
+        if (FLAGS_scrub) {
+            Scrubber::Options sc_opts;
+            sc_opts.bytes_per_sec = static_cast<uint64_t>(std::max(0, FLAGS_scrub_mbps)) << 20;
+            sc_opts.pass_interval = std::chrono::hours(std::max(1, FLAGS_scrub_interval_hours));
+            Scrubber::Hooks hooks;
+            hooks.list_chunks = [metadata_mgr]() { return metadata_mgr->ListChunks(); };
+            hooks.chunk_path = [metadata_mgr](uint64_t chunk_id) { return metadata_mgr->GetPath(chunk_id); };
+            if (disk_scheduler) {
+                hooks.submit = [metadata_mgr, disk_scheduler](uint64_t chunk_id, uint64_t bytes,
+                                                               std::function<void()> io) {
+                    const int root = metadata_mgr->RootOf(chunk_id);
+                    return disk_scheduler->Submit(root < 0 ? 0 : static_cast<size_t>(root), std::move(io),
+                                                  DiskScheduler::kScrub, bytes);
+                };
+            }
+            scrubber = std::make_unique<Scrubber>(sc_opts, checksums, std::move(hooks));
+            scrub_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_scrub_corrupt_blocks", ScrubCorruptBlocks, scrubber.get()));
+            scrub_vars.emplace_back(new bvar::PassiveStatus<double>("real_node_scrub_bytes", ScrubBytes, scrubber.get()));
+            scrubber->Start();
+        }
+    }
     std::unique_ptr<NodeAgent> agent;
     if (!FLAGS_srm_addr.empty()) {
         agent = std::make_unique<NodeAgent>(FLAGS_srm_addr,
@@ -80,10 +470,14 @@ int main(int argc, char** argv) {
 
     std::cout << "Storage real node server started at port " << FLAGS_port
               << ", base_path=" << (FLAGS_base_path.empty() ? FLAGS_mount_point : FLAGS_base_path)
+              << ", data_roots=" << data_roots.size()
               << ", skip_mount=" << (FLAGS_skip_mount ? "true" : "false")
               << ", srm_addr=" << (FLAGS_srm_addr.empty() ? "<disabled>" : FLAGS_srm_addr)
               << std::endl;
     server.RunUntilAskedToQuit();
+    if (scrubber) {
+        scrubber->Stop();
+    }
     if (agent) {
         agent->Stop();
     }
@@ -0,0 +1,208 @@
+#include <brpc/channel.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/EcStripe.h"
+#include "common/ReedSolomon.h"
+#include "storage_node.pb.h"
+
+DEFINE_int32(k, 8, "Data shards per stripe");
+DEFINE_int32(m, 3, "Parity shards per stripe");
+DEFINE_int32(shard_kb, 1024, "Shard buffer size (KB) for the kernel benchmark");
+DEFINE_int32(rounds, 200, "Encode/decode rounds per kernel");
+DEFINE_int32(lost, 3, "Shards lost in the decode benchmark (at most m)");
+DEFINE_string(server, "", "Gateway or real node address; when set, also run a write / degraded read / repair pass");
+DEFINE_string(nodes, "", "Comma-separated k + m node ids for the cluster pass");
+DEFINE_string(spare_node, "", "Node that receives the repaired shard (empty skips repair)");
+DEFINE_uint64(chunk_id, 1, "Chunk id for the cluster pass");
+DEFINE_int32(unit_kb, 1024, "Stripe unit (KB) for the cluster pass");
+DEFINE_int32(object_mb, 64, "Bytes (MB) written in the cluster pass");
+
+static double Seconds(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static double MiBps(uint64_t bytes, double sec) {
+    return sec > 0 ? static_cast<double>(bytes) / (1 << 20) / sec : 0.0;
+}
+
+// Encode and decode throughput of every kernel this CPU runs, counted in
+// data bytes. Decode loses the first `lost` data shards, the worst case.
+static bool RunKernels(size_t k, size_t m) {
+    const size_t len = static_cast<size_t>(std::max(1, FLAGS_shard_kb)) << 10;
+    const size_t lost = std::min<size_t>(static_cast<size_t>(std::max(1, FLAGS_lost)), std::min(m, k));
+    const int rounds = std::max(1, FLAGS_rounds);
+    ReedSolomon rs(k, m);
+
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<uint8_t>> shards(k + m, std::vector<uint8_t>(len));
+    for (size_t d = 0; d < k; ++d) {
+        for (auto& b : shards[d]) {
+            b = static_cast<uint8_t>(rng());
+        }
+    }
+    std::vector<const uint8_t*> data(k);
+    std::vector<uint8_t*> parity(m);
+    std::vector<uint8_t*> all(k + m);
+    for (size_t i = 0; i < k + m; ++i) {
+        all[i] = shards[i].data();
+        if (i < k) {
+            data[i] = shards[i].data();
+        } else {
+            parity[i - k] = shards[i].data();
+        }
+    }
+    std::vector<std::vector<uint8_t>> reference(shards.begin(), shards.begin() + static_cast<long>(lost));
+
+    const ReedSolomon::Kernel initial = ReedSolomon::ActiveKernel();
+    bool ok = true;
+    for (auto kernel : {ReedSolomon::Kernel::kScalar, ReedSolomon::Kernel::kSsse3, ReedSolomon::Kernel::kAvx2}) {
+        if (!ReedSolomon::UseKernel(kernel)) {
+            std::cout << ReedSolomon::KernelName(kernel) << ": not supported" << std::endl;
+            continue;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            rs.Encode(data.data(), parity.data(), len);
+        }
+        const double encode_sec = Seconds(begin);
+
+        std::unique_ptr<bool[]> present(new bool[k + m]);
+        double decode_sec = 0;
+        for (int r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < k + m; ++i) {
+                present[i] = i >= lost;
+            }
+            for (size_t i = 0; i < lost; ++i) {
+                std::memset(all[i], 0, len);
+            }
+            begin = std::chrono::steady_clock::now();
+            ok = rs.Reconstruct(all.data(), present.get(), len) && ok;
+            decode_sec += Seconds(begin);
+        }
+        for (size_t i = 0; i < lost; ++i) {
+            ok = ok && shards[i] == reference[i];
+        }
+        const uint64_t bytes = static_cast<uint64_t>(rounds) * k * len;
+        std::cout << ReedSolomon::KernelName(kernel) << ": encode " << MiBps(bytes, encode_sec)
+                  << " MiB/s, decode (" << lost << " lost) " << MiBps(bytes, decode_sec) << " MiB/s"
+                  << std::endl;
+    }
+    ReedSolomon::UseKernel(initial);
+    if (!ok) {
+        std::cerr << "decode mismatch" << std::endl;
+    }
+    return ok;
+}
+
+static std::vector<std::string> SplitNodes(const std::string& list) {
+    std::vector<std::string> out;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            out.push_back(item);
+        }
+    }
+    return out;
+}
+
+// Writes an object, reads it back healthy, then with the first data node
+// swapped for a missing one (a degraded read), then repairs that shard onto
+// spare_node and reads it once more.
+static bool RunCluster(size_t k, size_t m) {
+    brpc::Channel channel;
+    brpc::ChannelOptions opts;
+    if (channel.Init(FLAGS_server.c_str(), &opts) != 0) {
+        std::cerr << "Failed to init channel to " << FLAGS_server << std::endl;
+        return false;
+    }
+    storagenode::StorageService_Stub stub(&channel);
+
+    EcStripe::Layout layout;
+    layout.k = k;
+    layout.m = m;
+    layout.unit = static_cast<uint64_t>(std::max(1, FLAGS_unit_kb)) << 10;
+    layout.nodes = SplitNodes(FLAGS_nodes);
+    if (layout.nodes.size() != k + m) {
+        std::cerr << "--nodes needs " << k + m << " node ids" << std::endl;
+        return false;
+    }
+    const size_t size = static_cast<size_t>(std::max(1, FLAGS_object_mb)) << 20;
+    std::string object(size, '\0');
+    std::mt19937_64 rng(7);
+    for (auto& c : object) {
+        c = static_cast<char>(rng());
+    }
+
+    EcStripe ec(&stub, layout);
+    auto begin = std::chrono::steady_clock::now();
+    EcStripe::Result r = ec.Write(FLAGS_chunk_id, 0, object.data(), object.size());
+    if (r.code != rpc::STATUS_SUCCESS) {
+        std::cerr << "write failed: " << r.message << std::endl;
+        return false;
+    }
+    std::cout << "write: " << MiBps(size, Seconds(begin)) << " MiB/s" << std::endl;
+
+    auto read = [&](EcStripe& stripe, const char* label) {
+        std::string out;
+        auto start = std::chrono::steady_clock::now();
+        EcStripe::Result res = stripe.Read(FLAGS_chunk_id, 0, size, &out);
+        const double sec = Seconds(start);
+        if (res.code != rpc::STATUS_SUCCESS || out != object) {
+            std::cerr << label << " read failed: " << (res.message.empty() ? "data mismatch" : res.message)
+                      << std::endl;
+            return false;
+        }
+        std::cout << label << " read: " << MiBps(size, sec) << " MiB/s, degraded shards " << res.degraded
+                  << std::endl;
+        return true;
+    };
+    if (!read(ec, "healthy")) {
+        return false;
+    }
+    EcStripe::Layout broken = layout;
+    broken.nodes[0] = "ec-bench-missing-node";
+    EcStripe degraded(&stub, broken);
+    if (!read(degraded, "degraded")) {
+        return false;
+    }
+    if (FLAGS_spare_node.empty()) {
+        return true;
+    }
+    begin = std::chrono::steady_clock::now();
+    r = degraded.Repair(FLAGS_chunk_id, 0, FLAGS_spare_node);
+    if (r.code != rpc::STATUS_SUCCESS) {
+        std::cerr << "repair failed: " << r.message << std::endl;
+        return false;
+    }
+    std::cout << "repair: " << r.bytes << " bytes at " << MiBps(r.bytes, Seconds(begin)) << " MiB/s"
+              << std::endl;
+    return read(degraded, "repaired");
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_k < 1 || FLAGS_m < 1 || FLAGS_k + FLAGS_m > 256) {
+        std::cerr << "need k >= 1, m >= 1, k + m <= 256" << std::endl;
+        return -1;
+    }
+    const size_t k = static_cast<size_t>(FLAGS_k);
+    const size_t m = static_cast<size_t>(FLAGS_m);
+    std::cout << k << "+" << m << ", default kernel " << ReedSolomon::KernelName(ReedSolomon::ActiveKernel())
+              << std::endl;
+    bool ok = RunKernels(k, m);
+    if (!FLAGS_server.empty()) {
+        ok = RunCluster(k, m) && ok;
+    }
+    return ok ? 0 : 1;
+}
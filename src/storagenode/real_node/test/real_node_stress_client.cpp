@@ -4,12 +4,17 @@
 
 #include <fcntl.h>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <random>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
+#include "common/ChunkStream.h"
+#include "common/ExtentBatch.h"
 #include "storage_node.pb.h"
 
 DEFINE_string(server, "127.0.0.1:9010", "Storage real node server address");
@@ -21,6 +26,15 @@ DEFINE_uint64(max_offset_blocks, 0, "Max offset in payload-sized blocks (0 means
 DEFINE_int32(flags, 0, "POSIX open flags to pass through to server");
 DEFINE_int32(mode, 0644, "POSIX mode to use when creating files");
 DEFINE_bool(verify_read, false, "If true, verify read data matches last written value for the chunk/offset");
+DEFINE_int32(concurrency, 1, "Number of client threads issuing requests in parallel");
+DEFINE_int32(hot_chunks, 0, "Hot chunks read in the background during the run to probe page-cache pollution (0 disables)");
+DEFINE_int32(hot_read_size, 4096, "Read size (bytes) for the hot-chunk probe");
+DEFINE_int32(hot_hit_us, 200, "Hot reads at or under this latency (us) are counted as page-cache hits");
+DEFINE_int32(io_class, 0, "IO class of the main workload: 0 foreground, 1 migration, 2 scrub (the hot probe stays foreground)");
+DEFINE_int32(wire_version, 0, "Payload placement of the main workload: 0 protobuf bytes, 1 RPC attachment");
+DEFINE_bool(stream, false, "Move main-workload payloads over OpenReadStream/OpenWriteStream instead of unary calls");
+DEFINE_int32(stream_block_kb, 1024, "Frame size (KB) for --stream");
+DEFINE_int32(batch, 1, "Extents per ReadV/WriteV call in the main workload (1 = unary calls)");
 
 struct Stats {
     int writes{0};
@@ -30,6 +44,20 @@ struct Stats {
     int verify_failures{0};
     int64_t total_latency_us{0};
     int completed{0};
+    uint64_t bytes{0};
+    std::vector<int64_t> latencies_us;
+
+    void Merge(const Stats& o) {
+        writes += o.writes;
+        reads += o.reads;
+        write_failures += o.write_failures;
+        read_failures += o.read_failures;
+        verify_failures += o.verify_failures;
+        total_latency_us += o.total_latency_us;
+        completed += o.completed;
+        bytes += o.bytes;
+        latencies_us.insert(latencies_us.end(), o.latencies_us.begin(), o.latencies_us.end());
+    }
 };
 
 static std::string MakeKey(uint64_t chunk_id, uint64_t offset) {
@@ -45,49 +73,212 @@ static std::string MakePayload(std::mt19937_64& rng, size_t size) {
     return data;
 }
 
-int main(int argc, char** argv) {
-    gflags::ParseCommandLineFlags(&argc, &argv, true);
+// Runs `ops` requests on one thread. With verify_read each worker owns a
+// disjoint chunk-id range so its read-after-write checks stay meaningful.
+// --stream variants of one write/read; fill error on failure and return the
+// call's latency.
+static int64_t StreamWrite(storagenode::StorageService_Stub* stub, uint64_t chunk_id, uint64_t offset,
+                           const std::string& payload, std::string* error) {
+    storagenode::OpenStreamRequest req;
+    req.set_chunk_id(chunk_id);
+    req.set_offset(offset);
+    req.set_block_size(static_cast<uint32_t>(std::max(4, FLAGS_stream_block_kb)) << 10);
+    req.set_flags(FLAGS_flags);
+    req.set_mode(FLAGS_mode);
+    req.set_io_class(static_cast<storagenode::IOClass>(FLAGS_io_class));
+    const auto start = std::chrono::steady_clock::now();
+    const auto res = ChunkStream::Write(stub, req, ChunkStream::Options(), 3000, payload.data(), payload.size());
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (res.code != rpc::STATUS_SUCCESS) {
+        *error = res.message;
+    } else if (res.bytes != payload.size()) {
+        *error = "short stream write: " + std::to_string(res.bytes) + " bytes";
+    }
+    return us.count();
+}
 
+static int64_t StreamRead(storagenode::StorageService_Stub* stub, uint64_t chunk_id, uint64_t offset,
+                          uint64_t length, std::string* data, std::string* error) {
+    storagenode::OpenStreamRequest req;
+    req.set_chunk_id(chunk_id);
+    req.set_offset(offset);
+    req.set_length(length);
+    req.set_block_size(static_cast<uint32_t>(std::max(4, FLAGS_stream_block_kb)) << 10);
+    req.set_flags(FLAGS_flags == 0 ? O_RDONLY : FLAGS_flags);
+    req.set_io_class(static_cast<storagenode::IOClass>(FLAGS_io_class));
+    const auto start = std::chrono::steady_clock::now();
+    const auto res = ChunkStream::Read(stub, req, ChunkStream::Options(), 3000,
+                                       [data](uint64_t, butil::IOBuf* block) {
+                                           data->append(block->to_string());
+                                           return true;
+                                       });
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (res.code != rpc::STATUS_SUCCESS) {
+        *error = res.message;
+    }
+    return us.count();
+}
+
+// --batch variant: each round draws one op kind and issues batch extents of
+// it as vectored calls; every extent is charged the round's latency.
+static void RunBatchWorker(storagenode::StorageService_Stub* stub, int worker, int ops, Stats* out) {
     const int write_ratio = std::clamp(FLAGS_write_ratio, 0, 100);
     const size_t payload_size = static_cast<size_t>(std::max(1, FLAGS_data_size));
     const uint64_t max_chunk = std::max<uint64_t>(1, FLAGS_max_chunk_id);
+    const uint64_t chunk_base = FLAGS_verify_read ? static_cast<uint64_t>(worker) * max_chunk : 0;
+    const int batch = std::max(1, FLAGS_batch);
 
-    brpc::Channel channel;
-    brpc::ChannelOptions opts;
-    if (channel.Init(FLAGS_server.c_str(), &opts) != 0) {
-        std::cerr << "Failed to init channel to " << FLAGS_server << std::endl;
-        return -1;
+    std::mt19937_64 rng(123456789 + static_cast<uint64_t>(worker));
+    std::uniform_int_distribution<int> pct_dist(1, 100);
+    std::uniform_int_distribution<uint64_t> chunk_dist(1, max_chunk);
+    std::uniform_int_distribution<uint64_t> offset_block_dist(0, FLAGS_max_offset_blocks);
+
+    ExtentBatch::Options opts;
+    opts.flags = FLAGS_flags;
+    opts.mode = FLAGS_mode;
+    opts.io_class = static_cast<storagenode::IOClass>(FLAGS_io_class);
+    Stats& stats = *out;
+    stats.latencies_us.reserve(static_cast<size_t>(std::max(0, ops)));
+    std::unordered_map<std::string, std::string> last_written;
+
+    for (int done = 0; done < ops;) {
+        const int n = std::min(batch, ops - done);
+        done += n;
+        const bool do_write = pct_dist(rng) <= write_ratio;
+        if (do_write) {
+            std::vector<std::string> payloads;
+            std::vector<ExtentBatch::Write> writes(static_cast<size_t>(n));
+            for (auto& w : writes) {
+                w.chunk_id = chunk_base + chunk_dist(rng);
+                w.offset = (FLAGS_max_offset_blocks > 0 ? offset_block_dist(rng) : 0) * payload_size;
+                payloads.push_back(MakePayload(rng, payload_size));
+            }
+            for (size_t i = 0; i < writes.size(); ++i) {
+                writes[i].data = payloads[i].data();
+                writes[i].size = payloads[i].size();
+            }
+            const auto start = std::chrono::steady_clock::now();
+            ExtentBatch::WriteAll(stub, &writes, opts);
+            const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now() - start).count();
+            for (size_t i = 0; i < writes.size(); ++i) {
+                const auto& w = writes[i];
+                ++stats.writes;
+                if (w.code != rpc::STATUS_SUCCESS) {
+                    ++stats.write_failures;
+                    std::cerr << "[WRITEV] chunk=" << w.chunk_id << " offset=" << w.offset
+                              << " failed: " << w.message << std::endl;
+                    continue;
+                }
+                if (FLAGS_verify_read) {
+                    last_written[MakeKey(w.chunk_id, w.offset)] = payloads[i];
+                }
+                stats.bytes += w.written;
+                stats.total_latency_us += us;
+                stats.latencies_us.push_back(us);
+                ++stats.completed;
+            }
+        } else {
+            std::vector<ExtentBatch::Read> reads(static_cast<size_t>(n));
+            for (auto& r : reads) {
+                r.chunk_id = chunk_base + chunk_dist(rng);
+                r.offset = (FLAGS_max_offset_blocks > 0 ? offset_block_dist(rng) : 0) * payload_size;
+                r.length = payload_size;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            ExtentBatch::ReadAll(stub, &reads, opts);
+            const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now() - start).count();
+            for (const auto& r : reads) {
+                ++stats.reads;
+                if (r.code != rpc::STATUS_SUCCESS) {
+                    ++stats.read_failures;
+                    std::cerr << "[READV] chunk=" << r.chunk_id << " offset=" << r.offset
+                              << " failed: " << r.message << std::endl;
+                    continue;
+                }
+                if (FLAGS_verify_read) {
+                    const auto it = last_written.find(MakeKey(r.chunk_id, r.offset));
+                    if (it != last_written.end() && r.data != it->second) {
+                        ++stats.verify_failures;
+                        std::cerr << "[VERIFY] chunk=" << r.chunk_id << " offset=" << r.offset
+                                  << " mismatch: expected " << it->second.size()
+                                  << " bytes, got " << r.data.size() << std::endl;
+                    }
+                }
+                stats.bytes += r.data.size();
+                stats.total_latency_us += us;
+                stats.latencies_us.push_back(us);
+                ++stats.completed;
+            }
+        }
     }
-    storagenode::StorageService_Stub stub(&channel);
+}
+
+static void RunWorker(storagenode::StorageService_Stub* stub, int worker, int ops, Stats* out) {
+    if (FLAGS_batch > 1) {
+        RunBatchWorker(stub, worker, ops, out);
+        return;
+    }
+    const int write_ratio = std::clamp(FLAGS_write_ratio, 0, 100);
+    const size_t payload_size = static_cast<size_t>(std::max(1, FLAGS_data_size));
+    const uint64_t max_chunk = std::max<uint64_t>(1, FLAGS_max_chunk_id);
+    const uint64_t chunk_base = FLAGS_verify_read ? static_cast<uint64_t>(worker) * max_chunk : 0;
 
-    std::mt19937_64 rng(123456789);
+    std::mt19937_64 rng(123456789 + static_cast<uint64_t>(worker));
     std::uniform_int_distribution<int> pct_dist(1, 100);
     std::uniform_int_distribution<uint64_t> chunk_dist(1, max_chunk);
     std::uniform_int_distribution<uint64_t> offset_block_dist(0, FLAGS_max_offset_blocks);
 
-    Stats stats;
+    Stats& stats = *out;
+    stats.latencies_us.reserve(static_cast<size_t>(std::max(0, ops)));
     std::unordered_map<std::string, std::string> last_written;
 
-    for (int i = 0; i < FLAGS_ops; ++i) {
+    for (int i = 0; i < ops; ++i) {
         const bool do_write = pct_dist(rng) <= write_ratio;
-        const uint64_t chunk_id = chunk_dist(rng);
+        const uint64_t chunk_id = chunk_base + chunk_dist(rng);
         const uint64_t offset_blocks =
             FLAGS_max_offset_blocks > 0 ? offset_block_dist(rng) : 0;
         const uint64_t offset = offset_blocks * payload_size;
 
         if (do_write) {
             std::string payload = MakePayload(rng, payload_size);
+            if (FLAGS_stream) {
+                std::string error;
+                const int64_t us = StreamWrite(stub, chunk_id, offset, payload, &error);
+                ++stats.writes;
+                if (!error.empty()) {
+                    ++stats.write_failures;
+                    std::cerr << "[WRITE] chunk=" << chunk_id << " offset=" << offset << " stream failed: " << error
+                              << std::endl;
+                    continue;
+                }
+                if (FLAGS_verify_read) {
+                    last_written[MakeKey(chunk_id, offset)] = payload;
+                }
+                stats.bytes += payload_size;
+                stats.total_latency_us += us;
+                stats.latencies_us.push_back(us);
+                ++stats.completed;
+                continue;
+            }
             storagenode::WriteRequest req;
             storagenode::WriteReply resp;
             brpc::Controller cntl;
             req.set_chunk_id(chunk_id);
             req.set_offset(offset);
-            req.set_data(payload);
+            if (FLAGS_wire_version == storagenode::WIRE_ATTACHMENT) {
+                req.set_wire_version(storagenode::WIRE_ATTACHMENT);
+                cntl.request_attachment().append(payload);
+            } else {
+                req.set_data(payload);
+            }
             req.set_checksum(0);
             req.set_flags(FLAGS_flags);
             req.set_mode(FLAGS_mode);
+            req.set_io_class(static_cast<storagenode::IOClass>(FLAGS_io_class));
 
-            stub.Write(&cntl, &req, &resp, nullptr);
+            stub->Write(&cntl, &req, &resp, nullptr);
             ++stats.writes;
             if (cntl.Failed() || resp.status().code() != 0) {
                 ++stats.write_failures;
@@ -98,9 +289,35 @@ int main(int argc, char** argv) {
                 if (FLAGS_verify_read) {
                     last_written[MakeKey(chunk_id, offset)] = payload;
                 }
+                stats.bytes += payload_size;
                 stats.total_latency_us += cntl.latency_us();
+                stats.latencies_us.push_back(cntl.latency_us());
                 ++stats.completed;
             }
+        } else if (FLAGS_stream) {
+            std::string data;
+            std::string error;
+            const int64_t us = StreamRead(stub, chunk_id, offset, payload_size, &data, &error);
+            ++stats.reads;
+            if (!error.empty()) {
+                ++stats.read_failures;
+                std::cerr << "[READ] chunk=" << chunk_id << " offset=" << offset << " stream failed: " << error
+                          << std::endl;
+                continue;
+            }
+            if (FLAGS_verify_read) {
+                const auto it = last_written.find(MakeKey(chunk_id, offset));
+                if (it != last_written.end() && data != it->second) {
+                    ++stats.verify_failures;
+                    std::cerr << "[VERIFY] chunk=" << chunk_id << " offset=" << offset
+                              << " mismatch: expected " << it->second.size()
+                              << " bytes, got " << data.size() << std::endl;
+                }
+            }
+            stats.bytes += data.size();
+            stats.total_latency_us += us;
+            stats.latencies_us.push_back(us);
+            ++stats.completed;
         } else {
             storagenode::ReadRequest req;
             storagenode::ReadReply resp;
@@ -109,8 +326,13 @@ int main(int argc, char** argv) {
             req.set_offset(offset);
             req.set_length(static_cast<uint64_t>(payload_size));
             req.set_flags(FLAGS_flags == 0 ? O_RDONLY : FLAGS_flags);
+            req.set_io_class(static_cast<storagenode::IOClass>(FLAGS_io_class));
+            req.set_wire_version(static_cast<storagenode::WireVersion>(FLAGS_wire_version));
 
-            stub.Read(&cntl, &req, &resp, nullptr);
+            stub->Read(&cntl, &req, &resp, nullptr);
+            if (resp.wire_version() == storagenode::WIRE_ATTACHMENT) {
+                cntl.response_attachment().copy_to(resp.mutable_data());
+            }
             ++stats.reads;
             if (cntl.Failed() || resp.status().code() != 0) {
                 ++stats.read_failures;
@@ -127,11 +349,126 @@ int main(int argc, char** argv) {
                                   << " bytes, got " << resp.data().size() << std::endl;
                     }
                 }
+                stats.bytes += resp.data().size();
                 stats.total_latency_us += cntl.latency_us();
+                stats.latencies_us.push_back(cntl.latency_us());
                 ++stats.completed;
             }
         }
     }
+}
+
+struct HotProbe {
+    std::vector<int64_t> latencies_us;
+    int failures{0};
+};
+
+// Writes and warms the hot chunks so they start out in the server's page cache.
+static bool PrepareHotSet(storagenode::StorageService_Stub* stub, uint64_t base) {
+    const std::string payload(static_cast<size_t>(std::max(1, FLAGS_hot_read_size)), 'h');
+    for (int i = 1; i <= FLAGS_hot_chunks; ++i) {
+        storagenode::WriteRequest wreq;
+        storagenode::WriteReply wresp;
+        brpc::Controller wcntl;
+        wreq.set_chunk_id(base + static_cast<uint64_t>(i));
+        wreq.set_offset(0);
+        wreq.set_data(payload);
+        wreq.set_flags(O_WRONLY | O_CREAT);
+        wreq.set_mode(FLAGS_mode);
+        stub->Write(&wcntl, &wreq, &wresp, nullptr);
+        if (wcntl.Failed() || wresp.status().code() != 0) {
+            return false;
+        }
+        storagenode::ReadRequest rreq;
+        storagenode::ReadReply rresp;
+        brpc::Controller rcntl;
+        rreq.set_chunk_id(base + static_cast<uint64_t>(i));
+        rreq.set_length(payload.size());
+        rreq.set_flags(O_RDONLY);
+        stub->Read(&rcntl, &rreq, &rresp, nullptr);
+    }
+    return true;
+}
+
+// Re-reads hot chunks until `stop`; latency tells whether the page cache
+// still holds them while the main workload streams cold data.
+static void RunHotProbe(storagenode::StorageService_Stub* stub, uint64_t base,
+                        const std::atomic<bool>* stop, HotProbe* out) {
+    std::mt19937_64 rng(987654321);
+    std::uniform_int_distribution<uint64_t> chunk_dist(1, static_cast<uint64_t>(FLAGS_hot_chunks));
+    while (!stop->load()) {
+        storagenode::ReadRequest req;
+        storagenode::ReadReply resp;
+        brpc::Controller cntl;
+        req.set_chunk_id(base + chunk_dist(rng));
+        req.set_length(static_cast<uint64_t>(std::max(1, FLAGS_hot_read_size)));
+        req.set_flags(O_RDONLY);
+        stub->Read(&cntl, &req, &resp, nullptr);
+        if (cntl.Failed() || resp.status().code() != 0) {
+            ++out->failures;
+            continue;
+        }
+        out->latencies_us.push_back(cntl.latency_us());
+    }
+}
+
+static int64_t Percentile(const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    const int concurrency = std::max(1, FLAGS_concurrency);
+
+    brpc::Channel channel;
+    brpc::ChannelOptions opts;
+    if (channel.Init(FLAGS_server.c_str(), &opts) != 0) {
+        std::cerr << "Failed to init channel to " << FLAGS_server << std::endl;
+        return -1;
+    }
+    storagenode::StorageService_Stub stub(&channel);
+
+    // Hot chunk ids sit above every worker's range.
+    const uint64_t hot_base =
+        static_cast<uint64_t>(concurrency + 1) * std::max<uint64_t>(1, FLAGS_max_chunk_id);
+    HotProbe hot;
+    std::atomic<bool> hot_stop{false};
+    std::thread hot_thread;
+    if (FLAGS_hot_chunks > 0) {
+        if (!PrepareHotSet(&stub, hot_base)) {
+            std::cerr << "Failed to prepare hot chunks" << std::endl;
+            return -1;
+        }
+        hot_thread = std::thread(RunHotProbe, &stub, hot_base, &hot_stop, &hot);
+    }
+
+    std::vector<Stats> per_worker(static_cast<size_t>(concurrency));
+    std::vector<std::thread> workers;
+    const auto begin = std::chrono::steady_clock::now();
+    for (int w = 0; w < concurrency; ++w) {
+        int ops = FLAGS_ops / concurrency + (w < FLAGS_ops % concurrency ? 1 : 0);
+        workers.emplace_back(RunWorker, &stub, w, ops, &per_worker[static_cast<size_t>(w)]);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    const double elapsed_sec =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    hot_stop.store(true);
+    if (hot_thread.joinable()) {
+        hot_thread.join();
+    }
+
+    Stats stats;
+    for (const auto& s : per_worker) {
+        stats.Merge(s);
+    }
+    std::sort(stats.latencies_us.begin(), stats.latencies_us.end());
 
     const double avg_latency_ms =
         stats.completed > 0 ? (static_cast<double>(stats.total_latency_us) / 1000.0) / stats.completed : 0.0;
@@ -144,7 +481,31 @@ int main(int argc, char** argv) {
     if (FLAGS_verify_read) {
         std::cout << "verify mismatches: " << stats.verify_failures << std::endl;
     }
+    std::cout << "concurrency: " << concurrency << " | elapsed (s): " << elapsed_sec << std::endl;
+    std::cout << "IOPS: " << (elapsed_sec > 0 ? stats.completed / elapsed_sec : 0.0) << std::endl;
     std::cout << "avg latency (ms): " << avg_latency_ms << std::endl;
+    std::cout << "latency (us): p50=" << Percentile(stats.latencies_us, 0.50)
+              << " p95=" << Percentile(stats.latencies_us, 0.95)
+              << " p99=" << Percentile(stats.latencies_us, 0.99)
+              << " p999=" << Percentile(stats.latencies_us, 0.999)
+              << " max=" << (stats.latencies_us.empty() ? 0 : stats.latencies_us.back()) << std::endl;
+    std::cout << "throughput (MB/s): "
+              << (elapsed_sec > 0 ? static_cast<double>(stats.bytes) / (1024.0 * 1024.0) / elapsed_sec : 0.0)
+              << std::endl;
+    if (FLAGS_hot_chunks > 0) {
+        std::sort(hot.latencies_us.begin(), hot.latencies_us.end());
+        const auto hits = std::upper_bound(hot.latencies_us.begin(), hot.latencies_us.end(),
+                                           static_cast<int64_t>(FLAGS_hot_hit_us)) -
+                          hot.latencies_us.begin();
+        std::cout << "hot reads: " << hot.latencies_us.size() << " (failures=" << hot.failures << ")"
+                  << " p50=" << Percentile(hot.latencies_us, 0.50)
+                  << "us p99=" << Percentile(hot.latencies_us, 0.99) << "us" << std::endl;
+        std::cout << "hot page-cache hit rate (est., <=" << FLAGS_hot_hit_us << "us): "
+                  << (hot.latencies_us.empty()
+                          ? 0.0
+                          : static_cast<double>(hits) / static_cast<double>(hot.latencies_us.size()))
+                  << std::endl;
+    }
 
     return (stats.write_failures + stats.read_failures + stats.verify_failures) == 0 ? 0 : -1;
 }
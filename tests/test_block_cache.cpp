@@ -0,0 +1,162 @@
+#include <butil/crc32c.h>
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/storagenode/real_node/io/BlockCache.h"
+
+namespace {
+
+using Key = std::pair<uint64_t, uint64_t>;
+
+constexpr size_t kBlock = 1024;
+constexpr size_t kBlocksPerShard = 8;
+
+// 每个分片约能容纳 8 个整块；small FIFO 约占 2 个块
+BlockCache::Options small_options() {
+    BlockCache::Options opts;
+    opts.block_size = kBlock;
+    opts.capacity_bytes = 16 * kBlocksPerShard * 1200;
+    opts.small_ratio = 0.25;
+    return opts;
+}
+
+std::string block_of(char c, size_t n = kBlock) {
+    return std::string(n, c);
+}
+
+void put(BlockCache& cache, const Key& k, char c = 'x') {
+    cache.Insert(k.first, k.second, block_of(c), cache.FillToken(k.first));
+}
+
+// 找出与 (1, 0) 落在同一分片的若干 key：同一 chunk 的前 16 个块共享分片，
+// 其余通过探测得到——分片装满后再插入一个 key，若触发淘汰即为同一分片。
+std::vector<Key> same_shard_keys(size_t want) {
+    std::vector<Key> keys;
+    for (uint64_t i = 0; i < 16; ++i) {
+        keys.emplace_back(1, i);
+    }
+    for (uint64_t chunk = 2; keys.size() < want; ++chunk) {
+        BlockCache probe(small_options());
+        for (uint64_t i = 0; i < kBlocksPerShard; ++i) {
+            put(probe, {1, i});
+        }
+        assert(probe.GetStats().evictions == 0);
+        put(probe, {chunk, 0});
+        if (probe.GetStats().evictions > 0) {
+            keys.emplace_back(chunk, 0);
+        }
+    }
+    return keys;
+}
+
+} // namespace
+
+int main() {
+    const auto keys = same_shard_keys(40);
+    std::cout << "BlockCache test: found " << keys.size() << " same-shard keys" << std::endl;
+
+    // S3-FIFO 晋升：在 small 中被再次命中的块进入 main，一次性扫描的块被淘汰
+    {
+        BlockCache cache(small_options());
+        put(cache, keys[0]);
+        assert(cache.Lookup(keys[0].first, keys[0].second) != nullptr);
+        for (size_t i = 1; i < 16; ++i) {
+            put(cache, keys[i]);
+        }
+        auto stats = cache.GetStats();
+        assert(stats.evictions > 0);
+        assert(stats.hits == 1);
+        assert(cache.Contains(keys[0].first, keys[0].second));
+        assert(!cache.Contains(keys[1].first, keys[1].second));
+        assert(cache.Contains(keys[15].first, keys[15].second));
+        // 晋升后的块能扛住新一轮一次性扫描
+        for (size_t i = 16; i < 32; ++i) {
+            put(cache, keys[i]);
+        }
+        assert(cache.Contains(keys[0].first, keys[0].second));
+        assert(!cache.Contains(keys[16].first, keys[16].second));
+    }
+
+    // 幽灵队列：刚从 small 淘汰的 key 重新读入时直接进入 main
+    {
+        BlockCache cache(small_options());
+        for (size_t i = 0; i <= kBlocksPerShard; ++i) {
+            put(cache, keys[i]);
+        }
+        assert(!cache.Contains(keys[0].first, keys[0].second));
+        put(cache, keys[0]);                       // ghost 命中 -> main
+        const Key fresh = keys[kBlocksPerShard + 1];
+        put(cache, fresh);                         // 从未出现过 -> small
+        for (size_t i = kBlocksPerShard + 2; i < kBlocksPerShard + 14; ++i) {
+            put(cache, keys[i]);
+        }
+        assert(cache.Contains(keys[0].first, keys[0].second));
+        assert(!cache.Contains(fresh.first, fresh.second));
+    }
+
+    // 填充令牌：读盘期间块被失效，则插入被丢弃但仍返回读到的数据
+    {
+        BlockCache cache(small_options());
+        const uint64_t chunk = 7;
+        uint64_t token = cache.FillToken(chunk);
+        cache.Invalidate(chunk, 0, kBlock);
+        auto stale = cache.Insert(chunk, 0, block_of('s'), token);
+        assert(stale && stale->data == block_of('s'));
+        assert(!cache.Contains(chunk, 0));
+        token = cache.FillToken(chunk);
+        cache.Insert(chunk, 0, block_of('n'), token);
+        auto hit = cache.Lookup(chunk, 0);
+        assert(hit && hit->data == block_of('n'));
+        // 截断同样使未完成的填充失效
+        token = cache.FillToken(chunk);
+        cache.InvalidateFrom(chunk, 0);
+        cache.Insert(chunk, 0, block_of('t'), token);
+        assert(!cache.Contains(chunk, 0));
+    }
+
+    // 末尾短块：写到 EOF 之后与截断都要丢弃缓存中的短块
+    {
+        BlockCache cache(small_options());
+        const uint64_t chunk = 9;
+        cache.Insert(chunk, 0, block_of('a'), cache.FillToken(chunk));
+        cache.Insert(chunk, 1, block_of('b', 100), cache.FillToken(chunk));
+        cache.Invalidate(chunk, 4 * kBlock, 10);   // 扩展文件：块 1 不再是末尾
+        assert(cache.Contains(chunk, 0));
+        assert(!cache.Contains(chunk, 1));
+
+        cache.Insert(chunk, 1, block_of('b', 100), cache.FillToken(chunk));
+        cache.Insert(chunk, 3, block_of('c'), cache.FillToken(chunk));
+        cache.InvalidateFrom(chunk, 3 * kBlock);
+        assert(cache.Contains(chunk, 0));
+        assert(!cache.Contains(chunk, 1));
+        assert(!cache.Contains(chunk, 3));
+        cache.InvalidateFrom(chunk, 0);
+        assert(!cache.Contains(chunk, 0));
+        assert(cache.GetStats().blocks == 0);
+    }
+
+    // crc 拼接：CombineFullBlock(crc(A), crc(B)) == crc(A || B)
+    {
+        BlockCache cache(small_options());
+        const std::string a = "head bytes of odd length";
+        std::string b(kBlock, '\0');
+        for (size_t i = 0; i < b.size(); ++i) {
+            b[i] = static_cast<char>(i * 31 + 7);
+        }
+        auto block = cache.Insert(11, 0, b, cache.FillToken(11));
+        assert(block->crc == butil::crc32c::Value(b.data(), b.size()));
+        const uint32_t crc_a = butil::crc32c::Value(a.data(), a.size());
+        const std::string ab = a + b;
+        assert(cache.CombineFullBlock(crc_a, block->crc) == butil::crc32c::Value(ab.data(), ab.size()));
+        assert(Crc32cCombine(crc_a, block->crc, b.size()) == butil::crc32c::Value(ab.data(), ab.size()));
+        assert(Crc32cCombine(crc_a, butil::crc32c::Value("", 0), 0) == crc_a);
+    }
+
+    std::cout << "BlockCache test passed" << std::endl;
+    return 0;
+}
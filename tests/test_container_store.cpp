@@ -0,0 +1,146 @@
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "../src/storagenode/real_node/io/ContainerStore.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+fs::path make_temp_dir() {
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto dir = fs::temp_directory_path() / ("container_store_test_" + std::to_string(stamp));
+    fs::create_directories(dir);
+    return dir;
+}
+
+std::string read_all(ContainerStore& store, uint64_t chunk_id) {
+    std::string out;
+    auto res = store.Read(chunk_id, 0, 1 << 20, out);
+    assert(res.bytes >= 0);
+    return out;
+}
+
+std::string read_file(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+ContainerStore::Options small_options() {
+    ContainerStore::Options opts;
+    opts.small_chunk_limit = 4096;
+    // 每个容器只能放下少量记录，便于制造已封存的容器
+    opts.container_size = 3 * (4096 + 32);
+    opts.gc_dead_ratio = 0.5;
+    // 写入不落盘：压缩须自行同步搬运目标后才能删除旧容器
+    opts.sync_on_write = false;
+    return opts;
+}
+
+} // namespace
+
+int main() {
+    const fs::path dir = make_temp_dir();
+    const fs::path store_dir = dir / "containers";
+    std::cout << "ContainerStore test dir: " << dir << std::endl;
+
+    {
+        ContainerStore store(store_dir.string(), small_options());
+        assert(store.Open());
+
+        // 小块写入、覆盖与读取
+        const std::string hello = "hello";
+        assert(store.Write(1, 0, hello.data(), hello.size()).bytes == static_cast<ssize_t>(hello.size()));
+        assert(store.Contains(1));
+        assert(read_all(store, 1) == "hello");
+        assert(store.Write(1, 8, "xy", 2).bytes == 2);
+        uint64_t size = 0;
+        assert(store.Size(1, &size) && size == 10);
+        assert(read_all(store, 1) == std::string("hello\0\0\0xy", 10));
+        std::string missing;
+        assert(store.Read(99, 0, 16, missing).err == ENOENT);
+
+        // 超过 small_chunk_limit：Write/Truncate 返回 EFBIG，块原样保留
+        std::string big(4096, 'b');
+        assert(store.Write(1, 1, big.data(), big.size()).err == EFBIG);
+        assert(store.Truncate(1, 8192).err == EFBIG);
+        assert(read_all(store, 1) == std::string("hello\0\0\0xy", 10));
+
+        // EFBIG 后迁出为独立文件：内容一致，块离开容器
+        const fs::path exported = dir / "chunks" / "1.dat";
+        assert(store.ExportToFile(1, exported.string()));
+        assert(!store.Contains(1));
+        assert(read_file(exported) == std::string("hello\0\0\0xy", 10));
+        assert(!fs::exists(exported.string() + ".migrating"));
+        assert(store.ExportToFile(1, exported.string()));  // 已不在容器中
+
+        // 压缩：反复覆盖制造死空间，封存容器被回收，数据不变
+        const std::string a(4000, 'a');
+        const std::string c(4000, 'c');
+        for (int round = 0; round < 4; ++round) {
+            std::string payload(4000, static_cast<char>('0' + round));
+            assert(store.Write(2, 0, payload.data(), payload.size()).bytes == 4000);
+        }
+        assert(store.Write(3, 0, a.data(), a.size()).bytes == 4000);
+        assert(store.Write(4, 0, c.data(), c.size()).bytes == 4000);
+        auto before = store.GetStats();
+        assert(before.chunks == 3);
+        assert(before.dead_bytes > 0);
+        assert(store.CompactOnce() > 0);
+        auto after = store.GetStats();
+        assert(after.dead_bytes < before.dead_bytes);
+        assert(after.containers < before.containers);
+        assert(after.live_bytes == before.live_bytes);
+        assert(read_all(store, 2) == std::string(4000, '3'));
+        assert(read_all(store, 3) == a);
+        assert(read_all(store, 4) == c);
+
+        // 截断只追加新版本
+        assert(store.Truncate(4, 10).err == 0);
+        assert(read_all(store, 4) == std::string(10, 'c'));
+    }
+
+    // 重新打开：按 seq 重建索引，压缩搬运的记录不会被旧版本覆盖；skip 的块视为已迁出
+    {
+        ContainerStore store(store_dir.string(), small_options());
+        assert(store.Open([](uint64_t chunk_id) { return chunk_id == 3; }));
+        assert(!store.Contains(1));
+        assert(!store.Contains(3));
+        assert(read_all(store, 2) == std::string(4000, '3'));
+        assert(read_all(store, 4) == std::string(10, 'c'));
+        auto stats = store.GetStats();
+        assert(stats.chunks == 2);
+    }
+
+    // 压缩搬运仍存活的记录：旧容器删除前，目标容器必须已同步
+    {
+        ContainerStore store((dir / "sync").string(), small_options());
+        assert(store.Open());
+        const std::string a(4000, 'a');
+        const std::string b(4000, 'b');
+        assert(store.Write(5, 0, a.data(), a.size()).bytes == 4000);
+        for (int round = 0; round < 3; ++round) {
+            assert(store.Write(6, 0, b.data(), b.size()).bytes == 4000);
+        }
+        // 容器 1：[5 存活, 6 已死, 6 已死]，已封存
+        assert(store.GetStats().compaction_syncs == 0);
+        assert(store.CompactOnce() > 0);
+        auto stats = store.GetStats();
+        assert(stats.compaction_syncs == 1);
+        assert(stats.containers == 1);
+        assert(read_all(store, 5) == a);
+        assert(read_all(store, 6) == b);
+    }
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    std::cout << "ContainerStore test passed" << std::endl;
+    return 0;
+}
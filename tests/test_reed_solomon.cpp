@@ -0,0 +1,169 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../src/common/ReedSolomon.h"
+
+namespace {
+
+using Shards = std::vector<std::vector<uint8_t>>;
+
+Shards random_shards(size_t k, size_t len, std::mt19937& rng) {
+    Shards data(k, std::vector<uint8_t>(len));
+    for (auto& shard : data) {
+        for (auto& b : shard) {
+            b = static_cast<uint8_t>(rng());
+        }
+    }
+    return data;
+}
+
+// 编码得到 k + m 个分片
+Shards encode(const ReedSolomon& rs, const Shards& data, size_t len) {
+    Shards all = data;
+    all.resize(rs.data_shards() + rs.parity_shards(), std::vector<uint8_t>(len));
+    std::vector<const uint8_t*> in;
+    std::vector<uint8_t*> out;
+    for (size_t i = 0; i < rs.data_shards(); ++i) {
+        in.push_back(all[i].data());
+    }
+    for (size_t i = rs.data_shards(); i < all.size(); ++i) {
+        out.push_back(all[i].data());
+    }
+    rs.Encode(in.data(), out.data(), len);
+    return all;
+}
+
+// 按 lost 掩码清空分片后重建，并与原分片逐字节比较
+bool rebuild_matches(const ReedSolomon& rs, const Shards& full, uint32_t lost, size_t len) {
+    const size_t n = full.size();
+    Shards work = full;
+    std::vector<uint8_t*> ptrs(n);
+    bool present[256] = {};
+    for (size_t i = 0; i < n; ++i) {
+        present[i] = (lost & (1u << i)) == 0;
+        if (!present[i]) {
+            std::fill(work[i].begin(), work[i].end(), 0xEE);
+        }
+        ptrs[i] = work[i].data();
+    }
+    if (!rs.Reconstruct(ptrs.data(), present, len)) {
+        return false;
+    }
+    return work == full;
+}
+
+void check_all_erasures(size_t k, size_t m, size_t len, std::mt19937& rng) {
+    ReedSolomon rs(k, m);
+    const Shards full = encode(rs, random_shards(k, len, rng), len);
+    const size_t n = k + m;
+    for (uint32_t lost = 0; lost < (1u << n); ++lost) {
+        const size_t count = static_cast<size_t>(__builtin_popcount(lost));
+        if (count <= m) {
+            assert(rebuild_matches(rs, full, lost, len));
+        } else {
+            // 少于 k 个分片时无法重建
+            Shards work = full;
+            std::vector<uint8_t*> ptrs(n);
+            bool present[256] = {};
+            for (size_t i = 0; i < n; ++i) {
+                present[i] = (lost & (1u << i)) == 0;
+                ptrs[i] = work[i].data();
+            }
+            assert(!rs.Reconstruct(ptrs.data(), present, len));
+            assert(rs.Survivors(present).empty());
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(20261018);
+    std::cout << "ReedSolomon kernel: " << ReedSolomon::KernelName(ReedSolomon::ActiveKernel()) << std::endl;
+
+    // 系统码：编码不改动数据分片
+    {
+        ReedSolomon rs(4, 1);
+        const size_t len = 100;
+        const Shards data = random_shards(4, len, rng);
+        const Shards full = encode(rs, data, len);
+        for (size_t i = 0; i < 4; ++i) {
+            assert(full[i] == data[i]);
+        }
+        assert(rebuild_matches(rs, full, 1u << 2, len));
+    }
+
+    // 所有不超过 m 个分片的丢失组合都能重建；超过则失败
+    check_all_erasures(4, 2, 257, rng);
+    check_all_erasures(3, 3, 64, rng);
+    check_all_erasures(6, 3, 33, rng);
+
+    // Survivors：数据分片优先，取前 k 个
+    {
+        ReedSolomon rs(4, 2);
+        bool present[6] = {true, false, true, true, true, true};
+        auto s = rs.Survivors(present);
+        assert((s == std::vector<size_t>{0, 2, 3, 4}));
+    }
+
+    // wanted：只重建指定分片，其余缺失分片可为空指针
+    {
+        ReedSolomon rs(4, 2);
+        const size_t len = 96;
+        const Shards full = encode(rs, random_shards(4, len, rng), len);
+        Shards work = full;
+        std::fill(work[1].begin(), work[1].end(), 0);
+        std::vector<uint8_t*> ptrs = {work[0].data(), work[1].data(), work[2].data(), work[3].data(),
+                                      work[4].data(), nullptr};
+        bool present[6] = {true, false, true, true, true, false};
+        bool wanted[6] = {false, true, false, false, false, false};
+        assert(rs.Reconstruct(ptrs.data(), present, len, wanted));
+        assert(work[1] == full[1]);
+    }
+
+    // 各 SIMD 内核与标量内核结果一致（长度覆盖非对齐尾部）
+    {
+        const ReedSolomon::Kernel kernels[] = {ReedSolomon::Kernel::kScalar, ReedSolomon::Kernel::kSsse3,
+                                               ReedSolomon::Kernel::kAvx2};
+        const ReedSolomon::Kernel original = ReedSolomon::ActiveKernel();
+        ReedSolomon rs(5, 3);
+        const size_t len = 1000 + 13;
+        const Shards data = random_shards(5, len, rng);
+        assert(ReedSolomon::UseKernel(ReedSolomon::Kernel::kScalar));
+        const Shards reference = encode(rs, data, len);
+        for (auto kernel : kernels) {
+            if (!ReedSolomon::UseKernel(kernel)) {
+                std::cout << "skip kernel " << ReedSolomon::KernelName(kernel) << std::endl;
+                continue;
+            }
+            assert(encode(rs, data, len) == reference);
+            assert(rebuild_matches(rs, reference, (1u << 1) | (1u << 4) | (1u << 6), len));
+        }
+        assert(ReedSolomon::UseKernel(original));
+    }
+
+    // 最大码长 k + m = 256
+    {
+        ReedSolomon rs(200, 56);
+        const size_t len = 8;
+        const Shards full = encode(rs, random_shards(200, len, rng), len);
+        Shards work = full;
+        std::vector<uint8_t*> ptrs(256);
+        bool present[256];
+        for (size_t i = 0; i < 256; ++i) {
+            present[i] = i % 5 != 0;  // 丢失 52 个分片
+            if (!present[i]) {
+                std::fill(work[i].begin(), work[i].end(), 0);
+            }
+            ptrs[i] = work[i].data();
+        }
+        assert(rs.Reconstruct(ptrs.data(), present, len));
+        assert(work == full);
+    }
+
+    std::cout << "ReedSolomon test passed" << std::endl;
+    return 0;
+}
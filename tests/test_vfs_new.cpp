@@ -146,6 +146,42 @@ int main() {
     if (!expect(fs.shutdown_fd(temp_fd) == 0, "shutdown_fd")) return 23;
     if (!expect(fs.read(temp_fd, tmp_buf, sizeof(tmp_buf)) == -1, "read after shutdown_fd")) return 24;
 
+    // relatime：读路径只在内存推进 atime，flush_atime/close 时批量回写
+    std::cout << "Expect reads defer atime persistence until flush_atime()" << std::endl;
+    fs.set_atime_granularity(60);
+    auto data_ino = fs.lookup_inode("/io/data.bin");
+    // 把 MDS 上的 atime/mtime 拨回一年前，使下一次读满足 relatime 推进条件
+    auto age_inode = [&]() -> uint32_t {
+        Inode aged;
+        if (!fs.metadata()->ReadInode(data_ino, aged)) return 0;
+        InodeTimestamp old;
+        old.year -= 1;
+        aged.setFaTime(old);
+        aged.setFmTime(old);
+        if (!fs.metadata()->WriteInode(data_ino, aged)) return 0;
+        return old.to_minutes();
+    };
+    auto stored_atime = [&]() -> uint32_t {
+        Inode current;
+        return fs.metadata()->ReadInode(data_ino, current) ? current.fa_time.to_minutes() : 0;
+    };
+    const uint32_t aged_min = age_inode();
+    if (!expect(aged_min != 0, "age data inode")) return 30;
+    int atime_fd = fs.open("/io/data.bin", MO_RDONLY, 0644);
+    if (!expect(atime_fd >= 0, "open data read-only")) return 30;
+    if (!expect(fs.read(atime_fd, buffer.data(), buffer.size()) >= 0, "read with lazy atime")) return 31;
+    if (!expect(stored_atime() == aged_min, "read leaves stored atime untouched")) return 31;
+    if (!expect(fs.flush_atime(), "flush_atime")) return 32;
+    if (!expect(stored_atime() > aged_min, "flush_atime advances stored atime")) return 32;
+
+    std::cout << "Expect granularity 0 writes atime through on read" << std::endl;
+    fs.set_atime_granularity(0);
+    if (!expect(age_inode() == aged_min, "re-age data inode")) return 33;
+    if (!expect(fs.seek(atime_fd, 0, SEEK_SET) == 0, "seek read-only fd")) return 33;
+    if (!expect(fs.read(atime_fd, buffer.data(), buffer.size()) >= 0, "read with strict atime")) return 33;
+    if (!expect(stored_atime() > aged_min, "strict read persists atime immediately")) return 33;
+    if (!expect(fs.close(atime_fd) == 0, "close read-only fd")) return 33;
+
     // 冷数据接口：collect 列表、位图、百分位
     std::cout << "Expect cold inode utilities return bounded results" << std::endl;
     auto cold = fs.collect_cold_inodes(10, 1);